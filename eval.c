@@ -35,6 +35,10 @@ int init_evaluator()
 	value_hash_put_var(&global_variables, type_to_string(type.core.u_type), type);
 	type.core.u_type = VALUE_ARY;
 	value_hash_put_var(&global_variables, type_to_string(type.core.u_type), type);
+	type.core.u_type = VALUE_PAK;
+	value_hash_put_var(&global_variables, type_to_string(type.core.u_type), type);
+	type.core.u_type = VALUE_NDA;
+	value_hash_put_var(&global_variables, type_to_string(type.core.u_type), type);
 	type.core.u_type = VALUE_LST;
 	value_hash_put_var(&global_variables, type_to_string(type.core.u_type), type);
 	type.core.u_type = VALUE_HSH;
@@ -74,6 +78,19 @@ int init_evaluator()
 	 point after which arguments become optional. 0 means that all 
 	 are optional, 1 means that all but the first are optional, etc.
 	 
+	 A 'p' next means that the function is pure: it has no side effects 
+	 and always gives the same result for the same arguments. The 
+	 optimizer is allowed to evaluate a call to a pure function ahead 
+	 of time if all of the arguments are constants. A function that 
+	 pulls from a generator (to_a, take, pack) is not pure, because 
+	 calling it twice on the same generator gives different results.
+	 
+	 After that, a 'k' means that the function knows about packed arrays, 
+	 an 'n' that it knows about n-dimensional arrays and an 's' that it 
+	 knows about slices, in that order. A function without one of these 
+	 is given an ordinary array or string in place of that kind of 
+	 argument. See value_private_unpack_args().
+	 
 	 The first three characters are each either true ('t') or false 
 	 ('f'). They denote whether (1) the function takes variables, 
 	 (2) the function keeps the first argument if it is a variable, 
@@ -117,7 +134,7 @@ int init_evaluator()
 	 */
 
 	add_function("import", value_set_fun(&value_import_arg), "1r2");
-	add_function("=", value_set_fun(&value_assign_arg), "ttf2r3");
+	add_function("=", value_set_fun(&value_assign_arg), "knsttf2r3");
 	add_function("+=", value_set_fun(&value_assign_add_arg), "ttf2r3");
 	add_function("-=", value_set_fun(&value_assign_sub_arg), "ttf2r3");
 	add_function("*=", value_set_fun(&value_assign_mul_arg), "ttf2r3");
@@ -129,126 +146,153 @@ int init_evaluator()
 	add_function("<<=", value_set_fun(&value_assign_shl_arg), "ttf2r3");
 	add_function(">>=", value_set_fun(&value_assign_shr_arg), "ttf2r3");
 	
-	add_function("**", value_set_fun(&value_pow_arg), "2r16");
-	add_function("!", value_set_fun(&value_not_p_arg), "1l16");
-	add_function("~", value_set_fun(&value_not_arg), "1l16");
-	add_function("--", value_set_fun(&value_uminus_arg), "1l16");
-	add_function("++", value_set_fun(&value_uplus_arg), "1l16");
-	add_function("abs", value_set_fun(&value_abs_arg), "1l16");
-	add_function("exp", value_set_fun(&value_exp_arg), "1l16");
-	add_function("log", value_set_fun(&value_log_arg), "1l16");
-	add_function("log2", value_set_fun(&value_log2_arg), "1l16");
-	add_function("log10", value_set_fun(&value_log10_arg), "1l16");
-	add_function("sqrt", value_set_fun(&value_sqrt_arg), "1l16");
-	add_function("factorial", value_set_fun(&value_factorial_arg), "1l16");
-	add_function("choose", value_set_fun(&value_choose_arg), "2l15");
-	add_function("sin", value_set_fun(&value_sin_arg), "1l16");
-	add_function("cos", value_set_fun(&value_cos_arg), "1l16");
-	add_function("tan", value_set_fun(&value_tan_arg), "1l16");
-	add_function("csc", value_set_fun(&value_csc_arg), "1l16");
-	add_function("sec", value_set_fun(&value_sec_arg), "1l16");
-	add_function("cot", value_set_fun(&value_cot_arg), "1l16");
-	add_function("asin", value_set_fun(&value_asin_arg), "1l16");
-	add_function("acos", value_set_fun(&value_acos_arg), "1l16");
-	add_function("atan", value_set_fun(&value_atan_arg), "1l16");
-	add_function("sinh", value_set_fun(&value_sinh_arg), "1l16");
-	add_function("cosh", value_set_fun(&value_cosh_arg), "1l16");
-	add_function("tanh", value_set_fun(&value_tanh_arg), "1l16");
-	add_function("csch", value_set_fun(&value_csch_arg), "1l16");
-	add_function("sech", value_set_fun(&value_sech_arg), "1l16");
-	add_function("coth", value_set_fun(&value_coth_arg), "1l16");
-	add_function("asinh", value_set_fun(&value_asinh_arg), "1l16");
-	add_function("acosh", value_set_fun(&value_acosh_arg), "1l16");
-	add_function("atanh", value_set_fun(&value_atanh_arg), "1l16");
+	add_function("**", value_set_fun(&value_pow_arg), "pk2r16");
+	add_function("!", value_set_fun(&value_not_p_arg), "p1l16");
+	add_function("~", value_set_fun(&value_not_arg), "p1l16");
+	add_function("--", value_set_fun(&value_uminus_arg), "p1l16");
+	add_function("++", value_set_fun(&value_uplus_arg), "p1l16");
+	add_function("abs", value_set_fun(&value_abs_arg), "p1l16");
+	add_function("exp", value_set_fun(&value_exp_arg), "pk1l16");
+	add_function("log", value_set_fun(&value_log_arg), "pk1l16");
+	add_function("log2", value_set_fun(&value_log2_arg), "pk1l16");
+	add_function("log10", value_set_fun(&value_log10_arg), "pk1l16");
+	add_function("sqrt", value_set_fun(&value_sqrt_arg), "pk1l16");
+	add_function("factorial", value_set_fun(&value_factorial_arg), "p1l16");
+	add_function("choose", value_set_fun(&value_choose_arg), "p2l15");
+	add_function("sin", value_set_fun(&value_sin_arg), "pk1l16");
+	add_function("cos", value_set_fun(&value_cos_arg), "pk1l16");
+	add_function("tan", value_set_fun(&value_tan_arg), "pk1l16");
+	add_function("csc", value_set_fun(&value_csc_arg), "pk1l16");
+	add_function("sec", value_set_fun(&value_sec_arg), "pk1l16");
+	add_function("cot", value_set_fun(&value_cot_arg), "pk1l16");
+	add_function("asin", value_set_fun(&value_asin_arg), "pk1l16");
+	add_function("acos", value_set_fun(&value_acos_arg), "pk1l16");
+	add_function("atan", value_set_fun(&value_atan_arg), "pk1l16");
+	add_function("sinh", value_set_fun(&value_sinh_arg), "pk1l16");
+	add_function("cosh", value_set_fun(&value_cosh_arg), "pk1l16");
+	add_function("tanh", value_set_fun(&value_tanh_arg), "pk1l16");
+	add_function("csch", value_set_fun(&value_csch_arg), "pk1l16");
+	add_function("sech", value_set_fun(&value_sech_arg), "pk1l16");
+	add_function("coth", value_set_fun(&value_coth_arg), "pk1l16");
+	add_function("asinh", value_set_fun(&value_asinh_arg), "pk1l16");
+	add_function("acosh", value_set_fun(&value_acosh_arg), "pk1l16");
+	add_function("atanh", value_set_fun(&value_atanh_arg), "pk1l16");
 	add_function("deriv", value_set_fun(&value_deriv_arg), "1l16");
-	add_function("probab_prime?", value_set_fun(&value_probab_prime_p_arg), "1l16");
-	add_function("nextprime", value_set_fun(&value_nextprime_arg), "1l16");
-	add_function("gcd", value_set_fun(&value_gcd_arg), "2l15");
+	add_function("probab_prime?", value_set_fun(&value_probab_prime_p_arg), "p1l16");
+	add_function("nextprime", value_set_fun(&value_nextprime_arg), "p1l16");
+	add_function("gcd", value_set_fun(&value_gcd_arg), "p2l15");
+	add_function("set_default_prec", value_set_fun(&value_set_default_prec_arg), "1l16");
 	add_function("seconds", value_set_fun(&value_seconds_arg), "0l15");
 	
 	add_function("times", value_set_fun(&value_times_arg), "tff2r15");
-	add_function("summation", value_set_fun(&value_summation_arg), "tff2r15");
+	add_function("summation", value_set_fun(&value_summation_arg), "ktff2r15");
+	add_function("sum", value_set_fun(&value_sum_arg), "pk1l16");
 
-	add_function("to_a", value_set_fun(&value_to_a_arg), "1l16");
-	add_function("to_f", value_set_fun(&value_to_f_arg), "1l16");
-	add_function("to_h", value_set_fun(&value_to_h_arg), "1l16");
-	add_function("to_i", value_set_fun(&value_to_i_arg), "1l16");
-	add_function("to_l", value_set_fun(&value_to_l_arg), "1l16");
-	add_function("to_s", value_set_fun(&value_to_s_arg), "1l16");
-	add_function("to_r", value_set_fun(&value_to_r_arg), "1l16");
-	add_function("to_s_base", value_set_fun(&value_to_s_base_arg), "2l15");
-	add_function("type", value_set_fun(&value_type_arg), "1l16");
-	
-	add_function("*", value_set_fun(&value_mul_arg), "2l13");
-	add_function("/", value_set_fun(&value_div_arg), "2l13");
-	add_function("%", value_set_fun(&value_mod_arg), "2l13");
-	add_function("+", value_set_fun(&value_add_arg), "2l12");
-	add_function("-", value_set_fun(&value_sub_arg), "2l12");
-	add_function("<<", value_set_fun(&value_shl_arg), "2l11");
-	add_function(">>", value_set_fun(&value_shr_arg), "2l11");
-	add_function("<", value_set_fun(&value_lt_arg), "2l10");
-	add_function("<=", value_set_fun(&value_le_arg), "2l10");
-	add_function(">", value_set_fun(&value_gt_arg), "2l10");
-	add_function(">=", value_set_fun(&value_ge_arg), "2l10");
-	add_function("==", value_set_fun(&value_eq_arg), "2l9");
-	add_function("!=", value_set_fun(&value_ne_arg), "2l9");
-	add_function("&", value_set_fun(&value_and_arg), "2l8");
-	add_function("^", value_set_fun(&value_xor_arg), "2l7");
-	add_function("|", value_set_fun(&value_or_arg), "2l6");
-	add_function("&&", value_set_fun(&value_and_p_arg), "2l5");
-	add_function("||", value_set_fun(&value_or_p_arg), "2l4");
+	add_function("to_a", value_set_fun(&value_to_a_arg), "kns1l16");
+	add_function("to_f", value_set_fun(&value_to_f_arg), "p1l16");
+	add_function("to_h", value_set_fun(&value_to_h_arg), "p1l16");
+	add_function("to_i", value_set_fun(&value_to_i_arg), "p1l16");
+	add_function("to_l", value_set_fun(&value_to_l_arg), "p1l16");
+	add_function("to_s", value_set_fun(&value_to_s_arg), "pkns1l16");
+	add_function("to_r", value_set_fun(&value_to_r_arg), "p1l16");
+	add_function("to_s_base", value_set_fun(&value_to_s_base_arg), "p2l15");
+	add_function("type", value_set_fun(&value_type_arg), "pkns1l16");
+	
+	add_function("*", value_set_fun(&value_mul_arg), "pk2l13");
+	add_function("/", value_set_fun(&value_div_arg), "p2l13");
+	add_function("%", value_set_fun(&value_mod_arg), "p2l13");
+	add_function("+", value_set_fun(&value_add_arg), "pk2l12");
+	add_function("-", value_set_fun(&value_sub_arg), "p2l12");
+	add_function("<<", value_set_fun(&value_shl_arg), "p2l11");
+	add_function(">>", value_set_fun(&value_shr_arg), "p2l11");
+	add_function("<", value_set_fun(&value_lt_arg), "p2l10");
+	add_function("<=", value_set_fun(&value_le_arg), "p2l10");
+	add_function(">", value_set_fun(&value_gt_arg), "p2l10");
+	add_function(">=", value_set_fun(&value_ge_arg), "p2l10");
+	add_function("==", value_set_fun(&value_eq_arg), "pkns2l9");
+	add_function("!=", value_set_fun(&value_ne_arg), "pkns2l9");
+	add_function("&", value_set_fun(&value_and_arg), "p2l8");
+	add_function("^", value_set_fun(&value_xor_arg), "p2l7");
+	add_function("|", value_set_fun(&value_or_arg), "p2l6");
+	add_function("&&", value_set_fun(&value_and_p_arg), "ptft2l5");
+	add_function("||", value_set_fun(&value_or_p_arg), "ptft2l4");
+	
+	// Typed versions of the operators above. The optimizer uses these, but they can be 
+	// called directly too.
+	add_function("add_int", value_set_fun(&value_add_int_arg), "p2l15");
+	add_function("sub_int", value_set_fun(&value_sub_int_arg), "p2l15");
+	add_function("mul_int", value_set_fun(&value_mul_int_arg), "p2l15");
+	add_function("add_float", value_set_fun(&value_add_float_arg), "p2l15");
+	add_function("sub_float", value_set_fun(&value_sub_float_arg), "p2l15");
+	add_function("mul_float", value_set_fun(&value_mul_float_arg), "p2l15");
+	add_function("concat_str", value_set_fun(&value_concat_str_arg), "p2l15");
+	add_function("lt_int", value_set_fun(&value_lt_int_arg), "p2l15");
+	add_function("le_int", value_set_fun(&value_le_int_arg), "p2l15");
+	add_function("gt_int", value_set_fun(&value_gt_int_arg), "p2l15");
+	add_function("ge_int", value_set_fun(&value_ge_int_arg), "p2l15");
+	add_function("lt_float", value_set_fun(&value_lt_float_arg), "p2l15");
+	add_function("le_float", value_set_fun(&value_le_float_arg), "p2l15");
+	add_function("gt_float", value_set_fun(&value_gt_float_arg), "p2l15");
+	add_function("ge_float", value_set_fun(&value_ge_float_arg), "p2l15");
+	add_function("eq_int", value_set_fun(&value_eq_int_arg), "p2l15");
+	add_function("ne_int", value_set_fun(&value_ne_int_arg), "p2l15");
+	add_function("eq_float", value_set_fun(&value_eq_float_arg), "p2l15");
+	add_function("ne_float", value_set_fun(&value_ne_float_arg), "p2l15");
+	add_function("eq_str", value_set_fun(&value_eq_str_arg), "p2l15");
+	add_function("ne_str", value_set_fun(&value_ne_str_arg), "p2l15");
 	
 	add_function("set", value_set_fun(&value_set_arg), "ftt1l16");
-	add_function("true?", value_set_fun(&value_true_p_arg), "1l16");
-	add_function("..", value_set_fun(&value_range_to_arg), "2l17");
-	add_function("...", value_set_fun(&value_range_until_arg), "2l17");
+	add_function("true?", value_set_fun(&value_true_p_arg), "p1l16");
+	add_function("..", value_set_fun(&value_range_to_arg), "p2l17");
+	add_function("...", value_set_fun(&value_range_until_arg), "p2l17");
 	add_function("rand", value_set_fun(&value_rand_arg), "1l16");
-	add_function("array", value_set_fun(&value_array_arg), "x0r15");
-	add_function("list", value_set_fun(&value_list_arg), "x0r15");
-	add_function("hash", value_set_fun(&value_hash_arg), "x0r15");
-	add_function("->", value_set_fun(&value_make_pair_arg), "2r15");
-	add_function("print", value_set_fun(&value_print_arg), "1l2");
-	add_function("println", value_set_fun(&value_println_arg), "1l2");	
+	add_function("array", value_set_fun(&value_array_arg), "pknx0r15");
+	add_function("list", value_set_fun(&value_list_arg), "px0r15");
+	add_function("hash", value_set_fun(&value_hash_arg), "px0r15");
+	add_function("->", value_set_fun(&value_make_pair_arg), "p2r15");
+	add_function("print", value_set_fun(&value_print_arg), "kns1l2");
+	add_function("println", value_set_fun(&value_println_arg), "kns1l2");	
 	add_function("printf", value_set_fun(&value_printf_arg), "x0l2");
 	
 	add_function("gets", value_set_fun(&value_gets_arg), "0l16");
 	
-	add_function("asc", value_set_fun(&value_asc_arg), "1l16");
-	add_function("capitalize", value_set_fun(&value_capitalize_arg), "1l16");
-	add_function("chop", value_set_fun(&value_chop_arg), "1l16");
+	add_function("asc", value_set_fun(&value_asc_arg), "p1l16");
+	add_function("capitalize", value_set_fun(&value_capitalize_arg), "p1l16");
+	add_function("chop", value_set_fun(&value_chop_arg), "p1l16");
 	add_function("chop!", value_set_fun(&value_chop_now_arg), "1l16");
-	add_function("chr", value_set_fun(&value_chr_arg), "1l16");
-	add_function("contains?", value_set_fun(&value_contains_p_arg), "2l15");
-	add_function("ends_with?", value_set_fun(&value_ends_with_p_arg), "2l15");
-	add_function("index", value_set_fun(&value_index_arg), "2l15");
-	add_function("insert", value_set_fun(&value_insert_arg), "3l15");
+	add_function("chr", value_set_fun(&value_chr_arg), "p1l16");
+	add_function("contains?", value_set_fun(&value_contains_p_arg), "ps2l15");
+	add_function("ends_with?", value_set_fun(&value_ends_with_p_arg), "ps2l15");
+	add_function("index", value_set_fun(&value_index_arg), "ps2l15");
+	add_function("insert", value_set_fun(&value_insert_arg), "p3l15");
 	add_function("insert!", value_set_fun(&value_insert_now_arg), "3l15");
-	add_function("alpha?", value_set_fun(&value_alpha_p_arg), "1l16");
-	add_function("alnum?", value_set_fun(&value_alnum_p_arg), "1l16");
-	add_function("num?", value_set_fun(&value_num_p_arg), "1l16");
-	add_function("length", value_set_fun(&value_length_arg), "1l16");
-	add_function("lstrip", value_set_fun(&value_lstrip_arg), "1l16");
-	add_function("range", value_set_fun(&value_range_arg), "3l15");
-	add_function("replace", value_set_fun(&value_replace_arg), "3l15");
+	add_function("alpha?", value_set_fun(&value_alpha_p_arg), "p1l16");
+	add_function("alnum?", value_set_fun(&value_alnum_p_arg), "p1l16");
+	add_function("num?", value_set_fun(&value_num_p_arg), "p1l16");
+	add_function("length", value_set_fun(&value_length_arg), "pkns1l16");
+	add_function("lstrip", value_set_fun(&value_lstrip_arg), "p1l16");
+	add_function("range", value_set_fun(&value_range_arg), "ps3l15");
+	add_function("replace", value_set_fun(&value_replace_arg), "p3l15");
 	add_function("replace!", value_set_fun(&value_replace_now_arg), "3l15");
-	add_function("reverse", value_set_fun(&value_reverse_arg), "1l16");
+	add_function("reverse", value_set_fun(&value_reverse_arg), "p1l16");
 	add_function("reverse!", value_set_fun(&value_reverse_now_arg), "1l16");
-	add_function("rstrip", value_set_fun(&value_rstrip_arg), "1l16");
-	add_function("scan", value_set_fun(&value_scan_arg), "2l15");
-	add_function("split", value_set_fun(&value_split_arg), "2l15");
-	add_function("starts_with?", value_set_fun(&value_starts_with_p_arg), "2l15");
-	add_function("strip", value_set_fun(&value_strip_arg), "1l16");
+	add_function("rstrip", value_set_fun(&value_rstrip_arg), "p1l16");
+	add_function("scan", value_set_fun(&value_scan_arg), "p2l15");
+	add_function("split", value_set_fun(&value_split_arg), "ps2l15");
+	add_function("starts_with?", value_set_fun(&value_starts_with_p_arg), "ps2l15");
+	add_function("strip", value_set_fun(&value_strip_arg), "p1l16");
 	add_function("strip!", value_set_fun(&value_strip_now_arg), "1l16");
-	add_function("to_upper", value_set_fun(&value_to_upper_arg), "1l16");
-	add_function("to_lower", value_set_fun(&value_to_lower_arg), "1l16");
+	add_function("to_upper", value_set_fun(&value_to_upper_arg), "p1l16");
+	add_function("to_lower", value_set_fun(&value_to_lower_arg), "p1l16");
 	
-	add_function("match?", value_set_fun(&value_match_p_arg), "2l15");
-	add_function("match", value_set_fun(&value_match_arg), "2l15");
+	add_function("match?", value_set_fun(&value_match_p_arg), "ps2l15");
+	add_function("match", value_set_fun(&value_match_arg), "ps2l15");
 	
-	add_function("append", value_set_fun(&value_append_arg), "2l15");
-	add_function("append!", value_set_fun(&value_append_now_arg), "2l15");
-	add_function("array_with_length", value_set_fun(&value_array_with_length_arg), "1l15");
-	add_function("at", value_set_fun(&value_at_arg), "o1xl19");
+	add_function("append", value_set_fun(&value_append_arg), "pk2l15");
+	add_function("append!", value_set_fun(&value_append_now_arg), "k2l15");
+	add_function("array_with_capacity", value_set_fun(&value_array_with_capacity_arg), "1l15");
+	add_function("array_with_length", value_set_fun(&value_array_with_length_arg), "p1l15");
+	add_function("at", value_set_fun(&value_at_arg), "o1pknsxl19");
 	add_function("at_equals", value_set_fun(&value_at_assign_arg), "o3tffxl3");
 	add_function("at_add_equals", value_set_fun(&value_at_assign_add_arg), "o3tffxl3");
 	add_function("at_sub_equals", value_set_fun(&value_at_assign_sub_arg), "o3tffxl3");
@@ -260,46 +304,75 @@ int init_evaluator()
 	add_function("at_or_equals", value_set_fun(&value_at_assign_or_arg), "o3tffxl3");
 	add_function("at_shl_equals", value_set_fun(&value_at_assign_shl_arg), "o3tffxl3");
 	add_function("at_shr_equals", value_set_fun(&value_at_assign_shr_arg), "o3tffxl3");
-	add_function("concat", value_set_fun(&value_concat_arg), "2l15");
-	add_function("delete", value_set_fun(&value_delete_arg), "2l15");
-	add_function("delete_all", value_set_fun(&value_delete_all_arg), "2l15");
-	add_function("delete_at", value_set_fun(&value_delete_at_arg), "2l15");
+	add_function("capacity", value_set_fun(&value_capacity_arg), "k1l16");
+	add_function("concat", value_set_fun(&value_concat_arg), "p2l15");
+	add_function("delete", value_set_fun(&value_delete_arg), "p2l15");
+	add_function("delete_all", value_set_fun(&value_delete_all_arg), "p2l15");
+	add_function("delete_at", value_set_fun(&value_delete_at_arg), "p2l15");
 	add_function("delete_at!", value_set_fun(&value_delete_at_now_arg), "2l15");
-	add_function("each", value_set_fun(&value_each_arg), "tff2l15");
+	add_function("each", value_set_fun(&value_each_arg), "kstff2l15");
 	add_function("each_index", value_set_fun(&value_each_index_arg), "tff2l15");
-	add_function("empty?", value_set_fun(&value_empty_p_arg), "1l16");
+	add_function("empty?", value_set_fun(&value_empty_p_arg), "pkns1l16");
 	add_function("filter", value_set_fun(&value_filter_arg), "tff2l15");
 	add_function("find", value_set_fun(&value_find_arg), "tff2l15");
-	add_function("flatten", value_set_fun(&value_flatten_arg), "1l16");
+	add_function("flatten", value_set_fun(&value_flatten_arg), "p1l16");
 	add_function("flatten!", value_set_fun(&value_flatten_now_arg), "1l16");
 	add_function("fold", value_set_fun(&value_fold_arg), "tff3l15");
-	add_function("join", value_set_fun(&value_join_arg), "2l15");
-	add_function("last", value_set_fun(&value_last_arg), "1l16");
-	add_function("map", value_set_fun(&value_map_arg), "tff2l15");
-	add_function("map!", value_set_fun(&value_map_now_arg), "tff2l15");
-	add_function("pop", value_set_fun(&value_pop_arg), "1l16");
+	add_function("join", value_set_fun(&value_join_arg), "p2l15");
+	add_function("last", value_set_fun(&value_last_arg), "p1l16");
+	add_function("map", value_set_fun(&value_map_arg), "ktff2l15");
+	add_function("map!", value_set_fun(&value_map_now_arg), "ktff2l15");
+	add_function("pop", value_set_fun(&value_pop_arg), "p1l16");
 	add_function("pop!", value_set_fun(&value_pop_now_arg), "1l16");
+	add_function("reserve", value_set_fun(&value_reserve_arg), "k2l15");
+	add_function("shrink!", value_set_fun(&value_shrink_now_arg), "k1l16");
 	add_function("shuffle", value_set_fun(&value_shuffle_arg), "1l16");
 	add_function("shuffle!", value_set_fun(&value_shuffle_now_arg), "1l16");
-	add_function("size", value_set_fun(&value_size_arg), "1l16");
-	add_function("sort", value_set_fun(&value_sort_arg), "1l16");
-	add_function("sort!", value_set_fun(&value_sort_now_arg), "1l16");
-	add_function("uniq", value_set_fun(&value_uniq_arg), "1l16");
+	add_function("size", value_set_fun(&value_size_arg), "pkns1l16");
+	add_function("sort", value_set_fun(&value_sort_arg), "pk1l16");
+	add_function("sort!", value_set_fun(&value_sort_now_arg), "k1l16");
+	add_function("sort_by", value_set_fun(&value_sort_by_arg), "tff2l15");
+	add_function("sort_with", value_set_fun(&value_sort_with_arg), "tff2l15");
+	add_function("uniq", value_set_fun(&value_uniq_arg), "p1l16");
 	add_function("uniq!", value_set_fun(&value_uniq_now_arg), "1l16");
-	add_function("uniq_sort", value_set_fun(&value_uniq_sort_arg), "1l16");
+	add_function("uniq_sort", value_set_fun(&value_uniq_sort_arg), "p1l16");
 	add_function("uniq_sort!", value_set_fun(&value_uniq_sort_now_arg), "1l16");
 	
-	add_function("cons", value_set_fun(&value_cons_arg), "2r15");
+	add_function("cons", value_set_fun(&value_cons_arg), "p2r15");
 	add_function("cons!", value_set_fun(&value_cons_now_arg), "2r15");
-	add_function("drop", value_set_fun(&value_drop_arg), "2l15");
-	add_function("head", value_set_fun(&value_head_arg), "1l16");
-	add_function("tail", value_set_fun(&value_tail_arg), "1l16");
-	add_function("take", value_set_fun(&value_take_arg), "2l15");
-	
-	add_function("contains_value?", value_set_fun(&value_contains_value_arg), "2l15");
+	add_function("drop", value_set_fun(&value_drop_arg), "ps2l15");
+	add_function("head", value_set_fun(&value_head_arg), "p1l16");
+	add_function("tail", value_set_fun(&value_tail_arg), "p1l16");
+	add_function("take", value_set_fun(&value_take_arg), "s2l15");
+	add_function("slice?", value_set_fun(&value_slice_p_arg), "ps1l16");
+	add_function("next", value_set_fun(&value_next_arg), "1l16");
+	add_function("done?", value_set_fun(&value_done_p_arg), "1l16");
+	add_function("pack", value_set_fun(&value_pack_arg), "k1l16");
+	add_function("packed?", value_set_fun(&value_packed_p_arg), "pk1l16");
+	add_function("ndarray", value_set_fun(&value_ndarray_arg), "o1nfff2l15");
+	add_function("to_nd", value_set_fun(&value_to_nd_arg), "n1l16");
+	add_function("nd?", value_set_fun(&value_nd_p_arg), "pn1l16");
+	add_function("shape", value_set_fun(&value_shape_arg), "n1l16");
+	add_function("transpose", value_set_fun(&value_transpose_arg), "n1l16");
+	add_function("reshape", value_set_fun(&value_reshape_arg), "n2l15");
+	
+	add_function("matmul", value_set_fun(&value_matmul_arg), "n2l15");
+	add_function("matvec", value_set_fun(&value_matvec_arg), "n2l15");
+	add_function("solve", value_set_fun(&value_solve_arg), "n2l15");
+	
+	add_function("vadd", value_set_fun(&value_vadd_arg), "pk2l15");
+	add_function("vsub", value_set_fun(&value_vsub_arg), "pk2l15");
+	add_function("vmul", value_set_fun(&value_vmul_arg), "pk2l15");
+	add_function("vdiv", value_set_fun(&value_vdiv_arg), "pk2l15");
+	add_function("dot", value_set_fun(&value_dot_arg), "pk2l15");
+	add_function("min", value_set_fun(&value_min_arg), "pk1l16");
+	add_function("max", value_set_fun(&value_max_arg), "pk1l16");
+	add_function("prefix_sum", value_set_fun(&value_prefix_sum_arg), "pk1l16");
+	
+	add_function("contains_value?", value_set_fun(&value_contains_value_arg), "p2l15");
 		
 	add_function(";", value_set_fun(&value_do_both_arg), "tft2l0");
-	add_function(",", value_set_fun(&value_comma_arg), "fff2l1");
+	add_function(",", value_set_fun(&value_comma_arg), "pfff2l1");
 	add_function("do_all", value_set_fun(&value_do_all_arg), "tftx0l15");
 	add_function("if", value_set_fun(&value_if_arg), "o2ttt3l15");
 	add_function("unless", value_set_fun(&value_unless_arg), "o2ttt3l15");
@@ -310,12 +383,22 @@ int init_evaluator()
 	
 	add_function("break", value_set_fun(&value_break_arg), "fff0l2");
 	add_function("continue", value_set_fun(&value_continue_arg), "fff0l2");
-	add_function("yield", value_set_fun(&value_yield_arg), "fff1l2");
-	add_function("return", value_set_fun(&value_return_arg), "fff1l2");
+	add_function("yield", value_set_fun(&value_yield_arg), "knsfff1l2");
+	add_function("return", value_set_fun(&value_return_arg), "knsfff1l2");
 	add_function("exit", value_set_fun(&value_exit_arg), "fff0l2");
 	
 	add_function("def", value_set_fun(&value_def_arg), "uft3l2");
 	add_function("lambda", value_set_fun(&value_lambda_arg), "uft2l2");
+	add_function("defmemo", value_set_fun(&value_defmemo_arg), "uft3l2");
+	add_function("memoize", value_set_fun(&value_memoize_arg), "o2uff2l16");
+	add_function("memo_stats", value_set_fun(&value_memo_stats_arg), "uff1l16");
+	add_function("quicken_stats", value_set_fun(&value_quicken_stats_arg), "0l15");
+	add_function("jit_stats", value_set_fun(&value_jit_stats_arg), "0l15");
+	add_function("profile_start", value_set_fun(&value_profile_start_arg), "o0f1l15");
+	add_function("profile_stop", value_set_fun(&value_profile_stop_arg), "0l15");
+	add_function("profile_report", value_set_fun(&value_profile_report_arg), "o0f1l15");
+	add_function("memstats", value_set_fun(&value_memstats_arg), "0l15");
+	add_function("memo_clear", value_set_fun(&value_memo_clear_arg), "uff1l16");
 		
 	add_function("quote", value_set_fun(&value_quote_all_arg), "ftt1l18");
 	add_function("`", value_set_fun(&value_quote_arg), "ttt1l18");
@@ -482,18 +565,45 @@ struct value_spec compile_spec(char *str)
 		spec.associativity = 0;
 		spec.precedence = 0;
 		spec.not_stop_p = 0;
+		spec.generator_p = 0;
+		spec.pure_p = 0;
+		spec.packed_aware_p = 0;
+		spec.nd_aware_p = 0;
+		spec.slice_aware_p = 0;
 		return spec;
 	}
 	
 	char *ptr = str;
 	
-	spec.optional = INT_MAX;
+	spec.optional = SPEC_NO_OPTIONAL;
 	if (*ptr == 'o') {
 		spec.optional = 0;
 		while (isdigit(*(++ptr)))
 			spec.optional = (10 * spec.optional) + (*ptr - '0');
 	}
 	
+	spec.pure_p = FALSE;
+	if (*ptr == 'p') {
+		spec.pure_p = TRUE;
+		++ptr;
+	}
+	
+	spec.packed_aware_p = FALSE;
+	if (*ptr == 'k') {
+		spec.packed_aware_p = TRUE;
+		++ptr;
+	}
+	spec.nd_aware_p = FALSE;
+	if (*ptr == 'n') {
+		spec.nd_aware_p = TRUE;
+		++ptr;
+	}
+	spec.slice_aware_p = FALSE;
+	if (*ptr == 's') {
+		spec.slice_aware_p = TRUE;
+		++ptr;
+	}
+	
 	spec.change_scope_p = TRUE;
 	
 	if (*ptr == 't')
@@ -554,6 +664,7 @@ struct value_spec compile_spec(char *str)
 		spec.precedence = (10 * spec.precedence) + *ptr - '0';
 	
 	spec.not_stop_p = FALSE;
+	spec.generator_p = FALSE;
 	
 	return spec;
 }
@@ -351,7 +351,7 @@ value compile_values(value words[], size_t wordcount)
 	// Do a preliminary compilation. Find IDs that look like functions and make them  
 	// into UDF shells.
 	for (i = 0; i < wordcount; ++i) {
-		if (words[i].type == VALUE_BIF && words[i].core.u_bif->f == &value_def_arg) {
+		if (words[i].type == VALUE_BIF && (words[i].core.u_bif->f == &value_def_arg || words[i].core.u_bif->f == &value_defmemo_arg)) {
 			assume_first_is_function = FALSE;
 			
 			// If the function was previously defined, delete the old definition.
@@ -397,7 +397,7 @@ value compile_values(value words[], size_t wordcount)
 		}
 	}
 	
-	value res;
+	value res = value_init_nil();
 	
 	// Find parentheses and brackets. Also determine if the expression contains any functions.
 	int first_function_index = -1;
@@ -726,7 +726,6 @@ value compile_values(value words[], size_t wordcount)
 			tmpexp.type = VALUE_BLK;
 			tmpexp.core.u_blk.a = words;
 			tmpexp.core.u_blk.length = wordcount;
-			tmpexp.core.u_blk.s = NULL;
 			value_error(0, "Warning: Expression %s will probably not evaluate as expected (function at index %d has arg count %d).", tmpexp, first_function_index, wspec.argc);
 		}
 	}
@@ -804,7 +803,6 @@ value prefix_words_to_sexp(value words[], size_t *i, size_t length)
 		sexp.type = VALUE_BLK;
 		value_malloc(&sexp, next_size(1));
 		return_if_error(sexp);
-		sexp.core.u_blk.s = NULL;
 		sexp.core.u_blk.a[0] = value_set(words[*i]);
 		sexp.core.u_blk.length = 1;
 		return sexp;
@@ -819,7 +817,6 @@ value prefix_words_to_sexp(value words[], size_t *i, size_t length)
 		value_malloc(&sexp, next_size(length));
 		return_if_error(sexp);
 		sexp.core.u_blk.length = length;
-		sexp.core.u_blk.s = NULL;
 		size_t j;
 		for (j = *i; j < length; ++j)
 			sexp.core.u_blk.a[j] = value_set(words[j]);
@@ -845,11 +842,10 @@ value prefix_words_to_sexp(value words[], size_t *i, size_t length)
 	sexp.type = VALUE_BLK;
 	value_malloc(&sexp, next_size(argc+1));	
 	return_if_error(sexp);	
-	sexp.core.u_blk.s = NULL;
 	sexp.core.u_blk.a[0] = value_set(words[*i]);
 	
 	int prev_quote_p = words[*i].type == VALUE_BIF && words[*i].core.u_bif->f == &value_quote_arg;
-	int prev_def_p = words[*i].type == VALUE_BIF && words[*i].core.u_bif->f == &value_def_arg;
+	int prev_def_p = words[*i].type == VALUE_BIF && (words[*i].core.u_bif->f == &value_def_arg || words[*i].core.u_bif->f == &value_defmemo_arg);
 	size_t first = *i;
 	++*i;
 	size_t j;
@@ -857,6 +853,7 @@ value prefix_words_to_sexp(value words[], size_t *i, size_t length)
 		if (!prev_def_p && !prev_quote_p && (words[*i].type == VALUE_BIF || words[*i].type == VALUE_UDF || words[*i].type == VALUE_UDF_SHELL)) {
 			value temp = prefix_words_to_sexp(words, i, length);
 			if (temp.type == VALUE_ERROR) {
+				sexp.core.u_blk.length = j;
 				value_clear(&sexp);
 				return temp;
 			}
@@ -872,6 +869,7 @@ value prefix_words_to_sexp(value words[], size_t *i, size_t length)
 	if (first == 0 && *i < length) {
 		// This should be done at runtime.
 		value_error(1, "Argument Error: Too many arguments in function %s (%d expected, at least %ld found).", words[first], argc, j);
+		sexp.core.u_blk.length = j;
 		value_clear(&sexp);
 		return value_init_error();
 	}
@@ -899,6 +897,10 @@ value interpret_values(value *variables, value words[], size_t wordcount)
 		return sexp;
 	}
 	
+	// Specializing typed arithmetic is always safe, so every statement gets it.
+	value_optimize_now(&sexp, O_4);
+	value_private_make_sites(sexp);
+	
 	value res = eval(variables, sexp);
 	value_clear(&sexp);
 	return res;
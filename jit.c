@@ -0,0 +1,378 @@
+/*
+ *  jit.c
+ *  Simfpl
+ *
+ *  All definitions for functions and variables in jit.c can be found in value.h.
+ *
+ *  Tiered execution. value_udfcall() counts the calls to each user-defined
+ *  function. When a function has been called JIT_THRESHOLD times, sexp_to_c
+ *  translates it to C and the system C compiler builds a shared object from it in
+ *  a child process, so the interpreter keeps running in the meantime. Each call
+ *  after that checks whether the compiler has finished. Once it has, the shared
+ *  object is loaded with dlopen() and the function's calls go to the native code.
+ *
+ *  If the function can't be translated or the compiler fails, the function just
+ *  stays interpreted.
+ *
+ *  Shared objects are cached in jit_cache_dir under a hash of the generated C,
+ *  which contains everything in the function's body, and of JIT_BUILD_ID, so a
+ *  later run of the same build loads them without compiling again. Since loading
+ *  a shared object runs its code, the cache directory has to belong to the user
+ *  and be closed to everyone else (mode 0700), and so does every shared object
+ *  in it. Otherwise nothing is loaded and the function stays interpreted.
+ *
+ *  The native code calls the interpreter's functions, so simfpl has to be linked
+ *  with -rdynamic. These environment variables change the defaults:
+ *
+ *    SIMFPL_JIT=1          Turns the JIT on. It's off by default.
+ *    CC                    The C compiler. Defaults to cc.
+ *    SIMFPL_JIT_FLAGS      Flags for the C compiler. They have to let it find
+ *                          sexp_to_c.h. Defaults to "-O2 -std=gnu89 -fcommon -w -I.".
+ *    SIMFPL_JIT_CACHE      The directory for the shared objects. Defaults to
+ *                          $HOME/.cache/simfpl-jit, or /tmp/simfpl-jit-<uid> if
+ *                          HOME isn't set.
+ */
+
+#include "sexp_to_c.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * Identifies the build of the interpreter that a shared object was compiled
+ * against. jit.c includes the headers that define the value types and structs,
+ * so it's rebuilt, and this changes, whenever they do.
+ */
+#ifndef JIT_BUILD_ID
+#define JIT_BUILD_ID __DATE__ " " __TIME__
+#endif
+
+char jit_default_cache_dir[BUFSIZE];
+
+int init_jit()
+{
+	char *str = getenv("SIMFPL_JIT");
+	jit_enabled_p = str != NULL && *str != '\0' && strcmp(str, "0") != 0;
+
+	jit_cc = getenv("CC");
+	if (jit_cc == NULL || *jit_cc == '\0')
+		jit_cc = "cc";
+	jit_flags = getenv("SIMFPL_JIT_FLAGS");
+	if (jit_flags == NULL)
+		jit_flags = "-O2 -std=gnu89 -fcommon -w -I.";
+	jit_cache_dir = getenv("SIMFPL_JIT_CACHE");
+	if (jit_cache_dir == NULL || *jit_cache_dir == '\0') {
+		char *home = getenv("HOME");
+		if (home && *home)
+			snprintf(jit_default_cache_dir, BUFSIZE, "%s/.cache/simfpl-jit", home);
+		else snprintf(jit_default_cache_dir, BUFSIZE, "/tmp/simfpl-jit-%ld", (long) getuid());
+		jit_cache_dir = jit_default_cache_dir;
+	}
+
+	jit_compiled = jit_cached = jit_loaded = jit_failed = 0;
+	return 0;
+}
+
+struct value_jit * value_jit_init()
+{
+	struct value_jit *jit = value_malloc(NULL, sizeof(struct value_jit));
+	if (jit == NULL)
+		return NULL;
+
+	jit->refcount = 1;
+	jit->calls = 0;
+	jit->state = JIT_INTERPRETED;
+	jit->pid = 0;
+	jit->path = NULL;
+	jit->f = NULL;
+	return jit;
+}
+
+/*
+ * The shared object is never closed, because the native code may still be running
+ * further up the stack when the last copy of the function is cleared.
+ */
+void value_jit_free(struct value_jit *jit)
+{
+	if (--jit->refcount > 0)
+		return;
+
+	// Nothing will poll the compiler after this, so wait for it here rather than leave 
+	// a zombie behind.
+	if (jit->state == JIT_COMPILING)
+		waitpid(jit->pid, NULL, 0);
+	if (jit->path)
+		value_free(jit->path);
+	value_free(jit);
+}
+
+/*
+ * Counts a call to (op), which is about to be interpreted. Starts the compiler
+ * when the function becomes hot, and loads the native code when the compiler
+ * has finished.
+ */
+int value_jit_count(value op)
+{
+	struct value_jit *jit = op.core.u_udf->jit;
+
+	if (jit->state == JIT_COMPILING)
+		return value_jit_poll(jit);
+
+	if (jit->state == JIT_INTERPRETED && ++jit->calls >= JIT_THRESHOLD)
+		return value_jit_start(op);
+
+	return 0;
+}
+
+int value_jit_start(value op)
+{
+	struct value_jit *jit = op.core.u_udf->jit;
+	jit->state = JIT_FAILED;
+
+	FILE *code = tmpfile();
+	if (code == NULL) {
+		++jit_failed;
+		return VALUE_ERROR;
+	}
+
+	// A function that can't be compiled is an ordinary case here, not an error.
+	int saved_print_errors_p = print_errors_p;
+	print_errors_p = FALSE;
+	int error_p = sexp_to_c_jit(code, op);
+	print_errors_p = saved_print_errors_p;
+
+	if (error_p) {
+		fclose(code);
+		++jit_failed;
+		return 0;
+	}
+
+	unsigned long long hash = value_jit_hash(code);
+	char path[BUFSIZE], source[BUFSIZE], temp[BUFSIZE], command[3*BUFSIZE];
+	snprintf(path, BUFSIZE, "%s/%016llx.so", jit_cache_dir, hash);
+
+	jit->path = value_malloc(NULL, strlen(path) + 1);
+	if (jit->path == NULL) {
+		fclose(code);
+		++jit_failed;
+		return VALUE_ERROR;
+	}
+	strcpy(jit->path, path);
+
+	if (value_jit_make_cache_dir()) {
+		fclose(code);
+		++jit_failed;
+		return 0;
+	}
+
+	if (access(path, F_OK) == 0) {
+		fclose(code);
+		++jit_cached;
+		return value_jit_load(jit);
+	}
+
+	snprintf(source, BUFSIZE, "%s/%016llx.c", jit_cache_dir, hash);
+	snprintf(temp, BUFSIZE, "%s/%016llx.%ld.so", jit_cache_dir, hash, (long) getpid());
+
+	FILE *out = fopen(source, "w");
+	if (out == NULL) {
+		fclose(code);
+		++jit_failed;
+		return 0;
+	}
+	sexp_to_c_copy(out, code);
+	fclose(code);
+	if (fclose(out)) {
+		++jit_failed;
+		return 0;
+	}
+
+	// Compile into a temporary file and rename it, so that another process never
+	// loads a shared object that's only half written.
+	snprintf(command, sizeof(command), "%s %s -shared -fPIC -o '%s' '%s' >/dev/null 2>&1", jit_cc, jit_flags, temp, source);
+
+	fflush(stdout);
+	fflush(stderr);
+	pid_t pid = fork();
+	if (pid < 0) {
+		++jit_failed;
+		return 0;
+	}
+
+	if (pid == 0) {
+		int status = system(command);
+		if (status == 0 && chmod(temp, 0700) == 0 && rename(temp, path) == 0)
+			_exit(0);
+		remove(temp);
+		_exit(1);
+	}
+
+	jit->state = JIT_COMPILING;
+	jit->pid = pid;
+	++jit_compiled;
+	return 0;
+}
+
+/*
+ * Checks whether the compiler has finished, without waiting for it.
+ */
+int value_jit_poll(struct value_jit *jit)
+{
+	int status;
+	pid_t pid = waitpid(jit->pid, &status, WNOHANG);
+	if (pid == 0)
+		return 0;
+
+	if (pid == jit->pid && WIFEXITED(status) && WEXITSTATUS(status) == 0)
+		return value_jit_load(jit);
+
+	jit->state = JIT_FAILED;
+	++jit_failed;
+	return 0;
+}
+
+/*
+ * Creates jit_cache_dir if it doesn't exist. Returns VALUE_ERROR if it can't, or if
+ * it isn't a directory that belongs to the user and that no one else can use.
+ */
+int value_jit_make_cache_dir()
+{
+	// The parent is usually ~/.cache, which might not exist yet.
+	char parent[BUFSIZE];
+	snprintf(parent, BUFSIZE, "%s", jit_cache_dir);
+	char *slash = strrchr(parent, '/');
+	if (slash && slash != parent) {
+		*slash = '\0';
+		mkdir(parent, 0700);
+	}
+
+	if (mkdir(jit_cache_dir, 0700) && errno != EEXIST)
+		return VALUE_ERROR;
+
+	struct stat st;
+	if (lstat(jit_cache_dir, &st) || !S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 0777) != 0700)
+		return VALUE_ERROR;
+	return 0;
+}
+
+/*
+ * Returns VALUE_ERROR unless (path) is a regular file that belongs to the user and
+ * that no one else can use.
+ */
+int value_jit_check_file(char *path)
+{
+	struct stat st;
+	if (lstat(path, &st) || !S_ISREG(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 0077) != 0)
+		return VALUE_ERROR;
+	return 0;
+}
+
+int value_jit_load(struct value_jit *jit)
+{
+	jit->state = JIT_FAILED;
+
+	if (value_jit_make_cache_dir() || value_jit_check_file(jit->path)) {
+		++jit_failed;
+		return 0;
+	}
+
+	void *handle = dlopen(jit->path, RTLD_NOW | RTLD_LOCAL);
+	if (handle == NULL) {
+		++jit_failed;
+		return 0;
+	}
+
+	int (*init)(void) = (int (*)(void)) dlsym(handle, "sexp_to_c_jit_init");
+	value (*f)(int argc, value argv[]) = (value (*)(int, value *)) dlsym(handle, "sexp_to_c_jit_entry");
+	if (init == NULL || f == NULL || (*init)()) {
+		dlclose(handle);
+		++jit_failed;
+		return 0;
+	}
+
+	jit->f = f;
+	jit->state = JIT_NATIVE;
+	++jit_loaded;
+	return 0;
+}
+
+/*
+ * Calls the native version of (op). The arguments are evaluated just as
+ * value_private_udfcall() evaluates them.
+ */
+value value_jit_call(value *variables, value op, int argc, value argv[])
+{
+	int fargc = op.core.u_udf->spec.argc;
+	value args[fargc + 1];
+	int i;
+
+	for (i = 0; i < fargc; ++i) {
+		args[i] = eval(variables, argv[i]);
+		if (args[i].type == VALUE_ERROR || args[i].type == VALUE_STOP) {
+			value res = args[i];
+			while (i-- > 0)
+				value_clear(&args[i]);
+			return res;
+		}
+	}
+
+	return (*op.core.u_udf->jit->f)(fargc, args);
+}
+
+/*
+ * Calls the native version of (op) with arguments that have already been
+ * evaluated. Takes ownership of the arguments.
+ */
+value value_jit_call_evaluated(value op, int argc, value argv[])
+{
+	int fargc = op.core.u_udf->spec.argc;
+	int i;
+
+	for (i = fargc; i < argc; ++i)
+		value_clear(&argv[i]);
+
+	return (*op.core.u_udf->jit->f)(fargc, argv);
+}
+
+/*
+ * 64-bit FNV-1a hash of the contents of (code). JIT_BUILD_ID and the size of a
+ * value go in too, so that shared objects built against another build of the
+ * interpreter, which might lay values out differently, aren't loaded.
+ */
+unsigned long long value_jit_hash(FILE *code)
+{
+	unsigned long long hash = (14695981039346656037ULL ^ sizeof(value)) * 1099511628211ULL;
+	const char *id;
+	int c;
+
+	for (id = JIT_BUILD_ID; *id; ++id) {
+		hash ^= (unsigned char) *id;
+		hash *= 1099511628211ULL;
+	}
+
+	rewind(code);
+	while ((c = fgetc(code)) != EOF) {
+		hash ^= (unsigned char) c;
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+value value_jit_stats()
+{
+	value res = value_hash_init();
+	value_hash_put_str(&res, "compiled", value_set_ulong(jit_compiled));
+	value_hash_put_str(&res, "cached", value_set_ulong(jit_cached));
+	value_hash_put_str(&res, "native", value_set_ulong(jit_loaded));
+	value_hash_put_str(&res, "failed", value_set_ulong(jit_failed));
+	return res;
+}
+
+value value_jit_stats_arg(int argc, value argv[])
+{
+	return value_jit_stats();
+}
@@ -23,12 +23,15 @@ int consecutive_primes();
 
 int main(int argc, const char *argv[])
 {
+	init_memory();
 	init_tools();
 	init_values();
 	init_evaluator();
 	init_interpreter();
 	init_tests();
 	init_sexp_to_c();
+	init_jit();
+	init_profile();
 	
 	// TO TRY: Add an -O3 flag to Xcode's compile. Then compile and profile, and see if it runs faster.
 	
@@ -39,7 +42,15 @@ int main(int argc, const char *argv[])
 		if (streq(argv[1], "test")) {
 			run_tests();
 		} else if (streq(argv[1], "benchmark")) {
-			run_benchmarks();
+			return run_benchmarks(argc - 2, argv + 2);
+		} else if (streq(argv[1], "microbench")) {
+			return microbench_main(argc - 2, argv + 2);
+		} else if (streq(argv[1], "compile")) {
+			return sexp_to_c_main(argc - 2, argv + 2);
+		} else if (streq(argv[1], "compile_check")) {
+			return sexp_to_c_check_main(argc - 2, argv + 2);
+		} else if (streq(argv[1], "profile")) {
+			return value_profile_main(argc - 2, argv + 2);
 		} else {
 			value str = value_set_str(argv[1]);
 			value_import(str);
@@ -0,0 +1,386 @@
+/*
+ *  memory.c
+ *  Simfpl
+ *
+ *  All definitions for functions and variables in memory.c can be found in value.h.
+ *
+ *  Memory tracking. When the environment variable SIMFPL_MEMSTATS is set to
+ *  anything but 0, every block that value_malloc() and value_realloc() hand out is
+ *  recorded with its size, the type of the value it belongs to and the file and line
+ *  that asked for it, until value_free() frees it. GMP and MPFR are given allocation
+ *  functions that record their blocks too, under the category "Numbers".
+ *
+ *  memstats() returns the totals, and when the program exits a report of the
+ *  memory that is still allocated goes to stderr, grouped by type and by call site.
+ *  Some of that memory is held on purpose until the end, like the built-in
+ *  function tables, so a site only points to a leak if it keeps growing.
+ *
+ *  The counts of how arrays grow and shrink are kept whether or not tracking is on,
+ *  since they cost one addition each.
+ *
+ *  Memory allocated or freed some other way, like with plain malloc() and free(),
+ *  isn't seen. A block that's freed that way stays in the report. Tracking isn't
+ *  thread safe.
+ */
+
+#include "value.h"
+
+#include <sys/resource.h>
+
+int init_memory()
+{
+	memory_blocks = NULL;
+	memory_blocks_size = memory_blocks_used = 0;
+	memory_sites_used = 0;
+	memory_live_bytes = memory_live_blocks = memory_peak_bytes = 0;
+	memory_allocations = memory_frees = 0;
+	memory_array_grows = memory_array_grow_copies = memory_array_reserves = memory_array_shrinks = 0;
+	memset(memory_sites, 0, sizeof(memory_sites));
+	memset(memory_categories, 0, sizeof(memory_categories));
+
+	char *str = getenv("SIMFPL_MEMSTATS");
+	memory_tracking_p = str != NULL && *str != '\0' && strcmp(str, "0") != 0;
+	if (memory_tracking_p) {
+		mp_set_memory_functions(&value_memory_gmp_alloc, &value_memory_gmp_realloc, &value_memory_gmp_free);
+		atexit(&value_memory_exit_report);
+	}
+
+	return 0;
+}
+
+size_t value_memory_hash(void *ptr)
+{
+	size_t x = (size_t) ptr >> 4;
+	return x ^ (x >> 17) ^ (x >> 31);
+}
+
+/*
+ * Makes the table of blocks twice as big. The table itself isn't tracked.
+ */
+int value_memory_grow()
+{
+	size_t i, old_size = memory_blocks_size;
+	struct value_memory_block *old = memory_blocks;
+
+	memory_blocks_size = old_size ? 2 * old_size : 4096;
+	memory_blocks = calloc(memory_blocks_size, sizeof(struct value_memory_block));
+	if (memory_blocks == NULL) {
+		memory_tracking_p = FALSE;
+		memory_blocks = old;
+		memory_blocks_size = old_size;
+		return VALUE_ERROR;
+	}
+
+	for (i = 0; i < old_size; ++i) {
+		if (old[i].ptr) {
+			size_t j = value_memory_hash(old[i].ptr) & (memory_blocks_size - 1);
+			while (memory_blocks[j].ptr)
+				j = (j + 1) & (memory_blocks_size - 1);
+			memory_blocks[j] = old[i];
+		}
+	}
+
+	free(old);
+	return 0;
+}
+
+/*
+ * Finds the site for (file) and (line), or adds it. The last site holds every
+ * call site that doesn't fit.
+ */
+int value_memory_site(const char *file, int line)
+{
+	size_t i = (((size_t) file >> 3) * 31 + line) % (MEMORY_SITES - 1);
+	size_t count;
+
+	for (count = 0; count < MEMORY_SITES - 1; ++count) {
+		struct value_memory_site *site = &memory_sites[i];
+		if (site->file == NULL) {
+			site->file = file;
+			site->line = line;
+			++memory_sites_used;
+			return i;
+		}
+		if (site->file == file && site->line == line)
+			return i;
+		i = (i + 1) % (MEMORY_SITES - 1);
+	}
+
+	memory_sites[MEMORY_SITES-1].file = "(other)";
+	return MEMORY_SITES - 1;
+}
+
+int value_memory_track(void *ptr, size_t size, int category, const char *file, int line)
+{
+	if (2 * (memory_blocks_used + 1) > memory_blocks_size)
+		if (value_memory_grow())
+			return VALUE_ERROR;
+
+	// A block that was freed without value_free() may have the same address.
+	value_memory_untrack(ptr);
+
+	size_t i = value_memory_hash(ptr) & (memory_blocks_size - 1);
+	while (memory_blocks[i].ptr)
+		i = (i + 1) & (memory_blocks_size - 1);
+
+	struct value_memory_block *block = &memory_blocks[i];
+	block->ptr = ptr;
+	block->size = size;
+	block->category = category;
+	block->site = value_memory_site(file, line);
+	++memory_blocks_used;
+
+	memory_live_bytes += size;
+	++memory_live_blocks;
+	++memory_allocations;
+	if (memory_live_bytes > memory_peak_bytes)
+		memory_peak_bytes = memory_live_bytes;
+
+	memory_categories[category].live_bytes += size;
+	++memory_categories[category].live_blocks;
+	++memory_categories[category].allocations;
+	memory_sites[block->site].live_bytes += size;
+	++memory_sites[block->site].live_blocks;
+	++memory_sites[block->site].allocations;
+	return 0;
+}
+
+/*
+ * Forgets the block at (ptr) if it's being tracked. Uses backward shift deletion, so
+ * the table never needs tombstones.
+ */
+int value_memory_untrack(void *ptr)
+{
+	if (memory_blocks_used == 0)
+		return 0;
+
+	size_t mask = memory_blocks_size - 1;
+	size_t i = value_memory_hash(ptr) & mask;
+	while (memory_blocks[i].ptr != ptr) {
+		if (memory_blocks[i].ptr == NULL)
+			return 0;
+		i = (i + 1) & mask;
+	}
+
+	struct value_memory_block *block = &memory_blocks[i];
+	memory_live_bytes -= block->size;
+	--memory_live_blocks;
+	++memory_frees;
+	memory_categories[block->category].live_bytes -= block->size;
+	--memory_categories[block->category].live_blocks;
+	memory_sites[block->site].live_bytes -= block->size;
+	--memory_sites[block->site].live_blocks;
+	--memory_blocks_used;
+
+	size_t j = i;
+	for (;;) {
+		memory_blocks[i].ptr = NULL;
+		size_t home;
+		do {
+			j = (j + 1) & mask;
+			if (memory_blocks[j].ptr == NULL)
+				return 0;
+			home = value_memory_hash(memory_blocks[j].ptr) & mask;
+		} while (i <= j ? (i < home && home <= j) : (i < home || home <= j));
+		memory_blocks[i] = memory_blocks[j];
+		i = j;
+	}
+}
+
+/*
+ * Called after a block has been reallocated from the address (old), which may be 0,
+ * to (ptr). The old block may have been freed by then, so its address is passed as an
+ * integer that's only used to find it in the table.
+ */
+int value_memory_move(uintptr_t old, void *ptr, size_t size, int type, const char *file, int line)
+{
+	if (old)
+		value_memory_untrack((void *) old);
+	return value_memory_track(ptr, size, value_memory_category(type), file, line);
+}
+
+int value_memory_category(int type)
+{
+	if (type == MEMORY_UNTYPED || type == MEMORY_NUMBERS)
+		return type;
+	if (type < 0 || type >= MEMORY_UNTYPED)
+		return MEMORY_UNTYPED;
+	return type;
+}
+
+const char * value_memory_category_name(int category)
+{
+	if (category == MEMORY_UNTYPED)
+		return "Untyped";
+	if (category == MEMORY_NUMBERS)
+		return "Numbers";
+	return type_to_string(category);
+}
+
+void * value_memory_gmp_alloc(size_t size)
+{
+	void *ptr = malloc(size);
+	if (ptr == NULL) {
+		fprintf(stderr, "Memory Error: GMP allocation failed.\n");
+		abort();
+	}
+	if (memory_tracking_p)
+		value_memory_track(ptr, size, MEMORY_NUMBERS, "gmp", 0);
+	return ptr;
+}
+
+void * value_memory_gmp_realloc(void *old, size_t old_size, size_t new_size)
+{
+	uintptr_t old_address = (uintptr_t) old;
+	void *ptr = realloc(old, new_size);
+	if (ptr == NULL) {
+		fprintf(stderr, "Memory Error: GMP allocation failed.\n");
+		abort();
+	}
+	if (memory_tracking_p)
+		value_memory_move(old_address, ptr, new_size, MEMORY_NUMBERS, "gmp", 0);
+	return ptr;
+}
+
+void value_memory_gmp_free(void *ptr, size_t size)
+{
+	if (memory_tracking_p)
+		value_memory_untrack(ptr);
+	free(ptr);
+}
+
+/*
+ * The largest resident set size so far, in bytes.
+ */
+size_t value_memory_peak_rss()
+{
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage))
+		return 0;
+#ifdef __APPLE__
+	return (size_t) usage.ru_maxrss;
+#else
+	return (size_t) usage.ru_maxrss * 1024;
+#endif
+}
+
+int value_memory_compare_sites(const void *a, const void *b)
+{
+	const struct value_memory_site *x = &memory_sites[*(const int *) a], *y = &memory_sites[*(const int *) b];
+	if (x->live_bytes != y->live_bytes)
+		return x->live_bytes < y->live_bytes ? 1 : -1;
+	return (int) y->allocations - (int) x->allocations;
+}
+
+/*
+ * Puts the indices of the sites that still have memory allocated into (indices),
+ * sorted by how much, and returns how many there are.
+ */
+int value_memory_sorted_sites(int *indices)
+{
+	int i, count = 0;
+	for (i = 0; i < MEMORY_SITES; ++i)
+		if (memory_sites[i].live_blocks)
+			indices[count++] = i;
+	qsort(indices, count, sizeof(int), &value_memory_compare_sites);
+	return count;
+}
+
+int value_memory_write_report(FILE *out)
+{
+	int i, count;
+	int indices[MEMORY_SITES];
+
+	fprintf(out, "Memory still allocated: %lu bytes in %lu blocks.\n", (unsigned long) memory_live_bytes, (unsigned long) memory_live_blocks);
+	fprintf(out, "Peak: %lu bytes allocated, %lu bytes resident.\n", (unsigned long) memory_peak_bytes, (unsigned long) value_memory_peak_rss());
+	fprintf(out, "%lu allocations, %lu frees.\n", (unsigned long) memory_allocations, (unsigned long) memory_frees);
+	fprintf(out, "Arrays grew %lu times, moving %lu elements, with %lu reserves and %lu shrinks.\n\n", 
+			(unsigned long) memory_array_grows, (unsigned long) memory_array_grow_copies, 
+			(unsigned long) memory_array_reserves, (unsigned long) memory_array_shrinks);
+
+	fprintf(out, "%12s %10s %12s  %s\n", "bytes", "blocks", "allocations", "type");
+	for (i = 0; i < MEMORY_CATEGORIES; ++i) {
+		struct value_memory_site *cat = &memory_categories[i];
+		if (cat->allocations)
+			fprintf(out, "%12lu %10lu %12lu  %s\n", (unsigned long) cat->live_bytes, (unsigned long) cat->live_blocks, (unsigned long) cat->allocations, value_memory_category_name(i));
+	}
+
+	count = value_memory_sorted_sites(indices);
+	if (count > MEMORY_REPORT_SITES)
+		count = MEMORY_REPORT_SITES;
+
+	fprintf(out, "\n%12s %10s %12s  %s\n", "bytes", "blocks", "allocations", "site");
+	for (i = 0; i < count; ++i) {
+		struct value_memory_site *site = &memory_sites[indices[i]];
+		fprintf(out, "%12lu %10lu %12lu  %s:%d\n", (unsigned long) site->live_bytes, (unsigned long) site->live_blocks, (unsigned long) site->allocations, site->file, site->line);
+	}
+
+	return 0;
+}
+
+void value_memory_exit_report()
+{
+	if (!memory_tracking_p)
+		return;
+	fflush(stdout);
+	fprintf(stderr, "\n");
+	value_memory_write_report(stderr);
+}
+
+value value_memstats()
+{
+	value res = value_hash_init();
+	value_hash_put_str(&res, "tracking", value_set_bool(memory_tracking_p));
+	value_hash_put_str(&res, "live_bytes", value_set_ulong(memory_live_bytes));
+	value_hash_put_str(&res, "live_blocks", value_set_ulong(memory_live_blocks));
+	value_hash_put_str(&res, "peak_bytes", value_set_ulong(memory_peak_bytes));
+	value_hash_put_str(&res, "allocations", value_set_ulong(memory_allocations));
+	value_hash_put_str(&res, "frees", value_set_ulong(memory_frees));
+	value_hash_put_str(&res, "peak_rss", value_set_ulong(value_memory_peak_rss()));
+	
+	value arrays = value_hash_init();
+	value_hash_put_str(&arrays, "grows", value_set_ulong(memory_array_grows));
+	value_hash_put_str(&arrays, "grow_copies", value_set_ulong(memory_array_grow_copies));
+	value_hash_put_str(&arrays, "reserves", value_set_ulong(memory_array_reserves));
+	value_hash_put_str(&arrays, "shrinks", value_set_ulong(memory_array_shrinks));
+	value_hash_put_str(&res, "arrays", arrays);
+	value_clear(&arrays);
+
+	value types = value_hash_init();
+	int i, count;
+	for (i = 0; i < MEMORY_CATEGORIES; ++i) {
+		struct value_memory_site *cat = &memory_categories[i];
+		if (cat->allocations == 0)
+			continue;
+		value stats = value_hash_init();
+		value_hash_put_str(&stats, "bytes", value_set_ulong(cat->live_bytes));
+		value_hash_put_str(&stats, "blocks", value_set_ulong(cat->live_blocks));
+		value_hash_put_str(&stats, "allocations", value_set_ulong(cat->allocations));
+		value_hash_put_str(&types, value_memory_category_name(i), stats);
+		value_clear(&stats);
+	}
+	value_hash_put_str(&res, "types", types);
+	value_clear(&types);
+
+	int indices[MEMORY_SITES];
+	count = value_memory_sorted_sites(indices);
+	if (count > MEMORY_REPORT_SITES)
+		count = MEMORY_REPORT_SITES;
+
+	value sites = value_hash_init();
+	char name[BUFSIZE];
+	for (i = 0; i < count; ++i) {
+		struct value_memory_site *site = &memory_sites[indices[i]];
+		snprintf(name, BUFSIZE, "%s:%d", site->file, site->line);
+		value_hash_put_str(&sites, name, value_set_ulong(site->live_bytes));
+	}
+	value_hash_put_str(&res, "sites", sites);
+	value_clear(&sites);
+
+	return res;
+}
+
+value value_memstats_arg(int argc, value argv[])
+{
+	return value_memstats();
+}
@@ -0,0 +1,650 @@
+/*
+ *  microbench.c
+ *  Simfpl
+ *
+ *  All definitions for functions and variables in microbench.c can be found in tests.h.
+ *
+ *  Microbenchmarks for the value functions that scripts spend most of their time
+ *  in. Run them with
+ *
+ *    simfpl microbench [-s samples] [-t msec] [name ...]
+ *
+ *  Each case times one operation on operands that were made beforehand, so only the
+ *  operation is measured. The number of operations in a sample is doubled until a
+ *  sample takes about (msec / samples) milliseconds. After one untimed sample to
+ *  warm the caches, (samples) samples are timed, and the mean time per operation is
+ *  printed with its 95% confidence interval and the fastest sample. A difference
+ *  between two builds is only real if the intervals don't overlap.
+ *
+ *  Only the cases whose names contain one of the (name) arguments are run, so
+ *  "simfpl microbench hash_get" runs every hash lookup.
+ */
+
+#include "tests.h"
+
+#include <time.h>
+
+struct microbench microbenches[] = {
+	{ "set/integer", &microbench_setup_scalar, &microbench_run_set, VALUE_MPZ, 0 },
+	{ "set/float", &microbench_setup_scalar, &microbench_run_set, VALUE_MPF, 0 },
+	{ "set/string 16", &microbench_setup_scalar, &microbench_run_set, VALUE_STR, 16 },
+	{ "set/string 1024", &microbench_setup_scalar, &microbench_run_set, VALUE_STR, 1024 },
+	{ "set/array 16", &microbench_setup_container, &microbench_run_set, VALUE_ARY, 16 },
+	{ "set/array 1024", &microbench_setup_container, &microbench_run_set, VALUE_ARY, 1024 },
+	{ "set/list 16", &microbench_setup_container, &microbench_run_set, VALUE_LST, 16 },
+	{ "set/hash 16", &microbench_setup_container, &microbench_run_set, VALUE_HSH, 16 },
+	{ "set/hash 1024", &microbench_setup_container, &microbench_run_set, VALUE_HSH, 1024 },
+	{ "clear/integer", &microbench_setup_scalar, &microbench_run_clear, VALUE_MPZ, 0 },
+	{ "clear/float", &microbench_setup_scalar, &microbench_run_clear, VALUE_MPF, 0 },
+	{ "clear/string 16", &microbench_setup_scalar, &microbench_run_clear, VALUE_STR, 16 },
+	{ "clear/string 1024", &microbench_setup_scalar, &microbench_run_clear, VALUE_STR, 1024 },
+	{ "clear/array 16", &microbench_setup_container, &microbench_run_clear, VALUE_ARY, 16 },
+	{ "clear/array 1024", &microbench_setup_container, &microbench_run_clear, VALUE_ARY, 1024 },
+	{ "clear/list 16", &microbench_setup_container, &microbench_run_clear, VALUE_LST, 16 },
+	{ "clear/hash 16", &microbench_setup_container, &microbench_run_clear, VALUE_HSH, 16 },
+	{ "clear/hash 1024", &microbench_setup_container, &microbench_run_clear, VALUE_HSH, 1024 },
+	{ "hash_get/integer 16", &microbench_setup_hash, &microbench_run_hash_get, VALUE_MPZ, 16 },
+	{ "hash_get/integer 1024", &microbench_setup_hash, &microbench_run_hash_get, VALUE_MPZ, 1024 },
+	{ "hash_get/integer 65536", &microbench_setup_hash, &microbench_run_hash_get, VALUE_MPZ, 65536 },
+	{ "hash_get/string 16", &microbench_setup_hash, &microbench_run_hash_get, VALUE_STR, 16 },
+	{ "hash_get/string 1024", &microbench_setup_hash, &microbench_run_hash_get, VALUE_STR, 1024 },
+	{ "hash_get/string 65536", &microbench_setup_hash, &microbench_run_hash_get, VALUE_STR, 65536 },
+	{ "hash_put/integer 16", &microbench_setup_hash, &microbench_run_hash_put, VALUE_MPZ, 16 },
+	{ "hash_put/integer 1024", &microbench_setup_hash, &microbench_run_hash_put, VALUE_MPZ, 1024 },
+	{ "hash_put/integer 65536", &microbench_setup_hash, &microbench_run_hash_put, VALUE_MPZ, 65536 },
+	{ "hash_put/string 16", &microbench_setup_hash, &microbench_run_hash_put, VALUE_STR, 16 },
+	{ "hash_put/string 1024", &microbench_setup_hash, &microbench_run_hash_put, VALUE_STR, 1024 },
+	{ "hash_put/string 65536", &microbench_setup_hash, &microbench_run_hash_put, VALUE_STR, 65536 },
+	{ "hash_build/integer 1024", &microbench_setup_hash, &microbench_run_hash_build, VALUE_MPZ, 1024 },
+	{ "hash_build/string 1024", &microbench_setup_hash, &microbench_run_hash_build, VALUE_STR, 1024 },
+	{ "add/integer integer", &microbench_setup_pair, &microbench_run_add, VALUE_MPZ, VALUE_MPZ },
+	{ "add/integer float", &microbench_setup_pair, &microbench_run_add, VALUE_MPZ, VALUE_MPF },
+	{ "add/float integer", &microbench_setup_pair, &microbench_run_add, VALUE_MPF, VALUE_MPZ },
+	{ "add/float float", &microbench_setup_pair, &microbench_run_add, VALUE_MPF, VALUE_MPF },
+	{ "add/string string", &microbench_setup_pair, &microbench_run_add, VALUE_STR, VALUE_STR },
+	{ "add/array array", &microbench_setup_pair, &microbench_run_add, VALUE_ARY, VALUE_ARY },
+	{ "append_now/array", &microbench_setup_scalar, &microbench_run_append_now, VALUE_MPZ, 0 },
+	{ "cons/nil", &microbench_setup_container, &microbench_run_cons, VALUE_NIL, 0 },
+	{ "cons/list 16", &microbench_setup_container, &microbench_run_cons, VALUE_LST, 16 },
+	{ "cons/list 1024", &microbench_setup_container, &microbench_run_cons, VALUE_LST, 1024 },
+	{ "cast/integer", &microbench_setup_scalar, &microbench_run_cast, VALUE_MPZ, 0 },
+	{ "cast/float", &microbench_setup_scalar, &microbench_run_cast, VALUE_MPF, 0 },
+	{ "cast/array 16", &microbench_setup_container, &microbench_run_cast, VALUE_ARY, 16 },
+	{ "cast/hash 16", &microbench_setup_container, &microbench_run_cast, VALUE_HSH, 16 },
+	{ "put/integer", &microbench_setup_scalar, &microbench_run_put, VALUE_MPZ, 0 },
+	{ "put/float", &microbench_setup_scalar, &microbench_run_put, VALUE_MPF, 0 },
+	{ "put/string 16", &microbench_setup_scalar, &microbench_run_put, VALUE_STR, 16 },
+	{ "put/array 16", &microbench_setup_container, &microbench_run_put, VALUE_ARY, 16 },
+	{ "matmul/naive float 64", &microbench_setup_matrix, &microbench_run_matmul_naive, VALUE_MPF, 64 },
+	{ "matmul/integer 64", &microbench_setup_matrix, &microbench_run_matmul, VALUE_MPZ, 64 },
+	{ "matmul/float 16", &microbench_setup_matrix, &microbench_run_matmul, VALUE_MPF, 16 },
+	{ "matmul/float 64", &microbench_setup_matrix, &microbench_run_matmul, VALUE_MPF, 64 },
+	{ "matmul/float 256", &microbench_setup_matrix, &microbench_run_matmul, VALUE_MPF, 256 },
+	{ "matmul/float 512", &microbench_setup_matrix, &microbench_run_matmul, VALUE_MPF, 512 },
+	{ "matmul/nd float 256", &microbench_setup_matrix, &microbench_run_matmul, VALUE_NDA, 256 },
+	{ "matvec/float 256", &microbench_setup_matrix, &microbench_run_matvec, VALUE_MPF, 256 },
+	{ "solve/float 64", &microbench_setup_matrix, &microbench_run_solve, VALUE_MPF, 64 },
+	{ "solve/float 256", &microbench_setup_matrix, &microbench_run_solve, VALUE_MPF, 256 },
+	{ "slice/copy string 65536", &microbench_setup_container, &microbench_run_slice_copy, VALUE_STR, 65536 },
+	{ "slice/string 4096", &microbench_setup_container, &microbench_run_slice, VALUE_STR, 4096 },
+	{ "slice/string 65536", &microbench_setup_container, &microbench_run_slice, VALUE_STR, 65536 },
+	{ "slice/copy array 4096", &microbench_setup_container, &microbench_run_slice_copy, VALUE_ARY, 4096 },
+	{ "slice/array 4096", &microbench_setup_container, &microbench_run_slice, VALUE_ARY, 4096 },
+	{ NULL },
+};
+
+/*
+ * Student's t for a two-sided 95% confidence interval, indexed by the degrees of
+ * freedom. Anything past the end of the table uses the normal distribution.
+ */
+double microbench_t95[] = {
+	0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+int microbench_main(int argc, const char *argv[])
+{
+	int samples = 20;
+	double msec = 200;
+	int i;
+
+	for (i = 0; i < argc && argv[i][0] == '-'; i += 2) {
+		if (i + 1 >= argc)
+			break;
+		if (streq(argv[i], "-s"))
+			samples = atoi(argv[i+1]);
+		else if (streq(argv[i], "-t"))
+			msec = atof(argv[i+1]);
+		else break;
+	}
+
+	if ((i < argc && argv[i][0] == '-') || samples < 2 || msec <= 0) {
+		fprintf(stderr, "usage: simfpl microbench [-s samples] [-t msec] [name ...]\n");
+		return 1;
+	}
+
+	printf("%-26s %10s %16s %10s\n", "operation", "ns/op", "95% interval", "fastest");
+
+	struct microbench *mb;
+	for (mb = microbenches; mb->name; ++mb) {
+		if (i < argc) {
+			int j;
+			for (j = i; j < argc; ++j)
+				if (strstr(mb->name, argv[j]))
+					break;
+			if (j == argc)
+				continue;
+		}
+
+		double mean, interval, fastest;
+		if (microbench_measure(mb, samples, msec * 1e6 / samples, &mean, &interval, &fastest)) {
+			printf("%-26s %10s\n", mb->name, "failed");
+			continue;
+		}
+
+		printf("%-26s %10.1f %9.1f (%4.1f%%) %10.1f\n", mb->name, mean, interval,
+				100 * interval / mean, fastest);
+		fflush(stdout);
+	}
+
+	return 0;
+}
+
+/*
+ * Times (mb) and sets (mean) to the mean ns per operation, (interval) to the
+ * half-width of its 95% confidence interval and (fastest) to the fastest sample.
+ * A sample should take (target) ns.
+ */
+int microbench_measure(struct microbench *mb, int samples, double target,
+		double *mean, double *interval, double *fastest)
+{
+	mb->a = value_init_nil();
+	mb->b = value_init_nil();
+	mb->keys = value_init_nil();
+	if ((*mb->setup)(mb)) {
+		microbench_clear(mb);
+		return VALUE_ERROR;
+	}
+
+	size_t iters = 1;
+	while ((*mb->run)(mb, iters) < target && iters < ((size_t) 1 << 40))
+		iters *= 2;
+
+	// Warm up.
+	(*mb->run)(mb, iters);
+
+	double sum = 0, sum_squares = 0;
+	int i;
+	*fastest = 0;
+	for (i = 0; i < samples; ++i) {
+		double ns = (*mb->run)(mb, iters) / iters;
+		sum += ns;
+		sum_squares += ns * ns;
+		if (i == 0 || ns < *fastest)
+			*fastest = ns;
+	}
+
+	*mean = sum / samples;
+	double variance = (sum_squares - samples * *mean * *mean) / (samples - 1);
+	if (variance < 0)
+		variance = 0;
+
+	int df = samples - 1;
+	double t = df < sizeof(microbench_t95) / sizeof(double) ? microbench_t95[df] : 1.960;
+	*interval = t * sqrt(variance / samples);
+
+	microbench_clear(mb);
+	return 0;
+}
+
+int microbench_clear(struct microbench *mb)
+{
+	value_clear(&mb->a);
+	value_clear(&mb->b);
+	value_clear(&mb->keys);
+	return 0;
+}
+
+/*
+ * A monotonic clock in nanoseconds.
+ */
+double microbench_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * Makes a value of the given type and size.
+ */
+value microbench_make(int type, long size)
+{
+	value res;
+	long i;
+
+	switch (type) {
+	case VALUE_MPZ:
+		return value_set_long(123456789);
+	case VALUE_MPF:
+		return value_set_double(3.14159);
+	case VALUE_STR: {
+		char str[size + 1];
+		memset(str, 'a', size);
+		str[size] = '\0';
+		return value_set_str(str);
+	}
+	case VALUE_ARY:
+		res = value_init(VALUE_ARY);
+		for (i = 0; i < size; ++i) {
+			value item = value_set_long(i);
+			value_append_now2(&res, &item);
+		}
+		return res;
+	case VALUE_LST:
+		res = value_init_nil();
+		for (i = 0; i < size; ++i) {
+			value item = value_set_long(i);
+			value next = value_cons(item, res);
+			value_clear(&item);
+			value_clear(&res);
+			res = next;
+		}
+		return res;
+	case VALUE_HSH:
+		res = value_hash_init();
+		for (i = 0; i < size; ++i) {
+			value key = value_set_long(i);
+			value_hash_put(&res, key, key);
+			value_clear(&key);
+		}
+		return res;
+	}
+
+	return value_init_nil();
+}
+
+/*
+ * (a) is a scalar of type (arg1) and size (arg2).
+ */
+int microbench_setup_scalar(struct microbench *mb)
+{
+	mb->a = microbench_make(mb->arg1, mb->arg2);
+	if (mb->run == &microbench_run_append_now)
+		mb->b = value_init(VALUE_ARY);
+	return mb->a.type == VALUE_ERROR;
+}
+
+/*
+ * (a) is a container of type (arg1) with (arg2) integers in it.
+ */
+int microbench_setup_container(struct microbench *mb)
+{
+	mb->a = microbench_make(mb->arg1, mb->arg2);
+	mb->b = value_set_long(7);
+	return mb->a.type == VALUE_ERROR;
+}
+
+/*
+ * (a) is a hash with (arg2) keys of type (arg1) and (keys) is an array of its keys.
+ */
+int microbench_setup_hash(struct microbench *mb)
+{
+	char buffer[BUFSIZE];
+	long i;
+
+	mb->a = value_hash_init();
+	mb->keys = value_init(VALUE_ARY);
+	for (i = 0; i < mb->arg2; ++i) {
+		value key;
+		if (mb->arg1 == VALUE_STR) {
+			snprintf(buffer, BUFSIZE, "key%ld", i);
+			key = value_set_str(buffer);
+		} else key = value_set_long(i * 7919);
+
+		value_hash_put(&mb->a, key, key);
+		value_append_now2(&mb->keys, &key);
+	}
+
+	mb->b = value_set_long(1);
+	return 0;
+}
+
+/*
+ * (a) is of type (arg1) and (b) is of type (arg2).
+ */
+int microbench_setup_pair(struct microbench *mb)
+{
+	mb->a = microbench_make(mb->arg1, 16);
+	mb->b = microbench_make(mb->arg2, 16);
+	return 0;
+}
+
+/*
+ * (a) is an (arg2) by (arg2) matrix of floats or integers, as an array of rows, or as
+ * an NDArray of floats if (arg1) is VALUE_NDA. Its diagonal is large enough that it's
+ * never singular. (b) is a vector of (arg2) of the same kind of number.
+ */
+int microbench_setup_matrix(struct microbench *mb)
+{
+	long i, j, n = mb->arg2;
+
+	mb->a = value_init(VALUE_ARY);
+	mb->b = value_init(VALUE_ARY);
+	for (i = 0; i < n; ++i) {
+		value row = value_init(VALUE_ARY);
+		for (j = 0; j < n; ++j) {
+			long x = (i * 7 + j * 3) % 11 + (i == j ? 11 * n : 0);
+			value item = mb->arg1 == VALUE_MPZ ? value_set_long(x) : value_set_double(x + 0.5);
+			value_append_now2(&row, &item);
+		}
+		value_append_now2(&mb->a, &row);
+
+		value item = mb->arg1 == VALUE_MPZ ? value_set_long(i % 5) : value_set_double(i % 5 + 0.25);
+		value_append_now2(&mb->b, &item);
+	}
+
+	if (mb->arg1 == VALUE_NDA)
+		value_to_nd_now(&mb->a);
+	return 0;
+}
+
+/*
+ * The run functions do (iters) operations and return the nanoseconds they took.
+ */
+
+/*
+ * Copies are made and cleared in batches, so that only the copies are timed.
+ */
+double microbench_run_set(struct microbench *mb, size_t iters)
+{
+	value copies[MICROBENCH_BATCH];
+	double elapsed = 0;
+	size_t i, done;
+
+	for (done = 0; done < iters; done += MICROBENCH_BATCH) {
+		size_t n = iters - done < MICROBENCH_BATCH ? iters - done : MICROBENCH_BATCH;
+		double start = microbench_now();
+		for (i = 0; i < n; ++i)
+			copies[i] = value_set(mb->a);
+		elapsed += microbench_now() - start;
+		for (i = 0; i < n; ++i)
+			value_clear(&copies[i]);
+	}
+
+	return elapsed;
+}
+
+double microbench_run_clear(struct microbench *mb, size_t iters)
+{
+	value copies[MICROBENCH_BATCH];
+	double elapsed = 0;
+	size_t i, done;
+
+	for (done = 0; done < iters; done += MICROBENCH_BATCH) {
+		size_t n = iters - done < MICROBENCH_BATCH ? iters - done : MICROBENCH_BATCH;
+		for (i = 0; i < n; ++i)
+			copies[i] = value_set(mb->a);
+		double start = microbench_now();
+		for (i = 0; i < n; ++i)
+			value_clear(&copies[i]);
+		elapsed += microbench_now() - start;
+	}
+
+	return elapsed;
+}
+
+double microbench_run_hash_get(struct microbench *mb, size_t iters)
+{
+	size_t length = mb->keys.core.u_a.length;
+	size_t i;
+
+	double start = microbench_now();
+	for (i = 0; i < iters; ++i) {
+		value res = value_hash_get(mb->a, mb->keys.core.u_a.a[i % length]);
+		value_clear(&res);
+	}
+	return microbench_now() - start;
+}
+
+/*
+ * Replaces the value for a key that's already there, so the hash stays the same size.
+ */
+double microbench_run_hash_put(struct microbench *mb, size_t iters)
+{
+	size_t length = mb->keys.core.u_a.length;
+	size_t i;
+
+	double start = microbench_now();
+	for (i = 0; i < iters; ++i)
+		value_hash_put(&mb->a, mb->keys.core.u_a.a[i % length], mb->b);
+	return microbench_now() - start;
+}
+
+/*
+ * Puts every key into an empty hash, so the time includes resizing. One operation
+ * is one key, and the time to clear the hash is included.
+ */
+double microbench_run_hash_build(struct microbench *mb, size_t iters)
+{
+	size_t length = mb->keys.core.u_a.length;
+	size_t i;
+	value hash = value_hash_init();
+
+	double start = microbench_now();
+	for (i = 0; i < iters; ++i) {
+		if (i % length == 0) {
+			value_clear(&hash);
+			hash = value_hash_init();
+		}
+		value_hash_put(&hash, mb->keys.core.u_a.a[i % length], mb->b);
+	}
+	double elapsed = microbench_now() - start;
+
+	value_clear(&hash);
+	return elapsed;
+}
+
+double microbench_run_add(struct microbench *mb, size_t iters)
+{
+	size_t i;
+
+	double start = microbench_now();
+	for (i = 0; i < iters; ++i) {
+		value res = value_add(mb->a, mb->b);
+		value_clear(&res);
+	}
+	return microbench_now() - start;
+}
+
+/*
+ * Appends to an array that's emptied every MICROBENCH_BATCH elements, so the time
+ * includes growing it.
+ */
+double microbench_run_append_now(struct microbench *mb, size_t iters)
+{
+	size_t i;
+
+	double start = microbench_now();
+	for (i = 0; i < iters; ++i) {
+		if (i % MICROBENCH_BATCH == 0) {
+			value_clear(&mb->b);
+			mb->b = value_init(VALUE_ARY);
+		}
+		value_append_now(&mb->b, mb->a);
+	}
+	return microbench_now() - start;
+}
+
+double microbench_run_cons(struct microbench *mb, size_t iters)
+{
+	size_t i;
+
+	double start = microbench_now();
+	for (i = 0; i < iters; ++i) {
+		value res = value_cons(mb->b, mb->a);
+		value_clear(&res);
+	}
+	return microbench_now() - start;
+}
+
+double microbench_run_cast(struct microbench *mb, size_t iters)
+{
+	size_t i;
+
+	double start = microbench_now();
+	for (i = 0; i < iters; ++i) {
+		value res = value_cast(mb->a, VALUE_STR);
+		value_clear(&res);
+	}
+	return microbench_now() - start;
+}
+
+double microbench_run_matmul(struct microbench *mb, size_t iters)
+{
+	size_t i;
+
+	double start = microbench_now();
+	for (i = 0; i < iters; ++i) {
+		value res = value_matmul(mb->a, mb->a);
+		value_clear(&res);
+	}
+	return microbench_now() - start;
+}
+
+/*
+ * The product of (a) with itself the way a script would do it without matmul(), with 
+ * value_at() and value_mul() on each element. The result is made with ordinary arrays.
+ */
+double microbench_run_matmul_naive(struct microbench *mb, size_t iters)
+{
+	size_t i, j, k, n = mb->arg2;
+	size_t it;
+
+	double start = microbench_now();
+	for (it = 0; it < iters; ++it) {
+		value res = value_init(VALUE_ARY);
+		for (i = 0; i < n; ++i) {
+			value row = value_init(VALUE_ARY);
+			value ai = value_set_long(i);
+			value left = value_at(mb->a, ai, NULL, 0);
+			for (j = 0; j < n; ++j) {
+				value sum = value_set_long(0);
+				value aj = value_set_long(j);
+				for (k = 0; k < n; ++k) {
+					value ak = value_set_long(k);
+					value x = value_at(left, ak, NULL, 0);
+					value column = value_at(mb->a, ak, NULL, 0);
+					value y = value_at(column, aj, NULL, 0);
+					value product = value_mul(x, y);
+					value_add_now(&sum, product);
+					value_clear(&product);
+					value_clear(&x);
+					value_clear(&y);
+					value_clear(&column);
+					value_clear(&ak);
+				}
+				value_append_now2(&row, &sum);
+				value_clear(&aj);
+			}
+			value_append_now2(&res, &row);
+			value_clear(&left);
+			value_clear(&ai);
+		}
+		value_clear(&res);
+	}
+	return microbench_now() - start;
+}
+
+double microbench_run_matvec(struct microbench *mb, size_t iters)
+{
+	size_t i;
+
+	double start = microbench_now();
+	for (i = 0; i < iters; ++i) {
+		value res = value_matvec(mb->a, mb->b);
+		value_clear(&res);
+	}
+	return microbench_now() - start;
+}
+
+double microbench_run_solve(struct microbench *mb, size_t iters)
+{
+	size_t i;
+
+	double start = microbench_now();
+	for (i = 0; i < iters; ++i) {
+		value res = value_solve(mb->a, mb->b);
+		value_clear(&res);
+	}
+	return microbench_now() - start;
+}
+
+/*
+ * Each operation cuts MICROBENCH_PIECE characters or elements off the front of what's 
+ * left of (a) with take() and drop(), the way a parser works through its input, and 
+ * starts over from (a) when it runs out. The copy cases do the same with copies, the 
+ * way range() did before it made slices.
+ */
+double microbench_run_slice(struct microbench *mb, size_t iters)
+{
+	value piece_length = value_set_long(MICROBENCH_PIECE);
+	value rest = value_set(mb->a);
+	size_t i;
+
+	double start = microbench_now();
+	for (i = 0; i < iters; ++i) {
+		if (value_length(rest) < MICROBENCH_PIECE) {
+			value_clear(&rest);
+			rest = value_set(mb->a);
+		}
+		value piece = value_take(rest, piece_length);
+		value next = value_drop(rest, piece_length);
+		value_clear(&piece);
+		value_clear(&rest);
+		rest = next;
+	}
+	double elapsed = microbench_now() - start;
+
+	value_clear(&rest);
+	value_clear(&piece_length);
+	return elapsed;
+}
+
+double microbench_run_slice_copy(struct microbench *mb, size_t iters)
+{
+	value rest = value_set(mb->a);
+	size_t i, length;
+
+	double start = microbench_now();
+	for (i = 0; i < iters; ++i) {
+		if (value_length(rest) < MICROBENCH_PIECE) {
+			value_clear(&rest);
+			rest = value_set(mb->a);
+		}
+		char *s = value_string_view(rest, &length);
+		value *a = value_array_view(rest, &length);
+		value piece = s ? value_set_str_length(s, MICROBENCH_PIECE) : value_private_slice_array(a, MICROBENCH_PIECE);
+		value next = s ? value_set_str_length(s + MICROBENCH_PIECE, length - MICROBENCH_PIECE) 
+			: value_private_slice_array(a + MICROBENCH_PIECE, length - MICROBENCH_PIECE);
+		value_clear(&piece);
+		value_clear(&rest);
+		rest = next;
+	}
+	double elapsed = microbench_now() - start;
+
+	value_clear(&rest);
+	return elapsed;
+}
+
+double microbench_run_put(struct microbench *mb, size_t iters)
+{
+	char buffer[BUFSIZE];
+	size_t i;
+
+	double start = microbench_now();
+	for (i = 0; i < iters; ++i)
+		value_put(buffer, BUFSIZE, mb->a, NULL);
+	return microbench_now() - start;
+}
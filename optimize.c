@@ -8,7 +8,7 @@
  *  
  */
 
-#include "value.h"
+#include "eval.h"
 
 /* 
  * Possible Optimizations
@@ -29,6 +29,7 @@
  * -Pull function calls out of loops.
  * 
  * Advanced 
+ * -Specialize arithmetic on types inferred from the code.
  * -Convert tail-recursive calls to loops.
  * -Find and prevent/warn against infinite loops.
  * 
@@ -36,6 +37,13 @@
 
 
 #define OTHER_NUMERIC(assume_p, type) ((assume_p) && ((type) == VALUE_VAR || (type) == VALUE_BLK))
+#define CONSTANT_P(type) ((type) == VALUE_NIL || (type) == VALUE_BOO || (type) == VALUE_MPZ || (type) == VALUE_MPF || (type) == VALUE_STR || \
+		(type) == VALUE_RGX || (type) == VALUE_SYM || (type) == VALUE_ARY || (type) == VALUE_LST || (type) == VALUE_PAR || \
+		(type) == VALUE_HSH || (type) == VALUE_RNG)
+
+// A quoted block is data, not code, so it must be left exactly as it was written.
+#define QUOTED_P(words) ((words)[0].type == VALUE_BIF && \
+		((words)[0].core.u_bif->f == &value_quote_all_arg || (words)[0].core.u_bif->f == &value_quote_arg))
 
 value value_optimize(value op, int flags)
 {
@@ -122,7 +130,10 @@ value value_optimize1_now(value *op, int flags)
 	value *words = op->core.u_blk.a;
 	size_t i, length = op->core.u_blk.length;
 	
-	int assume_numeric = flags && O_ASSUME_NUMERIC;
+	int assume_numeric = flags & O_ASSUME_NUMERIC;
+	
+	if (length > 0 && QUOTED_P(words))
+		return res;
 	
 	// Recursively optimize all inner blocks.
 	for (i = 0; i < length; ++i) {
@@ -236,6 +247,33 @@ value value_optimize1_now(value *op, int flags)
 		*op = saved;
 	}
 	
+	/* A logical AND or OR whose first operand is a constant is either decided right 
+	 * away, as in (false && x) or (true || x), or comes down to the truth value of 
+	 * the second operand, as in (true && x) which becomes (true? x).
+	 */
+	else if (length == 3 && words[0].type == VALUE_BIF && CONSTANT_P(words[1].type) && 
+			(words[0].core.u_bif->f == &value_and_p_arg || words[0].core.u_bif->f == &value_or_p_arg)) {
+		int or_p = words[0].core.u_bif->f == &value_or_p_arg;
+		
+		if (!value_true_p(words[1]) == !or_p) {
+			value_clear(op);
+			*op = value_set_bool(or_p);
+		} else if (CONSTANT_P(words[2].type)) {
+			int truth = value_true_p(words[2]);
+			value_clear(op);
+			*op = value_set_bool(truth);
+		} else {
+			value key = value_set_id("true?");
+			value_clear(&words[0]);
+			words[0] = value_hash_get(primitive_funs, key);
+			value_clear(&key);
+			value_clear(&words[1]);
+			words[1] = words[2];
+			words[2].type = VALUE_NIL;
+			op->core.u_blk.length = 2;
+		}
+	}
+	
 	/* The negative of a negative can be turned into a positive.
 	 */
 	else if (assume_numeric && length == 2 && words[0].type == VALUE_BIF && words[0].core.u_bif->f == &value_uminus_arg && 
@@ -265,6 +303,9 @@ value value_optimize2_now(value *op, int flags)
 	
 	int assume_numeric = flags & O_ASSUME_NUMERIC;
 	
+	if (length > 0 && QUOTED_P(words))
+		return res;
+	
 	// Recursively optimize all inner blocks.
 	for (i = 0; i < length; ++i) {
 		if (words[i].type == VALUE_BLK) {
@@ -274,24 +315,47 @@ value value_optimize2_now(value *op, int flags)
 		}
 	}
 		
+	/* An if or unless with a constant condition always takes the same branch, so it 
+	 * can be replaced by that branch. A missing else branch becomes nil.
+	 */
+	if (length >= 3 && words[0].type == VALUE_BIF && CONSTANT_P(words[1].type) && 
+			(words[0].core.u_bif->f == &value_if_arg || words[0].core.u_bif->f == &value_unless_arg)) {
+		int unless_p = words[0].core.u_bif->f == &value_unless_arg;
+		size_t branch = (!value_true_p(words[1]) != !unless_p) ? 2 : 3;
+		value saved = value_init_nil();
+		if (branch < length) {
+			saved = words[branch];
+			words[branch].type = VALUE_NIL;
+		}
+		value_clear(op);
+		*op = saved;
+		return res;
+	}
+	
 	if (length > 1 && words[0].type == VALUE_BIF) {
 		
-		/* If the block is made up entirely of constants, evaluate it.
+		/* If a pure function is called on nothing but constants, evaluate it now. 
+		 * Functions with side effects are left alone, as is any call that fails; 
+		 * its error will be reported when the code actually runs.
 		 */
-		int all_constants_p = TRUE;
-		for (i = 1; i < length; ++i) {
-			all_constants_p &= words[i].type == VALUE_NIL || words[i].type == VALUE_BOO || words[i].type == VALUE_MPZ || words[i].type == VALUE_MPF;
-			if (all_constants_p == FALSE)
-				break;
-		}
+		int all_constants_p = words[0].core.u_bif->spec.pure_p;
+		for (i = 1; all_constants_p && i < length; ++i)
+			all_constants_p = CONSTANT_P(words[i].type);
 		
 		if (all_constants_p) {
+			int saved_print_errors_p = print_errors_p;
+			print_errors_p = FALSE;
 			// The variables don't actually matter because there aren't any inside of the block. 
 			value saved = eval(&value_nil, *op);
-			value_printf("clearing %ts\n", *op);
-			value_printf("putting in %ts\n", saved);
-			value_clear(op);
-			*op = saved;
+			print_errors_p = saved_print_errors_p;
+			
+			if (saved.type == VALUE_ERROR || saved.type == VALUE_STOP)
+				value_clear(&saved);
+			else {
+				value_clear(op);
+				*op = saved;
+				return res;
+			}
 		}
 		
 		optimize_put_constants_first(op, words, length, assume_numeric);
@@ -372,16 +436,814 @@ int optimize_simplify_constant_across_block(value *op, value words[], size_t len
 	return 0;
 }
 
+/* 
+ * Performs a level 3 optimization. This pulls loop-invariant expressions out of while, 
+ * until and for loops, so that (while (< i (length a)) ...) computes (length a) once 
+ * instead of once per iteration.
+ * 
+ * An expression is invariant if it is a call to a pure function whose arguments are 
+ * constants, invariant expressions, or variables that nothing in the loop can assign to. 
+ * Each one is assigned to a temporary right before the loop and replaced by that 
+ * temporary inside of it.
+ * 
+ * Only expressions that run on every iteration are moved, so that a call that would fail 
+ * in a branch that is never taken does not fail ahead of time. Expressions in the body are 
+ * only moved if the loop is guarded by a check that it runs at least once.
+ */
 value value_optimize3_now(value *op, int flags)
 {
-	value_error(1, "Implementation Error: optimize3!() not yet implemented.");
-	return value_init_error();
+	if (op->type != VALUE_BLK)
+		return value_init_nil();
+	
+	value res = value_init_nil();
+	
+	value *words = op->core.u_blk.a;
+	size_t i, length = op->core.u_blk.length;
+	
+	if (length == 0 || QUOTED_P(words))
+		return res;
+	
+	// Optimize inner loops first. Whatever they hoist may then be hoisted again by an outer loop.
+	for (i = 0; i < length; ++i) {
+		if (words[i].type == VALUE_BLK) {
+			res = value_optimize3_now(&words[i], flags);
+			if (res.type == VALUE_ERROR)
+				return res;
+		}
+	}
+	
+	if (words[0].type != VALUE_BIF)
+		return res;
+	
+	if (length >= 3 && (words[0].core.u_bif->f == &value_while_arg || words[0].core.u_bif->f == &value_until_arg))
+		optimize_hoist_while(op);
+	else if (length >= 3 && words[0].core.u_bif->f == &value_for_arg)
+		optimize_hoist_for(op);
+	
+	return res;
+}
+
+/* 
+ * Hoists the invariant expressions out of (while condition body) or (until condition body).
+ * The condition always runs at least once, so its invariants can always be hoisted. 
+ * The body's invariants are hoisted behind (if condition ...), which is only possible 
+ * when the condition has no side effects, since it is evaluated one extra time.
+ */
+int optimize_hoist_while(value *op)
+{
+	struct optimize_loop_info info;
+	optimize_loop_info_init(&info, *op);
+	if (info.unknown_p) {
+		value_clear(&info.writes);
+		return 0;
+	}
+	
+	value hoisted = optimize_call("do_all");
+	
+	optimize_hoist(&op->core.u_blk.a[1], &info, &hoisted);
+	size_t cond_length = hoisted.core.u_blk.length;
+	
+	if (optimize_side_effect_free_p(op->core.u_blk.a[1]))
+		optimize_hoist(&op->core.u_blk.a[2], &info, &hoisted);
+	
+	if (hoisted.core.u_blk.length > cond_length) {
+		// Move the body hoists and the loop into (if condition (do_all hoists... loop)).
+		value guarded = optimize_call("do_all");
+		size_t i;
+		for (i = cond_length; i < hoisted.core.u_blk.length; ++i)
+			value_append_now2(&guarded, &hoisted.core.u_blk.a[i]);
+		hoisted.core.u_blk.length = cond_length;
+		
+		value guard = optimize_call(op->core.u_blk.a[0].core.u_bif->f == &value_until_arg ? "unless" : "if");
+		value_append_now(&guard, op->core.u_blk.a[1]);
+		value_append_now2(&guarded, op);
+		value_append_now2(&guard, &guarded);
+		*op = guard;
+	}
+	
+	optimize_finish_hoist(op, &hoisted);
+	value_clear(&info.writes);
+	return 0;
 }
 
+/* 
+ * Hoists the invariant expressions out of the body of (for (x :in iterable) body) or 
+ * (for (x :dotimes n) body). The iterable is only evaluated once already, so there is 
+ * nothing to gain from it. The loop is guarded by (if (true? iterable) ...) so that the 
+ * hoisted expressions do not run for an empty loop. A loop with :if filters is left 
+ * alone because its body might never run.
+ */
+int optimize_hoist_for(value *op)
+{
+	value *condition = &op->core.u_blk.a[1];
+	if (condition->type != VALUE_BLK || condition->core.u_blk.length != 3 || 
+			!(value_eq(condition->core.u_blk.a[1], value_symbol_in) || value_eq(condition->core.u_blk.a[1], value_symbol_dotimes)))
+		return 0;
+	
+	struct optimize_loop_info info;
+	optimize_loop_info_init(&info, *op);
+	if (info.unknown_p) {
+		value_clear(&info.writes);
+		return 0;
+	}
+	
+	value hoisted = optimize_call("do_all");
+	
+	optimize_hoist(&op->core.u_blk.a[2], &info, &hoisted);
+	value_clear(&info.writes);
+	
+	if (hoisted.core.u_blk.length == 1) {
+		value_clear(&hoisted);
+		return 0;
+	}
+	
+	// Evaluate the iterable once, ahead of the guard, unless it is already a variable.
+	value iterable = condition->core.u_blk.a[2];
+	value prelude = optimize_call("do_all");
+	if (iterable.type != VALUE_VAR) {
+		value temp = optimize_temporary();
+		value assignment = optimize_call("=");
+		value_append_now(&assignment, temp);
+		value_append_now2(&assignment, &iterable);
+		value_append_now2(&prelude, &assignment);
+		condition->core.u_blk.a[2] = temp;
+		iterable = temp;
+	}
+	
+	value truth = optimize_call("true?");
+	value_append_now(&truth, iterable);
+	
+	value_append_now2(&hoisted, op);
+	
+	value guard = optimize_call("if");
+	value_append_now2(&guard, &truth);
+	value_append_now2(&guard, &hoisted);
+	*op = guard;
+	
+	optimize_finish_hoist(op, &prelude);
+	return 0;
+}
+
+/* 
+ * Puts (do_all hoists... op) into op, or just frees (hoists) if it doesn't contain any.
+ */
+int optimize_finish_hoist(value *op, value *hoisted)
+{
+	if (hoisted->core.u_blk.length == 1) {
+		value_clear(hoisted);
+	} else {
+		value_append_now2(hoisted, op);
+		*op = *hoisted;
+	}
+	
+	return 0;
+}
+
+/* 
+ * Fills (info) with every variable that (loop) might assign to.
+ */
+int optimize_loop_info_init(struct optimize_loop_info *info, value loop)
+{
+	info->writes = value_init(VALUE_ARY);
+	info->unknown_p = FALSE;
+	info->calls_p = FALSE;
+	optimize_find_writes(loop, info);
+	return 0;
+}
+
+int optimize_add_write(struct optimize_loop_info *info, value var)
+{
+	if (var.type == VALUE_VAR) {
+		if (!optimize_writes_p(info, var))
+			value_append_now(&info->writes, var);
+	} else if (var.type == VALUE_BLK) {
+		// A destructuring loop variable, such as (for ((k v) :in h) ...).
+		size_t i;
+		for (i = 0; i < var.core.u_blk.length; ++i)
+			optimize_add_write(info, var.core.u_blk.a[i]);
+	} else info->unknown_p = TRUE;
+	
+	return 0;
+}
+
+int optimize_writes_p(struct optimize_loop_info *info, value var)
+{
+	// A user-defined function can assign to a global variable from anywhere.
+	if (info->calls_p && var.core.u_var[0] == '$')
+		return TRUE;
+	
+	size_t i;
+	for (i = 0; i < info->writes.core.u_a.length; ++i)
+		if (value_eq(info->writes.core.u_a.a[i], var))
+			return TRUE;
+	return FALSE;
+}
+
+/* 
+ * Built-in functions that assign through their first argument, such as a[i] = x. They 
+ * are passed the variables but don't touch anything else in them.
+ */
+int optimize_at_assign_p(value (*f)(int, value *))
+{
+	return f == &value_at_assign_arg || f == &value_at_assign_add_arg || f == &value_at_assign_sub_arg || 
+			f == &value_at_assign_mul_arg || f == &value_at_assign_div_arg || f == &value_at_assign_mod_arg || 
+			f == &value_at_assign_and_arg || f == &value_at_assign_xor_arg || f == &value_at_assign_or_arg || 
+			f == &value_at_assign_shl_arg || f == &value_at_assign_shr_arg;
+}
+
+/* 
+ * Finds the variables that (op) might assign to and adds them to (info). If there is a 
+ * call whose writes can't be known, such as eval() or a function that keeps its caller's 
+ * scope, info->unknown_p is set.
+ */
+int optimize_find_writes(value op, struct optimize_loop_info *info)
+{
+	if (op.type != VALUE_BLK || op.core.u_blk.length == 0 || info->unknown_p)
+		return 0;
+	
+	value *words = op.core.u_blk.a;
+	size_t i, length = op.core.u_blk.length;
+	size_t first_arg = 1;
+	
+	if (words[0].type == VALUE_BIF) {
+		value (*f)(int, value *) = words[0].core.u_bif->f;
+		struct value_spec spec = words[0].core.u_bif->spec;
+		
+		if (QUOTED_P(words) || f == &value_lambda_arg) {
+			// Neither one runs any code in the current scope.
+			return 0;
+		} else if (f == &value_for_arg) {
+			if (length >= 2 && words[1].type == VALUE_BLK && words[1].core.u_blk.length >= 1) {
+				optimize_add_write(info, words[1].core.u_blk.a[0]);
+				for (i = 1; i < words[1].core.u_blk.length; ++i)
+					optimize_find_writes(words[1].core.u_blk.a[i], info);
+			} else info->unknown_p = TRUE;
+			first_arg = 2;
+		} else if (spec.pure_p || f == &value_do_both_arg || f == &value_do_all_arg || 
+				f == &value_if_arg || f == &value_unless_arg || f == &value_while_arg || f == &value_until_arg || 
+				f == &value_switch_arg || f == &value_break_arg || f == &value_continue_arg || 
+				f == &value_yield_arg || f == &value_return_arg || f == &value_exit_arg) {
+			// These only run their arguments.
+		} else if (spec.needs_variables_p == TRUE && (spec.keep_arg_p || optimize_at_assign_p(f))) {
+			// Assignment to the first argument.
+			if (length >= 2)
+				optimize_add_write(info, words[1]);
+		} else if (spec.needs_variables_p) {
+			info->unknown_p = TRUE;
+			return 0;
+		} else {
+			// Any variable passed directly to a function with side effects can be modified 
+			// in place, as with push!.
+			for (i = 1; i < length; ++i)
+				if (words[i].type == VALUE_VAR)
+					optimize_add_write(info, words[i]);
+		}
+		
+	} else if (words[0].type == VALUE_UDF || words[0].type == VALUE_UDF_SHELL) {
+		struct value_function *udf = words[0].core.u_udf;
+		if (words[0].type == VALUE_UDF_SHELL) {
+			value name = value_set_str(words[0].core.u_udf->name);
+			name.type = VALUE_VAR;
+			value *ptr = value_hash_exists(ud_functions, name) ? value_hash_get_ref(ud_functions, name) : NULL;
+			value_clear(&name);
+			udf = ptr && ptr->type == VALUE_UDF ? ptr->core.u_udf : NULL;
+		}
+		
+		// A function that keeps its caller's scope can assign to anything in it.
+		if (udf == NULL || udf->spec.change_scope_p == FALSE) {
+			info->unknown_p = TRUE;
+			return 0;
+		}
+		info->calls_p = TRUE;
+		
+	} else if (length > 1) {
+		// A computed function.
+		info->unknown_p = TRUE;
+		return 0;
+	}
+	
+	for (i = first_arg; i < length; ++i)
+		optimize_find_writes(words[i], info);
+	
+	return 0;
+}
+
+/* 
+ * Returns true if (op) is a constant, a variable, or a call to a pure built-in function on 
+ * other side-effect-free expressions.
+ */
+int optimize_side_effect_free_p(value op)
+{
+	if (op.type != VALUE_BLK)
+		return op.type != VALUE_UDF && op.type != VALUE_UDF_SHELL;
+	
+	if (op.core.u_blk.length == 0 || op.core.u_blk.a[0].type != VALUE_BIF || !op.core.u_blk.a[0].core.u_bif->spec.pure_p)
+		return FALSE;
+	
+	size_t i;
+	for (i = 1; i < op.core.u_blk.length; ++i)
+		if (!optimize_side_effect_free_p(op.core.u_blk.a[i]))
+			return FALSE;
+	return TRUE;
+}
+
+/* 
+ * Returns true if (op) gives the same result on every iteration of the loop described 
+ * by (info).
+ */
+int optimize_invariant_p(value op, struct optimize_loop_info *info)
+{
+	if (op.type == VALUE_VAR)
+		return !optimize_writes_p(info, op);
+	if (op.type != VALUE_BLK)
+		return CONSTANT_P(op.type);
+	
+	if (op.core.u_blk.length == 0 || op.core.u_blk.a[0].type != VALUE_BIF || 
+			!op.core.u_blk.a[0].core.u_bif->spec.pure_p || QUOTED_P(op.core.u_blk.a))
+		return FALSE;
+	
+	size_t i;
+	for (i = 1; i < op.core.u_blk.length; ++i)
+		if (!optimize_invariant_p(op.core.u_blk.a[i], info))
+			return FALSE;
+	return TRUE;
+}
+
+/* 
+ * Returns true if (op) might break out of, continue, or return from the loop.
+ */
+int optimize_jumps_p(value op)
+{
+	if (op.type != VALUE_BLK || op.core.u_blk.length == 0 || QUOTED_P(op.core.u_blk.a))
+		return FALSE;
+	
+	value *words = op.core.u_blk.a;
+	if (words[0].type == VALUE_BIF && (words[0].core.u_bif->f == &value_break_arg || 
+			words[0].core.u_bif->f == &value_continue_arg || words[0].core.u_bif->f == &value_return_arg || 
+			words[0].core.u_bif->f == &value_exit_arg))
+		return TRUE;
+	
+	size_t i;
+	for (i = 0; i < op.core.u_blk.length; ++i)
+		if (optimize_jumps_p(words[i]))
+			return TRUE;
+	return FALSE;
+}
+
+/* 
+ * Replaces every invariant expression in (op) that runs each time (op) runs with a 
+ * temporary, and appends an assignment to that temporary to (hoisted). Returns true if 
+ * the rest of the statements after (op) might not run.
+ */
+int optimize_hoist(value *op, struct optimize_loop_info *info, value *hoisted)
+{
+	if (op->type != VALUE_BLK || op->core.u_blk.length == 0)
+		return FALSE;
+	
+	value *words = op->core.u_blk.a;
+	size_t i, length = op->core.u_blk.length;
+	
+	// Something like (length a) is worth hoisting, but not a constant like (3).
+	if (length > 1 && optimize_invariant_p(*op, info) && optimize_reads_variable_p(*op)) {
+		value temp = optimize_temporary();
+		value assignment = optimize_call("=");
+		value_append_now(&assignment, temp);
+		value_append_now2(&assignment, op);
+		value_append_now2(hoisted, &assignment);
+		*op = temp;
+		return FALSE;
+	}
+	
+	if (words[0].type == VALUE_BIF) {
+		value (*f)(int, value *) = words[0].core.u_bif->f;
+		struct value_spec spec = words[0].core.u_bif->spec;
+		
+		if (f == &value_do_both_arg || f == &value_do_all_arg) {
+			// Statements run in order until one of them might jump.
+			for (i = 1; i < length; ++i) {
+				if (optimize_hoist(&words[i], info, hoisted) || optimize_jumps_p(words[i]))
+					return TRUE;
+			}
+			return FALSE;
+		} else if (f == &value_if_arg || f == &value_unless_arg || f == &value_while_arg || f == &value_until_arg || 
+				f == &value_switch_arg || f == &value_and_p_arg || f == &value_or_p_arg) {
+			// Only the condition is certain to run.
+			if (words[1].type != VALUE_SYM)
+				optimize_hoist(&words[1], info, hoisted);
+			return optimize_jumps_p(*op);
+		} else if (spec.delay_eval_p || QUOTED_P(words) || f == &value_lambda_arg || f == &value_for_arg) {
+			return optimize_jumps_p(*op);
+		}
+		
+		// Every argument to an ordinary function runs.
+		for (i = 1; i < length; ++i)
+			optimize_hoist(&words[i], info, hoisted);
+		
+	} else if (words[0].type == VALUE_UDF && words[0].core.u_udf->spec.delay_eval_p == FALSE) {
+		for (i = 1; i < length; ++i)
+			optimize_hoist(&words[i], info, hoisted);
+	}
+	
+	return optimize_jumps_p(*op);
+}
+
+/* 
+ * Returns true if (op) contains a variable.
+ */
+int optimize_reads_variable_p(value op)
+{
+	if (op.type == VALUE_VAR)
+		return TRUE;
+	if (op.type != VALUE_BLK)
+		return FALSE;
+	
+	size_t i;
+	for (i = 0; i < op.core.u_blk.length; ++i)
+		if (optimize_reads_variable_p(op.core.u_blk.a[i]))
+			return TRUE;
+	return FALSE;
+}
+
+/* 
+ * Returns a new variable to hold a hoisted expression. Its name can't be written in a 
+ * program, so it will never collide with a real variable.
+ */
+value optimize_temporary()
+{
+	static unsigned long count = 0;
+	char name[40];
+	sprintf(name, "invariant#%lu", count++);
+	value res = value_set_str(name);
+	res.type = VALUE_VAR;
+	return res;
+}
+
+/* 
+ * Returns a block that calls the built-in function with the given name. The arguments 
+ * are to be appended to it.
+ */
+value optimize_call(char *name)
+{
+	value fun = optimize_bif(name);
+	value res = value_init(VALUE_BLK);
+	value_append_now2(&res, &fun);
+	return res;
+}
+
+/* 
+ * Returns the built-in function with the given name.
+ */
+value optimize_bif(char *name)
+{
+	value key = value_set_id(name);
+	value res = value_hash_get(primitive_funs, key);
+	value_clear(&key);
+	return res;
+}
+
+/* 
+ * Performs a level 4 optimization. This infers the types of variables and expressions 
+ * and replaces calls like (+ a b), where a and b are known to be integers, with a call 
+ * to a specialized function like (add_int a b) that skips the generic type dispatch.
+ * 
+ * Types come from literals, from the results of built-in functions, and from 
+ * assignments, followed in order through the code. Where two paths meet, as after an 
+ * if or at the top of a loop, a variable keeps its type only if it has the same type 
+ * on both. Function arguments start out unknown.
+ * 
+ * The specialized functions check their arguments, so an incorrect inference is 
+ * still safe. Unlike O_ASSUME_NUMERIC, nothing here relies on a promise from the user.
+ */
 value value_optimize4_now(value *op, int flags)
 {
-	value_error(1, "Implementation Error: optimize3!() not yet implemented.");
-	return value_init_error();
+	value env = value_init(VALUE_ARY);
+	optimize_infer(op, &env, TRUE);
+	value_clear(&env);
+	return value_init_nil();
+}
+
+/* 
+ * Returns the type of (op) given the variable types in (env), and updates (env) with 
+ * any assignments that (op) makes. If (rewrite_p) is true, also specializes the calls 
+ * inside of (op).
+ */
+int optimize_infer(value *op, value *env, int rewrite_p)
+{
+	if (op->type == VALUE_VAR)
+		return optimize_env_get(*env, *op);
+	if (op->type != VALUE_BLK)
+		return CONSTANT_P(op->type) ? op->type : OPTIMIZE_UNKNOWN_TYPE;
+	
+	value *words = op->core.u_blk.a;
+	size_t i, length = op->core.u_blk.length;
+	
+	if (length == 0)
+		return VALUE_NIL;
+	
+	if (words[0].type != VALUE_BIF) {
+		if ((words[0].type == VALUE_UDF || words[0].type == VALUE_UDF_SHELL) && !words[0].core.u_udf->spec.delay_eval_p)
+			for (i = 1; i < length; ++i)
+				optimize_infer(&words[i], env, rewrite_p);
+		optimize_env_forget_writes(env, *op);
+		return OPTIMIZE_UNKNOWN_TYPE;
+	}
+	
+	value (*f)(int, value *) = words[0].core.u_bif->f;
+	struct value_spec spec = words[0].core.u_bif->spec;
+	int type = OPTIMIZE_UNKNOWN_TYPE;
+	
+	if (QUOTED_P(words) || f == &value_lambda_arg || f == &value_def_arg || f == &value_defmemo_arg) {
+		// Function bodies are optimized on their own when they are defined.
+		return OPTIMIZE_UNKNOWN_TYPE;
+		
+	} else if (f == &value_do_both_arg || f == &value_do_all_arg) {
+		type = VALUE_NIL;
+		for (i = 1; i < length; ++i)
+			type = optimize_infer(&words[i], env, rewrite_p);
+		return type;
+		
+	} else if (f == &value_if_arg || f == &value_unless_arg) {
+		if (length < 3)
+			return OPTIMIZE_UNKNOWN_TYPE;
+		optimize_infer(&words[1], env, rewrite_p);
+		value else_env = value_set(*env);
+		int then_type = optimize_infer(&words[2], env, rewrite_p);
+		int else_type = length > 3 ? optimize_infer(&words[3], &else_env, rewrite_p) : VALUE_NIL;
+		optimize_env_merge(env, else_env);
+		value_clear(&else_env);
+		return then_type == else_type ? then_type : OPTIMIZE_UNKNOWN_TYPE;
+		
+	} else if (f == &value_and_p_arg || f == &value_or_p_arg) {
+		// The second operand might not run.
+		if (length < 3)
+			return OPTIMIZE_UNKNOWN_TYPE;
+		optimize_infer(&words[1], env, rewrite_p);
+		value skipped_env = value_set(*env);
+		optimize_infer(&words[2], env, rewrite_p);
+		optimize_env_merge(env, skipped_env);
+		value_clear(&skipped_env);
+		return VALUE_BOO;
+		
+	} else if (length >= 3 && (f == &value_while_arg || f == &value_until_arg || f == &value_for_arg)) {
+		optimize_infer_loop(op, env, rewrite_p);
+		return OPTIMIZE_UNKNOWN_TYPE;
+		
+	} else if (spec.needs_variables_p == TRUE && spec.keep_arg_p && length == 3 && words[1].type == VALUE_VAR) {
+		// Assignment, plain or compound.
+		type = optimize_infer(&words[2], env, rewrite_p);
+		if (f != &value_assign_arg)
+			type = optimize_result_type(optimize_assign_op(f), optimize_env_get(*env, words[1]), type);
+		optimize_env_put(env, words[1], type);
+		return type;
+		
+	} else if (spec.delay_eval_p || spec.needs_variables_p) {
+		// Control flow or a callback into the current scope, which isn't followed.
+		optimize_env_forget_writes(env, *op);
+		return OPTIMIZE_UNKNOWN_TYPE;
+	}
+	
+	// An ordinary function call. Its arguments run in order.
+	int arg_types[2] = { OPTIMIZE_UNKNOWN_TYPE, OPTIMIZE_UNKNOWN_TYPE };
+	for (i = 1; i < length; ++i) {
+		type = optimize_infer(&words[i], env, rewrite_p);
+		if (i <= 2)
+			arg_types[i-1] = type;
+	}
+	
+	// A function with side effects may change the variables it is passed.
+	if (!spec.pure_p)
+		for (i = 1; i < length; ++i)
+			if (words[i].type == VALUE_VAR)
+				optimize_env_put(env, words[i], OPTIMIZE_UNKNOWN_TYPE);
+	
+	if (length == 2)
+		arg_types[1] = OPTIMIZE_UNKNOWN_TYPE;
+	else if (length == 3 && rewrite_p)
+		optimize_specialize(op, arg_types[0], arg_types[1]);
+	else if (length > 3)
+		return OPTIMIZE_UNKNOWN_TYPE;
+	
+	return optimize_result_type(f, arg_types[0], arg_types[1]);
+}
+
+/* 
+ * Infers types through a while, until or for loop. The body is analyzed repeatedly 
+ * until the variable types at the top of the loop stop changing, and then analyzed one 
+ * last time to specialize it.
+ */
+int optimize_infer_loop(value *op, value *env, int rewrite_p)
+{
+	value *words = op->core.u_blk.a;
+	int for_p = words[0].core.u_bif->f == &value_for_arg;
+	int element_type = OPTIMIZE_UNKNOWN_TYPE;
+	value *condition = &words[1];
+	
+	if (for_p) {
+		if (condition->type != VALUE_BLK || condition->core.u_blk.length < 3) {
+			optimize_env_forget_writes(env, *op);
+			return 0;
+		}
+		
+		// The iterable only runs once, before the loop.
+		int iterable_type = optimize_infer(&condition->core.u_blk.a[2], env, rewrite_p);
+		if (value_eq(condition->core.u_blk.a[1], value_symbol_dotimes) || 
+				(value_eq(condition->core.u_blk.a[1], value_symbol_in) && iterable_type == VALUE_RNG))
+			element_type = VALUE_MPZ;
+	}
+	
+	// A break or continue leaves the body partway through, where the types might be 
+	// different, so give up on anything that the loop assigns to.
+	if (optimize_jumps_p(words[2]))
+		optimize_env_forget_writes(env, *op);
+	
+	int changed_p;
+	int pass;
+	for (pass = 0; ; ++pass) {
+		value state = value_set(*env);
+		int final_p = pass > 0 && !changed_p;
+		
+		if (for_p) {
+			optimize_env_put_all(&state, condition->core.u_blk.a[0], element_type);
+		} else optimize_infer(&words[1], &state, final_p && rewrite_p);
+		optimize_infer(&words[2], &state, final_p && rewrite_p);
+		
+		changed_p = optimize_env_merge(env, state);
+		value_clear(&state);
+		if (final_p)
+			break;
+	}
+	
+	// The loop might not run at all, but the condition always does.
+	if (!for_p) {
+		value state = value_set(*env);
+		optimize_infer(&words[1], &state, FALSE);
+		optimize_env_merge(env, state);
+		value_clear(&state);
+	}
+	
+	return 0;
+}
+
+/* 
+ * The binary function that a compound assignment like += applies.
+ */
+value (*optimize_assign_op(value (*f)(int, value *)))(int, value *)
+{
+	if (f == &value_assign_add_arg)
+		return &value_add_arg;
+	if (f == &value_assign_sub_arg)
+		return &value_sub_arg;
+	if (f == &value_assign_mul_arg)
+		return &value_mul_arg;
+	return NULL;
+}
+
+/* 
+ * Returns the type that the built-in function (f) gives for arguments of the given 
+ * types, or OPTIMIZE_UNKNOWN_TYPE if it can't be known.
+ */
+int optimize_result_type(value (*f)(int, value *), int type1, int type2)
+{
+	int numeric_p = (type1 == VALUE_MPZ || type1 == VALUE_MPF) && (type2 == VALUE_MPZ || type2 == VALUE_MPF);
+	
+	if (f == &value_add_arg || f == &value_sub_arg || f == &value_mul_arg) {
+		if (numeric_p)
+			return type1 == VALUE_MPZ && type2 == VALUE_MPZ ? VALUE_MPZ : VALUE_MPF;
+		if (f == &value_add_arg && (type1 == VALUE_STR || (type2 == VALUE_STR && 
+				(type1 == VALUE_MPZ || type1 == VALUE_MPF || type1 == VALUE_BOO || type1 == VALUE_NIL))))
+			return VALUE_STR;
+		
+	} else if (f == &value_lt_arg || f == &value_le_arg || f == &value_gt_arg || f == &value_ge_arg || 
+			f == &value_eq_arg || f == &value_ne_arg || f == &value_not_p_arg || f == &value_true_p_arg) {
+		return VALUE_BOO;
+		
+	} else if (f == &value_uminus_arg || f == &value_uplus_arg || f == &value_abs_arg) {
+		if (type1 == VALUE_MPZ || type1 == VALUE_MPF)
+			return type1;
+		
+	} else if (f == &value_length_arg || f == &value_size_arg || f == &value_to_i_arg) {
+		return VALUE_MPZ;
+	} else if (f == &value_to_f_arg) {
+		return VALUE_MPF;
+	} else if (f == &value_to_s_arg) {
+		return VALUE_STR;
+	}
+	
+	return OPTIMIZE_UNKNOWN_TYPE;
+}
+
+/* 
+ * Replaces the function in a two-argument call with a version for the given argument 
+ * types, if there is one.
+ */
+int optimize_specialize(value *op, int type1, int type2)
+{
+	struct value_bif *bif = op->core.u_blk.a[0].core.u_bif;
+	value (*fast)(int, value *) = value_specialized_arg(bif->f, type1, type2);
+	
+	// The call site is already as fast as quickening could make it, so it isn't watched.
+	if (fast) {
+		bif->f = fast;
+		if (bif->site) {
+			value_private_site_free(bif->site);
+			bif->site = NULL;
+		}
+	}
+	
+	return 0;
+}
+
+/* 
+ * The type environment is an array of [variable, type] arrays. A variable that isn't in 
+ * it has an unknown type.
+ */
+int optimize_env_get(value env, value var)
+{
+	size_t i;
+	for (i = 0; i < env.core.u_a.length; ++i)
+		if (value_eq(env.core.u_a.a[i].core.u_a.a[0], var))
+			return env.core.u_a.a[i].core.u_a.a[1].core.u_type;
+	return OPTIMIZE_UNKNOWN_TYPE;
+}
+
+int optimize_env_put(value *env, value var, int type)
+{
+	// A user-defined function can assign to a global variable at any time.
+	if (var.core.u_var[0] == '$')
+		type = OPTIMIZE_UNKNOWN_TYPE;
+	
+	size_t i;
+	for (i = 0; i < env->core.u_a.length; ++i) {
+		if (value_eq(env->core.u_a.a[i].core.u_a.a[0], var)) {
+			env->core.u_a.a[i].core.u_a.a[1].core.u_type = type;
+			return 0;
+		}
+	}
+	
+	if (type == OPTIMIZE_UNKNOWN_TYPE)
+		return 0;
+	
+	value vtype;
+	vtype.type = VALUE_TYP;
+	vtype.core.u_type = type;
+	value entry = value_init(VALUE_ARY);
+	value_append_now(&entry, var);
+	value_append_now2(&entry, &vtype);
+	value_append_now2(env, &entry);
+	return 0;
+}
+
+/* 
+ * Puts (type) in for each variable in (vars), which is a variable or a block of them.
+ */
+int optimize_env_put_all(value *env, value vars, int type)
+{
+	if (vars.type == VALUE_VAR)
+		optimize_env_put(env, vars, type);
+	else if (vars.type == VALUE_BLK) {
+		size_t i;
+		for (i = 0; i < vars.core.u_blk.length; ++i)
+			optimize_env_put_all(env, vars.core.u_blk.a[i], OPTIMIZE_UNKNOWN_TYPE);
+	}
+	return 0;
+}
+
+/* 
+ * Combines the types in (env) with those in (other), where control flow from two places 
+ * meets. Returns true if anything in (env) changed.
+ */
+int optimize_env_merge(value *env, value other)
+{
+	int changed_p = FALSE;
+	size_t i;
+	for (i = 0; i < env->core.u_a.length; ++i) {
+		value *entry = env->core.u_a.a[i].core.u_a.a;
+		if (entry[1].core.u_type != OPTIMIZE_UNKNOWN_TYPE && 
+				entry[1].core.u_type != optimize_env_get(other, entry[0])) {
+			entry[1].core.u_type = OPTIMIZE_UNKNOWN_TYPE;
+			changed_p = TRUE;
+		}
+	}
+	return changed_p;
+}
+
+/* 
+ * Forgets the type of everything that (op) might assign to.
+ */
+int optimize_env_forget_writes(value *env, value op)
+{
+	struct optimize_loop_info info;
+	optimize_loop_info_init(&info, op);
+	
+	size_t i;
+	for (i = 0; i < env->core.u_a.length; ++i) {
+		value *entry = env->core.u_a.a[i].core.u_a.a;
+		if (info.unknown_p || optimize_writes_p(&info, entry[0]))
+			entry[1].core.u_type = OPTIMIZE_UNKNOWN_TYPE;
+	}
+	
+	value_clear(&info.writes);
+	return 0;
 }
 
 
@@ -0,0 +1,462 @@
+/*
+ *  profile.c
+ *  Simfpl
+ *
+ *  All definitions for functions and variables in profile.c can be found in value.h.
+ *
+ *  The profiler. While profiling_p is true, value_bifcall_sexp() and value_udfcall()
+ *  call value_profile_enter() before they call a function and value_profile_exit()
+ *  after it returns. Each function gets a call count, its inclusive time (time spent
+ *  in the function and everything it called) and its exclusive time (time spent in
+ *  the function itself). Time for a recursive function is only counted once in its
+ *  inclusive time.
+ *
+ *  Each distinct stack of function names gets the exclusive time spent with that
+ *  stack on top, in microseconds. value_profile_write_folded() writes these in the
+ *  folded format that flamegraph.pl reads: the stack, separated by semicolons, then
+ *  a space and the weight.
+ *
+ *  With a sampling interval, the profiler also sets a SIGPROF timer. The signal
+ *  handler only counts the signal; the next call to value_profile_enter() or
+ *  value_profile_exit() charges the pending samples to the stack at that point. When
+ *  there are samples, the folded output uses them instead of the times.
+ *
+ *  Functions that the JIT has compiled run as a single frame, since their calls
+ *  don't go through the interpreter. Leave SIMFPL_JIT unset to see inside them.
+ *  A generator's body runs on its own stack, so time spent in generators is only
+ *  attributed approximately.
+ */
+
+#include "value.h"
+
+#include <sys/time.h>
+
+int init_profile()
+{
+	profiling_p = FALSE;
+	profile_functions = value_hash_init();
+	profile_stacks = value_hash_init();
+	profile_entries = profile_stack_entries = NULL;
+	profile_entries_length = profile_entries_size = 0;
+	profile_stack_entries_length = profile_stack_entries_size = 0;
+	profile_frames = NULL;
+	profile_depth = profile_frames_size = 0;
+	profile_path = NULL;
+	profile_path_length = profile_path_size = 0;
+	profile_start_time = profile_total = 0;
+	profile_interval = 0;
+	profile_pending = 0;
+	return 0;
+}
+
+double value_profile_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void value_profile_signal(int sig)
+{
+	++profile_pending;
+}
+
+/*
+ * Throws away everything that has been recorded.
+ */
+void value_profile_reset()
+{
+	size_t i;
+	for (i = 0; i < profile_entries_length; ++i)
+		value_free(profile_entries[i].key);
+	for (i = 0; i < profile_stack_entries_length; ++i)
+		value_free(profile_stack_entries[i].key);
+	profile_entries_length = profile_stack_entries_length = 0;
+
+	value_clear(&profile_functions);
+	value_clear(&profile_stacks);
+	profile_functions = value_hash_init();
+	profile_stacks = value_hash_init();
+
+	profile_depth = 0;
+	profile_path_length = 0;
+	profile_total = 0;
+	profile_pending = 0;
+}
+
+/*
+ * Finds the entry for (key) in (table), or adds one. Returns its index, or -1 if
+ * memory runs out.
+ */
+long value_profile_find(value *table, struct value_profile_entry **entries, size_t *length, size_t *size, char *key)
+{
+	value vkey;
+	vkey.type = VALUE_STR;
+	vkey.core.u_s = key;
+
+	value *ref = value_hash_get_ref(*table, vkey);
+	if (ref)
+		return mpz_get_si(ref->core.u_mz);
+
+	if (*length == *size) {
+		size_t new_size = *size ? 2 * *size : 64;
+		struct value_profile_entry *tmp = realloc(*entries, new_size * sizeof(struct value_profile_entry));
+		if (tmp == NULL)
+			return -1;
+		*entries = tmp;
+		*size = new_size;
+	}
+
+	struct value_profile_entry *entry = &(*entries)[*length];
+	entry->key = value_malloc(NULL, strlen(key) + 1);
+	if (entry->key == NULL)
+		return -1;
+	strcpy(entry->key, key);
+	entry->calls = entry->samples = 0;
+	entry->inclusive = entry->exclusive = 0;
+	entry->active = 0;
+
+	value_hash_put(table, vkey, value_set_long(*length));
+	return (*length)++;
+}
+
+/*
+ * Charges any samples that have come in to the stack that's running now.
+ */
+void value_profile_take_samples()
+{
+	unsigned long samples = profile_pending;
+	profile_pending = 0;
+	if (profile_depth == 0)
+		return;
+
+	profile_entries[profile_frames[profile_depth-1].entry].samples += samples;
+	long i = value_profile_find(&profile_stacks, &profile_stack_entries, &profile_stack_entries_length, &profile_stack_entries_size, profile_path);
+	if (i >= 0)
+		profile_stack_entries[i].samples += samples;
+}
+
+char * value_profile_bif_name(struct value_bif *bif)
+{
+	value (*f)(int argc, value argv[]) = bif->f;
+	size_t i = ((size_t) f >> 4) % PROFILE_NAME_CACHE_SIZE;
+
+	if (profile_name_cache[i].f == f)
+		return profile_name_cache[i].name;
+
+	value op;
+	op.type = VALUE_BIF;
+	op.core.u_bif = bif;
+
+	value *var = value_hash_get_ref(primitive_names, op);
+	if (var == NULL || var->type != VALUE_VAR)
+		return "(primitive)";
+
+	profile_name_cache[i].f = f;
+	profile_name_cache[i].name = var->core.u_var;
+	return var->core.u_var;
+}
+
+int value_profile_enter(char *name)
+{
+	if (profile_pending)
+		value_profile_take_samples();
+
+	if (profile_depth == profile_frames_size) {
+		int new_size = profile_frames_size ? 2 * profile_frames_size : 256;
+		struct value_profile_frame *tmp = realloc(profile_frames, new_size * sizeof(struct value_profile_frame));
+		if (tmp == NULL)
+			return profile_depth;
+		profile_frames = tmp;
+		profile_frames_size = new_size;
+	}
+
+	long entry = value_profile_find(&profile_functions, &profile_entries, &profile_entries_length, &profile_entries_size, name);
+	if (entry < 0)
+		return profile_depth;
+
+	size_t length = strlen(name);
+	if (profile_path_length + length + 2 > profile_path_size) {
+		size_t new_size = 2 * (profile_path_length + length + 2);
+		char *tmp = realloc(profile_path, new_size);
+		if (tmp == NULL)
+			return profile_depth;
+		profile_path = tmp;
+		profile_path_size = new_size;
+	}
+
+	struct value_profile_frame *frame = &profile_frames[profile_depth];
+	frame->entry = entry;
+	frame->children = 0;
+	frame->path_length = profile_path_length;
+
+	if (profile_depth)
+		profile_path[profile_path_length++] = ';';
+	strcpy(profile_path + profile_path_length, name);
+	profile_path_length += length;
+
+	++profile_entries[entry].calls;
+	++profile_entries[entry].active;
+	frame->start = value_profile_now();
+	return profile_depth++;
+}
+
+/*
+ * Pops frames until there are only (depth) left. This is usually one frame, but a
+ * generator that yields leaves its frames on the stack.
+ */
+int value_profile_exit(int depth)
+{
+	if (profile_pending)
+		value_profile_take_samples();
+
+	double now = value_profile_now();
+	while (profile_depth > depth) {
+		struct value_profile_frame *frame = &profile_frames[--profile_depth];
+		struct value_profile_entry *entry = &profile_entries[frame->entry];
+		double elapsed = now - frame->start;
+		double exclusive = elapsed - frame->children;
+
+		entry->exclusive += exclusive;
+		if (--entry->active == 0)
+			entry->inclusive += elapsed;
+		if (profile_depth)
+			profile_frames[profile_depth-1].children += elapsed;
+
+		long i = value_profile_find(&profile_stacks, &profile_stack_entries, &profile_stack_entries_length, &profile_stack_entries_size, profile_path);
+		if (i >= 0)
+			profile_stack_entries[i].exclusive += exclusive;
+
+		profile_path_length = frame->path_length;
+		profile_path[profile_path_length] = '\0';
+	}
+
+	return 0;
+}
+
+/*
+ * Starts profiling. If (interval) is positive, the stack is also sampled every
+ * (interval) microseconds of CPU time.
+ */
+int value_profile_start_c(long interval)
+{
+	value_profile_reset();
+	profile_interval = interval;
+
+	if (interval > 0) {
+		struct sigaction action;
+		memset(&action, 0, sizeof(action));
+		action.sa_handler = &value_profile_signal;
+		action.sa_flags = SA_RESTART;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGPROF, &action, NULL);
+
+		struct itimerval timer;
+		timer.it_interval.tv_sec = interval / 1000000;
+		timer.it_interval.tv_usec = interval % 1000000;
+		timer.it_value = timer.it_interval;
+		setitimer(ITIMER_PROF, &timer, NULL);
+	}
+
+	profile_start_time = value_profile_now();
+	profiling_p = TRUE;
+	return 0;
+}
+
+int value_profile_stop_c()
+{
+	if (!profiling_p)
+		return 0;
+
+	profiling_p = FALSE;
+	if (profile_interval > 0) {
+		struct itimerval timer;
+		memset(&timer, 0, sizeof(timer));
+		setitimer(ITIMER_PROF, &timer, NULL);
+		signal(SIGPROF, SIG_IGN);
+	}
+
+	// Close any frames that are still open, like the one for profile_stop itself.
+	value_profile_exit(0);
+	profile_total = value_profile_now() - profile_start_time;
+	return 0;
+}
+
+int value_profile_compare(const void *a, const void *b)
+{
+	const struct value_profile_entry *x = a, *y = b;
+	if (x->exclusive != y->exclusive)
+		return x->exclusive < y->exclusive ? 1 : -1;
+	return strcmp(x->key, y->key);
+}
+
+/*
+ * Writes a report with one line per function, sorted by exclusive time.
+ */
+int value_profile_write_report(FILE *out)
+{
+	size_t i;
+	unsigned long calls = 0, samples = 0;
+
+	qsort(profile_entries, profile_entries_length, sizeof(struct value_profile_entry), &value_profile_compare);
+
+	// Sorting moved the entries, so the indices in profile_functions are out of date.
+	value_clear(&profile_functions);
+	profile_functions = value_hash_init();
+	for (i = 0; i < profile_entries_length; ++i) {
+		value key = value_set_str(profile_entries[i].key);
+		value index = value_set_long(i);
+		value_hash_put_refs(&profile_functions, &key, &index);
+		calls += profile_entries[i].calls;
+		samples += profile_entries[i].samples;
+	}
+
+	fprintf(out, "Profile: %.6f seconds, %lu calls, %lu samples.\n\n", profile_total, calls, samples);
+	fprintf(out, "%12s %12s %12s %9s  %s\n", "exclusive", "inclusive", "calls", "samples", "function");
+	for (i = 0; i < profile_entries_length; ++i) {
+		struct value_profile_entry *entry = &profile_entries[i];
+		fprintf(out, "%12.6f %12.6f %12lu %9lu  %s\n", entry->exclusive, entry->inclusive, entry->calls, entry->samples, entry->key);
+	}
+
+	return 0;
+}
+
+/*
+ * Writes the folded stacks. Uses the samples if there are any, and otherwise the
+ * exclusive time in microseconds.
+ */
+int value_profile_write_folded(FILE *out)
+{
+	size_t i;
+	int samples_p = FALSE;
+	for (i = 0; i < profile_stack_entries_length; ++i)
+		if (profile_stack_entries[i].samples)
+			samples_p = TRUE;
+
+	for (i = 0; i < profile_stack_entries_length; ++i) {
+		struct value_profile_entry *entry = &profile_stack_entries[i];
+		unsigned long weight = samples_p ? entry->samples : (unsigned long) (entry->exclusive * 1e6 + 0.5);
+		if (weight)
+			fprintf(out, "%s %lu\n", entry->key, weight);
+	}
+
+	return 0;
+}
+
+/*
+ * Runs the file (argv[0]) with the profiler on, writes the report to stderr, and
+ * writes the folded stacks to the file (argv[1]) if it's given. A first argument of
+ * -s turns on sampling every millisecond.
+ */
+int value_profile_main(int argc, const char *argv[])
+{
+	long interval = 0;
+	if (argc > 0 && streq(argv[0], "-s")) {
+		interval = 1000;
+		--argc;
+		++argv;
+	}
+
+	if (argc < 1) {
+		fprintf(stderr, "usage: simfpl profile [-s] program.simf [stacks.folded]\n");
+		return 1;
+	}
+
+	value str = value_set_str((char *) argv[0]);
+	value_profile_start_c(interval);
+	value_import(str);
+	value_profile_stop_c();
+	value_clear(&str);
+
+	fflush(stdout);
+	value_profile_write_report(stderr);
+
+	if (argc > 1) {
+		FILE *out = fopen(argv[1], "w");
+		if (out == NULL) {
+			fprintf(stderr, "Error: Could not open file %s.\n", argv[1]);
+			return 1;
+		}
+		value_profile_write_folded(out);
+		fclose(out);
+	}
+
+	return 0;
+}
+
+value value_profile_start(value interval)
+{
+	long usec = 0;
+	if (interval.type == VALUE_MPZ)
+		usec = mpz_get_si(interval.core.u_mz);
+	else if (interval.type != VALUE_NIL) {
+		value_error(1, "Type Error: profile_start() is undefined where interval is %ts (integer expected).", interval);
+		return value_init_error();
+	}
+
+	value_profile_start_c(usec);
+	return value_init_nil();
+}
+
+/*
+ * Returns a hash from each function's name to a hash with its calls, inclusive
+ * and exclusive time in seconds, and samples.
+ */
+value value_profile_stop()
+{
+	value_profile_stop_c();
+
+	value res = value_hash_init();
+	size_t i;
+	for (i = 0; i < profile_entries_length; ++i) {
+		struct value_profile_entry *entry = &profile_entries[i];
+		value stats = value_hash_init();
+		value_hash_put_str(&stats, "calls", value_set_ulong(entry->calls));
+		value_hash_put_str(&stats, "inclusive", value_set_double(entry->inclusive));
+		value_hash_put_str(&stats, "exclusive", value_set_double(entry->exclusive));
+		value_hash_put_str(&stats, "samples", value_set_ulong(entry->samples));
+		value_hash_put_str(&res, entry->key, stats);
+		value_clear(&stats);
+	}
+
+	return res;
+}
+
+value value_profile_report(value path)
+{
+	if (profiling_p)
+		value_profile_stop_c();
+
+	fflush(stdout);
+	value_profile_write_report(stdout);
+
+	if (path.type == VALUE_STR) {
+		FILE *out = fopen(path.core.u_s, "w");
+		if (out == NULL) {
+			value_error(1, "Error: Could not open file %s.", path);
+			return value_init_error();
+		}
+		value_profile_write_folded(out);
+		fclose(out);
+	} else if (path.type != VALUE_NIL) {
+		value_error(1, "Type Error: profile_report() is undefined where path is %ts (string expected).", path);
+		return value_init_error();
+	}
+
+	return value_init_nil();
+}
+
+value value_profile_start_arg(int argc, value argv[])
+{
+	return value_profile_start(argv[0]);
+}
+
+value value_profile_stop_arg(int argc, value argv[])
+{
+	return value_profile_stop();
+}
+
+value value_profile_report_arg(int argc, value argv[])
+{
+	return value_profile_report(argv[0]);
+}
@@ -8,119 +8,1914 @@
 
 #include "sexp_to_c.h"
 
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Built-in functions that the generated code calls directly rather than looking
+ * up by name when the program starts.
+ */
+struct sexp_to_c_direct {
+	value (*f)(int argc, value argv[]);
+	char *name;
+};
+
+static struct sexp_to_c_direct sexp_to_c_direct_calls[] = {
+	{ &value_add_arg, "value_add_arg" },
+	{ &value_sub_arg, "value_sub_arg" },
+	{ &value_mul_arg, "value_mul_arg" },
+	{ &value_div_arg, "value_div_arg" },
+	{ &value_mod_arg, "value_mod_arg" },
+	{ &value_lt_arg, "value_lt_arg" },
+	{ &value_le_arg, "value_le_arg" },
+	{ &value_gt_arg, "value_gt_arg" },
+	{ &value_ge_arg, "value_ge_arg" },
+	{ &value_eq_arg, "value_eq_arg" },
+	{ &value_ne_arg, "value_ne_arg" },
+	{ &value_not_p_arg, "value_not_p_arg" },
+	{ &value_add_int_arg, "value_add_int_arg" },
+	{ &value_sub_int_arg, "value_sub_int_arg" },
+	{ &value_mul_int_arg, "value_mul_int_arg" },
+	{ &value_add_float_arg, "value_add_float_arg" },
+	{ &value_sub_float_arg, "value_sub_float_arg" },
+	{ &value_mul_float_arg, "value_mul_float_arg" },
+	{ &value_concat_str_arg, "value_concat_str_arg" },
+	{ &value_lt_int_arg, "value_lt_int_arg" },
+	{ &value_le_int_arg, "value_le_int_arg" },
+	{ &value_gt_int_arg, "value_gt_int_arg" },
+	{ &value_ge_int_arg, "value_ge_int_arg" },
+	{ &value_lt_float_arg, "value_lt_float_arg" },
+	{ &value_le_float_arg, "value_le_float_arg" },
+	{ &value_gt_float_arg, "value_gt_float_arg" },
+	{ &value_ge_float_arg, "value_ge_float_arg" },
+	{ &value_eq_int_arg, "value_eq_int_arg" },
+	{ &value_ne_int_arg, "value_ne_int_arg" },
+	{ &value_eq_float_arg, "value_eq_float_arg" },
+	{ &value_ne_float_arg, "value_ne_float_arg" },
+	{ &value_eq_str_arg, "value_eq_str_arg" },
+	{ &value_ne_str_arg, "value_ne_str_arg" },
+	{ &value_array_arg, "value_array_arg" },
+	{ &value_at_arg, "value_at_arg" },
+	{ &value_length_arg, "value_length_arg" },
+	{ &value_size_arg, "value_size_arg" },
+	{ &value_print_arg, "value_print_arg" },
+	{ &value_println_arg, "value_println_arg" },
+	{ NULL, NULL }
+};
+
+/* The operation that each assignment operator performs before it stores the result.
+ */
+struct sexp_to_c_assignment {
+	value (*f)(int argc, value argv[]);
+	char *op;
+};
+
+static struct sexp_to_c_assignment sexp_to_c_assignments[] = {
+	{ &value_assign_arg, NULL },
+	{ &value_assign_add_arg, "value_add" },
+	{ &value_assign_sub_arg, "value_sub" },
+	{ &value_assign_mul_arg, "value_mul" },
+	{ &value_assign_div_arg, "value_div" },
+	{ &value_assign_mod_arg, "value_mod" },
+	{ &value_assign_and_arg, "value_and" },
+	{ &value_assign_xor_arg, "value_xor" },
+	{ &value_assign_or_arg, "value_or" },
+	{ &value_assign_shl_arg, "value_shl_std" },
+	{ &value_assign_shr_arg, "value_shr_std" },
+	{ NULL, NULL }
+};
+
 int init_sexp_to_c()
 {
+	sexp_to_c_variables = value_hash_init();
+	
+	sexp_to_c_cc = getenv("CC");
+	if (sexp_to_c_cc == NULL || *sexp_to_c_cc == '\0')
+		sexp_to_c_cc = "cc";
+	sexp_to_c_flags = getenv("SIMFPL_CFLAGS");
+	if (sexp_to_c_flags == NULL)
+		sexp_to_c_flags = "-O2 -std=gnu89 -fcommon -w -I.";
+	sexp_to_c_libs = getenv("SIMFPL_LIBS");
+	if (sexp_to_c_libs == NULL)
+		sexp_to_c_libs = "-lmpfr -lgmp -lm -ldl -lpthread";
 	return 0;
 }
 
-value create_associated_numbers(value sexp)
+int sexp_to_c_main(int argc, const char *argv[])
 {
-	return create_associated_numbers_recursive(sexp, value_zero);
+	if (argc < 1) {
+		fprintf(stderr, "usage: simfpl compile program.simf [program.c]\n");
+		return 1;
+	}
+
+	FILE *in = fopen(argv[0], "r");
+	if (in == NULL) {
+		value_error(1, "IO Error: Could not open file %c.", argv[0]);
+		return 1;
+	}
+
+	FILE *out = stdout;
+	if (argc > 1 && (out = fopen(argv[1], "w")) == NULL) {
+		value_error(1, "IO Error: Could not open file %c.", argv[1]);
+		fclose(in);
+		return 1;
+	}
+
+	int res = sexp_to_c_file(out, in, (char *) argv[0]);
+
+	fclose(in);
+	if (out != stdout)
+		fclose(out);
+	if (res && out != stdout)
+		remove(argv[1]);
+
+	return res ? 1 : 0;
 }
 
-value create_associated_numbers_recursive(value sexp, value start)
+/*
+ * The programs in compile_tests/. Each one is made of statements from tests.c and 
+ * prints their results.
+ */
+char *sexp_to_c_check_names[] = {
+	"numbers", "strings", "arrays", "controls", NULL, 
+};
+
+/*
+ * simfpl compile_check [name ...]
+ * 
+ * Checks that compiled programs do just what the interpreter does. Each program in 
+ * compile_tests/ is run by the interpreter, compiled to C, built into a shared object 
+ * with sexp_to_c_cc and sexp_to_c_flags, and run again by calling the shared object's 
+ * main(). Everything the two runs print has to be the same, and so does whether they 
+ * succeed. Returns 1 if any program differs or can't be built.
+ * 
+ * The shared object calls the interpreter's functions, so this needs simfpl to be 
+ * linked with -rdynamic. The first program is also linked the way sexp_to_c.h says a 
+ * compiled program should be, with the interpreter's sources and sexp_to_c_libs, and 
+ * run on its own. This has to be run from the directory with the sources.
+ */
+int sexp_to_c_check_main(int argc, const char *argv[])
 {
-	if (sexp.type != VALUE_BLK) {
-		return value_inc(start);
+	char dir[] = "/tmp/simfpl-compile-test.XXXXXX";
+	char command[BUFSIZE];
+	int i, failures = 0;
+	
+	if (argc > 0 && argv[0][0] == '-') {
+		fprintf(stderr, "usage: simfpl compile_check [name ...]\n");
+		return 1;
 	}
 	
-	value associated = value_init(VALUE_BLK);
-	size_t i;
-	for (i = 0; i < sexp.core.u_blk.length; ++i) {
-		value num = create_associated_numbers_recursive(sexp.core.u_blk.a[i], start);
-		value_inc_now(&start);
-		value_append_now2(&associated, &num);
+	if (mkdtemp(dir) == NULL) {
+		value_error(1, "IO Error: Could not create a temporary directory.");
+		return 1;
+	}
+	
+	if (argc > 0) {
+		for (i = 0; i < argc; ++i)
+			failures += sexp_to_c_check((char *) argv[i], dir, i == 0) != 0;
+	} else {
+		for (i = 0; sexp_to_c_check_names[i]; ++i)
+			failures += sexp_to_c_check(sexp_to_c_check_names[i], dir, i == 0) != 0;
 	}
 	
-	return associated;
+	snprintf(command, BUFSIZE, "rm -rf '%s'", dir);
+	system(command);
+	
+	return failures > 0;
 }
 
-value get_count(value counts)
+/*
+ * Compiles and runs compile_tests/(name).simf, using (dir) for the files in between, 
+ * and prints whether its output is the same as the interpreter's. If (standalone_p) is 
+ * true, it's also checked as a standalone program.
+ */
+int sexp_to_c_check(char *name, char *dir, int standalone_p)
 {
-	if (counts.type == VALUE_MPZ) {
-		return counts;
+	char path[BUFSIZE], expected[BUFSIZE], found[BUFSIZE], source[BUFSIZE], object[BUFSIZE];
+	char command[4*BUFSIZE];
+	
+	snprintf(path, BUFSIZE, "compile_tests/%s.simf", name);
+	snprintf(expected, BUFSIZE, "%s/%s.expected", dir, name);
+	snprintf(found, BUFSIZE, "%s/%s.found", dir, name);
+	snprintf(source, BUFSIZE, "%s/%s.c", dir, name);
+	snprintf(object, BUFSIZE, "%s/%s.so", dir, name);
+	if (access(path, R_OK)) {
+		printf("%-12s could not open %s\n", name, path);
+		return VALUE_ERROR;
+	}
+	
+	const char *compile_argv[] = { path, source };
+	int interpreted = sexp_to_c_check_run(path, NULL, expected);
+	if (sexp_to_c_check_run(NULL, compile_argv, NULL)) {
+		printf("%-12s could not be compiled\n", name);
+		return VALUE_ERROR;
+	}
+	
+	snprintf(command, sizeof(command), "%s %s -shared -fPIC -o '%s' '%s' >/dev/null 2>&1", sexp_to_c_cc, sexp_to_c_flags, object, source);
+	if (system(command)) {
+		printf("%-12s could not be built: %s\n", name, command);
+		return VALUE_ERROR;
+	}
+	
+	int compiled = sexp_to_c_check_run(NULL, NULL, found);
+	
+	char line[BUFSIZE];
+	long linenum = sexp_to_c_check_compare(expected, found, line);
+	if (interpreted != compiled) {
+		printf("%-12s %s when interpreted but %s when compiled\n", name, 
+				interpreted ? "fails" : "succeeds", compiled ? "fails" : "succeeds");
+		return VALUE_ERROR;
+	} else if (linenum) {
+		printf("%-12s differs at line %ld: %s", name, linenum, line);
+		return VALUE_ERROR;
 	}
 	
-	return get_count(counts.core.u_blk.a[0]);
+	printf("%-12s ok\n", name);
+	
+	if (standalone_p)
+		return sexp_to_c_check_standalone(name, dir, interpreted);
+	return 0;
 }
 
-int sexp_to_c(FILE *stream, value sexp)
+/*
+ * Links the C program that sexp_to_c_check() wrote for (name) into an executable, as 
+ * described at the top of sexp_to_c.h, and checks that running it prints the same 
+ * thing as the interpreter did and fails only if (interpreted) is nonzero.
+ */
+int sexp_to_c_check_standalone(char *name, char *dir, int interpreted)
 {
-	value counts = create_associated_numbers(sexp);
+	char expected[BUFSIZE], found[BUFSIZE], source[BUFSIZE], program[BUFSIZE];
+	char command[4*BUFSIZE];
 	
-	int res = sexp_to_c_recursive(stream, sexp, counts);
-	value_clear(&counts);
-	return res;
+	snprintf(expected, BUFSIZE, "%s/%s.expected", dir, name);
+	snprintf(found, BUFSIZE, "%s/%s.standalone", dir, name);
+	snprintf(source, BUFSIZE, "%s/%s.c", dir, name);
+	snprintf(program, BUFSIZE, "%s/%s", dir, name);
+	
+	// tree.c has never built, so it's left out along with main.c.
+	snprintf(command, sizeof(command), "%s %s -o '%s' '%s' $(ls *.c | grep -v -x -e main.c -e tree.c) %s >/dev/null 2>&1", 
+			sexp_to_c_cc, sexp_to_c_flags, program, source, sexp_to_c_libs);
+	if (system(command)) {
+		printf("%-12s could not be built as a standalone program: %s\n", name, command);
+		return VALUE_ERROR;
+	}
+	
+	fflush(stdout);
+	fflush(stderr);
+	snprintf(command, sizeof(command), "'%s' >'%s' 2>&1", program, found);
+	int status = system(command);
+	int compiled = status == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+	
+	char line[BUFSIZE];
+	long linenum = sexp_to_c_check_compare(expected, found, line);
+	if ((interpreted != 0) != compiled) {
+		printf("%-12s %s when interpreted but %s as a standalone program\n", name, 
+				interpreted ? "fails" : "succeeds", compiled ? "fails" : "succeeds");
+		return VALUE_ERROR;
+	} else if (linenum) {
+		printf("%-12s differs as a standalone program at line %ld: %s", name, linenum, line);
+		return VALUE_ERROR;
+	}
+	
+	printf("%-12s ok as a standalone program\n", name);
+	return 0;
 }
 
-/* 
- * Convert the given s-expression into C code.
+/*
+ * Does one step of sexp_to_c_check() in a child process, so that the steps don't 
+ * change each other's variables and functions. If (program) isn't NULL, the child 
+ * runs it with the interpreter. If (compile_argv) isn't NULL, it compiles a program as 
+ * "simfpl compile" does. Otherwise it loads the shared object whose path is (out) with 
+ * ".found" replaced by ".so" and calls its main(). If (out) isn't NULL, everything the 
+ * child prints goes there. Returns nonzero if the child failed.
  */
-int sexp_to_c_recursive(FILE *stream, value sexp, value counts)
+int sexp_to_c_check_run(char *program, const char *compile_argv[], char *out)
 {
-	if (sexp.type == VALUE_MPZ || sexp.type == VALUE_MPF) {
-		value_fprintf(stream, "var%v = value_set_str_smart(\"%v\", 0);\n", counts, sexp);
-	}
+	fflush(stdout);
+	fflush(stderr);
+	pid_t pid = fork();
+	if (pid < 0)
+		return VALUE_ERROR;
 	
-	if (sexp.type != VALUE_BLK) {
-		return 0;
-//		value_error(1, "Type Error: sexp_to_c() is undefined where sexp is %ts (block expected).", sexp);
-//		return VALUE_ERROR;
+	if (pid == 0) {
+		int res = 1;
+		if (out) {
+			int fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+			if (fd < 0)
+				_exit(1);
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
+		}
+		
+		if (program) {
+			res = import_benchmark(program);
+		} else if (compile_argv) {
+			res = sexp_to_c_main(2, compile_argv);
+		} else {
+			char object[BUFSIZE];
+			snprintf(object, BUFSIZE, "%s", out);
+			strcpy(strrchr(object, '.'), ".so");
+			void *handle = dlopen(object, RTLD_NOW | RTLD_LOCAL);
+			int (*program_main)(int, char **) = handle ? (int (*)(int, char **)) dlsym(handle, "main") : NULL;
+			char *argv[] = { object, NULL };
+			if (program_main)
+				res = (*program_main)(1, argv);
+			else fprintf(stderr, "%s\n", dlerror());
+		}
+		
+		fflush(stdout);
+		fflush(stderr);
+		_exit(res ? 1 : 0);
 	}
 	
-	int error_p = 0;
+	int status;
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+		return VALUE_ERROR;
+	return WEXITSTATUS(status);
+}
+
+/*
+ * Returns the number of the first line where the files (path1) and (path2) differ, 
+ * and copies that line of (path2) into (line). Returns 0 if they're the same.
+ */
+long sexp_to_c_check_compare(char *path1, char *path2, char *line)
+{
+	FILE *in1 = fopen(path1, "r"), *in2 = fopen(path2, "r");
+	char line1[BUFSIZE];
+	long linenum = 0, res = 0;
 	
-	size_t i;
-	for (i = 0; i < sexp.core.u_blk.length; ++i) {
-		if (sexp.core.u_blk.a[i].type == VALUE_BIF && sexp.core.u_blk.a[i].core.u_bif->spec.delay_eval_p)
-			;
-		else if (error_p = sexp_to_c_recursive(stream, sexp.core.u_blk.a[i], counts.core.u_blk.a[i]))
-			return error_p;
+	strcpy(line, "(missing output)\n");
+	if (in1 == NULL || in2 == NULL) {
+		res = 1;
+	} else while (res == 0) {
+		++linenum;
+		char *got1 = fgets(line1, BUFSIZE, in1), *got2 = fgets(line, BUFSIZE, in2);
+		if (got1 == NULL && got2 == NULL)
+			break;
+		if (got1 == NULL || got2 == NULL || strcmp(line1, line)) {
+			if (got2 == NULL) strcpy(line, "(end of output)\n");
+			res = linenum;
+		}
 	}
 	
-	char *name;
-	
-	if (sexp.core.u_blk.length > 0 && sexp.core.u_blk.a[0].type == VALUE_BIF) {
-		value (*f)(int argc, value argv[]) = sexp.core.u_blk.a[0].core.u_bif->f;
-		int type = 0;
-		if (f == &value_add_arg) {
-			name = "value_add";
-		} else if (f == &value_sub_arg) {
-			name = "value_sub";
-		} else if (f == &value_mul_arg) {
-			name = "value_mul";
-		} else if (f == &value_div_arg) {
-			name = "value_div";
-		} else if (f == &value_eq_arg) {
-			name = "value_eq";
-		} else if (f == &value_if_arg) {
-			type = S2C_IF;
-		} else if (f == &value_times_arg) {
-			type = S2C_TIMES;
-		} else {
-			name = "UNDEFINED_FUNCTION";
-		}
-
-		if (type == 0) {
-			value str = value_set_str(name);
-			value_fprintf(stream, "var%v = %v(var%v, var%v);\n", get_count(counts), str, get_count(counts.core.u_blk.a[1]), get_count(counts.core.u_blk.a[2]));
-			value_clear(&str);
-		} else if (type == S2C_IF) {
-			// Do some different stuff.
-			
-		} else if (type == S2C_TIMES) {
-			value iter;
-			for (iter = value_set_long(0); value_lt(iter, sexp.core.u_blk.a[1]); value_inc_now(&iter)) {
-				sexp_to_c_recursive(stream, sexp.core.u_blk.a[2], counts.core.u_blk.a[2]);
+	if (in1) fclose(in1);
+	if (in2) fclose(in2);
+	return res;
+}
+
+int sexp_to_c_file(FILE *out, FILE *in, char *source)
+{
+	struct sexp_to_c_state st;
+	if (sexp_to_c_init_state(&st, source))
+		return VALUE_ERROR;
+
+	FILE *old_stream = input_stream;
+	int old_linenum = linenum;
+	input_stream = in;
+	linenum = 0;
+
+	int error_p = FALSE;
+	while (error_p == FALSE && is_eof == FALSE) {
+		value values = get_values();
+		if (values.type == VALUE_ARY && values.core.u_a.length > 0) {
+			value sexp = compile_values(values.core.u_a.a, values.core.u_a.length);
+			if (sexp.type == VALUE_ERROR)
+				error_p = TRUE;
+			else {
+				value_optimize_now(&sexp, O_4);
+				error_p = sexp_to_c_statement(&st, sexp) != 0;
 			}
+			value_clear(&sexp);
 		}
+		value_clear(&values);
 	}
-	
+
+	input_stream = old_stream;
+	linenum = old_linenum;
+	is_eof = FALSE;
+
+	if (error_p == FALSE)
+		error_p = sexp_to_c_finish(&st, out) != 0;
+	sexp_to_c_clear_state(&st);
+
+	return error_p ? VALUE_ERROR : 0;
+}
+
+int sexp_to_c(FILE *stream, value sexp)
+{
+	struct sexp_to_c_state st;
+	if (sexp_to_c_init_state(&st, NULL))
+		return VALUE_ERROR;
+
+	int res = sexp_to_c_statement(&st, sexp);
+	if (res == 0)
+		res = sexp_to_c_finish(&st, stream);
+	sexp_to_c_clear_state(&st);
+	return res;
+}
+
+/*
+ * Writes a shared object for the JIT that contains the user-defined function
+ * (fun). The object exports sexp_to_c_jit_init(), which sets up the constants,
+ * and sexp_to_c_jit_entry(), which is the function itself. Calls to other
+ * user-defined functions go back through the interpreter.
+ */
+int sexp_to_c_jit(FILE *stream, value fun)
+{
+	struct sexp_to_c_state st;
+	if (sexp_to_c_init_state(&st, NULL))
+		return VALUE_ERROR;
+	st.jit_p = TRUE;
+
+	value var = value_set_str(fun.core.u_udf->name ? fun.core.u_udf->name : "lambda");
+	var.type = VALUE_VAR;
+	int res = sexp_to_c_udf(&st, var, fun.core.u_udf);
+	if (res == 0)
+		res = sexp_to_c_finish(&st, stream);
+	value_clear(&var);
+	sexp_to_c_clear_state(&st);
+	return res;
+}
+
+int sexp_to_c_init_state(struct sexp_to_c_state *st, char *source)
+{
+	st->functions = tmpfile();
+	st->init = tmpfile();
+	if (st->functions == NULL || st->init == NULL) {
+		value_error(1, "IO Error: Could not create a temporary file.");
+		if (st->functions) fclose(st->functions);
+		if (st->init) fclose(st->init);
+		return VALUE_ERROR;
+	}
+
+	if (sexp_to_c_begin_function(&st->main, FALSE)) {
+		fclose(st->functions);
+		fclose(st->init);
+		return VALUE_ERROR;
+	}
+
+	st->constants = 0;
+	st->builtins = value_init(VALUE_ARY);
+	st->udfs = value_init(VALUE_ARY);
+	st->globals = value_init(VALUE_ARY);
+	st->fn = &st->main;
+	st->source = source;
+	st->jit_p = FALSE;
+	return 0;
+}
+
+int sexp_to_c_clear_state(struct sexp_to_c_state *st)
+{
+	fclose(st->functions);
+	fclose(st->init);
+	if (st->main.code)
+		fclose(st->main.code);
+	value_clear(&st->main.locals);
+	value_clear(&st->builtins);
+	value_clear(&st->udfs);
+	value_clear(&st->globals);
+	return 0;
+}
+
+/*
+ * Writes the whole program to (out). The file-scope declarations come first,
+ * followed by the compiled functions, the function that sets up the constants
+ * and main().
+ */
+int sexp_to_c_finish(struct sexp_to_c_state *st, FILE *out)
+{
+	size_t i;
+
+	if (st->jit_p)
+		fprintf(out, "/*\n * Compiled by the simfpl JIT.\n */\n\n");
+	else fprintf(out, "/*\n * Compiled from %s by simfpl.\n */\n\n", st->source ? st->source : "an s-expression");
+	fprintf(out, "#include \"sexp_to_c.h\"\n\n");
+
+	for (i = 0; i < st->constants; ++i)
+		fprintf(out, "static value c%d;\n", (int) i);
+	for (i = 0; i < st->builtins.core.u_a.length; ++i)
+		fprintf(out, "static value (*f%d)(int argc, value argv[]);\n", (int) i);
+	for (i = 0; i < st->globals.core.u_a.length; ++i)
+		fprintf(out, "static value %s;\n", st->globals.core.u_a.a[i].core.u_a.a[1].core.u_s);
+	for (i = 0; i < st->udfs.core.u_a.length; ++i)
+		fprintf(out, "static value %s(int argc, value argv[]);\n", st->udfs.core.u_a.a[i].core.u_a.a[1].core.u_s);
+	fprintf(out, "\n");
+
+	if (st->jit_p) {
+		sexp_to_c_copy(out, st->functions);
+		fprintf(out, "int sexp_to_c_jit_init(void)\n{\n");
+		sexp_to_c_copy(out, st->init);
+		fprintf(out, "\treturn 0;\n}\n\n");
+		fprintf(out, "value sexp_to_c_jit_entry(int argc, value argv[])\n{\n");
+		fprintf(out, "\treturn %s(argc, argv);\n}\n", st->udfs.core.u_a.a[0].core.u_a.a[1].core.u_s);
+		return ferror(out) ? VALUE_ERROR : 0;
+	}
+
+	st->fn = &st->main;
+	if (sexp_to_c_end_function(st, "static value run_program(void)", 0))
+		return VALUE_ERROR;
+	sexp_to_c_copy(out, st->functions);
+
+	fprintf(out, "static int init_program(void)\n{\n");
+	sexp_to_c_copy(out, st->init);
+	fprintf(out, "\treturn 0;\n}\n\n");
+
+	fprintf(out, "int main(int argc, char *argv[])\n{\n");
+	fprintf(out, "\tvalue res;\n\t\n");
+	fprintf(out, "\tinit_tools();\n\tinit_values();\n\tinit_evaluator();\n\tinit_interpreter();\n\tinit_sexp_to_c();\n");
+	fprintf(out, "\tif (init_program())\n\t\treturn 1;\n\t\n");
+	fprintf(out, "\tres = run_program();\n");
+	fprintf(out, "\treturn res.type == VALUE_ERROR;\n}\n");
+
+	return ferror(out) ? VALUE_ERROR : 0;
+}
+
+int sexp_to_c_statement(struct sexp_to_c_state *st, value sexp)
+{
+	st->fn = &st->main;
+
+	if (sexp.type == VALUE_BLK && sexp.core.u_blk.length > 0 && sexp.core.u_blk.a[0].type == VALUE_BIF) {
+		value (*f)(int argc, value argv[]) = sexp.core.u_blk.a[0].core.u_bif->f;
+		if (f == &value_def_arg)
+			return sexp_to_c_def(st, sexp);
+
+		// A sequence at the top level may contain definitions, so each part is
+		// compiled as its own statement.
+		if (f == &value_do_both_arg || f == &value_do_all_arg) {
+			size_t i;
+			for (i = 1; i < sexp.core.u_blk.length; ++i)
+				if (sexp_to_c_statement(st, sexp.core.u_blk.a[i]))
+					return VALUE_ERROR;
+			return 0;
+		}
+	}
+
+	// Declare every variable that the statement assigns to first, so that a loop can
+	// read a variable before the assignment that comes later in its body.
+	if (sexp_to_c_collect_locals(st, sexp))
+		return VALUE_ERROR;
+
+	int target = sexp_to_c_temp(st);
+	if (sexp_to_c_into(st, sexp, target))
+		return VALUE_ERROR;
+	sexp_to_c_line(st, "value_clear(&t%d);", target);
 	return 0;
 }
 
-int run_me()
+/*
+ * Defines the function while compiling, the same way the interpreter does, so
+ * that the statements after it are read with the function's name. Then the
+ * function's body is compiled into a C function.
+ */
+int sexp_to_c_def(struct sexp_to_c_state *st, value sexp)
+{
+	if (sexp.core.u_blk.length < 4)
+		return sexp_to_c_unsupported(sexp);
+
+	value name = sexp.core.u_blk.a[1];
+	value var;
+	if (name.type == VALUE_BIF) {
+		var = value_hash_get(primitive_names, name);
+	} else if ((name.type == VALUE_UDF || name.type == VALUE_UDF_SHELL) && name.core.u_udf->name) {
+		var = value_set_str(name.core.u_udf->name);
+		var.type = VALUE_VAR;
+	} else if (name.type == VALUE_VAR) {
+		var = value_set(name);
+	} else return sexp_to_c_unsupported(sexp);
+
+	value res = eval(&outer_variables, sexp);
+	if (res.type == VALUE_ERROR) {
+		value_clear(&var);
+		return VALUE_ERROR;
+	}
+	value_clear(&res);
+
+	value *fun = value_hash_get_ref(ud_functions, var);
+	if (fun == NULL || fun->type != VALUE_UDF) {
+		value_clear(&var);
+		return sexp_to_c_unsupported(sexp);
+	}
+
+	int error_p = sexp_to_c_udf(st, var, fun->core.u_udf);
+	value_clear(&var);
+	return error_p;
+}
+
+/*
+ * Compiles the user-defined function (udf), which is named (var), into a C
+ * function.
+ */
+int sexp_to_c_udf(struct sexp_to_c_state *st, value var, struct value_function *udf)
+{
+	if (udf->spec.generator_p || udf->spec.delay_eval_p || udf->spec.change_scope_p == FALSE || udf->memo) {
+		value_error(1, "Compile Error: %s can't be compiled because it's a generator or uses :keep_scope or :delay_eval.", var);
+		return VALUE_ERROR;
+	}
+
+	// A function that's defined again gets a new C name, since the calls that were
+	// compiled before still refer to the old one.
+	char cname[BUFSIZE];
+	char header[BUFSIZE];
+	char buffer[BUFSIZE];
+	if (sexp_to_c_name(cname, "u_", var.core.u_var))
+		return VALUE_ERROR;
+	size_t length = strlen(cname);
+	if ((sexp_to_c_lookup(st->udfs, var.core.u_var, buffer) >= 0 && 
+			snprintf(cname + length, BUFSIZE - length, "_%d", (int) st->udfs.core.u_a.length) >= BUFSIZE - length) || 
+			snprintf(header, BUFSIZE, "static value %s(int argc, value argv[])", cname) >= BUFSIZE) {
+		value_error(1, "Compile Error: the name %s is too long.", var);
+		return VALUE_ERROR;
+	}
+
+	value row = value_init(VALUE_ARY);
+	value_append_now(&row, var);
+	value tmp = value_set_str(cname);
+	value_append_now2(&row, &tmp);
+	tmp = value_set_long(udf->spec.argc);
+	value_append_now2(&row, &tmp);
+	value_append_now2(&st->udfs, &row);
+
+	struct sexp_to_c_function fn;
+	if (sexp_to_c_begin_function(&fn, TRUE))
+		return VALUE_ERROR;
+	st->fn = &fn;
+
+	size_t i;
+	int error_p = FALSE;
+	for (i = 0; i < udf->vars.core.u_blk.length; ++i)
+		sexp_to_c_variable(st, udf->vars.core.u_blk.a[i], TRUE, buffer);
+
+	if (sexp_to_c_collect_locals(st, udf->body) || sexp_to_c_into(st, udf->body, fn.result))
+		error_p = TRUE;
+
+	if (error_p == FALSE)
+		error_p = sexp_to_c_end_function(st, header, udf->spec.argc) != 0;
+	else fclose(fn.code);
+
+	value_clear(&fn.locals);
+	st->fn = &st->main;
+	return error_p ? VALUE_ERROR : 0;
+}
+
+int sexp_to_c_begin_function(struct sexp_to_c_function *fn, int udf_p)
+{
+	fn->code = tmpfile();
+	if (fn->code == NULL) {
+		value_error(1, "IO Error: Could not create a temporary file.");
+		return VALUE_ERROR;
+	}
+
+	fn->locals = value_init(VALUE_ARY);
+	fn->udf_p = udf_p;
+	fn->temps = 1;
+	fn->bools = fn->iters = 0;
+	fn->result = 0;
+	fn->loop_result = -1;
+	fn->loop_depth = 0;
+	fn->depth = 1;
+	return 0;
+}
+
+/*
+ * Writes the function being compiled to st->functions, with its declarations
+ * before the code and the cleanup after it. The first (argc) locals are the
+ * arguments, which the function takes ownership of.
+ */
+int sexp_to_c_end_function(struct sexp_to_c_state *st, char *header, int argc)
+{
+	struct sexp_to_c_function *fn = st->fn;
+	FILE *out = st->functions;
+	size_t i;
+
+	fprintf(out, "%s\n{\n", header);
+	for (i = 0; i < fn->locals.core.u_a.length; ++i) {
+		char *name = fn->locals.core.u_a.a[i].core.u_a.a[1].core.u_s;
+		if (i < argc)
+			fprintf(out, "\tvalue %s = argv[%d];\n", name, (int) i);
+		else fprintf(out, "\tvalue %s = value_init_nil();\n", name);
+	}
+	for (i = 0; i < fn->temps; ++i)
+		fprintf(out, "\tvalue t%d = value_init_nil();\n", (int) i);
+	for (i = 0; i < fn->bools; ++i)
+		fprintf(out, "\tint b%d;\n", (int) i);
+	for (i = 0; i < fn->iters; ++i)
+		fprintf(out, "\tstruct sexp_to_c_iter i%d;\n", (int) i);
+	fprintf(out, "\t\n");
+	for (i = 0; i < fn->iters; ++i)
+		fprintf(out, "\tmemset(&i%d, 0, sizeof(i%d));\n", (int) i, (int) i);
+
+	sexp_to_c_copy(out, fn->code);
+	fclose(fn->code);
+	fn->code = NULL;
+
+	fprintf(out, "\tgoto done;\n");
+	fprintf(out, "fail:\n\tvalue_clear(&t%d);\n\tt%d = value_init_error();\n", fn->result, fn->result);
+	fprintf(out, "done:\n");
+	for (i = 0; i < fn->locals.core.u_a.length; ++i)
+		fprintf(out, "\tvalue_clear(&%s);\n", fn->locals.core.u_a.a[i].core.u_a.a[1].core.u_s);
+	for (i = 0; i < fn->temps; ++i)
+		if (i != fn->result)
+			fprintf(out, "\tvalue_clear(&t%d);\n", (int) i);
+	for (i = 0; i < fn->iters; ++i)
+		fprintf(out, "\tsexp_to_c_iter_clear(&i%d);\n", (int) i);
+	fprintf(out, "\treturn t%d;\n}\n\n", fn->result);
+
+	return 0;
+}
+
+/*
+ * Declares every variable that (sexp) assigns to, including the variables of
+ * for loops.
+ */
+int sexp_to_c_collect_locals(struct sexp_to_c_state *st, value sexp)
+{
+	if (sexp.type != VALUE_BLK)
+		return 0;
+
+	char buffer[BUFSIZE];
+	size_t i, length = sexp.core.u_blk.length;
+
+	if (length > 1 && sexp.core.u_blk.a[0].type == VALUE_BIF) {
+		value (*f)(int argc, value argv[]) = sexp.core.u_blk.a[0].core.u_bif->f;
+		value var = sexp.core.u_blk.a[1];
+
+		// A def inside of a function is compiled as a call, which isn't supported,
+		// so its variables don't matter.
+		if (f == &value_def_arg)
+			return 0;
+
+		for (i = 0; sexp_to_c_assignments[i].f; ++i)
+			if (f == sexp_to_c_assignments[i].f && var.type == VALUE_VAR)
+				sexp_to_c_variable(st, var, TRUE, buffer);
+
+		if (f == &value_for_arg && var.type == VALUE_BLK && var.core.u_blk.length > 0) {
+			value vars = var.core.u_blk.a[0];
+			if (vars.type == VALUE_VAR)
+				sexp_to_c_variable(st, vars, TRUE, buffer);
+			else if (vars.type == VALUE_BLK)
+				for (i = 0; i < vars.core.u_blk.length; ++i)
+					if (vars.core.u_blk.a[i].type == VALUE_VAR)
+						sexp_to_c_variable(st, vars.core.u_blk.a[i], TRUE, buffer);
+		}
+	}
+
+	for (i = 0; i < length; ++i)
+		if (sexp_to_c_collect_locals(st, sexp.core.u_blk.a[i]))
+			return VALUE_ERROR;
+
+	return 0;
+}
+
+/*
+ * Writes code that evaluates (sexp) and stores the result in temporary
+ * (target). Returns 0 on success or VALUE_ERROR if (sexp) can't be compiled.
+ */
+int sexp_to_c_into(struct sexp_to_c_state *st, value sexp, int target)
+{
+	char name[BUFSIZE];
+
+	if (sexp.type == VALUE_NIL) {
+		sexp_to_c_line(st, "value_clear(&t%d);", target);
+		return 0;
+	}
+
+	if (sexp.type != VALUE_BLK) {
+		int kind = sexp_to_c_operand(st, sexp, name);
+		if (kind == VALUE_ERROR)
+			return VALUE_ERROR;
+		sexp_to_c_line(st, "value_clear(&t%d);", target);
+		sexp_to_c_line(st, "t%d = value_set(%s);", target, name);
+		return 0;
+	}
+
+	size_t length = sexp.core.u_blk.length;
+	if (length == 0) {
+		sexp_to_c_line(st, "value_clear(&t%d);", target);
+		return 0;
+	}
+
+	value first = sexp.core.u_blk.a[0];
+	if (first.type == VALUE_BIF)
+		return sexp_to_c_bif(st, sexp, target);
+	if (first.type == VALUE_UDF || first.type == VALUE_UDF_SHELL)
+		return sexp_to_c_udfcall(st, sexp, target);
+	if (length == 1)
+		return sexp_to_c_into(st, first, target);
+
+	value_error(1, "Syntax Error: S-expressions are undefined where the first element is %ts.", first);
+	return VALUE_ERROR;
+}
+
+/*
+ * Makes the value of (sexp) available under a C name, which is written to
+ * (name). Returns 1 if the name is a temporary that the caller has to clear, 2 if
+ * it's a variable, 0 if it's a constant or VALUE_ERROR.
+ */
+int sexp_to_c_operand(struct sexp_to_c_state *st, value sexp, char *name)
+{
+	if (sexp.type == VALUE_VAR)
+		return sexp_to_c_variable(st, sexp, FALSE, name) ? VALUE_ERROR : 2;
+
+	if (sexp.type != VALUE_BLK)
+		return sexp_to_c_constant(st, sexp, name) ? VALUE_ERROR : 0;
+
+	int target = sexp_to_c_temp(st);
+	if (sexp_to_c_into(st, sexp, target))
+		return VALUE_ERROR;
+	sprintf(name, "t%d", target);
+	return 1;
+}
+
+/*
+ * Writes code that evaluates (sexp), and writes a C expression that's true if the
+ * result is true to (test).
+ */
+int sexp_to_c_truth(struct sexp_to_c_state *st, value sexp, char *test)
+{
+	char name[BUFSIZE];
+
+	int kind = sexp_to_c_operand(st, sexp, name);
+	if (kind == VALUE_ERROR)
+		return VALUE_ERROR;
+	if (kind == 1)
+		sprintf(test, "sexp_to_c_test(&%s)", name);
+	else sprintf(test, "value_true_p(%s)", name);
+	return 0;
+}
+
+int sexp_to_c_bif(struct sexp_to_c_state *st, value sexp, int target)
+{
+	value (*f)(int argc, value argv[]) = sexp.core.u_blk.a[0].core.u_bif->f;
+	size_t i;
+
+	if (f == &value_do_both_arg || f == &value_do_all_arg) {
+		if (sexp.core.u_blk.length == 1)
+			sexp_to_c_line(st, "value_clear(&t%d);", target);
+		for (i = 1; i < sexp.core.u_blk.length; ++i)
+			if (sexp_to_c_into(st, sexp.core.u_blk.a[i], target))
+				return VALUE_ERROR;
+		return 0;
+	}
+
+	if (f == &value_if_arg || f == &value_unless_arg)
+		return sexp_to_c_if(st, sexp, target, f == &value_unless_arg);
+	if (f == &value_while_arg || f == &value_until_arg)
+		return sexp_to_c_while(st, sexp, target, f == &value_until_arg);
+	if (f == &value_for_arg)
+		return sexp_to_c_for(st, sexp, target);
+	if (f == &value_switch_arg)
+		return sexp_to_c_switch(st, sexp, target);
+	if (f == &value_and_p_arg || f == &value_or_p_arg)
+		return sexp_to_c_logical(st, sexp, target, f == &value_or_p_arg);
+	if (f == &value_break_arg || f == &value_continue_arg || f == &value_return_arg || f == &value_yield_arg || f == &value_exit_arg)
+		return sexp_to_c_jump(st, sexp, target);
+
+	for (i = 0; sexp_to_c_assignments[i].f; ++i)
+		if (f == sexp_to_c_assignments[i].f)
+			return sexp_to_c_assign(st, sexp, target, sexp_to_c_assignments[i].op);
+
+	return sexp_to_c_call(st, sexp, target);
+}
+
+/*
+ * Calls a built-in function with its arguments in an array, like
+ * value_bifcall_sexp() does.
+ */
+int sexp_to_c_call(struct sexp_to_c_state *st, value sexp, int target)
+{
+	value bif = sexp.core.u_blk.a[0];
+	struct value_spec spec = bif.core.u_bif->spec;
+	size_t i, j, length = sexp.core.u_blk.length;
+
+	if (spec.delay_eval_p || spec.keep_arg_p || spec.needs_variables_p == NEEDS_UD_FUNCTIONS)
+		return sexp_to_c_unsupported(sexp);
+
+	int argc = spec.argc;
+	if (spec.rest_p && length - 1 > argc)
+		argc = length - 1;
+	if (length - 1 > argc) {
+		value_error(1, "Argument Error: In %s, %d extra arguments (%d expected, %d found).", bif, (int) (length - 1 - argc), argc, (int) (length - 1));
+		return VALUE_ERROR;
+	}
+
+	int necessary_length = argc + (spec.needs_variables_p ? 1 : 0);
+	char names[necessary_length + 1][BUFSIZE];
+	int kinds[necessary_length + 1];
+
+	char fname[BUFSIZE];
+	if (sexp_to_c_builtin_name(st, bif, fname))
+		return VALUE_ERROR;
+
+	j = 0;
+	if (spec.needs_variables_p) {
+		strcpy(names[j], "value_refer(&sexp_to_c_variables)");
+		kinds[j++] = 0;
+	}
+	for (i = 1; i < length; ++i, ++j)
+		if ((kinds[j] = sexp_to_c_operand(st, sexp.core.u_blk.a[i], names[j])) == VALUE_ERROR)
+			return VALUE_ERROR;
+	size_t count = j;
+
+	sexp_to_c_line(st, "{");
+	++st->fn->depth;
+	sexp_to_c_line(st, "value a[%d];", necessary_length > 0 ? necessary_length : 1);
+	for (j = 0; j < count; ++j)
+		if (kinds[j] == 1)
+			sexp_to_c_line(st, "a[%d] = sexp_to_c_take(&%s);", (int) j, names[j]);
+		else sexp_to_c_line(st, "a[%d] = %s;", (int) j, names[j]);
+	for (; j < necessary_length; ++j)
+		sexp_to_c_line(st, "a[%d].type = %s;", (int) j, j < spec.optional ? "VALUE_MISSING_ARG" : "VALUE_NIL");
+	sexp_to_c_line(st, "value_clear(&t%d);", target);
+	sexp_to_c_line(st, "t%d = %s(%d, a);", target, fname, (int) j);
+
+	// Copy variables back in case the function changed them in place.
+	for (j = 0; j < count; ++j)
+		if (kinds[j] == 2)
+			sexp_to_c_line(st, "%s = a[%d];", names[j], (int) j);
+		else if (kinds[j] == 1)
+			sexp_to_c_line(st, "value_clear(&a[%d]);", (int) j);
+	--st->fn->depth;
+	sexp_to_c_line(st, "}");
+	sexp_to_c_line(st, "if (t%d.type == VALUE_ERROR) goto fail;", target);
+	return 0;
+}
+
+int sexp_to_c_udfcall(struct sexp_to_c_state *st, value sexp, int target)
 {
+	char *name = sexp.core.u_blk.a[0].core.u_udf->name;
+	char fname[BUFSIZE];
+	size_t i, length = sexp.core.u_blk.length;
+
+	int row = name ? sexp_to_c_lookup(st->udfs, name, fname) : -1;
+	if (row < 0 && st->jit_p && name) {
+		// The JIT compiles one function at a time, so the others are called
+		// by name.
+		int args[length];
+		for (i = 1; i < length; ++i) {
+			args[i] = sexp_to_c_temp(st);
+			if (sexp_to_c_into(st, sexp.core.u_blk.a[i], args[i]))
+				return VALUE_ERROR;
+		}
+
+		sexp_to_c_line(st, "{");
+		++st->fn->depth;
+		sexp_to_c_line(st, "value a[%d];", (int) length);
+		for (i = 1; i < length; ++i)
+			sexp_to_c_line(st, "a[%d] = sexp_to_c_take(&t%d);", (int) i-1, args[i]);
+		sexp_to_c_line(st, "value_clear(&t%d);", target);
+		for (i = 0; i < st->fn->depth; ++i)
+			fputc('\t', st->fn->code);
+		fprintf(st->fn->code, "t%d = sexp_to_c_call_udf(", target);
+		sexp_to_c_write_string(st->fn->code, name);
+		fprintf(st->fn->code, ", %d, a);\n", (int) length-1);
+		--st->fn->depth;
+		sexp_to_c_line(st, "}");
+		sexp_to_c_line(st, "if (t%d.type == VALUE_ERROR) goto fail;", target);
+		return 0;
+	}
+	if (row < 0) {
+		value_error(1, "Compile Error: %ts can't be compiled because it isn't defined by the program.", sexp.core.u_blk.a[0]);
+		return VALUE_ERROR;
+	}
+
+	int argc = mpz_get_si(st->udfs.core.u_a.a[row].core.u_a.a[2].core.u_mz);
+	if (length - 1 < argc) {
+		value_error(1, "Argument Error: In %c, %d missing arguments (%d expected, %d found).", name, (int) (argc - length + 1), argc, (int) (length - 1));
+		return VALUE_ERROR;
+	}
+
+	int args[argc + 1];
+	for (i = 0; i < argc; ++i) {
+		args[i] = sexp_to_c_temp(st);
+		if (sexp_to_c_into(st, sexp.core.u_blk.a[i+1], args[i]))
+			return VALUE_ERROR;
+	}
 
-return 0;
-}
\ No newline at end of file
+	sexp_to_c_line(st, "{");
+	++st->fn->depth;
+	sexp_to_c_line(st, "value a[%d];", argc > 0 ? argc : 1);
+	for (i = 0; i < argc; ++i)
+		sexp_to_c_line(st, "a[%d] = sexp_to_c_take(&t%d);", (int) i, args[i]);
+	sexp_to_c_line(st, "value_clear(&t%d);", target);
+	sexp_to_c_line(st, "t%d = %s(%d, a);", target, fname, argc);
+	--st->fn->depth;
+	sexp_to_c_line(st, "}");
+	sexp_to_c_line(st, "if (t%d.type == VALUE_ERROR) goto fail;", target);
+	return 0;
+}
+
+int sexp_to_c_if(struct sexp_to_c_state *st, value sexp, int target, int reverse)
+{
+	char test[BUFSIZE];
+
+	if (sexp.core.u_blk.length < 3)
+		return sexp_to_c_unsupported(sexp);
+
+	if (sexp_to_c_truth(st, sexp.core.u_blk.a[1], test))
+		return VALUE_ERROR;
+	sexp_to_c_line(st, reverse ? "if (!%s) {" : "if (%s) {", test);
+	++st->fn->depth;
+	if (sexp_to_c_into(st, sexp.core.u_blk.a[2], target))
+		return VALUE_ERROR;
+	--st->fn->depth;
+	sexp_to_c_line(st, "} else {");
+	++st->fn->depth;
+	if (sexp.core.u_blk.length > 3) {
+		if (sexp_to_c_into(st, sexp.core.u_blk.a[3], target))
+			return VALUE_ERROR;
+	} else sexp_to_c_line(st, "value_clear(&t%d);", target);
+	--st->fn->depth;
+	sexp_to_c_line(st, "}");
+	return 0;
+}
+
+int sexp_to_c_while(struct sexp_to_c_state *st, value sexp, int target, int reverse)
+{
+	struct sexp_to_c_function *fn = st->fn;
+	char test[BUFSIZE];
+
+	if (sexp.core.u_blk.length < 3)
+		return sexp_to_c_unsupported(sexp);
+
+	int saved_result = fn->loop_result;
+	int body = sexp_to_c_temp(st);
+	fn->loop_result = target;
+	++fn->loop_depth;
+
+	sexp_to_c_line(st, "value_clear(&t%d);", target);
+	sexp_to_c_line(st, "while (1) {");
+	++fn->depth;
+	if (sexp_to_c_truth(st, sexp.core.u_blk.a[1], test))
+		return VALUE_ERROR;
+	sexp_to_c_line(st, reverse ? "if (%s) break;" : "if (!%s) break;", test);
+	if (sexp_to_c_into(st, sexp.core.u_blk.a[2], body))
+		return VALUE_ERROR;
+	sexp_to_c_line(st, "value_clear(&t%d);", body);
+	--fn->depth;
+	sexp_to_c_line(st, "}");
+
+	fn->loop_result = saved_result;
+	--fn->loop_depth;
+	return 0;
+}
+
+int sexp_to_c_for(struct sexp_to_c_state *st, value sexp, int target)
+{
+	struct sexp_to_c_function *fn = st->fn;
+	char name1[BUFSIZE], name2[BUFSIZE], test[BUFSIZE];
+	value vars[2];
+	int varc = 0;
+	size_t i;
+
+	if (sexp.core.u_blk.length < 3)
+		return sexp_to_c_unsupported(sexp);
+
+	value condition = sexp.core.u_blk.a[1];
+	if (condition.type != VALUE_BLK) {
+		value_error(1, "Type Error: for() is undefined where condition is %ts (block expected).", condition);
+		return VALUE_ERROR;
+	}
+
+	size_t length = condition.core.u_blk.length;
+	if (length < 3) {
+		value_error(1, "Error: for() is undefined where the condition contains fewer than three words.");
+		return VALUE_ERROR;
+	}
+
+	if (condition.core.u_blk.a[0].type == VALUE_VAR) {
+		vars[varc++] = condition.core.u_blk.a[0];
+	} else if (condition.core.u_blk.a[0].type == VALUE_BLK) {
+		value names = condition.core.u_blk.a[0];
+		for (i = 0; i < names.core.u_blk.length; ++i) {
+			if (names.core.u_blk.a[i].type != VALUE_VAR || varc == 2)
+				return sexp_to_c_unsupported(sexp);
+			vars[varc++] = names.core.u_blk.a[i];
+		}
+		if (varc == 0)
+			return sexp_to_c_unsupported(sexp);
+	} else {
+		value_error(1, "Error: Undefined syntax for loop's condition %s. No variable found.", condition);
+		return VALUE_ERROR;
+	}
+
+	value symbol = condition.core.u_blk.a[1];
+	int dotimes_p;
+	if (symbol.type == VALUE_SYM && value_eq(symbol, value_symbol_in))
+		dotimes_p = FALSE;
+	else if (symbol.type == VALUE_SYM && value_eq(symbol, value_symbol_dotimes))
+		dotimes_p = TRUE;
+	else return sexp_to_c_unsupported(sexp);
+
+	size_t ifs_position = length;
+	while (ifs_position >= 5 && value_eq(condition.core.u_blk.a[ifs_position-2], value_symbol_if))
+		ifs_position -= 2;
+
+	if (sexp_to_c_variable(st, vars[0], TRUE, name1))
+		return VALUE_ERROR;
+	if (varc > 1 && sexp_to_c_variable(st, vars[1], TRUE, name2))
+		return VALUE_ERROR;
+
+	int iterable = sexp_to_c_temp(st);
+	int body = sexp_to_c_temp(st);
+	int iter = fn->iters++;
+	if (sexp_to_c_into(st, condition.core.u_blk.a[2], iterable))
+		return VALUE_ERROR;
+	sexp_to_c_line(st, "if (sexp_to_c_iter_init(&i%d, t%d, %d) == VALUE_ERROR) goto fail;", iter, iterable, dotimes_p);
+	sexp_to_c_line(st, "value_clear(&t%d);", target);
+
+	int saved_result = fn->loop_result;
+	fn->loop_result = target;
+	++fn->loop_depth;
+
+	if (varc > 1)
+		sexp_to_c_line(st, "while (sexp_to_c_iter_next(&i%d, &%s, &%s)) {", iter, name1, name2);
+	else sexp_to_c_line(st, "while (sexp_to_c_iter_next(&i%d, &%s, NULL)) {", iter, name1);
+	++fn->depth;
+	for (i = length; i > ifs_position; i -= 2) {
+		if (sexp_to_c_truth(st, condition.core.u_blk.a[i-1], test))
+			return VALUE_ERROR;
+		sexp_to_c_line(st, "if (!%s) continue;", test);
+	}
+	if (sexp_to_c_into(st, sexp.core.u_blk.a[2], body))
+		return VALUE_ERROR;
+	sexp_to_c_line(st, "value_clear(&t%d);", body);
+	--fn->depth;
+	sexp_to_c_line(st, "}");
+
+	fn->loop_result = saved_result;
+	--fn->loop_depth;
+
+	sexp_to_c_line(st, "if (i%d.error_p) goto fail;", iter);
+	sexp_to_c_line(st, "sexp_to_c_iter_clear(&i%d);", iter);
+	sexp_to_c_line(st, "value_clear(&t%d);", iterable);
+	return 0;
+}
+
+/*
+ * A switch becomes a chain of if statements. When it compares against a value,
+ * each case has to be a constant, just as value_switch() compares against the
+ * case without evaluating it.
+ */
+int sexp_to_c_switch(struct sexp_to_c_state *st, value sexp, int target)
+{
+	struct sexp_to_c_function *fn = st->fn;
+	char cmp[BUFSIZE], test[BUFSIZE];
+	value val = sexp.core.u_blk.length > 1 ? sexp.core.u_blk.a[1] : value_nil;
+	value body = sexp.core.u_blk.length > 2 ? sexp.core.u_blk.a[2] : value_nil;
+	int compare_p = TRUE;
+	int kind = 0;
+
+	if (body.type == VALUE_NIL) {
+		compare_p = FALSE;
+		body = val;
+	}
+
+	if (body.type != VALUE_BLK) {
+		value_error(1, "Type Error: switch() is undefined where body is %ts (block expected).", body);
+		return VALUE_ERROR;
+	}
+
+	if (compare_p && (kind = sexp_to_c_operand(st, val, cmp)) == VALUE_ERROR)
+		return VALUE_ERROR;
+
+	value vdefault = value_nil;
+	int default_defined = FALSE;
+	int opened = 0;
+	size_t i, length = body.core.u_blk.length;
+
+	for (i = 0; i < length; ++i) {
+		value x = body.core.u_blk.a[i];
+		if (x.type == VALUE_SYM && streq(x.core.u_s, "if")) {
+			if (i + 2 >= length)
+				return sexp_to_c_unsupported(sexp);
+			++i;
+			if (compare_p) {
+				if (body.core.u_blk.a[i].type == VALUE_BLK)
+					return sexp_to_c_unsupported(sexp);
+				if (sexp_to_c_constant(st, body.core.u_blk.a[i], test))
+					return VALUE_ERROR;
+				sexp_to_c_line(st, "if (value_eq(%s, %s)) {", test, cmp);
+			} else {
+				if (sexp_to_c_truth(st, body.core.u_blk.a[i], test))
+					return VALUE_ERROR;
+				sexp_to_c_line(st, "if (%s) {", test);
+			}
+			++fn->depth;
+			if (sexp_to_c_into(st, body.core.u_blk.a[++i], target))
+				return VALUE_ERROR;
+			--fn->depth;
+			sexp_to_c_line(st, "} else {");
+			++fn->depth;
+			++opened;
+
+		} else if (x.type == VALUE_SYM && streq(x.core.u_s, "else")) {
+			if (default_defined) {
+				value_error(1, "Error: In switch(), multiple :else symbols found.");
+				return VALUE_ERROR;
+			}
+			default_defined = TRUE;
+			if (++i >= length) break;
+			vdefault = body.core.u_blk.a[i];
+		}
+	}
+
+	if (sexp_to_c_into(st, vdefault, target))
+		return VALUE_ERROR;
+	while (opened--) {
+		--fn->depth;
+		sexp_to_c_line(st, "}");
+	}
+
+	if (kind == 1)
+		sexp_to_c_line(st, "value_clear(&%s);", cmp);
+	return 0;
+}
+
+int sexp_to_c_logical(struct sexp_to_c_state *st, value sexp, int target, int or_p)
+{
+	char test[BUFSIZE];
+
+	if (sexp.core.u_blk.length < 3)
+		return sexp_to_c_unsupported(sexp);
+
+	int b = st->fn->bools++;
+	if (sexp_to_c_truth(st, sexp.core.u_blk.a[1], test))
+		return VALUE_ERROR;
+	sexp_to_c_line(st, "b%d = %s;", b, test);
+	sexp_to_c_line(st, or_p ? "if (!b%d) {" : "if (b%d) {", b);
+	++st->fn->depth;
+	if (sexp_to_c_truth(st, sexp.core.u_blk.a[2], test))
+		return VALUE_ERROR;
+	sexp_to_c_line(st, "b%d = %s;", b, test);
+	--st->fn->depth;
+	sexp_to_c_line(st, "}");
+	sexp_to_c_line(st, "value_clear(&t%d);", target);
+	sexp_to_c_line(st, "t%d = value_set_bool(b%d);", target, b);
+	return 0;
+}
+
+/*
+ * Compiles =, or an assignment operator like += if (op) is the name of the
+ * function that performs the operation.
+ */
+int sexp_to_c_assign(struct sexp_to_c_state *st, value sexp, int target, char *op)
+{
+	char name[BUFSIZE], arg[BUFSIZE];
+
+	if (sexp.core.u_blk.length < 3)
+		return sexp_to_c_unsupported(sexp);
+
+	value var = sexp.core.u_blk.a[1];
+	if (var.type != VALUE_VAR) {
+		value_error(1, "Type Error: assignment is undefined where the variable is %ts (variable expected).", var);
+		return VALUE_ERROR;
+	}
+
+	if (op == NULL) {
+		if (sexp_to_c_into(st, sexp.core.u_blk.a[2], target))
+			return VALUE_ERROR;
+		if (sexp_to_c_variable(st, var, TRUE, name))
+			return VALUE_ERROR;
+	} else {
+		if (sexp_to_c_variable(st, var, FALSE, name))
+			return VALUE_ERROR;
+		int kind = sexp_to_c_operand(st, sexp.core.u_blk.a[2], arg);
+		if (kind == VALUE_ERROR)
+			return VALUE_ERROR;
+		sexp_to_c_line(st, "value_clear(&t%d);", target);
+		sexp_to_c_line(st, "t%d = %s(%s, %s);", target, op, name, arg);
+		if (kind == 1)
+			sexp_to_c_line(st, "value_clear(&%s);", arg);
+		sexp_to_c_line(st, "if (t%d.type == VALUE_ERROR) goto fail;", target);
+	}
+
+	sexp_to_c_line(st, "value_clear(&%s);", name);
+	sexp_to_c_line(st, "%s = value_set(t%d);", name, target);
+	return 0;
+}
+
+int sexp_to_c_jump(struct sexp_to_c_state *st, value sexp, int target)
+{
+	struct sexp_to_c_function *fn = st->fn;
+	value (*f)(int argc, value argv[]) = sexp.core.u_blk.a[0].core.u_bif->f;
+
+	if (f == &value_exit_arg) {
+		sexp_to_c_line(st, "exit(0);");
+		return 0;
+	}
+
+	if (f == &value_break_arg || f == &value_continue_arg) {
+		if (fn->loop_depth == 0) {
+			value_error(1, "Compile Error: %s is outside of a loop.", sexp.core.u_blk.a[0]);
+			return VALUE_ERROR;
+		}
+		sexp_to_c_line(st, f == &value_break_arg ? "break;" : "continue;");
+		return 0;
+	}
+
+	if (sexp.core.u_blk.length < 2) {
+		value_error(1, "Argument Error: In %s, 1 missing argument (1 expected, 0 found).", sexp.core.u_blk.a[0]);
+		return VALUE_ERROR;
+	}
+
+	if (f == &value_return_arg) {
+		if (fn->udf_p == FALSE) {
+			value_error(1, "Compile Error: return is outside of a function.");
+			return VALUE_ERROR;
+		}
+		if (sexp_to_c_into(st, sexp.core.u_blk.a[1], fn->result))
+			return VALUE_ERROR;
+		sexp_to_c_line(st, "goto done;");
+		return 0;
+	}
+
+	// yield
+	if (fn->loop_result < 0) {
+		value_error(1, "Compile Error: yield is outside of a loop.");
+		return VALUE_ERROR;
+	}
+	int yielded = sexp_to_c_temp(st);
+	if (sexp_to_c_into(st, sexp.core.u_blk.a[1], yielded))
+		return VALUE_ERROR;
+	sexp_to_c_line(st, "sexp_to_c_yield(&t%d, &t%d);", fn->loop_result, yielded);
+	if (target != fn->loop_result)
+		sexp_to_c_line(st, "value_clear(&t%d);", target);
+	return 0;
+}
+
+int sexp_to_c_temp(struct sexp_to_c_state *st)
+{
+	return st->fn->temps++;
+}
+
+int sexp_to_c_line(struct sexp_to_c_state *st, char *format, ...)
+{
+	FILE *out = st->fn->code;
+	int i;
+	for (i = 0; i < st->fn->depth; ++i)
+		fputc('\t', out);
+
+	va_list ap;
+	va_start(ap, format);
+	vfprintf(out, format, ap);
+	va_end(ap);
+
+	fputc('\n', out);
+	return 0;
+}
+
+/*
+ * Turns (name) into a C identifier that starts with (prefix). Letters and digits
+ * are kept, an underscore is doubled and any other character becomes _ followed
+ * by its hex code, so two different names never collide.
+ */
+int sexp_to_c_name(char *buffer, char *prefix, char *name)
+{
+	char *ptr = buffer + snprintf(buffer, BUFSIZE, "%s", prefix);
+	char *end = buffer + BUFSIZE - 4;
+	char *start = name;
+
+	for (; *name && ptr < end; ++name) {
+		if (isalnum((unsigned char) *name)) {
+			*ptr++ = *name;
+		} else if (*name == '_') {
+			*ptr++ = '_';
+			*ptr++ = '_';
+		} else ptr += sprintf(ptr, "_%02x", (unsigned char) *name);
+	}
+
+	*ptr = '\0';
+	
+	// Cutting the name short could give two names the same C name.
+	if (*name) {
+		value_error(1, "Compile Error: the name %c is too long.", start);
+		return VALUE_ERROR;
+	}
+	return 0;
+}
+
+/*
+ * Finds the row of (table) whose first element is named (key) and copies its C
+ * name into (buffer). Returns the index of the row, or -1 if there is none. Later
+ * rows take precedence.
+ */
+int sexp_to_c_lookup(value table, char *key, char *buffer)
+{
+	size_t i;
+	for (i = table.core.u_a.length; i > 0; --i) {
+		value row = table.core.u_a.a[i-1];
+		if (streq(row.core.u_a.a[0].core.u_s, key)) {
+			strcpy(buffer, row.core.u_a.a[1].core.u_s);
+			return i-1;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Writes the C name of (var) to (buffer). If the variable hasn't been declared
+ * and (declare_p) is TRUE, declares it. A variable that's never assigned may still
+ * be one of the interpreter's global variables, which becomes a constant.
+ */
+int sexp_to_c_variable(struct sexp_to_c_state *st, value var, int declare_p, char *buffer)
+{
+	value *table = st->fn->udf_p ? &st->fn->locals : &st->globals;
+
+	if (sexp_to_c_lookup(*table, var.core.u_var, buffer) >= 0)
+		return 0;
+
+	if (declare_p == FALSE) {
+		if (value_hash_exists(global_variables, var)) {
+			sprintf(buffer, "c%d", st->constants++);
+			fprintf(st->init, "\tc%d = sexp_to_c_global(", st->constants - 1);
+			sexp_to_c_write_string(st->init, var.core.u_var);
+			fprintf(st->init, ");\n");
+			return 0;
+		}
+
+		value_error(1, "Error: Unrecognized function or value %s.", var);
+		return VALUE_ERROR;
+	}
+
+	if (sexp_to_c_name(buffer, "v_", var.core.u_var))
+		return VALUE_ERROR;
+
+	value row = value_init(VALUE_ARY);
+	value_append_now(&row, var);
+	value tmp = value_set_str(buffer);
+	value_append_now2(&row, &tmp);
+	value_append_now2(table, &row);
+	return 0;
+}
+
+int sexp_to_c_constant(struct sexp_to_c_state *st, value op, char *name)
+{
+	sprintf(name, "c%d", st->constants);
+	if (sexp_to_c_write_constant(st->init, op, name, 0))
+		return VALUE_ERROR;
+	++st->constants;
+	return 0;
+}
+
+/*
+ * Writes the C name of the built-in function (bif) to (name). The common ones
+ * are called directly; the rest are looked up by name when the program starts.
+ */
+int sexp_to_c_builtin_name(struct sexp_to_c_state *st, value bif, char *name)
+{
+	size_t i;
+	for (i = 0; sexp_to_c_direct_calls[i].f; ++i) {
+		if (bif.core.u_bif->f == sexp_to_c_direct_calls[i].f) {
+			strcpy(name, sexp_to_c_direct_calls[i].name);
+			return 0;
+		}
+	}
+
+	value *var = value_hash_get_ref(primitive_names, bif);
+	if (var == NULL || var->type != VALUE_VAR) {
+		value_error(1, "Compile Error: Built-in function %s has no name.", bif);
+		return VALUE_ERROR;
+	}
+
+	char *key = var->core.u_var;
+	for (i = 0; i < st->builtins.core.u_a.length; ++i) {
+		if (streq(st->builtins.core.u_a.a[i].core.u_s, key)) {
+			sprintf(name, "f%d", (int) i);
+			return 0;
+		}
+	}
+
+	sprintf(name, "f%d", (int) i);
+	value tmp = value_set_str(key);
+	value_append_now2(&st->builtins, &tmp);
+	fprintf(st->init, "\tif ((%s = sexp_to_c_builtin(", name);
+	sexp_to_c_write_string(st->init, key);
+	fprintf(st->init, ")) == NULL)\n\t\treturn 1;\n");
+	return 0;
+}
+
+/*
+ * Writes code that sets (lvalue) to a copy of (op). Containers are built up in
+ * a nested block using scratch variables named after (level).
+ */
+int sexp_to_c_write_constant(FILE *out, value op, char *lvalue, int level)
+{
+	char element[BUFSIZE], other[BUFSIZE];
+	size_t i, j;
+
+	switch (op.type) {
+	case VALUE_NIL:
+		fprintf(out, "\t%s = value_init_nil();\n", lvalue);
+		break;
+	case VALUE_BOO:
+		fprintf(out, "\t%s = value_set_bool(%d);\n", lvalue, op.core.u_b ? TRUE : FALSE);
+		break;
+	case VALUE_MPZ: {
+		char digits[mpz_sizeinbase(op.core.u_mz, 10) + 2];
+		mpz_get_str(digits, 10, op.core.u_mz);
+		fprintf(out, "\t%s = sexp_to_c_mpz(\"%s\");\n", lvalue, digits);
+		break;
+	}
+	case VALUE_MPF: {
+		// Hexadecimal digits represent the number exactly.
+		mpfr_exp_t exp;
+		char *digits = mpfr_get_str(NULL, &exp, 16, 0, op.core.u_mf, value_mpfr_round);
+		if (mpfr_number_p(op.core.u_mf)) {
+			int negative_p = digits[0] == '-';
+			fprintf(out, "\t%s = sexp_to_c_mpf(\"%s0.%s@%ld\", %ld);\n", lvalue, negative_p ? "-" : "", digits + negative_p, (long) exp, (long) mpfr_get_prec(op.core.u_mf));
+		} else fprintf(out, "\t%s = sexp_to_c_mpf(\"%s\", %ld);\n", lvalue, digits, (long) mpfr_get_prec(op.core.u_mf));
+		mpfr_free_str(digits);
+		break;
+	}
+	case VALUE_STR:
+	case VALUE_RGX:
+	case VALUE_SYM:
+	case VALUE_ID:
+	case VALUE_VAR:
+		fprintf(out, "\t%s = sexp_to_c_string(%d, ", lvalue, op.type);
+		sexp_to_c_write_string(out, op.core.u_s);
+		fprintf(out, ");\n");
+		break;
+	case VALUE_ARY:
+		sprintf(element, "e%d", level);
+		fprintf(out, "\t%s = value_init(VALUE_ARY);\n", lvalue);
+		for (i = 0; i < op.core.u_a.length; ++i) {
+			fprintf(out, "\t{\n\tvalue %s;\n", element);
+			if (sexp_to_c_write_constant(out, op.core.u_a.a[i], element, level+1))
+				return VALUE_ERROR;
+			fprintf(out, "\tvalue_append_now2(&%s, &%s);\n\t}\n", lvalue, element);
+		}
+		break;
+	case VALUE_PAR:
+		sprintf(element, "e%dh", level);
+		sprintf(other, "e%dt", level);
+		fprintf(out, "\t{\n\tvalue %s, %s;\n", element, other);
+		if (sexp_to_c_write_constant(out, op.core.u_p->head, element, level+1))
+			return VALUE_ERROR;
+		if (sexp_to_c_write_constant(out, op.core.u_p->tail, other, level+1))
+			return VALUE_ERROR;
+		fprintf(out, "\t%s = value_make_pair_refs(&%s, &%s);\n\t}\n", lvalue, element, other);
+		break;
+	case VALUE_HSH:
+		sprintf(element, "e%dk", level);
+		sprintf(other, "e%dv", level);
+		fprintf(out, "\t%s = value_hash_init();\n", lvalue);
+		for (i = 0; i < op.core.u_h->length; ++i) {
+			value bucket = op.core.u_h->a[i];
+			if (bucket.type != VALUE_ARY)
+				continue;
+			for (j = 0; j < bucket.core.u_a.length; ++j) {
+				value pair = bucket.core.u_a.a[j];
+				if (pair.type != VALUE_ARY || pair.core.u_a.length != 2)
+					continue;
+				fprintf(out, "\t{\n\tvalue %s, %s;\n", element, other);
+				if (sexp_to_c_write_constant(out, pair.core.u_a.a[0], element, level+1))
+					return VALUE_ERROR;
+				if (sexp_to_c_write_constant(out, pair.core.u_a.a[1], other, level+1))
+					return VALUE_ERROR;
+				fprintf(out, "\tvalue_hash_put_refs(&%s, &%s, &%s);\n\t}\n", lvalue, element, other);
+			}
+		}
+		break;
+	case VALUE_RNG:
+		sprintf(element, "e%dmin", level);
+		sprintf(other, "e%dmax", level);
+		fprintf(out, "\t{\n\tvalue %s, %s;\n", element, other);
+		if (sexp_to_c_write_constant(out, op.core.u_r->min, element, level+1))
+			return VALUE_ERROR;
+		if (sexp_to_c_write_constant(out, op.core.u_r->max, other, level+1))
+			return VALUE_ERROR;
+		fprintf(out, "\t%s = sexp_to_c_range(%s, %s, %d);\n\t}\n", lvalue, element, other, op.core.u_r->inclusive_p ? TRUE : FALSE);
+		break;
+	case VALUE_BIF: {
+		value *var = value_hash_get_ref(primitive_names, op);
+		if (var == NULL || var->type != VALUE_VAR)
+			return sexp_to_c_unsupported(op);
+		fprintf(out, "\t%s = sexp_to_c_builtin_value(", lvalue);
+		sexp_to_c_write_string(out, var->core.u_var);
+		fprintf(out, ");\n");
+		break;
+	}
+	default:
+		return sexp_to_c_unsupported(op);
+	}
+
+	return 0;
+}
+
+/*
+ * Writes (str) as a C string literal.
+ */
+int sexp_to_c_write_string(FILE *out, char *str)
+{
+	fputc('"', out);
+	for (; *str; ++str) {
+		unsigned char c = *str;
+		if (c == '"' || c == '\\' || c == '?')
+			fprintf(out, "\\%c", c);
+		else if (isprint(c))
+			fputc(c, out);
+		else fprintf(out, "\\%03o", c);
+	}
+	fputc('"', out);
+	return 0;
+}
+
+int sexp_to_c_unsupported(value sexp)
+{
+	if (sexp.type == VALUE_BLK && sexp.core.u_blk.length > 0)
+		sexp = sexp.core.u_blk.a[0];
+	value_error(1, "Compile Error: %s can't be compiled.", sexp);
+	return VALUE_ERROR;
+}
+
+int sexp_to_c_copy(FILE *out, FILE *in)
+{
+	int c;
+	rewind(in);
+	while ((c = fgetc(in)) != EOF)
+		fputc(c, out);
+	return 0;
+}
+
+/*
+ * Functions called by the generated code.
+ */
+
+value (*sexp_to_c_builtin(char *name))(int argc, value argv[])
+{
+	value key = value_set_id(name);
+	value *fun = value_hash_get_ref(primitive_funs, key);
+	value_clear(&key);
+
+	if (fun == NULL || fun->type != VALUE_BIF) {
+		value_error(1, "Error: Unrecognized built-in function %c.", name);
+		return NULL;
+	}
+
+	return fun->core.u_bif->f;
+}
+
+value sexp_to_c_builtin_value(char *name)
+{
+	value key = value_set_id(name);
+	value res = value_hash_get(primitive_funs, key);
+	value_clear(&key);
+	return res;
+}
+
+/*
+ * Calls the user-defined function named (name) with arguments that have already
+ * been evaluated. Takes ownership of the arguments.
+ */
+value sexp_to_c_call_udf(char *name, int argc, value argv[])
+{
+	value key = value_set_str(name);
+	key.type = VALUE_VAR;
+	value *fun = value_hash_get_ref(ud_functions, key);
+	value res;
+	int i;
+
+	if (fun == NULL || fun->type != VALUE_UDF) {
+		value_error(1, "Error: Unrecognized function or value %s.", key);
+		res = value_init_error();
+	} else if (fun->core.u_udf->jit && fun->core.u_udf->jit->state == JIT_NATIVE && argc >= fun->core.u_udf->spec.argc) {
+		value_clear(&key);
+		return value_jit_call_evaluated(*fun, argc, argv);
+	} else {
+		// The arguments are already values, so evaluating them again only copies them.
+		res = value_udfcall(&sexp_to_c_variables, *fun, argc, argv);
+	}
+
+	value_clear(&key);
+	for (i = 0; i < argc; ++i)
+		value_clear(&argv[i]);
+	return res;
+}
+
+value sexp_to_c_global(char *name)
+{
+	value key = value_set_str(name);
+	key.type = VALUE_VAR;
+	value res = value_hash_get(global_variables, key);
+	value_clear(&key);
+	return res;
+}
+
+value sexp_to_c_string(int type, char *str)
+{
+	value res = value_set_str(str);
+	res.type = type;
+	return res;
+}
+
+value sexp_to_c_mpz(char *str)
+{
+	value res;
+	value_box_mpz(&res);
+	mpz_init_set_str(res.core.u_mz, str, 10);
+	return res;
+}
+
+value sexp_to_c_mpf(char *str, long prec)
+{
+	value res;
+	res.type = VALUE_MPF;
+	mpfr_init2(value_box_mpf(&res), prec);
+	mpfr_set_str(res.core.u_mf, str, 16, value_mpfr_round);
+	return res;
+}
+
+/*
+ * Takes ownership of (min) and (max).
+ */
+value sexp_to_c_range(value min, value max, int inclusive_p)
+{
+	value res;
+	res.type = VALUE_RNG;
+	value_malloc(&res, 1);
+	return_if_error(res);
+
+	res.core.u_r->min = min;
+	res.core.u_r->max = max;
+	res.core.u_r->inclusive_p = inclusive_p;
+	return res;
+}
+
+/*
+ * Moves the value out of a temporary so that it can be passed to a function.
+ */
+value sexp_to_c_take(value *op)
+{
+	value res = *op;
+	op->type = VALUE_NIL;
+	return res;
+}
+
+/*
+ * Determines whether the temporary (op) is true and clears it.
+ */
+int sexp_to_c_test(value *op)
+{
+	int res = value_true_p(*op);
+	value_clear(op);
+	return res;
+}
+
+/*
+ * Adds (op) to the values that a loop has yielded so far. Takes ownership of
+ * (op).
+ */
+int sexp_to_c_yield(value *res, value *op)
+{
+	if (res->type != VALUE_ARY) {
+		value_clear(res);
+		*res = value_init(VALUE_ARY);
+	}
+
+	value_append_now2(res, op);
+	op->type = VALUE_NIL;
+	return 0;
+}
+
+/*
+ * Starts walking through (op) the way value_each() does, or counts from 0 up to
+ * (op) the way value_times() does if (dotimes_p). (op) is borrowed, so it has
+ * to stay alive until the loop ends.
+ */
+int sexp_to_c_iter_init(struct sexp_to_c_iter *it, value op, int dotimes_p)
+{
+	sexp_to_c_iter_clear(it);
+	it->op = op;
+	it->i = it->j = 0;
+	it->reversed_p = FALSE;
+	it->error_p = FALSE;
+
+	if (dotimes_p) {
+		if (op.type != VALUE_MPZ) {
+			value_error(1, "Type Error: times() is undefined where op is %ts (integer expected).", op);
+			return VALUE_ERROR;
+		}
+		it->type = SEXP_TO_C_DOTIMES;
+		it->cur = value_set_long(0);
+		it->max = value_set(op);
+		return 0;
+	}
+
+	switch (op.type) {
+	case VALUE_ARY:
+	case VALUE_HSH:
+	case VALUE_GEN:
+		it->type = op.type;
+		break;
+	case VALUE_LST:
+		it->type = op.type;
+		it->cur = op;
+		break;
+	case VALUE_RNG:
+		// An empty range runs zero times, like in value_each().
+		if (value_eq(op.core.u_r->min, op.core.u_r->max))
+			break;
+		it->type = op.type;
+		it->cur = value_set(op.core.u_r->min);
+		it->max = value_set(op.core.u_r->max);
+		it->reversed_p = value_gt(it->cur, it->max);
+		if (op.core.u_r->inclusive_p) {
+			if (it->reversed_p)
+				value_dec_now(&it->max);
+			else value_inc_now(&it->max);
+		}
+		break;
+	default:
+		value_error(1, "Type Error: each() is undefined where op is %ts (iterable expected).", op);
+		return VALUE_ERROR;
+	}
+
+	return 0;
+}
+
+/*
+ * Stores the next element in (var1), or the next key and value in (var1) and
+ * (var2) for a hash. Returns FALSE when there are no more elements. If a
+ * generator fails, sets it->error_p.
+ */
+int sexp_to_c_iter_next(struct sexp_to_c_iter *it, value *var1, value *var2)
+{
+	value x;
+	int found_p;
+
+	switch (it->type) {
+	case SEXP_TO_C_DOTIMES:
+	case VALUE_RNG:
+		if (it->reversed_p ? !value_gt(it->cur, it->max) : !value_lt(it->cur, it->max))
+			return FALSE;
+		value_clear(var1);
+		*var1 = value_set(it->cur);
+		if (it->reversed_p)
+			value_dec_now(&it->cur);
+		else value_inc_now(&it->cur);
+		break;
+	case VALUE_ARY:
+		if (it->i >= it->op.core.u_a.length)
+			return FALSE;
+		value_clear(var1);
+		*var1 = value_set(it->op.core.u_a.a[it->i++]);
+		break;
+	case VALUE_LST:
+		if (it->cur.type != VALUE_LST)
+			return FALSE;
+		value_clear(var1);
+		*var1 = value_set(it->cur.core.u_l[0]);
+		it->cur = it->cur.core.u_l[1];
+		break;
+	case VALUE_HSH:
+		while (it->i < it->op.core.u_h->length) {
+			value bucket = it->op.core.u_h->a[it->i];
+			if (bucket.type == VALUE_ARY && it->j < bucket.core.u_a.length) {
+				value pair = bucket.core.u_a.a[it->j++];
+				if (pair.type != VALUE_ARY || pair.core.u_a.length != 2)
+					continue;
+				value_clear(var1);
+				*var1 = value_set(pair.core.u_a.a[0]);
+				if (var2) {
+					value_clear(var2);
+					*var2 = value_set(pair.core.u_a.a[1]);
+				}
+				return TRUE;
+			}
+			++it->i;
+			it->j = 0;
+		}
+		return FALSE;
+	case VALUE_GEN:
+		found_p = value_generator_pull(it->op, &x);
+		if (found_p == VALUE_ERROR)
+			it->error_p = TRUE;
+		if (found_p != TRUE)
+			return FALSE;
+		value_clear(var1);
+		*var1 = x;
+		break;
+	default:
+		return FALSE;
+	}
+
+	if (var2)
+		value_clear(var2);
+	return TRUE;
+}
+
+int sexp_to_c_iter_clear(struct sexp_to_c_iter *it)
+{
+	if (it->type == VALUE_RNG || it->type == SEXP_TO_C_DOTIMES) {
+		value_clear(&it->cur);
+		value_clear(&it->max);
+	}
+
+	it->type = VALUE_NIL;
+	it->cur.type = VALUE_NIL;
+	it->max.type = VALUE_NIL;
+	return 0;
+}
@@ -4,19 +4,183 @@
  *
  *  Created by Michael Dickens on 8/22/10.
  *
+ *  Compiles s-expressions ahead of time into a C program. The program calls the
+ *  same value functions that the interpreter does, so it has to be linked against
+ *  every source file except main.c:
+ *
+ *    simfpl compile program.simf program.c
+ *    cc -std=gnu89 -fcommon -I. program.c <every .c file but main.c and tree.c> -lmpfr -lgmp -lm -ldl -lpthread
+ *
  */
 
 #include "tests.h"
 
-#define S2C_IF 1
-#define S2C_TIMES 2
+/*
+ * How the s-expressions become C:
+ *
+ * - Each top-level def becomes a C function that takes its arguments in an array,
+ *   like a built-in function. The rest of the top-level statements go into one
+ *   function that main() calls.
+ * - Variables become C variables. Inside a function, the arguments and every
+ *   variable that the function assigns to are locals. Top-level variables are
+ *   declared at file scope.
+ * - Values in the middle of an expression go in numbered temporaries. A temporary
+ *   owns its value, so it's cleared before it's reused and when the function ends.
+ * - Control structures (if, unless, while, until, for, switch, &&, ||, break,
+ *   continue, return, yield and exit) and assignment become C statements.
+ * - Every other built-in function is called through its _arg function, with the
+ *   arguments in an array just as value_bifcall_sexp() passes them. A variable is
+ *   passed by value and copied back afterward, so functions like sort! still modify
+ *   it in place.
+ * - An error goes to the end of the function, which returns it. The program stops
+ *   at the first top-level statement that results in an error, like the
+ *   interpreter does when it runs a file.
+ *
+ * Functions that work with unevaluated code (quote, eval, lambda, set, and so on),
+ * generators, memoized functions and functions with :keep_scope or :delay_eval
+ * can't be compiled. sexp_to_c() reports them as errors.
+ */
+
+struct sexp_to_c_function {
+	FILE *code; // The body of the function.
+	value locals; // Array of [variable, C name] pairs.
+	int udf_p; // FALSE for the function that holds the top-level statements.
+	int temps, bools, iters;
+	int result; // The temporary that holds the return value.
+	int loop_result; // The temporary that holds the result of the innermost loop, or -1.
+	int loop_depth;
+	int depth; // Indentation.
+};
+
+struct sexp_to_c_state {
+	FILE *functions; // Every function that's been compiled so far.
+	FILE *init; // Code that sets up the constants and the built-in functions.
+	int constants; // Constant i is c<i>.
+	value builtins; // Array of names of built-in functions. Built-in function i is f<i>.
+	value udfs; // Array of [function name, C name, argc] triples.
+	value globals; // Array of [variable, C name] pairs.
+	struct sexp_to_c_function main;
+	struct sexp_to_c_function *fn; // The function being compiled.
+	char *source;
+	int jit_p; // Compiling one function for the JIT rather than a whole program.
+};
+
+/* Walks through a loop's iterable. Used by the generated code.
+ */
+struct sexp_to_c_iter {
+	value op;
+	value cur, max;
+	size_t i, j;
+	int type;
+	int reversed_p;
+	int error_p;
+};
+
+#define SEXP_TO_C_DOTIMES -2
+
+// Passed to the built-in functions that take the variables as their first argument.
+value sexp_to_c_variables;
+
+/*
+ * The C compiler and flags that simfpl uses to build generated C itself. They come 
+ * from the environment variables CC and SIMFPL_CFLAGS, and default to cc and 
+ * "-O2 -std=gnu89 -fcommon -w -I.". The flags have to let the compiler find 
+ * sexp_to_c.h.
+ */
+char *sexp_to_c_cc;
+char *sexp_to_c_flags;
+
+/*
+ * The libraries that a standalone compiled program is linked with. They come from 
+ * SIMFPL_LIBS, and default to the ones in the link line at the top of this file.
+ */
+char *sexp_to_c_libs;
 
 int init_sexp_to_c();
 
-value create_associated_numbers(value sexp);
-value create_associated_numbers_recursive(value sexp, value start);
-value get_count(value counts);
+/*
+ * Compiles the file (argv[0]) and writes the C program to the file (argv[1]), or to
+ * stdout if there is no argv[1].
+ */
+int sexp_to_c_main(int argc, const char *argv[]);
+
+/*
+ * Compiles and runs the programs in compile_tests/ and checks that they print what 
+ * the interpreter prints. See sexp_to_c.c.
+ */
+extern char *sexp_to_c_check_names[];
+int sexp_to_c_check_main(int argc, const char *argv[]);
+int sexp_to_c_check(char *name, char *dir, int standalone_p);
+int sexp_to_c_check_standalone(char *name, char *dir, int interpreted);
+int sexp_to_c_check_run(char *program, const char *compile_argv[], char *out);
+long sexp_to_c_check_compare(char *path1, char *path2, char *line);
 
+/* Compiles every statement read from (in).
+ */
+int sexp_to_c_file(FILE *out, FILE *in, char *source);
+
+/* Writes a C program that evaluates (sexp).
+ */
 int sexp_to_c(FILE *stream, value sexp);
-int sexp_to_c_recursive(FILE *stream, value sexp, value counts);
 
+/* Writes a C file for the JIT that contains the user-defined function (fun).
+ * See jit.c.
+ */
+int sexp_to_c_jit(FILE *stream, value fun);
+
+int sexp_to_c_init_state(struct sexp_to_c_state *st, char *source);
+int sexp_to_c_clear_state(struct sexp_to_c_state *st);
+int sexp_to_c_finish(struct sexp_to_c_state *st, FILE *out);
+int sexp_to_c_statement(struct sexp_to_c_state *st, value sexp);
+int sexp_to_c_def(struct sexp_to_c_state *st, value sexp);
+int sexp_to_c_udf(struct sexp_to_c_state *st, value var, struct value_function *udf);
+
+int sexp_to_c_begin_function(struct sexp_to_c_function *fn, int udf_p);
+int sexp_to_c_end_function(struct sexp_to_c_state *st, char *header, int argc);
+int sexp_to_c_collect_locals(struct sexp_to_c_state *st, value sexp);
+
+int sexp_to_c_into(struct sexp_to_c_state *st, value sexp, int target);
+int sexp_to_c_operand(struct sexp_to_c_state *st, value sexp, char *name);
+int sexp_to_c_truth(struct sexp_to_c_state *st, value sexp, char *test);
+int sexp_to_c_bif(struct sexp_to_c_state *st, value sexp, int target);
+int sexp_to_c_call(struct sexp_to_c_state *st, value sexp, int target);
+int sexp_to_c_udfcall(struct sexp_to_c_state *st, value sexp, int target);
+int sexp_to_c_if(struct sexp_to_c_state *st, value sexp, int target, int reverse);
+int sexp_to_c_while(struct sexp_to_c_state *st, value sexp, int target, int reverse);
+int sexp_to_c_for(struct sexp_to_c_state *st, value sexp, int target);
+int sexp_to_c_switch(struct sexp_to_c_state *st, value sexp, int target);
+int sexp_to_c_logical(struct sexp_to_c_state *st, value sexp, int target, int or_p);
+int sexp_to_c_assign(struct sexp_to_c_state *st, value sexp, int target, char *op);
+int sexp_to_c_jump(struct sexp_to_c_state *st, value sexp, int target);
+
+int sexp_to_c_temp(struct sexp_to_c_state *st);
+int sexp_to_c_line(struct sexp_to_c_state *st, char *format, ...);
+int sexp_to_c_name(char *buffer, char *prefix, char *name);
+int sexp_to_c_lookup(value table, char *key, char *buffer);
+int sexp_to_c_variable(struct sexp_to_c_state *st, value var, int declare_p, char *buffer);
+int sexp_to_c_constant(struct sexp_to_c_state *st, value op, char *name);
+int sexp_to_c_builtin_name(struct sexp_to_c_state *st, value bif, char *name);
+int sexp_to_c_write_constant(FILE *out, value op, char *lvalue, int level);
+int sexp_to_c_write_string(FILE *out, char *str);
+int sexp_to_c_unsupported(value sexp);
+int sexp_to_c_copy(FILE *out, FILE *in);
+
+/*
+ * Functions called by the generated code.
+ */
+
+value (*sexp_to_c_builtin(char *name))(int argc, value argv[]);
+value sexp_to_c_builtin_value(char *name);
+value sexp_to_c_global(char *name);
+value sexp_to_c_call_udf(char *name, int argc, value argv[]);
+value sexp_to_c_string(int type, char *str);
+value sexp_to_c_mpz(char *str);
+value sexp_to_c_mpf(char *str, long prec);
+value sexp_to_c_range(value min, value max, int inclusive_p);
+value sexp_to_c_take(value *op);
+int sexp_to_c_test(value *op);
+int sexp_to_c_yield(value *res, value *op);
+
+int sexp_to_c_iter_init(struct sexp_to_c_iter *it, value op, int dotimes_p);
+int sexp_to_c_iter_next(struct sexp_to_c_iter *it, value *var1, value *var2);
+int sexp_to_c_iter_clear(struct sexp_to_c_iter *it);
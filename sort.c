@@ -345,6 +345,42 @@ void custom_sort2_run(int array[], int left, int right, int cutoff)
 
 }
 
+int radix_sort(int array[], int length)
+{
+	unsigned int temp[length];
+	unsigned int *src = (unsigned int *) array, *dst = temp, *swap;
+	unsigned int sign = 1u << (sizeof(int) * 8 - 1);
+	int count[256];
+	int i, b, start, shift;
+	
+	for (i = 0; i < length; ++i)
+		src[i] ^= sign;
+	
+	// An int has an even number of bytes, so the last pass leaves the result in (array).
+	for (shift = 0; shift < sizeof(int) * 8; shift += 8) {
+		for (b = 0; b < 256; ++b)
+			count[b] = 0;
+		for (i = 0; i < length; ++i)
+			++count[(src[i] >> shift) & 255];
+		for (b = 0, start = 0; b < 256; ++b) {
+			int n = count[b];
+			count[b] = start;
+			start += n;
+		}
+		for (i = 0; i < length; ++i)
+			dst[count[(src[i] >> shift) & 255]++] = src[i];
+		
+		swap = src;
+		src = dst;
+		dst = swap;
+	}
+	
+	for (i = 0; i < length; ++i)
+		src[i] ^= sign;
+	
+	return 0;
+}
+
 
 int vcustom_sort2(value array[], int length, int cutoff)
 {
@@ -67,6 +67,14 @@ void custom_sort1_run(int array[], int left, int right);
 int custom_sort2(int array[], int length, int cutoff);
 void custom_sort2_run(int array[], int left, int right, int cutoff);
 
+/* 
+ * Worst O(n), Average O(n), Memory n
+ * 
+ * LSD radix sort, one byte at a time. The sign bit is flipped so that the negative 
+ * numbers come first.
+ */
+int radix_sort(int array[], int length);
+
 int vcustom_sort2(value array[], int length, int cutoff);
 int vcustom_sort2_run(value array[], int left, int right, int cutoff);
 
@@ -9,6 +9,12 @@
 
 #include "tests.h"
 
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 int init_tests()
 {
 	test_vars = value_hash_init();
@@ -36,6 +42,10 @@ int run_tests()
 		printf("Test suite aborted.\n\n");
 		return 1;
 	}
+	if (test_primitives()) {
+		printf("Test suite aborted.\n\n");
+		return 1;
+	}
 	if (test_errors()) {
 		printf("Test suite aborted.\n\n");
 		return 1;
@@ -52,6 +62,10 @@ int run_tests()
 		printf("Test suite aborted.\n\n");
 		return 1;
 	}
+	if (test_controls()) {
+		printf("Test suite aborted.\n\n");
+		return 1;
+	}
 	if (test_lists()) {
 		printf("Test suite aborted.\n\n");
 		return 1;
@@ -62,37 +76,218 @@ int run_tests()
 	return 0;
 }
 
-int run_benchmarks()
+/*
+ * The workloads in benchmarks/. Each one exercises a single part of the
+ * interpreter.
+ */
+char *benchmark_names[] = {
+	"arithmetic", "bigint", "float", "string", "regex", "array", "list", 
+	"hash", "recursion", "sort", "parse", NULL, 
+};
+
+/* 
+ * simfpl benchmark [-n runs] [-w warmups] [-j results.json] 
+ *                  [-b baseline.json] [-t percent] [name ...]
+ * 
+ * Runs each benchmark in its own process, (warmups) times without timing it 
+ * and then (runs) times, and prints the median and 95th percentile of the 
+ * wall time and the peak memory. -j writes the results as JSON, one benchmark 
+ * per line. -b compares the medians against a file written by -j and returns 
+ * 1 if any of them is more than (percent) slower.
+ */
+int run_benchmarks(int argc, const char *argv[])
 {
-	import_benchmark("benchmarks/array benchmark 1.simf");
-	import_benchmark("benchmarks/hash benchmark 1.simf");
-	import_benchmark("benchmarks/long benchmark 1.simf");
-	import_benchmark("benchmarks/long benchmark 2.simf");
-//	import_benchmark("benchmarks/loop benchmark 1.simf");
-	import_benchmark("benchmarks/math benchmark 1.simf");
-	import_benchmark("benchmarks/math benchmark 2.simf");
-	import_benchmark("benchmarks/misc benchmark 1.simf");
-	import_benchmark("benchmarks/recursion benchmark 1.simf");
-	import_benchmark("benchmarks/sort benchmark 1.simf");
-//	import_benchmark("benchmarks/sort benchmark 2.simf");
-	
-//	import_benchmark("benchmarks/math benchmark 3.simf"); // buggy
+	struct benchmark_result results[BENCHMARK_MAX];
+	int runs = 5, warmups = 1;
+	double threshold = 10.0;
+	const char *json = NULL, *baseline = NULL;
+	int count = 0, regressions = 0;
+	int i;
+	
+	for (i = 0; i < argc; ++i) {
+		if (argv[i][0] == '-' && i + 1 < argc) {
+			if (streq(argv[i], "-n"))
+				runs = atoi(argv[++i]);
+			else if (streq(argv[i], "-w"))
+				warmups = atoi(argv[++i]);
+			else if (streq(argv[i], "-j"))
+				json = argv[++i];
+			else if (streq(argv[i], "-b"))
+				baseline = argv[++i];
+			else if (streq(argv[i], "-t"))
+				threshold = atof(argv[++i]);
+			else break;
+		} else if (argv[i][0] == '-') {
+			break;
+		} else if (count < BENCHMARK_MAX) {
+			results[count++].name = (char *) argv[i];
+		}
+	}
+	
+	if (i < argc || runs < 1 || warmups < 0) {
+		fprintf(stderr, "usage: simfpl benchmark [-n runs] [-w warmups] [-j results.json] [-b baseline.json] [-t percent] [name ...]\n");
+		return 1;
+	}
+	
+	if (count == 0)
+		for (i = 0; benchmark_names[i]; ++i)
+			results[count++].name = benchmark_names[i];
+	
+	printf("%-12s %12s %12s %12s\n", "benchmark", "median (ms)", "p95 (ms)", "peak (KB)");
+	for (i = 0; i < count; ++i) {
+		if (time_benchmark(&results[i], runs, warmups)) {
+			printf("%-12s %12s\n", results[i].name, "failed");
+			++regressions;
+			continue;
+		}
+		
+		printf("%-12s %12.2f %12.2f %12lu", results[i].name, results[i].median / 1000.0, 
+				results[i].p95 / 1000.0, (unsigned long) (results[i].peak_rss / 1024));
+		
+		double base;
+		if (baseline && read_benchmark_baseline(baseline, results[i].name, &base) == 0) {
+			double change = 100.0 * (results[i].median - base) / base;
+			printf(" %+7.1f%%", change);
+			if (change > threshold) {
+				printf(" REGRESSION");
+				++regressions;
+			}
+		}
+		printf("\n");
+	}
+	
+	if (json && write_benchmark_json(json, results, count))
+		return 1;
+	
+	return regressions > 0;
+}
 
+/* 
+ * Runs benchmarks/(name).simf in a child process (warmups + runs) times and 
+ * fills in (res) from the timed runs. The child's output is thrown away. 
+ * SIMFPL_JIT and the other environment variables are passed on to it.
+ */
+int time_benchmark(struct benchmark_result *res, int runs, int warmups)
+{
+	double times[runs];
+	char path[BUFSIZE];
+	int i;
+	
+	snprintf(path, BUFSIZE, "benchmarks/%s.simf", res->name);
+	if (access(path, R_OK)) {
+		fprintf(stderr, "Error: Could not open file %s.\n", path);
+		return VALUE_ERROR;
+	}
+	
+	res->peak_rss = 0;
+	for (i = -warmups; i < runs; ++i) {
+		struct rusage usage;
+		int status;
+		
+		fflush(stdout);
+		fflush(stderr);
+		time_t start = usec();
+		pid_t pid = fork();
+		if (pid < 0)
+			return VALUE_ERROR;
+		
+		if (pid == 0) {
+			int null = open("/dev/null", O_WRONLY);
+			if (null >= 0)
+				dup2(null, STDOUT_FILENO);
+			_exit(import_benchmark(path) ? 1 : 0);
+		}
+		
+		if (wait4(pid, &status, 0, &usage) != pid)
+			return VALUE_ERROR;
+		time_t finish = usec();
+		
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			return VALUE_ERROR;
+		if (i < 0)
+			continue;
+		
+		times[i] = (double) (finish - start);
+#ifdef __APPLE__
+		size_t rss = (size_t) usage.ru_maxrss;
+#else
+		size_t rss = (size_t) usage.ru_maxrss * 1024;
+#endif
+		if (rss > res->peak_rss)
+			res->peak_rss = rss;
+	}
+	
+	qsort(times, runs, sizeof(double), &compare_doubles);
+	res->median = runs % 2 ? times[runs / 2] : (times[runs / 2 - 1] + times[runs / 2]) / 2;
+	res->p95 = times[(int) ceil(0.95 * runs) - 1];
+	
 	return 0;
 }
 
-
+/* 
+ * Runs the program in (name). Returns nonzero if it printed any errors.
+ */
 int import_benchmark(char *name)
 {
-	printf("\n*****\n*****\n*****\n\nRunning benchmark \"%s\".\n\n", name);
-	
 	value benchmark = value_set_str(name);
+	error_count = 0;
 	value res = value_import(benchmark);
+	int error_p = res.type == VALUE_ERROR || error_count > 0;
 	
-	value_printf("\nBenchmark returned %ts.\n\n", res);
-	printf("*****\n*****\n*****\n\n");
+	value_clear(&res);
+	value_clear(&benchmark);
+	return error_p;
+}
+
+int compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+/* 
+ * The times are in microseconds and the memory is in bytes.
+ */
+int write_benchmark_json(const char *path, struct benchmark_result *results, int count)
+{
+	FILE *out = fopen(path, "w");
+	if (out == NULL) {
+		fprintf(stderr, "Error: Could not open file %s.\n", path);
+		return VALUE_ERROR;
+	}
 	
-	return 0;
+	int i;
+	fprintf(out, "[\n");
+	for (i = 0; i < count; ++i)
+		fprintf(out, "{\"name\": \"%s\", \"median\": %.0f, \"p95\": %.0f, \"peak_rss\": %lu}%s\n", 
+				results[i].name, results[i].median, results[i].p95, 
+				(unsigned long) results[i].peak_rss, i + 1 < count ? "," : "");
+	fprintf(out, "]\n");
+	
+	return fclose(out) ? VALUE_ERROR : 0;
+}
+
+/* 
+ * Finds the median for (name) in a file written by write_benchmark_json(). 
+ * Returns nonzero if it isn't there.
+ */
+int read_benchmark_baseline(const char *path, char *name, double *median)
+{
+	FILE *in = fopen(path, "r");
+	if (in == NULL)
+		return VALUE_ERROR;
+	
+	char line[BUFSIZE], key[BUFSIZE];
+	int found_p = FALSE;
+	snprintf(key, BUFSIZE, "\"name\": \"%s\"", name);
+	while (!found_p && fgets(line, BUFSIZE, in)) {
+		char *ptr = strstr(line, "\"median\": ");
+		if (strstr(line, key) && ptr && sscanf(ptr + strlen("\"median\": "), "%lf", median) == 1)
+			found_p = *median > 0;
+	}
+	
+	fclose(in);
+	return found_p ? 0 : VALUE_ERROR;
 }
 
 /* This has a lot of memory leakage, but that's okay because it will 
@@ -161,7 +356,327 @@ int test_string(char *str, value expected)
 	if (error_p == 0) {
 //		printf("succeeded: %s\n", str);
 	}
+
+	return error_p;
+}
+
+/*
+ * Checks that value_vector_math() on a packed array of doubles from (min) to (max)
+ * is within (max_ulps) of MPFR's correctly rounded result for every element.
+ */
+int test_vector_accuracy(int func, double min, double max, long max_ulps)
+{
+	int i, length = 1000;
+	double xs[length];
+	for (i = 0; i < length; ++i)
+		xs[i] = min + (max - min) * i / (length - 1);
+
+	value op = value_set_pak_double(xs, length);
+	value res = value_vector_math(op, func);
+	int error_p = 0;
+	if (res.type != VALUE_PAK) {
+		value_error(0, "Test failed: for function %d, a packed array expected, %ts found.", func, res);
+		error_p = VALUE_ERROR;
+	}
+
+	for (i = 0; i < length && error_p == 0; ++i) {
+		value x = value_set_double(xs[i]);
+		value expected = value_math_function(x, func);
+		double found = res.core.u_pk->a.f[i], exact = mpfr_get_d(expected.core.u_mf, value_mpfr_round);
+		int64_t bits1, bits2;
+		memcpy(&bits1, &found, sizeof(double));
+		memcpy(&bits2, &exact, sizeof(double));
+		if (bits1 - bits2 > max_ulps || bits2 - bits1 > max_ulps) {
+			value_error(0, "Test failed: for function %d of %s, %s expected, %ts found.", func, x, expected, value_packed_get(res, i));
+			error_p = VALUE_ERROR;
+		}
+		value_clear(&x);
+		value_clear(&expected);
+	}
+
+	value_clear(&op);
+	value_clear(&res);
+	return error_p;
+}
+
+/*
+ * Checks that value_vector_math() gives what MPFR does for one number when the
+ * default precision is more than a double has.
+ */
+int test_vector_precision(int func, char *str)
+{
+	value prec = value_set_long(200), orig = value_set_long(mpfr_get_default_prec());
+	value_set_default_prec(prec);
+
+	value x = value_set_str_smart(str, 10);
+	value op = value_init(VALUE_ARY);
+	value_append_now(&op, x);
+	value res = value_vector_math(op, func);
+	value expected = value_math_function(x, func);
+
+	int error_p = 0;
+	if (res.type != VALUE_ARY || value_ne(res.core.u_a.a[0], expected)
+			|| mpfr_get_prec(res.core.u_a.a[0].core.u_mf) != 200) {
+		value_error(0, "Test failed: for function %d of %s, (array %s) expected, %ts found.", func, x, expected, res);
+		error_p = VALUE_ERROR;
+	}
+
+	value_set_default_prec(orig);
+	value_clear(&prec);
+	value_clear(&orig);
+	value_clear(&x);
+	value_clear(&op);
+	value_clear(&res);
+	value_clear(&expected);
+	return error_p;
+}
+
+/* 
+ * Sorts (length) integers laid out in one of the patterns that trip up a naive 
+ * quicksort and checks that the result is in order. Sorted and reversed input must 
+ * take a linear number of comparisons.
+ * 
+ * The patterns are 0: sorted, 1: reversed, 2: random, 3: four distinct values, 
+ * 4: organ pipe, 5: sawtooth, 6: random with integers and floats mixed.
+ */
+int test_sort_pattern(int pattern, size_t length)
+{
+	value array[length];
+	size_t i;
+	long sum = 0, sorted_sum = 0;
+	for (i = 0; i < length; ++i) {
+		long x = pattern == 0 ? i 
+				: pattern == 1 ? length - i 
+				: pattern == 3 ? i % 4 
+				: pattern == 4 ? (i < length / 2 ? i : length - i) 
+				: pattern == 5 ? i % 64 
+				: genrand_int31() % length;
+		sum += x;
+		array[i] = pattern == 6 && (i & 1) ? value_set_double(x) : value_set_long(x);
+	}
+	
+	struct value_sort sort;
+	sort.cmp = &test_sort_counting_cmp;
+	sort.error_p = FALSE;
+	test_sort_comparisons = 0;
+	
+	int error_p = value_private_sort_with(&sort, array, length);
+	for (i = 0; i < length; ++i) {
+		if (i > 0 && value_cmp_any(array[i-1], array[i]) > 0)
+			error_p = VALUE_ERROR;
+		sorted_sum += value_get_long(array[i]);
+		value_clear(&array[i]);
+	}
+	
+	if (sorted_sum != sum || (pattern <= 1 && test_sort_comparisons > 2 * (long) length))
+		error_p = VALUE_ERROR;
+	if (error_p)
+		value_error(0, "Test failed: for sort pattern %d of %ld elements, %ld comparisons.\n", 
+				pattern, (long) length, test_sort_comparisons);
+	
+	return error_p;
+}
+
+int test_sort_counting_cmp(struct value_sort *sort, value op1, value op2)
+{
+	++test_sort_comparisons;
+	return value_private_sort_cmp_any(sort, op1, op2);
+}
+
+/* 
+ * Sorts (array) with (f), which is given (threads), and checks that the result is 
+ * the same as value_private_sort_with() gives. Clears and frees (array).
+ */
+int test_sort_same(value *array, size_t length, int (*f)(value array[], size_t length, int threads), int threads)
+{
+	value *copy = value_malloc(NULL, sizeof(value) * length);
+	size_t i;
+	for (i = 0; i < length; ++i)
+		copy[i] = array[i];
+	
+	struct value_sort sort;
+	value_private_sort_comparator(&sort, copy, length);
+	sort.error_p = FALSE;
+	
+	int error_p = value_private_sort_with(&sort, copy, length);
+	error_p |= (*f)(array, length, threads);
+	for (i = 0; i < length; ++i)
+		if (value_ne(array[i], copy[i]))
+			error_p = VALUE_ERROR;
+	
+	// (copy) holds the same values as (array), so only one of them is cleared.
+	for (i = 0; i < length; ++i)
+		value_clear(&array[i]);
+	value_free(array);
+	value_free(copy);
+	return error_p;
+}
+
+/* 
+ * Sorts random integers, floats or strings (type 0, 1 or 2) on (threads) threads 
+ * and checks that the result is the same as sorting on one thread.
+ */
+int test_sort_parallel(int type, size_t length, int threads)
+{
+	value *array = value_malloc(NULL, sizeof(value) * length);
+	char buf[SMALLBUFSIZE];
+	size_t i;
+	for (i = 0; i < length; ++i) {
+		// Only a few thousand distinct values, so that there are plenty of duplicates.
+		long x = genrand_int31() % 5000;
+		sprintf(buf, "%ld", x);
+		array[i] = type == 0 ? value_set_long(x) : type == 1 ? value_set_double(x / 7.0) : value_set_str(buf);
+	}
+	
+	int error_p = test_sort_same(array, length, &value_private_sort_parallel, threads);
+	if (error_p)
+		value_error(0, "Test failed: sorting %ld elements of type %d on %d threads.\n", 
+				(long) length, type, threads);
+	return error_p;
+}
+
+/* 
+ * Radix sorts random integers of up to 64 bits (type 0), integers with one too 
+ * big for a long among them (type 1) or strings with shared prefixes (type 2), 
+ * and checks that the result is the same as pdqsort gives.
+ */
+int test_sort_radix(int type, size_t length)
+{
+	value *array = value_malloc(NULL, sizeof(value) * length);
+	char buf[BUFSIZE];
+	size_t i;
+	for (i = 0; i < length; ++i) {
+		long x = (long) genrand_int31() << 32 ^ genrand_int31();
+		if (genrand_int31() & 1)
+			x = -x;
+		if (type == 2) {
+			sprintf(buf, "%.*s%ld", (int) (i % 4) * 6, "prefixprefixprefixprefix", labs(x) % 1000);
+			array[i] = value_set_str(i % 50 ? buf : "");
+		} else if (type == 1 && i == length / 2)
+			array[i] = value_set_str_smart("123456789012345678901234567890", 10);
+		else array[i] = value_set_long(type == 0 && i % 3 ? x : x % 100);
+	}
 	
+	int error_p = test_sort_same(array, length, &test_sort_fast, 1);
+	if (error_p)
+		value_error(0, "Test failed: radix sorting %ld elements of type %d.\n", (long) length, type);
+	return error_p;
+}
+
+/* 
+ * Sorts with value_private_sort_fast(), in the form that test_sort_same() takes.
+ */
+int test_sort_fast(value array[], size_t length, int threads)
+{
+	struct value_sort sort;
+	value_private_sort_comparator(&sort, array, length);
+	sort.error_p = FALSE;
+	return value_private_sort_fast(&sort, array, length);
+}
+
+/* 
+ * Makes a (rows) by (cols) matrix of random integers (type 0), floats (type 1) or 
+ * integers big enough that their products overflow a long (type 2).
+ */
+value test_matrix_random(int type, size_t rows, size_t cols)
+{
+	value res = value_init(VALUE_ARY);
+	size_t i, j;
+	for (i = 0; i < rows; ++i) {
+		value row = value_init(VALUE_ARY);
+		for (j = 0; j < cols; ++j) {
+			long x = (long) (genrand_int31() % 2001) - 1000;
+			value item = type == 0 ? value_set_long(x) : type == 1 ? value_set_double(x / 7.0) 
+				: value_set_long(x << 52);
+			value_append_now2(&row, &item);
+		}
+		value_append_now2(&res, &row);
+	}
+	return res;
+}
+
+/* 
+ * Multiplies random matrices of the given type (see test_matrix_random()) with 
+ * matmul() on (threads) threads, and with and without SIMD instructions, and checks 
+ * that every element is exactly what a naive loop over value_mul() and value_add() 
+ * gives.
+ */
+int test_matmul(int type, size_t rows, size_t inner, size_t cols, int threads)
+{
+	value a = test_matrix_random(type, rows, inner);
+	value b = test_matrix_random(type, inner, cols);
+	value expected = value_init(VALUE_ARY);
+	size_t i, j, k;
+	
+	for (i = 0; i < rows; ++i) {
+		value row = value_init(VALUE_ARY);
+		for (j = 0; j < cols; ++j) {
+			value sum = value_set_long(0);
+			for (k = 0; k < inner; ++k) {
+				value product = value_mul(a.core.u_a.a[i].core.u_a.a[k], b.core.u_a.a[k].core.u_a.a[j]);
+				value_add_now(&sum, product);
+				value_clear(&product);
+			}
+			value_append_now2(&row, &sum);
+		}
+		value_append_now2(&expected, &row);
+	}
+	
+	int orig_threads = value_sort_threads(), orig_level = value_vector_level();
+	size_t orig_threshold = value_matrix_parallel_threshold();
+	sort_threads = threads;
+	matrix_parallel_threshold = 1;
+	
+	int error_p = FALSE, level;
+	for (level = VECTOR_SCALAR; level <= orig_level; ++level) {
+		vector_level = level;
+		value res = value_matmul(a, b);
+		if (!value_eq(res, expected)) {
+			value_error(0, "Test failed: multiplying matrices of type %d (%ld by %ld by %ld) on %d threads at SIMD level %d.\n", 
+					type, (long) rows, (long) inner, (long) cols, threads, level);
+			error_p = VALUE_ERROR;
+		}
+		value_clear(&res);
+	}
+	
+	sort_threads = orig_threads;
+	vector_level = orig_level;
+	matrix_parallel_threshold = orig_threshold;
+	value_clear(&a);
+	value_clear(&b);
+	value_clear(&expected);
+	return error_p;
+}
+
+/* 
+ * Solves a random (n) by (n) system of floats whose solution is known, and checks 
+ * that each element of the solution is within (tolerance) of it. The matrix is 
+ * made diagonally dominant so that it's well conditioned.
+ */
+int test_solve(size_t n, double tolerance)
+{
+	value a = test_matrix_random(1, n, n);
+	value x = value_init(VALUE_ARY);
+	size_t i;
+	for (i = 0; i < n; ++i) {
+		value_add_now(&a.core.u_a.a[i].core.u_a.a[i], value_set_long(1000 * n));
+		value item = value_set_double((double) (genrand_int31() % 100) - 50);
+		value_append_now2(&x, &item);
+	}
+	
+	value b = value_matvec(a, x);
+	value res = value_solve(a, b);
+	int error_p = res.type != VALUE_PAK || res.core.u_pk->length != n;
+	for (i = 0; i < n && !error_p; ++i)
+		if (fabs(res.core.u_pk->a.f[i] - value_get_double(x.core.u_a.a[i])) > tolerance)
+			error_p = TRUE;
+	if (error_p)
+		value_error(0, "Test failed: solving a random %ld by %ld system.\n", (long) n, (long) n);
+	
+	value_clear(&a);
+	value_clear(&x);
+	value_clear(&b);
+	value_clear(&res);
 	return error_p;
 }
 
@@ -328,6 +843,9 @@ int test_primitives()
 	did_fail |= test_string("3 == 4 && 2 < 3", value_set_bool(FALSE));
 	did_fail |= test_string("3 != 4 || 2 > 3", value_set_bool(TRUE));
 	did_fail |= test_string("! (3 <= 4 && 2 <= 3)", value_set_bool(FALSE));
+	did_fail |= test_string("false && undefined_variable", value_set_bool(FALSE));
+	did_fail |= test_string("true || undefined_variable", value_set_bool(TRUE));
+	did_fail |= test_string("3 && \"hello\"", value_set_bool(TRUE));
 	did_fail |= test_string("(1 << 10) >> 6", value_set_long(16));
 	did_fail |= test_string("15 & 7 & 12", value_set_long(4));
 	did_fail |= test_string("7 | 12", value_set_long(15));
@@ -340,6 +858,15 @@ int test_primitives()
 	did_fail |= test_string("log 5", value_set_double(log(5)));
 	did_fail |= test_string("log10 5", value_set_double(log10(5)));
 	did_fail |= test_string("sqrt 25", value_set_double(5.0));
+	did_fail |= test_string("add_int 2.5 1", value_set_double(3.5));
+	did_fail |= test_string("concat_str \"a\" 1", value_set_str("a1"));
+	did_fail |= test_string("eq_int 3 3", value_set_bool(TRUE));
+	did_fail |= test_string("ne_float 2.5 2.5", value_set_bool(FALSE));
+	did_fail |= test_string("eq_str \"ab\" \"ab\"", value_set_bool(TRUE));
+	did_fail |= test_string("ne_str \"ab\" \"ac\"", value_set_bool(TRUE));
+	did_fail |= test_string("eq_int 2 2.0", value_set_bool(TRUE));
+	did_fail |= test_string("total = 0; for (k :dotimes 4) { total += k * k }; total", value_set_long(14));
+	did_fail |= test_string("x = 1; for (k :dotimes 2) { x = x * 1.5 }; x", value_set_double(2.25));
 	did_fail |= test_string("8 factorial", value_set_long(40320));
 	did_fail |= test_string("sin 2", value_set_double(sin(2)));
 	did_fail |= test_string("cos 2", value_set_double(cos(2)));
@@ -623,6 +1150,31 @@ int test_numbers()
 	did_fail |= test_string("cot 1.0", value_set_str_smart("0.6420926159343307570992465116432867944240570068359375", 10));
 	did_fail |= test_string("cot 10.0", value_set_str_smart("1.542351045356920025142244412563741207122802734375", 10));
 	
+	double internal_roots[] = { 2, 3, 0.5 };
+	long internal_squares[] = { 1, 4, 9 };
+	did_fail |= test_string("sqrt (array 4 9 0.25)", value_set_pak_double(internal_roots, 3));
+	did_fail |= test_string("sin (array 0 1.0 10.0) at 1", value_set_str_smart("0.8414709848078965048756572286947630345821380615234375", 10));
+	did_fail |= test_string("(log (array 1 0)) at 1", value_init(VALUE_NAN));
+	did_fail |= test_string("(array 1 2 3) ** 2", value_set_ary_long(internal_squares, 3));
+	did_fail |= test_vector_accuracy(VALUE_SQRT, 0, 1e6, 0);
+	did_fail |= test_vector_accuracy(VALUE_SIN, -10, 10, 1);
+	did_fail |= test_vector_accuracy(VALUE_COS, -10, 10, 1);
+	did_fail |= test_vector_accuracy(VALUE_TAN, -1.5, 1.5, 1);
+	did_fail |= test_vector_accuracy(VALUE_ASIN, -1, 1, 1);
+	did_fail |= test_vector_accuracy(VALUE_ATAN, -100, 100, 1);
+	did_fail |= test_vector_accuracy(VALUE_ACOS, -1, 1, 1);
+	did_fail |= test_vector_accuracy(VALUE_SINH, -20, 20, 2);
+	did_fail |= test_vector_accuracy(VALUE_COSH, -20, 20, 2);
+	did_fail |= test_vector_accuracy(VALUE_TANH, -5, 5, 2);
+	did_fail |= test_vector_accuracy(VALUE_EXP, -700, 700, 1);
+	did_fail |= test_vector_accuracy(VALUE_LOG, 0.001, 1e6, 1);
+	did_fail |= test_vector_accuracy(VALUE_LOG2, 0.001, 1e6, 1);
+	did_fail |= test_vector_accuracy(VALUE_LOG10, 0.001, 1e6, 1);
+	did_fail |= test_vector_precision(VALUE_SIN, "1.0");
+	did_fail |= test_vector_precision(VALUE_EXP, "0.5");
+	did_fail |= test_vector_precision(VALUE_LOG, "3.0");
+	did_fail |= test_vector_precision(VALUE_SQRT, "2.0");
+	
 	if (did_fail) {
 		printf("\nTest of numbers failed.\n\n");
 	} else {
@@ -788,6 +1340,29 @@ int test_strings()
 	did_fail |= test_string("\"HELLO\" to_lower", value_set_str("hello"));
 	did_fail |= test_string("\"hello World\" to_lower", value_set_str("hello world"));
 	
+	did_fail |= test_string("(drop \"the quick brown fox jumps over the lazy dog again and again\" 4) slice?", value_set_bool(TRUE));
+	did_fail |= test_string("(drop \"hello\" 1) slice?", value_set_bool(FALSE));
+	did_fail |= test_string("\"hello\" drop 2", value_set_str("llo"));
+	did_fail |= test_string("\"hello\" take 2", value_set_str("he"));
+	did_fail |= test_string("\"hello\" range 1 3", value_set_str("el"));
+	did_fail |= test_string("(take (drop \"the quick brown fox jumps over the lazy dog again and again\" 4) 35)", value_set_str("quick brown fox jumps over the lazy"));
+	did_fail |= test_string("(type (take (drop \"the quick brown fox jumps over the lazy dog again and again\" 4) 35)) == String", value_set_bool(TRUE));
+	did_fail |= test_string("(take (drop \"the quick brown fox jumps over the lazy dog again and again\" 4) 35) at 0", value_set_str("q"));
+	did_fail |= test_string("(take (drop \"the quick brown fox jumps over the lazy dog again and again\" 4) 35) length", value_set_long(35));
+	did_fail |= test_string("(take (drop \"the quick brown fox jumps over the lazy dog again and again\" 4) 35) contains? \"lazy\"", value_set_bool(TRUE));
+	did_fail |= test_string("(take (drop \"the quick brown fox jumps over the lazy dog again and again\" 4) 35) contains? \"dog\"", value_set_bool(FALSE));
+	did_fail |= test_string("(take (drop \"the quick brown fox jumps over the lazy dog again and again\" 4) 35) index \"lazy\"", value_set_long(31));
+	did_fail |= test_string("(take (drop \"the quick brown fox jumps over the lazy dog again and again\" 4) 35) starts_with? \"quick\"", value_set_bool(TRUE));
+	did_fail |= test_string("(take (drop \"the quick brown fox jumps over the lazy dog again and again\" 4) 35) ends_with? \"lazy\"", value_set_bool(TRUE));
+	did_fail |= test_string("\"lazy\" ends_with? \"the lazy\"", value_set_bool(FALSE));
+	did_fail |= test_string("((take (drop \"the quick brown fox jumps over the lazy dog again and again\" 4) 35) split \" \") length", value_set_long(7));
+	did_fail |= test_string("\"lazy$\" match? (take (drop \"the quick brown fox jumps over the lazy dog again and again\" 4) 35)", value_set_bool(TRUE));
+	did_fail |= test_string("\"^the\" match? (take (drop \"the quick brown fox jumps over the lazy dog again and again\" 4) 35)", value_set_bool(FALSE));
+	did_fail |= test_string("((take (drop \"the quick brown fox jumps over the lazy dog again and again\" 4) 35) + \"!\") ends_with? \"lazy!\"", value_set_bool(TRUE));
+	did_fail |= test_string("sl_a = drop \"the quick brown fox jumps over the lazy dog again and again\" 4; sl_b = sl_a + \"!\"; sl_a == (drop \"the quick brown fox jumps over the lazy dog again and again\" 4)", value_set_bool(TRUE));
+	did_fail |= test_string("(range (drop (\"a\" * 400) 1) 0 10) slice?", value_set_bool(FALSE));
+	did_fail |= test_string("(range (drop (\"a\" * 400) 1) 0 200) slice?", value_set_bool(TRUE));
+	
 	if (did_fail) {
 		printf("\nTest of strings failed.\n\n");
 	} else {
@@ -817,6 +1392,8 @@ int test_arrays()
 	value arr = value_set_ary_long(internal_arr, 4);
 	
 	int did_fail = FALSE;
+	// Every element of an array pays for the size of a value.
+	did_fail |= test_assert(sizeof(value) == 16, "a value is 16 bytes");
 	did_fail |= test_string("array 2 4 5 8", value_set(arr));
 	did_fail |= test_string("(array 2 4 5 8)", value_set(arr));
 	did_fail |= test_string("array", value_init(VALUE_ARY));
@@ -874,8 +1451,41 @@ int test_arrays()
 	did_fail |= test_string("(array 2 4 5 8) size", value_set_long(4));
 	did_fail |= test_string("(array) size", value_set_long(0));
 	
+	did_fail |= test_string("(array_with_capacity 100) capacity", value_set_long(100));
+	did_fail |= test_string("(array_with_capacity 100) size", value_set_long(0));
+	did_fail |= test_string("cap_ary = array_with_capacity 40; for (k :dotimes 40) { append! cap_ary k }; capacity cap_ary", value_set_long(40));
+	did_fail |= test_string("cap_ary = (array 2 4); reserve cap_ary 50; cap_ary append 5 append 8", value_set(arr));
+	did_fail |= test_string("cap_ary = (array 2 4); reserve cap_ary 50; cap_ary2 = cap_ary; capacity cap_ary2", value_set_long(50));
+	did_fail |= test_string("cap_ary = (array 2 4 5 8); reserve cap_ary 50; shrink! cap_ary; capacity cap_ary", value_set_long(4));
+	did_fail |= test_string("cap_ary = (array 2 4 5 8); reserve cap_ary 50; shrink! cap_ary; cap_ary", value_set(arr));
+	did_fail |= test_string("cap_ary = (array); reserve cap_ary 8; shrink! cap_ary; capacity cap_ary", value_set_long(0));
+	did_fail |= test_string("cap_ary = (array 1); reserve cap_ary (-- 1)", value_init_error());
+	did_fail |= test_string("cap_grows = (((memstats) at \"arrays\") at \"grows\"); cap_ary = array_with_capacity 1000; "
+			"for (k :dotimes 1000) { append! cap_ary k }; (((memstats) at \"arrays\") at \"grows\") - cap_grows", value_set_long(0));
+	did_fail |= test_string("cap_pk = pack(1 .. 40); reserve cap_pk 500; capacity cap_pk", value_set_long(500));
+	did_fail |= test_string("cap_pk = pack(1 .. 40); reserve cap_pk 500; shrink! cap_pk; capacity cap_pk", value_set_long(40));
+	did_fail |= test_string("cap_pk = pack(1 .. 40); reserve cap_pk 500; shrink! cap_pk; packed? cap_pk", value_set_bool(TRUE));
+	
 	did_fail |= test_string("(array 8 5 4 2) sort", value_set(arr));
 	did_fail |= test_string("(array 5 4 8 2) sort", value_set(arr));
+	did_fail |= test_string("(array 5 4.0 8 2.0) sort == (array 2.0 4.0 5 8)", value_set_bool(TRUE));
+	did_fail |= test_string("(array \"pear\" \"apple\" \"fig\") sort == (array \"apple\" \"fig\" \"pear\")", value_set_bool(TRUE));
+	int pattern;
+	for (pattern = 0; pattern <= 6; ++pattern)
+		did_fail |= test_sort_pattern(pattern, 5000);
+	for (pattern = 0; pattern <= 2; ++pattern)
+		did_fail |= test_sort_parallel(pattern, 20000, 4);
+	for (pattern = 0; pattern <= 2; ++pattern)
+		did_fail |= test_sort_radix(pattern, 20000);
+	
+	did_fail |= test_string("(array 5 8 4 2) sort_by (lambda (x) x)", value_set(arr));
+	did_fail |= test_string("(array 5 2 8 4) sort_by (lambda (x) (-- x)) == (array 8 5 4 2)", value_set_bool(TRUE));
+	did_fail |= test_string("(array \"pear\" \"fig\" \"apple\" \"kiwi\") sort_by (lambda (s) (length s)) "
+			"== (array \"fig\" \"pear\" \"kiwi\" \"apple\")", value_set_bool(TRUE));
+	did_fail |= test_string("(array 5 2 8 4) sort_with (lambda (a b) (a - b))", value_set(arr));
+	did_fail |= test_string("(array 5 2 8 4) sort_with (lambda (a b) (a > b)) == (array 8 5 4 2)", value_set_bool(TRUE));
+	did_fail |= test_string("(array (array 2 1) (array 1 2) (array 2 3) (array 1 4)) sort_with (lambda (a b) ((a at 0) - (b at 0))) "
+			"== (array (array 1 2) (array 1 4) (array 2 1) (array 2 3))", value_set_bool(TRUE));
 	
 	did_fail |= test_string("(array 2 4 2 5 8) uniq", value_set(arr));
 	did_fail |= test_string("(array 2 4 5 4 2 8) uniq", value_set(arr));
@@ -924,6 +1534,88 @@ int test_arrays()
 	did_fail |= test_string("(array 2 4 5 8 9 10 11) take 4", value_set(arr));
 	did_fail |= test_string("(array 1 2 3) take 0", value_init_nil());
 
+	long internal_range[] = { 2, 3, 4, 5 };
+	int internal_bools[] = { FALSE, TRUE, TRUE };
+	did_fail |= test_string("pack (array 2 4 5 8)", value_set_pak_long(internal_arr, 4));
+	did_fail |= test_string("pack (2 .. 5)", value_set_pak_long(internal_range, 4));
+	did_fail |= test_string("packed? (pack (array 2 4 5 8))", value_set_bool(TRUE));
+	did_fail |= test_string("packed? (pack (array 2 \"4\"))", value_set_bool(FALSE));
+	did_fail |= test_string("(pack (array 2 4 5 8)) at 2", value_set_long(5));
+	did_fail |= test_string("(pack (array 2 4 5 8)) size", value_set_long(4));
+	did_fail |= test_string("(pack (array 8 5 4 2)) sort", value_set(arr));
+	did_fail |= test_string("(pack (array true false true)) sort", value_set_pak_bool(internal_bools, 3));
+	did_fail |= test_string("(pack (array 2 4 5)) append 8", value_set(arr));
+	did_fail |= test_string("packed? ((pack (array 2 4 5)) append 8)", value_set_bool(TRUE));
+	did_fail |= test_string("packed? ((pack (array 2 4 5)) append \"8\")", value_set_bool(FALSE));
+	did_fail |= test_string("(pack (array 1 2 3 4)) map (lambda (v) (v + 1))", value_set_ary_long(internal_range, 4));
+	did_fail |= test_string("(pack (array 2 4 5 8)) join \"+\"", value_set_str("2+4+5+8"));
+	did_fail |= test_string("sum (pack (array 2 4 5 8))", value_set_long(19));
+	did_fail |= test_string("sum (pack (array 0.5 0.25))", value_set_double(0.75));
+	did_fail |= test_string("sum (pack (array 9223372036854775807 1))", value_set_str_smart("9223372036854775808", 10));
+	did_fail |= test_string("sum (array 2 4 5 8)", value_set_long(19));
+
+	long internal_sums[] = { 2, 6, 11, 19 };
+	double internal_halves[] = { 1, 2, 2.5, 4 };
+	long internal_floors[] = { -4, -4 };
+	did_fail |= test_string("vadd (array 1 2 2 4) (array 1 2 3 4)", value_set(arr));
+	did_fail |= test_string("packed? (vadd (array 1 2 2 4) (array 1 2 3 4))", value_set_bool(TRUE));
+	did_fail |= test_string("vsub (array 3 5 6 9) 1", value_set(arr));
+	did_fail |= test_string("vsub 10 (array 8 6 5 2)", value_set(arr));
+	did_fail |= test_string("vmul (pack (array 1 2 2.5 4)) 2", value_set(arr));
+	did_fail |= test_string("vdiv (array 2 4 5 8) 2.0", value_set_pak_double(internal_halves, 4));
+	did_fail |= test_string("vdiv (array 5 9 11 17) 2", value_set(arr));
+	did_fail |= test_string("vdiv (array (-- 7) 7) (array 2 (-- 2))", value_set_pak_long(internal_floors, 2));
+	did_fail |= test_string("packed? (vadd (array 9223372036854775807) 1)", value_set_bool(FALSE));
+	did_fail |= test_string("(vadd (array 9223372036854775807) 1) at 0", value_set_str_smart("9223372036854775808", 10));
+	did_fail |= test_string("vadd (array 1 2) (array 1 2 3)", value_init_error());
+	did_fail |= test_string("dot (array 2 4 5 8) (array 1 1 1 1)", value_set_long(19));
+	did_fail |= test_string("dot (array 0.5 1.5) (array 2 4)", value_set_double(7));
+	did_fail |= test_string("min (array 5 2 8 4)", value_set_long(2));
+	did_fail |= test_string("max (pack (array 5 2 8 4))", value_set_long(8));
+	did_fail |= test_string("min (array)", value_init_nil());
+	did_fail |= test_string("prefix_sum (array 2 4 5 8)", value_set_pak_long(internal_sums, 4));
+
+	did_fail |= test_string("(to_nd (array (array 1 2 3) (array 4 5 6))) at 1 0", value_set_long(4));
+	did_fail |= test_string("((to_nd (array (array 1 2 3) (array 4 5 6))) at 0 (1 .. 2)) == (array 2 3)", value_set_bool(TRUE));
+	did_fail |= test_string("shape (to_nd (array (array 1 2 3) (array 4 5 6))) == (array 2 3)", value_set_bool(TRUE));
+	did_fail |= test_string("size (to_nd (array (array 1 2 3) (array 4 5 6)))", value_set_long(6));
+	did_fail |= test_string("(type (to_nd (array 2 4 5 8))) == NDArray", value_set_bool(TRUE));
+	did_fail |= test_string("(ndarray (array 2 2) 7) == (array (array 7 7) (array 7 7))", value_set_bool(TRUE));
+	did_fail |= test_string("(transpose (to_nd (array (array 1 2 3) (array 4 5 6)))) == (array (array 1 4) (array 2 5) (array 3 6))", value_set_bool(TRUE));
+	did_fail |= test_string("(reshape (to_nd (array 1 2 3 4 5 6)) (array 3 2)) == (array (array 1 2) (array 3 4) (array 5 6))", value_set_bool(TRUE));
+	did_fail |= test_string("(reshape (transpose (to_nd (array (array 1 2) (array 3 4)))) 4) == (array 1 3 2 4)", value_set_bool(TRUE));
+	did_fail |= test_string("nd_a = to_nd (array (array 1 2) (array 3 4)); nd_b = nd_a; (nd_b[0][0] = 9); nd_a at 0 0", value_set_long(1));
+	did_fail |= test_string("nd_a = to_nd (array (array 1 2) (array 3 4)); nd_v = (nd_a at 1); (nd_v[0] = 9); nd_a at 1 0", value_set_long(3));
+	did_fail |= test_string("sum (to_nd (array 2 4 5 8))", value_set_long(19));
+	did_fail |= test_string("to_nd (array (array 1 2) (array 3))", value_init_error());
+	
+	did_fail |= test_string("(drop (1..100 to_a) 10) slice?", value_set_bool(TRUE));
+	did_fail |= test_string("(take (drop (1..100 to_a) 10) 40) == (11..50 to_a)", value_set_bool(TRUE));
+	did_fail |= test_string("(type (drop (1..100 to_a) 10)) == Array", value_set_bool(TRUE));
+	did_fail |= test_string("(drop (1..100 to_a) 10) at 5", value_set_long(16));
+	did_fail |= test_string("size (drop (1..100 to_a) 10)", value_set_long(90));
+	did_fail |= test_string("sum (drop (1..100 to_a) 50)", value_set_long(3775));
+	did_fail |= test_string("(drop (1..100 to_a) 10) index 50", value_set_long(39));
+	did_fail |= test_string("(drop (1..100 to_a) 10) contains? 5", value_set_bool(FALSE));
+	did_fail |= test_string("sl_a = drop (1..100 to_a) 10; sl_b = sl_a; (sl_b[0] = 0); sl_a at 0", value_set_long(11));
+	did_fail |= test_string("sl_a = drop (1..100 to_a) 10; (sl_a[0] = 0); slice? sl_a", value_set_bool(FALSE));
+	
+	did_fail |= test_string("(matmul (array (array 1 2) (array 3 4)) (array (array 5 6) (array 7 8))) == (array (array 19 22) (array 43 50))", value_set_bool(TRUE));
+	did_fail |= test_string("(matmul (array (array 1.5 2) (array 3 4)) (array (array 2 0) (array 0 2))) == (array (array 3.0 4) (array 6 8))", value_set_bool(TRUE));
+	did_fail |= test_string("(matvec (array (array 1 2) (array 3 4)) (array 1 1)) == (array 3 7)", value_set_bool(TRUE));
+	did_fail |= test_string("((matvec (array (array 0.1 0.2 0.3)) (array 0.4 0.5 0.6)) at 0) == (dot (array 0.1 0.2 0.3) (array 0.4 0.5 0.6))", value_set_bool(TRUE));
+	did_fail |= test_string("(matmul (array (array 1 1 1) (array 0 1 0)) (array 1 2 3)) == (array 6 2)", value_set_bool(TRUE));
+	did_fail |= test_string("(type (matmul (to_nd (array (array 1 2) (array 3 4))) (array (array 1 0) (array 0 1)))) == NDArray", value_set_bool(TRUE));
+	did_fail |= test_string("(transpose (array (array 1 2 3) (array 4 5 6))) == (array (array 1 4) (array 2 5) (array 3 6))", value_set_bool(TRUE));
+	did_fail |= test_string("(solve (array (array 2 0) (array 0 4)) (array 3 5)) == (array 1.5 1.25)", value_set_bool(TRUE));
+	did_fail |= test_string("matmul (array (array 1 2) (array 3 4)) (array (array 1 2 3))", value_init_error());
+	did_fail |= test_string("solve (array (array 1 2) (array 2 4)) (array 3 5)", value_init_error());
+	for (pattern = 0; pattern <= 2; ++pattern) {
+		did_fail |= test_matmul(pattern, 67, 130, 71, 1);
+		did_fail |= test_matmul(pattern, 67, 130, 71, 4);
+	}
+	did_fail |= test_solve(100, 1e-9);
+
 
 	did_fail |= test_string("(array 2 4 5 8)", value_set(arr));
 
@@ -1034,6 +1726,8 @@ int test_lists()
 	
 	did_fail |= test_string("(list 8 5 4 2) sort", value_set(arr));
 	did_fail |= test_string("(list 5 4 8 2) sort", value_set(arr));
+	did_fail |= test_string("(list 5 8 4 2) sort_by (lambda (x) x)", value_set(arr));
+	did_fail |= test_string("(list 5 4 8 2) sort_with (lambda (a b) (a < b))", value_set(arr));
 	
 //	did_fail |= test_string("(list 2 4 2 5 8) uniq", value_set(arr));
 //	did_fail |= test_string("(list 2 4 5 4 2 8) uniq", value_set(arr));
@@ -1142,6 +1836,197 @@ int test_controls()
 	did_fail |= test_string("if true then 3 { 5 }", value_set_long(3));
 	did_fail |= test_string("if false then 3 { 5 }", value_set_long(5));
 
+	// Memoized functions.
+	value def = interpret_given_statement(&test_vars, "defmemo memo_fib(n) { if (n < 2) { n } { memo_fib(n-1) + memo_fib(n-2) } }");
+	value_clear(&def);
+	did_fail |= test_string("memo_fib(60)", value_set_long(1548008755920));
+	did_fail |= test_string("(memo_stats :memo_fib) at \"misses\"", value_set_long(61));
+	did_fail |= test_string("memo_fib(60)", value_set_long(1548008755920));
+	did_fail |= test_string("(memo_stats :memo_fib) at \"hits\"", value_set_long(59));
+	
+	def = interpret_given_statement(&test_vars, "def lru_fib(n) { if (n < 2) { n } { lru_fib(n-1) + lru_fib(n-2) } }");
+	value_clear(&def);
+	def = interpret_given_statement(&test_vars, "memoize :lru_fib 3");
+	value_clear(&def);
+	did_fail |= test_string("lru_fib(30)", value_set_long(832040));
+	did_fail |= test_string("(memo_stats :lru_fib) at \"size\"", value_set_long(3));
+	
+	// Generators.
+	long internal_naturals[] = { 5, 6, 7, 8 };
+	def = interpret_given_statement(&test_vars, "def naturals(start :generator) { n = start; while true { yield n; n = n + 1 } }");
+	value_clear(&def);
+	did_fail |= test_string("naturals(5) take 4", value_set_ary_long(internal_naturals, 4));
+	did_fail |= test_string("next(naturals(5))", value_set_long(5));
+	
+	long internal_squares[] = { 25, 36, 49, 64 };
+	def = interpret_given_statement(&test_vars, "def squares(src :generator) { for (x :in src) { yield x * x } }");
+	value_clear(&def);
+	did_fail |= test_string("squares(naturals(5)) take 4", value_set_ary_long(internal_squares, 4));
+	
+	long internal_two[] = { 1, 2 };
+	def = interpret_given_statement(&test_vars, "def two(:generator) { yield 1; yield 2 }");
+	value_clear(&def);
+	did_fail |= test_string("to_a((two))", value_set_ary_long(internal_two, 2));
+	did_fail |= test_string("done?((two))", value_set_bool(FALSE));
+	
+	// Generators run on a stack of their own. Running out of it is an error, not a crash.
+	def = interpret_given_statement(&test_vars, "def deep(n) { if (n < 1) { 0 } { 1 + deep(n - 1) } }");
+	value_clear(&def);
+	def = interpret_given_statement(&test_vars, "def gen_deep(n :generator) { yield deep(n) }");
+	value_clear(&def);
+	did_fail |= test_string("next gen_deep(2000)", value_set_long(2000));
+	def = interpret_given_statement(&test_vars, "def bottomless(n) { 1 + bottomless(n) }");
+	value_clear(&def);
+	def = interpret_given_statement(&test_vars, "def gen_bottomless(n :generator) { yield bottomless(n) }");
+	value_clear(&def);
+	did_fail |= test_string("next gen_bottomless(0)", value_init_error());
+
+	
+	// Function bodies are optimized when they are defined.
+	def = interpret_given_statement(&test_vars, "def folded(x) { if (2 > 1) { x + (\"ab\" + \"cd\") } { x } }");
+	value_clear(&def);
+	did_fail |= test_string("folded(\"x\")", value_set_str("xabcd"));
+	def = interpret_given_statement(&test_vars, "def unfolded(x) { if x { \"abc\" at 10 } { (1 .. 3) to_a } }");
+	value_clear(&def);
+	long internal_unfolded[] = { 1, 2, 3 };
+	did_fail |= test_string("unfolded(false)", value_set_ary_long(internal_unfolded, 3));
+	
+	// Loop-invariant expressions are computed once, before the loop.
+	def = interpret_given_statement(&test_vars, "def hoisted(a n) { i = 0; total = 0; while (i < length(a)) { total += (a at i) * (n * 2); i += 1 }; total }");
+	value_clear(&def);
+	did_fail |= test_string("hoisted (array 1 2 3) 5", value_set_long(60));
+	def = interpret_given_statement(&test_vars, "def hoisted_for(a n) { total = 0; for (x :in a) { total += x * (n + 1) }; total }");
+	value_clear(&def);
+	did_fail |= test_string("hoisted_for (array 1 2 3) 4", value_set_long(30));
+	did_fail |= test_string("hoisted_for (array) 4", value_set_long(0));
+	did_fail |= test_string("hoisted_for (drop (1..100 to_a) 60) 0", value_set_long(3220));
+	
+	// Pulling from a generator gives a different result on each iteration, so it stays in the loop.
+	long internal_consumed[] = { 0, 1, 2, 3, 4, 5 };
+	def = interpret_given_statement(&test_vars, "def consume(g) { i = 0; out = (array); while (i < 3) { out = out + (take g 2); i += 1 }; out }");
+	value_clear(&def);
+	did_fail |= test_string("consume(naturals(0))", value_set_ary_long(internal_consumed, 6));
+	def = interpret_given_statement(&test_vars, "def consume_for(g) { out = (array); for (k :dotimes 3) { out = out + (to_a (take g 2)) }; out }");
+	value_clear(&def);
+	did_fail |= test_string("consume_for(naturals(0))", value_set_ary_long(internal_consumed, 6));
+	
+	// A call site that keeps seeing two integers is quickened, and goes back to the 
+	// generic function when it sees something else.
+	def = interpret_given_statement(&test_vars, "q = ((quicken_stats) at \"quickened\"); d = ((quicken_stats) at \"deoptimized\")");
+	value_clear(&def);
+	def = interpret_given_statement(&test_vars, "def running_total(a) { total = 0; for (x :in a) { total = total + x }; total }");
+	value_clear(&def);
+	did_fail |= test_string("running_total (array 1 2 3 4 5 6 7 8 9 10 0.5)", value_set_double(55.5));
+	did_fail |= test_string("((quicken_stats) at \"quickened\") - q", value_set_long(1));
+	did_fail |= test_string("((quicken_stats) at \"deoptimized\") - d", value_set_long(1));
+	
+	// What a site has seen lasts across calls, so a deoptimized site stays deoptimized and a 
+	// site that runs once per call is still quickened.
+	did_fail |= test_string("running_total (array 1 2 3 4 5 6 7 8 9 10)", value_set_long(55));
+	did_fail |= test_string("running_total (array 1 2 3 4 5 6 7 8 9 10)", value_set_long(55));
+	did_fail |= test_string("((quicken_stats) at \"quickened\") - q", value_set_long(1));
+	def = interpret_given_statement(&test_vars, "def quick_fib(n) { if (n < 2) { n } { quick_fib(n - 1) + quick_fib(n - 2) } }");
+	value_clear(&def);
+	def = interpret_given_statement(&test_vars, "q = ((quicken_stats) at \"quickened\")");
+	value_clear(&def);
+	did_fail |= test_string("quick_fib 12", value_set_long(144));
+	did_fail |= test_string("((quicken_stats) at \"quickened\") - q", value_set_long(4));
+	
+	// == and != sites are quickened for integers, floats and strings too.
+	def = interpret_given_statement(&test_vars, "def count_eq(a x) { n = 0; for (y :in a) { if (y == x) { n = n + 1 } }; n }");
+	value_clear(&def);
+	def = interpret_given_statement(&test_vars, "def count_ne(a x) { n = 0; for (y :in a) { if (y != x) { n = n + 1 } }; n }");
+	value_clear(&def);
+	def = interpret_given_statement(&test_vars, "q = ((quicken_stats) at \"quickened\")");
+	value_clear(&def);
+	did_fail |= test_string("count_eq (array 1 2 1 3 1 4 1 5 1 6) 1", value_set_long(5));
+	did_fail |= test_string("count_ne (array \"a\" \"b\" \"a\" \"c\" \"a\" \"d\" \"a\" \"e\") \"a\"", value_set_long(4));
+	did_fail |= test_string("((quicken_stats) at \"quickened\") - q", value_set_long(2));
+	did_fail |= test_string("count_eq (array 0.5 1.5 0.5 2.5 0.5 3.5 0.5 4.5 0.5 5.5) 0.5", value_set_long(5));
+	did_fail |= test_string("count_eq (array 1 2 1 3 1 4 1 5 1 1.0) 1", value_set_long(6));
+	
+	// A hot function that can't be compiled to C stays interpreted.
+	int orig_jit_enabled_p = jit_enabled_p;
+	jit_enabled_p = TRUE;
+	def = interpret_given_statement(&test_vars, "fails = ((jit_stats) at \"failed\")");
+	value_clear(&def);
+	def = interpret_given_statement(&test_vars, "def keep_quoted(x) { quote (x + 1) }");
+	value_clear(&def);
+	def = interpret_given_statement(&test_vars, "def count_quoted(n) { c = 0; for (k :dotimes n) { keep_quoted(k); c += 1 }; c }");
+	value_clear(&def);
+	did_fail |= test_string("count_quoted 1200", value_set_long(1200));
+	did_fail |= test_string("((jit_stats) at \"failed\") - fails", value_set_long(1));
+	
+	// A hot function that can be compiled runs natively once the compiler has finished.
+	char *orig_jit_cache_dir = jit_cache_dir;
+	char jit_dir[] = "/tmp/simfpl-jit-test.XXXXXX", jit_open_dir[] = "/tmp/simfpl-jit-test.XXXXXX";
+	char command[BUFSIZE];
+	if (mkdtemp(jit_dir) && mkdtemp(jit_open_dir)) {
+		jit_cache_dir = jit_dir;
+		def = interpret_given_statement(&test_vars, "natives = ((jit_stats) at \"native\")");
+		value_clear(&def);
+		def = interpret_given_statement(&test_vars, "def jit_poly(x) { x * x + 3 * x + 1 }");
+		value_clear(&def);
+		def = interpret_given_statement(&test_vars, "def call_poly(n) { t = 0; for (k :dotimes n) { t += jit_poly(k) }; t }");
+		value_clear(&def);
+		did_fail |= test_string("call_poly 1000", value_set_long(334333000));
+		int tries;
+		unsigned long orig_jit_loaded = jit_loaded, orig_jit_failed = jit_failed;
+		for (tries = 0; tries < 1000 && jit_loaded == orig_jit_loaded && jit_failed == orig_jit_failed; ++tries) {
+			usleep(20000);
+			def = interpret_given_statement(&test_vars, "jit_poly 2");
+			value_clear(&def);
+		}
+		did_fail |= test_string("jit_poly 7", value_set_long(71));
+		
+		// The compiler may not be able to build against these headers with the default 
+		// flags (SIMFPL_JIT_FLAGS). That says nothing about the JIT, so the native checks 
+		// are skipped.
+		int native_p = jit_failed == orig_jit_failed;
+		if (native_p) {
+			did_fail |= test_string("((jit_stats) at \"native\") - natives", value_set_long(1));
+			
+			// An argument that is an error is returned before the native code runs.
+			did_fail |= test_string("jit_poly (nil nil)", value_init_error());
+		} else printf("Skipping the native JIT tests: %s could not compile with \"%s\".\n", jit_cc, jit_flags);
+		
+		// Nothing is loaded from a cache directory that other users can get into.
+		chmod(jit_open_dir, 0755);
+		jit_cache_dir = jit_open_dir;
+		def = interpret_given_statement(&test_vars, "fails = ((jit_stats) at \"failed\")");
+		value_clear(&def);
+		def = interpret_given_statement(&test_vars, "def jit_poly2(x) { x * x + 2 }");
+		value_clear(&def);
+		def = interpret_given_statement(&test_vars, "def call_poly2(n) { t = 0; for (k :dotimes n) { t += jit_poly2(k) }; t }");
+		value_clear(&def);
+		did_fail |= test_string("call_poly2 1000", value_set_long(332835500));
+		did_fail |= test_string("((jit_stats) at \"failed\") - fails", value_set_long(1));
+		if (native_p)
+			did_fail |= test_string("((jit_stats) at \"native\") - natives", value_set_long(1));
+		
+		snprintf(command, BUFSIZE, "rm -rf '%s' '%s'", jit_dir, jit_open_dir);
+		system(command);
+	} else did_fail |= test_assert(FALSE, "could not make a JIT cache directory");
+	jit_cache_dir = orig_jit_cache_dir;
+	jit_enabled_p = orig_jit_enabled_p;
+	
+	// The profiler counts the calls to each function.
+	def = interpret_given_statement(&test_vars, "def prof_fib(n) { if (n < 2) { n } { prof_fib(n-1) + prof_fib(n-2) } }");
+	value_clear(&def);
+	def = interpret_given_statement(&test_vars, "profile_start()");
+	value_clear(&def);
+	did_fail |= test_string("prof_fib 10", value_set_long(55));
+	did_fail |= test_string("((profile_stop) at \"prof_fib\") at \"calls\"", value_set_long(177));
+	
+	// With memory tracking on, memstats sees the blocks that an array allocates.
+	int orig_memory_tracking_p = memory_tracking_p;
+	memory_tracking_p = TRUE;
+	def = interpret_given_statement(&test_vars, "allocs = ((memstats) at \"allocations\")");
+	value_clear(&def);
+	did_fail |= test_string("mem_ary = (1 .. 100) to_a; ((memstats) at \"allocations\") > allocs", value_set_bool(TRUE));
+	did_fail |= test_string("((((memstats) at \"types\") at \"Array\") at \"bytes\") > 0", value_set_bool(TRUE));
+	memory_tracking_p = orig_memory_tracking_p;
+
 	print_errors_p = orig_print_errors_p;
 
 	if (did_fail) {
@@ -1159,7 +2044,7 @@ int test_controls()
 
 int print_time(time_t time)
 {
-	printf("%ld sec, %ld msec\n", time / 1000000, time % 1000);
+	printf("%ld sec, %ld msec\n", time / 1000000, time / 1000 % 1000);
 }
 
 /* 
@@ -1243,6 +2128,15 @@ int sort_speeds(int min_length, int max_length, int max_repeats)
 		printf("time to sort %d items using custom1: ", length);
 		print_time(finish - start - time);		
 		
+		start = usec();
+		for (i = 0; i < max_repeats / length; ++i) {
+			fill_array(array, length);
+			radix_sort(array, length);
+		}
+		finish = usec();
+		printf("time to sort %d items using radix: ", length);
+		print_time(finish - start - time);
+		
 		printf("\n");
 	}
 	
@@ -1299,6 +2193,27 @@ int value_sort_speeds(int min_length, int max_length, int max_repeats)
 		printf("time to sort %d items using cutoff 24: ", length);
 		print_time(finish - start - time);
 		
+		start = usec();
+		for (i = 0; i < max_repeats / length; ++i) {
+			vshuffle_array(array, length);
+			value_private_sort_radix_int(array, length);
+		}
+		finish = usec();
+		printf("time to sort %d items using radix: ", length);
+		print_time(finish - start - time);
+		
+		int threads;
+		for (threads = 1; threads <= value_sort_threads(); threads *= 2) {
+			start = usec();
+			for (i = 0; i < max_repeats / length; ++i) {
+				vshuffle_array(array, length);
+				value_private_sort_parallel(array, length, threads);
+			}
+			finish = usec();
+			printf("time to sort %d items using %d threads: ", length, threads);
+			print_time(finish - start - time);
+		}
+		
 		printf("\n");
 	}
 	
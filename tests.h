@@ -12,6 +12,14 @@
 
 value test_vars;
 
+#define BENCHMARK_MAX 64
+
+struct benchmark_result {
+	char *name;
+	double median, p95; // Wall time in microseconds.
+	size_t peak_rss; // The largest peak memory of any run, in bytes.
+};
+
 int init_tests();
 
 time_t usec();
@@ -25,15 +33,30 @@ int run_tests();
 /*
  * Run several benchmarks to determine how fast the program is running.
  */
-int run_benchmarks();
-
+int run_benchmarks(int argc, const char *argv[]);
 
+int time_benchmark(struct benchmark_result *res, int runs, int warmups);
 int import_benchmark(char *name);
+int compare_doubles(const void *a, const void *b);
+int write_benchmark_json(const char *path, struct benchmark_result *results, int count);
+int read_benchmark_baseline(const char *path, char *name, double *median);
 int set_benchmark1();
 
 int test_assert(int p, char *description);
 int test_sexp(char *str, value sexp, value expected);
 int test_string(char *str, value expected);
+int test_vector_accuracy(int func, double min, double max, long max_ulps);
+int test_vector_precision(int func, char *str);
+int test_sort_pattern(int pattern, size_t length);
+long test_sort_comparisons;
+int test_sort_counting_cmp(struct value_sort *sort, value op1, value op2);
+int test_sort_same(value *array, size_t length, int (*f)(value array[], size_t length, int threads), int threads);
+int test_sort_parallel(int type, size_t length, int threads);
+int test_sort_radix(int type, size_t length);
+int test_sort_fast(value array[], size_t length, int threads);
+value test_matrix_random(int type, size_t rows, size_t cols);
+int test_matmul(int type, size_t rows, size_t inner, size_t cols, int threads);
+int test_solve(size_t n, double tolerance);
 
 int test_inputs();
 int test_to_prefix();
@@ -47,6 +70,55 @@ int test_inputs();
 int test_controls();
 
 
+/*
+ * Declarations for microbench.c
+ * 
+ * See microbench.c for documentation.
+ */
+
+#define MICROBENCH_BATCH 1024
+#define MICROBENCH_PIECE 64
+
+struct microbench {
+	char *name;
+	int (*setup)(struct microbench *mb);
+	double (*run)(struct microbench *mb, size_t iters);
+	int arg1; // Usually a type.
+	long arg2; // Usually a size.
+	value a, b, keys; // Operands made by (setup).
+};
+
+int microbench_main(int argc, const char *argv[]);
+int microbench_measure(struct microbench *mb, int samples, double target, 
+		double *mean, double *interval, double *fastest);
+int microbench_clear(struct microbench *mb);
+double microbench_now();
+value microbench_make(int type, long size);
+
+int microbench_setup_scalar(struct microbench *mb);
+int microbench_setup_container(struct microbench *mb);
+int microbench_setup_hash(struct microbench *mb);
+int microbench_setup_pair(struct microbench *mb);
+int microbench_setup_matrix(struct microbench *mb);
+
+double microbench_run_set(struct microbench *mb, size_t iters);
+double microbench_run_clear(struct microbench *mb, size_t iters);
+double microbench_run_hash_get(struct microbench *mb, size_t iters);
+double microbench_run_hash_put(struct microbench *mb, size_t iters);
+double microbench_run_hash_build(struct microbench *mb, size_t iters);
+double microbench_run_add(struct microbench *mb, size_t iters);
+double microbench_run_append_now(struct microbench *mb, size_t iters);
+double microbench_run_cons(struct microbench *mb, size_t iters);
+double microbench_run_cast(struct microbench *mb, size_t iters);
+double microbench_run_put(struct microbench *mb, size_t iters);
+double microbench_run_matmul(struct microbench *mb, size_t iters);
+double microbench_run_matmul_naive(struct microbench *mb, size_t iters);
+double microbench_run_matvec(struct microbench *mb, size_t iters);
+double microbench_run_solve(struct microbench *mb, size_t iters);
+double microbench_run_slice(struct microbench *mb, size_t iters);
+double microbench_run_slice_copy(struct microbench *mb, size_t iters);
+
+
 int sort_speeds(int min_length, int max_length, int max_repeats);
 int value_sort_speeds(int min_length, int max_length, int max_repeats);
 int small_sort_speeds();
@@ -32,6 +32,9 @@
 #ifndef REGEX_H
 #include <regex.h>
 #endif
+#ifndef SIGNAL_H
+#include <signal.h>
+#endif
 #ifndef STDARG_H
 #include <stdarg.h>
 #endif
@@ -47,6 +50,9 @@
 #ifndef TIME_H
 #include <time.h>
 #endif
+#ifndef UCONTEXT_H
+#include <ucontext.h>
+#endif
 
 
 #define E_TYPE unsigned int
@@ -65,26 +71,79 @@
 
 #define string_to_number(string) value_set_str(string, 0)
 
+// length is 32 bits so that the type of a value fits in the rest of the word, and a 
+// value stays 16 bytes. An array can hold at most ARRAY_MAX_LENGTH elements. How many 
+// elements (a) has room for is kept in the value just before a[0]; see 
+// value_array_capacity().
 struct value_array {
 	struct value_struct *a;
-	size_t length;
-};
+	uint32_t length;
+} __attribute__((packed));
+
+#define ARRAY_MAX_LENGTH UINT32_MAX
 
 struct value_hash {
 	struct value_struct *a;
 	size_t length, occupied, size;
 };
 
+// Same layout as value_array.
 struct value_block {
 	struct value_struct *a;
+	uint32_t length;
+} __attribute__((packed));
+
+// An array of integers, floats or booleans stored unboxed. See value_packed.c.
+struct value_packed {
+	int kind; // PACKED_INT, PACKED_FLOAT or PACKED_BOOL.
+	size_t length, capacity;
+	union {
+		int64_t *z;
+		double *f;
+		uint8_t *b;
+	} a;
+};
+
+#define ND_MAX_RANK 8
+
+// The elements behind one or more n-dimensional arrays. Every array that shares them 
+// counts toward (refcount). See value_nd.c.
+struct value_nd_data {
+	size_t refcount;
 	size_t length;
-	char *s;
+	struct value_struct *a;
+};
+
+// An n-dimensional array. Element (i, j, ...) is data->a[offset + i * strides[0] + 
+// j * strides[1] + ...], so a slice or a transpose is just a different header.
+struct value_nd {
+	struct value_nd_data *data;
+	size_t offset;
+	int rank;
+	size_t shape[ND_MAX_RANK];
+	size_t strides[ND_MAX_RANK];
+};
+
+// The characters of a string, or the elements of an array, behind one or more slices. 
+// Every slice that shares them counts toward (refcount). See value_slice.c.
+struct value_slice_data {
+	size_t refcount;
+	size_t length;
+	char *s; // NULL if the slices are of an array.
+	struct value_struct *a; // NULL if the slices are of a string.
+};
+
+// (length) characters or elements of (data), starting at (offset). A value points to 
+// its own header, since the header is bigger than the rest of a value.
+struct value_slice {
+	struct value_slice_data *data;
+	uint32_t offset, length;
 };
 
 struct value_stop {
-	int type : 8;
 	struct value_struct *core;
-};
+	int type : 8;
+} __attribute__((packed));
 
 #define STOP_BREAK 0
 #define STOP_CONTINUE 1
@@ -100,19 +159,40 @@ struct value_spec {
 	int needs_variables_p : 2;
 	int keep_arg_p : 2;
 	int delay_eval_p : 2;
-	int argc;
-	int optional; // Every argument after this one is optional.
+	// These share a word with the flags above, so that a spec stays small enough to 
+	// fit in a value.
+	int packed_aware_p : 2; // The function is given packed arrays as they are.
+	int nd_aware_p : 2; // The function is given n-dimensional arrays as they are.
+	int slice_aware_p : 2; // The function is given slices as they are.
+	int16_t argc;
+	int16_t optional; // Every argument after this one is optional. SPEC_NO_OPTIONAL if none are.
 	int rest_p : 2;
 	char associativity;
 	int precedence : 8;
 	int not_stop_p : 2; // Internal. Used by iterators only.
+	int generator_p : 2; // Calling the function returns a generator instead of running the body.
+	int pure_p : 2; // The function has no side effects, so it can be evaluated ahead of time.
 };
 
+#define SPEC_NO_OPTIONAL INT16_MAX
+
 #define NEEDS_UD_FUNCTIONS -1
 
+// What a call site has seen, for quickening. See value_private_observe_site(). Every 
+// copy of the call site points to the same one, so (refcount) keeps track of how many 
+// copies there are.
+struct value_site {
+	size_t refcount;
+	struct value_struct (*f)(int argc, struct value_struct *argv); // The specialized function once the site is quickened, otherwise NULL.
+	int seen_type1;
+	int seen_type2;
+	int seen_count;
+};
+
 struct value_bif {
 	struct value_spec spec;
 	struct value_struct (*f)(int argc, struct value_struct *argv);
+	struct value_site *site; // NULL if the call site isn't watched for quickening.
 };
 
 typedef struct value_exception {
@@ -123,23 +203,24 @@ typedef struct value_exception {
 } exception;
 
 /* 
- * The definition for the value struct.
+ * The definition for the value struct. The union is packed to 12 bytes, and the 
+ * type takes the word after it, so a value is 16 bytes. Anything bigger than the 
+ * union lives out of line.
  */
 typedef struct value_struct {
-	int type : 8;
 	union {
 		int u_b;
 		int u_nil;
 		long u_z;
 		double u_f;
-		mpz_t u_mz;
-		mpfr_t u_mf;
+		mpz_ptr u_mz; // Use value_box_mpz() to allocate it.
+		mpfr_ptr u_mf; // Use value_box_mpf() to allocate it.
 		char *u_s;
 		char *u_x; // Regex.
 		struct value_array u_a;
 		struct value_struct *u_l;
 		struct value_pair *u_p;
-		struct value_hash u_h;
+		struct value_hash *u_h;
 		struct value_struct *u_ptr;
 		struct tree_struct *u_t;
 		struct value_range *u_r;
@@ -151,9 +232,14 @@ typedef struct value_struct {
 		int u_type;
 		struct value_bif *u_bif;
 		struct value_function *u_udf; // Contains a pointer to an ID with the name.
-		struct value_exception u_exc;
-	} core;
-} value;
+		struct value_exception *u_exc;
+		struct value_generator *u_gen;
+		struct value_packed *u_pk;
+		struct value_nd *u_nd;
+		struct value_slice *u_sl;
+	} __attribute__((packed)) core;
+	int type : 8;
+} __attribute__((aligned(8))) value;
 
 // These have to be defined after value_struct because they contain a value_struct.
 
@@ -173,6 +259,148 @@ struct value_function {
 	struct value_spec spec;
 	struct value_struct vars; // A block containing the variable names.
 	struct value_struct body;
+	struct value_memo *memo; // The result cache if the function is memoized, otherwise NULL.
+	struct value_jit *jit; // Shared by every copy of a named function, otherwise NULL.
+};
+
+struct value_memo_entry {
+	struct value_struct args;
+	struct value_struct result;
+	size_t prev;
+	size_t next;
+};
+
+// A memoized function's result cache. Every copy of the function points to the same 
+// cache, so (refcount) keeps track of how many copies there are.
+struct value_memo {
+	size_t refcount;
+	size_t capacity;
+	size_t size;
+	size_t hits;
+	size_t misses;
+	size_t head; // The most recently used entry.
+	size_t tail; // The least recently used entry. This is the next one to be evicted.
+	struct value_struct index; // A hash from argument arrays to entry numbers.
+	struct value_memo_entry *entries;
+};
+
+struct value_jit {
+	size_t refcount;
+	unsigned long calls;
+	int state; // JIT_INTERPRETED, JIT_COMPILING, JIT_NATIVE or JIT_FAILED.
+	int pid; // The compiler's process while the state is JIT_COMPILING.
+	char *path; // The shared object.
+	struct value_struct (*f)(int argc, struct value_struct *argv); // The native function, once it is loaded.
+};
+
+// The state of one sort, passed to every comparison. See value_private_sort_array().
+struct value_sort {
+	int (*cmp)(struct value_sort *sort, struct value_struct op1, struct value_struct op2);
+	int error_p; // Set when two of the elements could not be compared.
+	
+	// For sort_with(). See value_private_sort_cmp_block().
+	struct value_struct *variables;
+	struct value_struct func;
+	struct value_struct result; // The error or stop that ended the sort, or nil.
+};
+
+// An integer to be radix sorted, as an unsigned key, and where it came from.
+struct value_radix_key {
+	uint64_t key;
+	size_t index;
+};
+
+// The shared state of a parallel sort. See value_private_sort_parallel().
+struct value_sort_team {
+	struct value_sort sort;
+	struct value_struct *array;
+	struct value_struct *temp; // The elements grouped by bucket.
+	unsigned char *buckets; // The bucket of each element of (array).
+	size_t length;
+	int threads; // Also the number of buckets.
+	struct value_struct *splitters; // (threads - 1) of them, in order.
+	size_t *counts; // counts[t * threads + b] is how many of thread t's elements are in bucket b.
+};
+
+struct value_sort_worker {
+	struct value_sort_team *team;
+	int id;
+	int round; // SORT_ROUND_CLASSIFY, SORT_ROUND_SCATTER or SORT_ROUND_SORT.
+};
+
+// A matrix or vector of numbers, stored row-major. See value_matrix.c.
+struct value_matrix {
+	size_t rows, cols;
+	int vector_p; // A vector is stored as one column.
+	int kind; // PACKED_INT for (z), PACKED_FLOAT for (f) or PACKED_NONE for (a).
+	int64_t *z;
+	double *f;
+	struct value_struct *a;
+};
+
+// The shared state of a parallel matrix product. See value_private_matrix_mul_fast().
+struct value_matrix_team {
+	struct value_matrix *a, *b, *c;
+	int threads;
+};
+
+struct value_matrix_worker {
+	struct value_matrix_team *team;
+	int id;
+	int bad_p; // Whether an integer overflowed.
+};
+
+// One function, or one folded stack, in the profile. See profile.c.
+struct value_profile_entry {
+	char *key;
+	unsigned long calls;
+	double inclusive, exclusive;
+	unsigned long samples;
+	int active; // How many frames for this function are on the stack.
+};
+
+struct value_profile_frame {
+	size_t entry;
+	double start;
+	double children; // Inclusive time of the functions this one called.
+	size_t path_length; // Length of the folded stack below this frame.
+};
+
+struct value_profile_name {
+	struct value_struct (*f)(int argc, struct value_struct *argv);
+	char *name;
+};
+
+// A block of memory that's being tracked. See memory.c.
+struct value_memory_block {
+	void *ptr;
+	size_t size;
+	int category;
+	int site;
+};
+
+// The memory allocated from one call site, or for one type of value.
+struct value_memory_site {
+	const char *file;
+	int line;
+	size_t live_bytes, live_blocks;
+	size_t allocations;
+};
+
+struct value_generator {
+	size_t refcount;
+	int state;
+	int buffered_p; // Is there a yielded value that hasn't been pulled out yet?
+	int closing_p;
+	int error_p;
+	ucontext_t context; // The generator's own context.
+	ucontext_t caller; // The context that most recently resumed the generator.
+	char *stack;
+	struct value_generator *outer; // The generator that was running when this one was resumed.
+	struct value_struct func;
+	struct value_struct args;
+	struct value_struct scope;
+	struct value_struct yielded;
 };
 
 FILE *input_stream;
@@ -197,10 +425,43 @@ int same_type_determiner;
  * is VALUE_STR and size is 10, enough memory will be allocated for a 
  * 10-character string (9 text and 1 null terminator).
  * 
+ * The macros pass in the caller's file and line so that the allocation can 
+ * be charged to it when memory tracking is on. See memory.c.
+ * 
  * Defined in value.c.
  */
-void * value_malloc(value *op, size_t size);
-void * value_realloc(value *op, size_t size);
+#define value_malloc(op, size) value_malloc_at((op), (size), __FILE__, __LINE__)
+#define value_realloc(op, size) value_realloc_at((op), (size), __FILE__, __LINE__)
+
+/* 
+ * An mpfr_t is too big to fit in a value, so floats live outside of it. This 
+ * makes (op) a float and allocates the number for it, and evaluates to the 
+ * number so that it can go straight into an mpfr init function:
+ * 
+ *   mpfr_init2(value_box_mpf(&res), prec);
+ * 
+ * mpfr's init_set functions are macros that use their first argument twice, 
+ * so box the value in its own statement before calling one of them. 
+ * value_clear() frees the number.
+ */
+#define value_box_mpf(op) ((op)->type = VALUE_MPF, (mpfr_ptr) value_malloc((op), 1))
+
+/* 
+ * The same for integers:
+ * 
+ *   mpz_init(value_box_mpz(&res));
+ */
+#define value_box_mpz(op) ((op)->type = VALUE_MPZ, (mpz_ptr) value_malloc((op), 1))
+
+/* 
+ * The number of elements (a), the elements of an array or block, has room for. 
+ * value_malloc() and value_realloc() keep it in the value before a[0], so free the 
+ * elements with value_free_elements() rather than value_free().
+ */
+#define value_array_capacity(a) ((a) ? (size_t) (a)[-1].core.u_z : 0)
+#define value_free_elements(a) value_free_at((a) ? (void *) ((a) - 1) : NULL)
+void * value_malloc_at(value *op, size_t size, const char *file, int line);
+void * value_realloc_at(value *op, size_t size, const char *file, int line);
 
 /* 
  * Return Codes
@@ -208,7 +469,8 @@ void * value_realloc(value *op, size_t size);
  * -1: ptr could not be freed.
  */
 //int value_value_free(void *ptr);
-#define value_free(ptr) free(ptr)
+#define value_free(ptr) value_free_at(ptr)
+void value_free_at(void *ptr);
 
 /* 
  * This function must be called for the other functions in tools.c to work.
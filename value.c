@@ -29,10 +29,15 @@ int init_values()
 	value_nil_function_spec.keep_arg_p = FALSE;
 	value_nil_function_spec.delay_eval_p = FALSE;
 	value_nil_function_spec.argc = 0;
-	value_nil_function_spec.optional = INT_MAX;
+	value_nil_function_spec.optional = SPEC_NO_OPTIONAL;
 	value_nil_function_spec.rest_p = FALSE;
 	value_nil_function_spec.associativity = '\0';
 	value_nil_function_spec.precedence = 0;
+	value_nil_function_spec.generator_p = FALSE;
+	value_nil_function_spec.pure_p = FALSE;
+	value_nil_function_spec.packed_aware_p = FALSE;
+	value_nil_function_spec.nd_aware_p = FALSE;
+	value_nil_function_spec.slice_aware_p = FALSE;
 
 	generic_error = exception_init(NULL, "GenericError");
 	runtime_error = exception_init(&generic_error, "RuntimeError");
@@ -123,6 +128,14 @@ const char * type_to_string(int type)
 			return "Function";
 		case VALUE_UDF_SHELL:
 			return "FunctionShell";
+		case VALUE_GEN:
+			return "Generator";
+		case VALUE_PAK:
+			return "PackedArray";
+		case VALUE_NDA:
+			return "NDArray";
+		case VALUE_SLC:
+			return "Slice";
 		case VALUE_TYP:
 			return "Type";
 		case VALUE_MISSING_ARG:
@@ -189,10 +202,10 @@ value value_init(int type)
 			res.core.u_b = FALSE;
 			break;
 		case VALUE_MPZ:
-			mpz_init(res.core.u_mz);
+			mpz_init(value_box_mpz(&res));
 			break;
 		case VALUE_MPF:
-			mpfr_init(res.core.u_mf);
+			mpfr_init(value_box_mpf(&res));
 			break;
 		case VALUE_STR:
 		case VALUE_RGX:
@@ -226,10 +239,13 @@ value value_init(int type)
 			value_error(1, "Error: Cannot initialize a range.");
 			res.type = VALUE_ERROR;
 			break;
+		case VALUE_GEN:
+			value_error(1, "Error: Cannot initialize a generator.");
+			res.type = VALUE_ERROR;
+			break;
 		case VALUE_BLK:
 			res.core.u_blk.a = NULL;
 			res.core.u_blk.length = 0;
-			res.core.u_blk.s = NULL;
 			break;
 		case VALUE_PTR:
 			res.core.u_ptr = NULL;
@@ -245,6 +261,8 @@ value value_init(int type)
 			res.core.u_udf->vars = value_init_nil();
 			res.core.u_udf->body = value_init_nil();
 			res.core.u_udf->spec = compile_spec("0l15");
+			res.core.u_udf->memo = NULL;
+			res.core.u_udf->jit = NULL;
 			break;
 		default:
 			value_error(1, "Type Error: init() is undefined for type %d.", type);
@@ -272,9 +290,11 @@ int value_clear(value *op)
 		break;
 	case VALUE_MPZ:
 		mpz_clear(op->core.u_mz);
+		value_free(op->core.u_mz);
 		break;
 	case VALUE_MPF:
 		mpfr_clear(op->core.u_mf);
+		value_free(op->core.u_mf);
 		break;
 	case VALUE_STR:
 	case VALUE_RGX:
@@ -287,7 +307,7 @@ int value_clear(value *op)
 		if (op->core.u_a.a) {
 			for (i = 0; i < op->core.u_a.length; ++i)
 				value_clear(&(op->core.u_a.a[i]));
-			value_free(op->core.u_a.a);
+			value_free_elements(op->core.u_a.a);
 		}
 		break;
 	case VALUE_LST:
@@ -322,14 +342,24 @@ int value_clear(value *op)
 		value_clear(&op->core.u_r->max);
 		value_free(op->core.u_r);
 		break;
+	case VALUE_GEN:
+		value_private_generator_free(op->core.u_gen);
+		break;
+	case VALUE_PAK:
+		value_packed_clear(op);
+		break;
+	case VALUE_NDA:
+		value_nd_clear(op);
+		break;
+	case VALUE_SLC:
+		value_slice_clear(op);
+		break;
 	case VALUE_BLK:
 		length = value_length(*op);
 		for (i = 0; i < length; ++i)
 			value_clear(&(op->core.u_blk.a[i]));
 		if (op->core.u_blk.a)
-			value_free(op->core.u_blk.a);
-		if (op->core.u_blk.s)
-			value_free(op->core.u_blk.s);
+			value_free_elements(op->core.u_blk.a);
 		break;
 	case VALUE_STOP:
 		if (op->core.u_stop.core) {
@@ -338,8 +368,11 @@ int value_clear(value *op)
 		}
 		break;
 	case VALUE_BIF:
-		if (op->core.u_bif)
+		if (op->core.u_bif) {
+			if (op->core.u_bif->site)
+				value_private_site_free(op->core.u_bif->site);
 			value_free(op->core.u_bif);
+		}
 		break;
 	case VALUE_UDF:
 	case VALUE_UDF_SHELL:
@@ -347,21 +380,22 @@ int value_clear(value *op)
 			value_free(op->core.u_udf->name);
 		value_clear(&op->core.u_udf->vars);
 		value_clear(&op->core.u_udf->body);
+		if (op->core.u_udf->memo)
+			value_private_memo_free(op->core.u_udf->memo);
+		if (op->core.u_udf->jit)
+			value_jit_free(op->core.u_udf->jit);
 		value_free(op->core.u_udf);
 		break;
 	case VALUE_EXC:
-		if (op->core.u_exc.name)
-			value_free(op->core.u_exc.name);
-		if (op->core.u_exc.description)
-			value_free(op->core.u_exc.description);
-		if (op->core.u_exc.stack_trace) {
-			value_clear(op->core.u_exc.stack_trace);
-			value_free(op->core.u_exc.stack_trace);
+		if (op->core.u_exc->name)
+			value_free(op->core.u_exc->name);
+		if (op->core.u_exc->description)
+			value_free(op->core.u_exc->description);
+		if (op->core.u_exc->stack_trace) {
+			value_clear(op->core.u_exc->stack_trace);
+			value_free(op->core.u_exc->stack_trace);
 		}
-		op->core.u_exc.parent = NULL;
-		op->core.u_exc.name = NULL;
-		op->core.u_exc.description = NULL;
-		op->core.u_exc.stack_trace = NULL;
+		value_free(op->core.u_exc);
 		break;
 	default:
 		value_error(1, "Error: In value_clear(), undefined op type %d.", op->type);
@@ -393,9 +427,11 @@ value value_set(value op)
 		res.core.u_b = op.core.u_b;
 		break;
 	case VALUE_MPZ:
+		value_box_mpz(&res);
 		mpz_init_set(res.core.u_mz, op.core.u_mz);
 		break;
 	case VALUE_MPF:
+		value_box_mpf(&res);
 		mpfr_init_set(res.core.u_mf, op.core.u_mf, value_mpfr_round);
 		break;
 	case VALUE_STR: case VALUE_RGX: case VALUE_SYM: case VALUE_ID: case VALUE_VAR:
@@ -404,13 +440,18 @@ value value_set(value op)
 		strcpy(res.core.u_s, op.core.u_s);
 		break;
 	case VALUE_ARY:
-		if (op.core.u_a.a) {
-			value_malloc(&res, next_size(op.core.u_a.length));
+		// The copy has the same capacity as the original, so room set aside with reserve() 
+		// survives assignment.
+		if (value_array_capacity(op.core.u_a.a)) {
+			value_malloc(&res, value_array_capacity(op.core.u_a.a));
 			return_if_error(res);
 			for (i = 0; i < op.core.u_a.length; ++i)
 				res.core.u_a.a[i] = value_set(op.core.u_a.a[i]);
 			res.core.u_a.length = op.core.u_a.length;
-		} else res.core.u_a.a = NULL;
+		} else {
+			res.core.u_a.a = NULL;
+			res.core.u_a.length = 0;
+		}
 		break;
 	case VALUE_LST:
 		// This is more complicated than the recursive version, but it's nearly twice 
@@ -448,15 +489,17 @@ value value_set(value op)
 		break;
 
 	case VALUE_HSH:
-		// Notice that (op.core.u_h.length) will already be a legal size, so a call to next_size() 
+		res.core.u_h = value_malloc(NULL, sizeof(struct value_hash));
+		return_if_null(res.core.u_h);
+		// Notice that (op.core.u_h->length) will already be a legal size, so a call to next_size() 
 		// is not necessary.
-		value_malloc(&res, op.core.u_h.length);
+		value_malloc(&res, op.core.u_h->length);
 		return_if_error(res);
-		for (i = 0; i < op.core.u_h.length; ++i)
-			res.core.u_h.a[i] = value_set(op.core.u_h.a[i]);
-		res.core.u_h.length = op.core.u_h.length;
-		res.core.u_h.size = op.core.u_h.size;
-		res.core.u_h.occupied = op.core.u_h.occupied;
+		for (i = 0; i < op.core.u_h->length; ++i)
+			res.core.u_h->a[i] = value_set(op.core.u_h->a[i]);
+		res.core.u_h->length = op.core.u_h->length;
+		res.core.u_h->size = op.core.u_h->size;
+		res.core.u_h->occupied = op.core.u_h->occupied;
 		break;
 	case VALUE_RNG:
 		value_malloc(&res, sizeof(struct value_range));
@@ -465,6 +508,20 @@ value value_set(value op)
 		res.core.u_r->min = value_set(op.core.u_r->min);
 		res.core.u_r->max = value_set(op.core.u_r->max);
 		break;
+	case VALUE_GEN:
+		// Generators are shared, not copied.
+		res.core.u_gen = op.core.u_gen;
+		++res.core.u_gen->refcount;
+		break;
+	case VALUE_PAK:
+		res = value_packed_set(op);
+		break;
+	case VALUE_NDA:
+		res = value_nd_set(op);
+		break;
+	case VALUE_SLC:
+		res = value_slice_set(op);
+		break;
 	case VALUE_PTR:
 		res.core.u_ptr = op.core.u_ptr;
 		break;
@@ -474,13 +531,6 @@ value value_set(value op)
 		return_if_error(res);
 		for (i = 0; i < length; ++i)
 			res.core.u_blk.a[i] = value_set(op.core.u_blk.a[i]);
-		if (op.core.u_blk.s == NULL)
-			res.core.u_blk.s = NULL;
-		else {
-			value_malloc(&res, strlen(op.core.u_blk.s) + 1);
-			return_if_error(res);
-			strcpy(res.core.u_blk.s, op.core.u_blk.s);
-		}
 		break;
 	case VALUE_TYP:
 		res.core.u_type = op.core.u_type;
@@ -499,8 +549,9 @@ value value_set(value op)
 	case VALUE_BIF:
 		res.core.u_bif = value_malloc(NULL, sizeof(struct value_bif));
 		return_if_null(res.core.u_bif);
-		res.core.u_bif->f = op.core.u_bif->f;
-		res.core.u_bif->spec = op.core.u_bif->spec;
+		*res.core.u_bif = *op.core.u_bif;
+		if (res.core.u_bif->site)
+			++res.core.u_bif->site->refcount;
 		break;
 	case VALUE_UDF: case VALUE_UDF_SHELL:
 		res.core.u_udf = value_malloc(NULL, sizeof(struct value_function));
@@ -518,26 +569,34 @@ value value_set(value op)
 		res.core.u_udf->body = value_set(op.core.u_udf->body);
 		return_if_error(res.core.u_udf->body);
 		res.core.u_udf->spec = op.core.u_udf->spec;
+		res.core.u_udf->memo = op.core.u_udf->memo;
+		if (res.core.u_udf->memo)
+			++res.core.u_udf->memo->refcount;
+		res.core.u_udf->jit = op.core.u_udf->jit;
+		if (res.core.u_udf->jit)
+			++res.core.u_udf->jit->refcount;
 		break;
 	case VALUE_EXC:
-		res.core.u_exc.parent = op.core.u_exc.parent;
-		if (op.core.u_exc.name) {
-			res.core.u_exc.name = value_malloc(NULL, strlen(op.core.u_exc.name) + 1);
-			return_if_null(res.core.u_exc.name);
-			strcpy(res.core.u_exc.name, op.core.u_exc.name);
-		} else res.core.u_exc.name = NULL;
-		
-		if (op.core.u_exc.description) {
-			res.core.u_exc.description = value_malloc(NULL, strlen(op.core.u_exc.description) + 1);
-			return_if_null(res.core.u_exc.description);
-			strcpy(res.core.u_exc.description, op.core.u_exc.description);
-		} else res.core.u_exc.description = NULL;
-		
-		if (op.core.u_exc.stack_trace) {
-			res.core.u_exc.stack_trace = value_malloc(NULL, sizeof(value));
-			return_if_null(res.core.u_exc.stack_trace);
-			*res.core.u_exc.stack_trace = value_set(*op.core.u_exc.stack_trace);
-		} else res.core.u_exc.stack_trace = NULL;
+		res.core.u_exc = value_malloc(NULL, sizeof(struct value_exception));
+		return_if_null(res.core.u_exc);
+		res.core.u_exc->parent = op.core.u_exc->parent;
+		if (op.core.u_exc->name) {
+			res.core.u_exc->name = value_malloc(NULL, strlen(op.core.u_exc->name) + 1);
+			return_if_null(res.core.u_exc->name);
+			strcpy(res.core.u_exc->name, op.core.u_exc->name);
+		} else res.core.u_exc->name = NULL;
+		
+		if (op.core.u_exc->description) {
+			res.core.u_exc->description = value_malloc(NULL, strlen(op.core.u_exc->description) + 1);
+			return_if_null(res.core.u_exc->description);
+			strcpy(res.core.u_exc->description, op.core.u_exc->description);
+		} else res.core.u_exc->description = NULL;
+		
+		if (op.core.u_exc->stack_trace) {
+			res.core.u_exc->stack_trace = value_malloc(NULL, sizeof(value));
+			return_if_null(res.core.u_exc->stack_trace);
+			*res.core.u_exc->stack_trace = value_set(*op.core.u_exc->stack_trace);
+		} else res.core.u_exc->stack_trace = NULL;
 		break;
 	default:
 		value_error(1, "Error: In value_set(), undefined op type %d.", op.type);
@@ -566,7 +625,7 @@ value value_set_bool(int x)
 value value_set_long(long x)
 {
 	value res;
-	res.type = VALUE_MPZ;
+	value_box_mpz(&res);
 	mpz_init_set_si(res.core.u_mz, x);
 	return res;
 }
@@ -575,7 +634,7 @@ value value_set_ulong(unsigned long x)
 {
 	value res;
 	
-	res.type = VALUE_MPZ;
+	value_box_mpz(&res);
 	mpz_init_set_ui(res.core.u_mz, x);
 	return res;
 }
@@ -585,6 +644,7 @@ value value_set_double(double x)
 	value res;
 	
 	res.type = VALUE_MPF;
+	value_box_mpf(&res);
 	mpfr_init_set_d(res.core.u_mf, x, value_mpfr_round);
 	return res;
 }
@@ -603,8 +663,7 @@ value value_set_str_smart(char *str, int base)
 			res = value_init_error();
 			break;
 		case 1:
-			res.type = VALUE_MPZ;
-			mpz_init(res.core.u_mz);
+			mpz_init(value_box_mpz(&res));
 			mpz_set_str(res.core.u_mz, str, base);
 			break;
 		case 2:
@@ -614,8 +673,8 @@ value value_set_str_smart(char *str, int base)
 			// precision, make it big enough to hold the given 
 			// number.
 			if ((length = strlen(str)) * 4 > value_mpfr_default_prec)
-				mpfr_init2(res.core.u_mf, length * 4);
-			else mpfr_init(res.core.u_mf);
+				mpfr_init2(value_box_mpf(&res), length * 4);
+			else mpfr_init(value_box_mpf(&res));
 			mpfr_set_str(res.core.u_mf, str, base, value_mpfr_round);
 			break;
 		default:
@@ -697,11 +756,11 @@ value value_copy(value op)
 		res = value_hash_init_capacity(next_size(length));
 		size_t i, j;
 		for (i = 0; i < length; ++i) {
-			if (op.core.u_h.a[i].type == VALUE_NIL)
+			if (op.core.u_h->a[i].type == VALUE_NIL)
 				continue;
-			inner_len = value_length(op.core.u_h.a[i]);
+			inner_len = value_length(op.core.u_h->a[i]);
 			for (j = 0; j < inner_len; ++j)
-				value_hash_put_refs(&res, &op.core.u_h.a[i].core.u_a.a[j].core.u_a.a[0], &op.core.u_h.a[i].core.u_a.a[j].core.u_a.a[1]);
+				value_hash_put_refs(&res, &op.core.u_h->a[i].core.u_a.a[j].core.u_a.a[0], &op.core.u_h->a[i].core.u_a.a[j].core.u_a.a[1]);
 		}
 		
 	} else {
@@ -711,10 +770,14 @@ value value_copy(value op)
 	return res;
 }
 
-void * value_malloc(value *op, size_t size)
+void * value_malloc_at(value *op, size_t size, const char *file, int line)
 {
 	if (op == NULL) {
 		
+	} else if (op->type == VALUE_MPZ) {
+		op->core.u_mz = NULL;
+	} else if (op->type == VALUE_MPF) {
+		op->core.u_mf = NULL;
 	} else if (op->type == VALUE_STR || op->type == VALUE_RGX || op->type == VALUE_SYM || op->type == VALUE_ID || op->type == VALUE_VAR) {
 		op->core.u_s = NULL;
 	} else if (op->type == VALUE_ARY) {
@@ -724,7 +787,9 @@ void * value_malloc(value *op, size_t size)
 	} else if (op->type == VALUE_PAR) {
 		op->core.u_p = NULL;
 	} else if (op->type == VALUE_HSH) {
-		op->core.u_h.a = NULL;
+		op->core.u_h->a = NULL;
+	} else if (op->type == VALUE_PAK) {
+		op->core.u_pk->a.b = NULL;
 	} else if (op->type == VALUE_RNG) {
 		op->core.u_r = NULL;
 	} else if (op->type == VALUE_BLK) {
@@ -736,59 +801,118 @@ void * value_malloc(value *op, size_t size)
 		return NULL;
 	}
 	
-	return value_realloc(op, size);
+	return value_realloc_at(op, size, file, line);
 }
 
-void * value_realloc(value *op, size_t size)
+void * value_realloc_at(value *op, size_t size, const char *file, int line)
 {
 	void *res;
+	uintptr_t old = 0;
+	size_t bytes;
+	int type = op ? op->type : MEMORY_UNTYPED;
 	if (op == NULL) {
-		res = malloc(size);
+		bytes = size;
+		res = malloc(bytes);
 		if (res == NULL) {
 			value_error(1, "Memory Error: Allocation failed.");
 		}
 				
+	} else if (op->type == VALUE_MPZ) {
+		old = (uintptr_t) op->core.u_mz;
+		bytes = sizeof(__mpz_struct) * size;
+		res = op->core.u_mz = realloc(op->core.u_mz, bytes);
+		if (op->core.u_mz == NULL) {
+			value_error(1, "Memory Error: Integer allocation failed.");
+			*op = value_init_error();
+		}
+	} else if (op->type == VALUE_MPF) {
+		old = (uintptr_t) op->core.u_mf;
+		bytes = sizeof(__mpfr_struct) * size;
+		res = op->core.u_mf = realloc(op->core.u_mf, bytes);
+		if (op->core.u_mf == NULL) {
+			value_error(1, "Memory Error: Float allocation failed.");
+			*op = value_init_error();
+		}
 	} else if (op->type == VALUE_STR || op->type == VALUE_RGX || op->type == VALUE_SYM || op->type == VALUE_ID || op->type == VALUE_VAR) {
-		res = op->core.u_s = realloc(op->core.u_s, sizeof(char) * size);
+		old = (uintptr_t) op->core.u_s;
+		bytes = sizeof(char) * size;
+		res = op->core.u_s = realloc(op->core.u_s, bytes);
 		if (op->core.u_s == NULL) {
 			value_error(1, "Memory Error: String allocation failed.");
 			*op = value_init_error();
 		}
 	} else if (op->type == VALUE_ARY) {
-		res = op->core.u_a.a = realloc(op->core.u_a.a, sizeof(value) * size);
-		if (op->core.u_a.a == NULL) {
+		if (size > ARRAY_MAX_LENGTH) {
+			value_error(1, "Memory Error: Array of %ld elements is too large.", (long) size);
+			*op = value_init_error();
+			return NULL;
+		}
+		// One more value in front of the elements holds the capacity.
+		old = (uintptr_t) (op->core.u_a.a ? op->core.u_a.a - 1 : NULL);
+		bytes = sizeof(value) * (size + 1);
+		res = realloc((void *) old, bytes);
+		if (res == NULL) {
 			value_error(1, "Memory Error: Array allocation failed.");
 			*op = value_init_error();
+		} else {
+			op->core.u_a.a = (value *) res + 1;
+			op->core.u_a.a[-1].core.u_z = size;
 		}
 	} else if (op->type == VALUE_LST) {
-		res = op->core.u_l = realloc(op->core.u_l, sizeof(value) * size);
+		old = (uintptr_t) op->core.u_l;
+		bytes = sizeof(value) * size;
+		res = op->core.u_l = realloc(op->core.u_l, bytes);
 		if (op->core.u_l == NULL) {
 			value_error(1, "Memory Error: List allocation failed.");
 			*op = value_init_error();
 		}
 	} else if (op->type == VALUE_PAR) {
-		res = op->core.u_p = realloc(op->core.u_p, sizeof(struct value_pair) * size);
+		old = (uintptr_t) op->core.u_p;
+		bytes = sizeof(struct value_pair) * size;
+		res = op->core.u_p = realloc(op->core.u_p, bytes);
 		if (op->core.u_l == NULL) {
 			value_error(1, "Memory Error: Pair allocation failed.");
 			*op = value_init_error();
 		}
 	} else if (op->type == VALUE_HSH) {
-		res = op->core.u_h.a = realloc(op->core.u_h.a, sizeof(value) * size);
-		if (op->core.u_h.a == NULL) {
+		old = (uintptr_t) op->core.u_h->a;
+		bytes = sizeof(value) * size;
+		res = op->core.u_h->a = realloc(op->core.u_h->a, bytes);
+		if (op->core.u_h->a == NULL) {
 			value_error(1, "Memory Error: Hash allocation failed.");
 			*op = value_init_error();
 		}
+	} else if (op->type == VALUE_PAK) {
+		old = (uintptr_t) op->core.u_pk->a.b;
+		bytes = value_packed_width(op->core.u_pk->kind) * size;
+		res = op->core.u_pk->a.b = realloc(op->core.u_pk->a.b, bytes);
+		if (op->core.u_pk->a.b == NULL) {
+			value_error(1, "Memory Error: Packed array allocation failed.");
+			*op = value_init_error();
+		} else op->core.u_pk->capacity = size;
 	} else if (op->type == VALUE_RNG) {
-		res = op->core.u_r = realloc(op->core.u_r, sizeof(struct value_range) * size);
+		old = (uintptr_t) op->core.u_r;
+		bytes = sizeof(struct value_range) * size;
+		res = op->core.u_r = realloc(op->core.u_r, bytes);
 		if (op->core.u_r == NULL) {
 			value_error(1, "Memory Error: Range allocation failed.");
 			*op = value_init_error();
 		}
 	} else if (op->type == VALUE_BLK) {
-		res = op->core.u_blk.a = realloc(op->core.u_blk.a, sizeof(value) * size);
-		if (op->core.u_blk.a == NULL) {
+		if (size > ARRAY_MAX_LENGTH) {
+			value_error(1, "Memory Error: Block of %ld elements is too large.", (long) size);
+			*op = value_init_error();
+			return NULL;
+		}
+		old = (uintptr_t) (op->core.u_blk.a ? op->core.u_blk.a - 1 : NULL);
+		bytes = sizeof(value) * (size + 1);
+		res = realloc((void *) old, bytes);
+		if (res == NULL) {
 			value_error(1, "Memory Error: Block allocation failed.");
 			*op = value_init_error();
+		} else {
+			op->core.u_blk.a = (value *) res + 1;
+			op->core.u_blk.a[-1].core.u_z = size;
 		}
 	} else {
 		value_error(1, "Type Error: malloc() is undefined where op is %ts (linear container expected).", *op);
@@ -802,15 +926,20 @@ void * value_realloc(value *op, size_t size)
 		x = 10 / x;
 		return &x;
 	}
+	
+	if (memory_tracking_p)
+		value_memory_move(old, res, bytes, type, file, line);
+	if (type == VALUE_ARY || type == VALUE_BLK)
+		return (value *) res + 1;
 	return res;
 }
 
-// This is defined using a macro.
-//int value_free(void *ptr)
-//{
-//	free(ptr);
-//	return 0;
-//}
+void value_free_at(void *ptr)
+{
+	if (memory_tracking_p && ptr)
+		value_memory_untrack(ptr);
+	free(ptr);
+}
 
 value value_import(value op)
 {
@@ -892,6 +1021,14 @@ value value_hash_arg(int argc, value argv[])
 // This is ugly. It should be refactored.
 value value_cast(value op, int type)
 {
+	if (op.type == VALUE_SLC) {
+		value copy = value_unslice(op);
+		return_if_error(copy);
+		value res = value_cast(copy, type);
+		value_clear(&copy);
+		return res;
+	}
+	
 	value res = value_init_nil();
 	int error_p = FALSE;
 	
@@ -910,11 +1047,12 @@ value value_cast(value op, int type)
 			if (op.type == VALUE_MPZ)
 				res = value_set(op);
 			else if (op.type == VALUE_MPF) {
-				mpz_init(res.core.u_mz);
+				mpz_init(value_box_mpz(&res));
 				mpfr_get_z(res.core.u_mz, op.core.u_mf, value_mpfr_round_cast);
-			} else if (op.type == VALUE_STR)
+			} else if (op.type == VALUE_STR) {
+				value_box_mpz(&res);
 				mpz_init_set_str(res.core.u_mz, op.core.u_s, 0);
-			else error_p = TRUE;
+			} else error_p = TRUE;
 			
 			res.type = VALUE_MPZ;
 			break;
@@ -923,11 +1061,12 @@ value value_cast(value op, int type)
 			if (op.type == VALUE_MPF)
 				res = value_set(op);
 			else if (op.type == VALUE_MPZ) {
+				value_box_mpf(&res);
 				mpfr_init_set_z(res.core.u_mf, op.core.u_mz, value_mpfr_round);
-			} else if (op.type == VALUE_STR)
+			} else if (op.type == VALUE_STR) {
+				value_box_mpf(&res);
 				mpfr_init_set_str(res.core.u_mf, op.core.u_s, 0, value_mpfr_round);
-			else error_p = TRUE;
-			res.type = VALUE_MPF;
+			} else error_p = TRUE;
 			break;
 			
 		case VALUE_STR:
@@ -964,6 +1103,10 @@ value value_cast(value op, int type)
 		case VALUE_ARY:
 			if (op.type == VALUE_ARY)
 				res = value_set(op);
+			else if (op.type == VALUE_PAK)
+				res = value_unpack(op);
+			else if (op.type == VALUE_NDA)
+				res = value_nd_to_a(op);
 			else if (op.type == VALUE_STR) {
 				size_t length = strlen(op.core.u_s);
 				char str[2];
@@ -1002,12 +1145,12 @@ value value_cast(value op, int type)
 				res = value_set_ary(array, length);
 				
 			} else if (op.type == VALUE_HSH) {
-				size_t size = op.core.u_h.size;
+				size_t size = op.core.u_h->size;
 				// size is too large.
 				value bucket, array[size];
 				size_t i, j, k;
-				for (i = 0, j = 0; i < op.core.u_h.length; ++i) {
-					bucket = op.core.u_h.a[i];
+				for (i = 0, j = 0; i < op.core.u_h->length; ++i) {
+					bucket = op.core.u_h->a[i];
 					if (bucket.type != VALUE_ARY) continue;
 					for (k = 0; k < bucket.core.u_a.length; ++k) {
 						if (bucket.core.u_a.a[k].type != VALUE_ARY || bucket.core.u_a.a[k].core.u_a.length != 2)
@@ -1061,6 +1204,10 @@ value value_cast(value op, int type)
 					res.core.u_a.a[i] = value_set(op.core.u_blk.a[i]);
 				}
 
+			} else if (op.type == VALUE_GEN) {
+				res = value_generator_to_a(op);
+				return_if_error(res);
+				
 			} else {
 				res = value_set_ary(&op, 1);
 			}
@@ -1217,7 +1364,7 @@ value value_type(value op)
 	value res;
 	
 	res.type = VALUE_TYP;
-	res.core.u_type = op.type;
+	res.core.u_type = value_slice_type(op);
 	return res;
 }
 
@@ -1240,6 +1387,9 @@ int value_true_p(value op)
 			return value_ne(op, value_zero);
 		case VALUE_STR:
 		case VALUE_ARY:
+		case VALUE_PAK:
+		case VALUE_NDA:
+		case VALUE_SLC:
 		case VALUE_LST:
 		case VALUE_HSH:
 		case VALUE_TRE:
@@ -1635,7 +1785,11 @@ value value_gets_arg(int argc, value argv[])
 value value_set_default_prec(value prec)
 {
 	if (prec.type == VALUE_MPZ) {
-		mpfr_set_default_prec(value_get_ulong(prec));
+		if (mpz_cmp_ui(prec.core.u_mz, MPFR_PREC_MIN) < 0 || mpz_cmp_ui(prec.core.u_mz, MPFR_PREC_MAX) > 0) {
+			value_error(1, "Domain Error: set_default_prec() is undefined where prec is %s (%ld to %ld expected).", prec, (long) MPFR_PREC_MIN, (long) MPFR_PREC_MAX);
+			return value_init_error();
+		}
+		mpfr_set_default_prec(value_mpfr_default_prec = value_get_ulong(prec));
 		return value_init_nil();
 	} else {
 		value_error(1, "Type Error: set_default_prec() is undefined where prec is %ts (integer expected).", prec);
@@ -1719,6 +1873,8 @@ unsigned long value_get_ulong(value op)
 int value_put(char buffer[], size_t length, value op, char *format)
 {
 	if (length < 1) return VALUE_ERROR;
+	if (op.type == VALUE_SLC)
+		return value_slice_put(buffer, length, op, format);
 	buffer[0] = '\0';
 	
 	char *fptr = format;
@@ -1728,6 +1884,7 @@ int value_put(char buffer[], size_t length, value op, char *format)
 	size_t precision = 10;
 	int is_precision_default = TRUE;
 	int is_width_default = TRUE;
+	char print_type = 0;
 		
 	// GOTO might strike fear into the hearts of men, but it's still better than putting 
 	// a big if statement over a bunch of stuff, which would be ugly and unclear.
@@ -1748,7 +1905,6 @@ int value_put(char buffer[], size_t length, value op, char *format)
 			precision = 10*precision + *fptr - '0';
 	}
 	
-	char print_type = 0;
 	if (*fptr == 'r' || *fptr == 't') {
 		print_type = *fptr;
 		if (is_width_default)
@@ -1979,6 +2135,14 @@ done_with_format:
 		if (ptrlen < 2) return VALUE_ERROR;
 		sprintf(ptr, ")");
 		
+	} else if (op.type == VALUE_PAK) {
+		int error_p = value_packed_put(buffer, length, op, format);
+		if (error_p) return error_p;
+		
+	} else if (op.type == VALUE_NDA) {
+		int error_p = value_nd_put(buffer, length, op, format);
+		if (error_p) return error_p;
+		
 	} else if (op.type == VALUE_LST) {
 		if (strlen("(list)") + 1 > length) return VALUE_ERROR;
 		sprintf(buffer, "(list");
@@ -2026,10 +2190,10 @@ done_with_format:
 		size_t i, j, ptrlen = length - added_len;
 		int first_p = TRUE;
 		
-		for (i = 0; i < op.core.u_h.length; ++i) 
-		if (op.core.u_h.a[i].type != VALUE_NIL) {
-			for (j = 0; j < op.core.u_h.a[i].core.u_a.length; ++j)
-			if (op.core.u_h.a[i].core.u_a.a[j].type != VALUE_NIL) {
+		for (i = 0; i < op.core.u_h->length; ++i) 
+		if (op.core.u_h->a[i].type != VALUE_NIL) {
+			for (j = 0; j < op.core.u_h->a[i].core.u_a.length; ++j)
+			if (op.core.u_h->a[i].core.u_a.a[j].type != VALUE_NIL) {
 				if (first_p) {
 					if (ptrlen < 3) return VALUE_ERROR;
 					first_p = FALSE;
@@ -2040,7 +2204,7 @@ done_with_format:
 				}
 
 				
-				int error_p = value_put(ptr, ptrlen, op.core.u_h.a[i].core.u_a.a[j].core.u_p->head, format);
+				int error_p = value_put(ptr, ptrlen, op.core.u_h->a[i].core.u_a.a[j].core.u_p->head, format);
 				if (error_p) return error_p;
 				added_len = strlen(ptr);
 				ptr += added_len;
@@ -2052,7 +2216,7 @@ done_with_format:
 				*(ptr++) = '>'; --ptrlen;
 				*(ptr++) = ' '; --ptrlen;
 				
-				error_p = value_put(ptr, ptrlen, op.core.u_h.a[i].core.u_a.a[j].core.u_p->tail, format);
+				error_p = value_put(ptr, ptrlen, op.core.u_h->a[i].core.u_a.a[j].core.u_p->tail, format);
 				if (error_p) return error_p;
 				added_len = strlen(ptr);
 				ptr += added_len;
@@ -2104,29 +2268,23 @@ done_with_format:
 		char *ptr = buffer + added_len;
 		size_t i, ptrlen = length - added_len;
 		
-		if (op.core.u_blk.s) {
-			if (strlen(op.core.u_blk.s) + 2 > ptrlen) return VALUE_ERROR;
-			sprintf(ptr, "%s)", op.core.u_blk.s);
-			
-		} else {
-			for (i = 0; i < op.core.u_blk.length; ++i) {
-				if (ptrlen < 3) return VALUE_ERROR;
-				if (i) { *(ptr++) = ' '; --ptrlen; }
-				
-				int error_p = value_put(ptr, ptrlen, op.core.u_blk.a[i], format);
-				if (error_p) return error_p;
-				added_len = strlen(ptr);
-				ptr += added_len;
-				ptrlen -= added_len;
-			}
+		for (i = 0; i < op.core.u_blk.length; ++i) {
+			if (ptrlen < 3) return VALUE_ERROR;
+			if (i) { *(ptr++) = ' '; --ptrlen; }
 			
-			if (ptrlen < 2) return VALUE_ERROR;
-			sprintf(ptr, ")");
+			int error_p = value_put(ptr, ptrlen, op.core.u_blk.a[i], format);
+			if (error_p) return error_p;
 			added_len = strlen(ptr);
 			ptr += added_len;
 			ptrlen -= added_len;
 		}
 		
+		if (ptrlen < 2) return VALUE_ERROR;
+		sprintf(ptr, ")");
+		added_len = strlen(ptr);
+		ptr += added_len;
+		ptrlen -= added_len;
+		
 		*ptr = '\0';
 		
 	} else if (op.type == VALUE_NAN) {
@@ -2184,6 +2342,10 @@ done_with_format:
 //		error_p = value_put(buffer + added_len, length - added_len, op.core.u_udf->body, format);
 //		if (error_p) return VALUE_ERROR;	
 		
+	} else if (op.type == VALUE_GEN) {
+		if (strlen("(generator)") + 1 >= length) return VALUE_ERROR;
+		sprintf(buffer, "(generator)");
+		
 	} else if (op.type == VALUE_ERROR) {
 		if (strlen("error") > length + 1) return VALUE_ERROR;
 		sprintf(buffer, "error");
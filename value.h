@@ -40,11 +40,15 @@
 #define VALUE_BLK 25	// Block, in the form of an S-expression.
 
 #define VALUE_STOP 26	// Stop the execution of a loop or iterator.
+#define VALUE_GEN 27	// Generator.
+#define VALUE_PAK 28	// Packed array.
+#define VALUE_NDA 29	// N-dimensional array.
 
 #define VALUE_BIF 30	// Built-in function.
 #define VALUE_UDF 31	// User-defined function.
 #define VALUE_UDF_SHELL 32
 #define VALUE_MAC 33	// Macro.
+#define VALUE_SLC 34	// Slice of a string or array.
 
 #define VALUE_EXC 40	// Exception.
 #define VALUE_MISSING_ARG 41
@@ -85,6 +89,12 @@
  * value_range.c: Functions for ranges.
  * value_block.c: Functions for blocks, control structures, and user-defined functions.
  * value_exception.c: Functions for exceptions.
+ * value_generator.c: Functions for generators.
+ * value_packed.c: Functions for packed arrays.
+ * value_vector.c: Elementwise arithmetic and reductions over numeric arrays.
+ * value_nd.c: Functions for n-dimensional arrays.
+ * value_matrix.c: Functions for matrices.
+ * value_slice.c: Functions for slices of strings and arrays.
  */
 
 // The actual definition for the value type is in tools.h.
@@ -154,9 +164,200 @@ value value_optimize4_now(value *op, int flags);
 int optimize_put_constants_first(value *op, value words[], size_t length, int assume_numeric);
 int optimize_simplify_constant_across_block(value *op, value words[], size_t length, int assume_numeric);
 
+/* What a loop might assign to, as found by optimize_find_writes().
+ */
+struct optimize_loop_info {
+	value writes; // An array of the variables that the loop might assign to.
+	int unknown_p; // The loop might assign to anything, so nothing in it is invariant.
+	int calls_p; // The loop calls a user-defined function, which might assign to a global variable.
+};
+
+int optimize_hoist_while(value *op);
+int optimize_hoist_for(value *op);
+int optimize_finish_hoist(value *op, value *hoisted);
+int optimize_loop_info_init(struct optimize_loop_info *info, value loop);
+int optimize_add_write(struct optimize_loop_info *info, value var);
+int optimize_writes_p(struct optimize_loop_info *info, value var);
+int optimize_at_assign_p(value (*f)(int, value *));
+int optimize_find_writes(value op, struct optimize_loop_info *info);
+int optimize_side_effect_free_p(value op);
+int optimize_invariant_p(value op, struct optimize_loop_info *info);
+int optimize_jumps_p(value op);
+int optimize_hoist(value *op, struct optimize_loop_info *info, value *hoisted);
+int optimize_reads_variable_p(value op);
+value optimize_temporary();
+value optimize_call(char *name);
+value optimize_bif(char *name);
+
+// The type of an expression whose type can't be inferred.
+#define OPTIMIZE_UNKNOWN_TYPE -2
+
+int optimize_infer(value *op, value *env, int rewrite_p);
+int optimize_infer_loop(value *op, value *env, int rewrite_p);
+value (*optimize_assign_op(value (*f)(int, value *)))(int, value *);
+int optimize_result_type(value (*f)(int, value *), int type1, int type2);
+int optimize_specialize(value *op, int type1, int type2);
+int optimize_env_get(value env, value var);
+int optimize_env_put(value *env, value var, int type);
+int optimize_env_put_all(value *env, value vars, int type);
+int optimize_env_merge(value *env, value other);
+int optimize_env_forget_writes(value *env, value op);
+
 value value_optimize_arg(int argc, value argv[]);
 
 
+/* 
+ * Declarations for jit.c
+ * 
+ * See jit.c for documentation.
+ */
+
+#define JIT_THRESHOLD 1000
+
+#define JIT_INTERPRETED 0
+#define JIT_COMPILING 1
+#define JIT_NATIVE 2
+#define JIT_FAILED 3
+
+// These are set in init_jit().
+int jit_enabled_p;
+char *jit_cc, *jit_flags, *jit_cache_dir;
+unsigned long jit_compiled, jit_cached, jit_loaded, jit_failed;
+
+int init_jit();
+struct value_jit * value_jit_init();
+void value_jit_free(struct value_jit *jit);
+int value_jit_count(value op);
+int value_jit_start(value op);
+int value_jit_poll(struct value_jit *jit);
+int value_jit_make_cache_dir();
+int value_jit_check_file(char *path);
+int value_jit_load(struct value_jit *jit);
+value value_jit_call(value *variables, value op, int argc, value argv[]);
+value value_jit_call_evaluated(value op, int argc, value argv[]);
+unsigned long long value_jit_hash(FILE *code);
+value value_jit_stats();
+
+value value_jit_stats_arg(int argc, value argv[]);
+
+
+/* 
+ * Declarations for profile.c
+ * 
+ * See profile.c for documentation.
+ * 
+ * profile_start(interval): Starts profiling. If (interval) is given, the stack is 
+ *   also sampled every (interval) microseconds of CPU time.
+ * profile_stop(): Stops profiling and returns a hash from each function's name to 
+ *   a hash with its calls, inclusive and exclusive time in seconds, and samples.
+ * profile_report(path): Stops profiling and prints a report sorted by exclusive 
+ *   time. If (path) is given, writes the folded stacks to that file.
+ */
+
+#define PROFILE_NAME_CACHE_SIZE 1024
+
+int profiling_p;
+
+// These are set in init_profile().
+value profile_functions, profile_stacks; // Keys to indices in the arrays below.
+struct value_profile_entry *profile_entries, *profile_stack_entries;
+size_t profile_entries_length, profile_entries_size;
+size_t profile_stack_entries_length, profile_stack_entries_size;
+struct value_profile_frame *profile_frames;
+int profile_depth, profile_frames_size;
+char *profile_path; // The current folded stack.
+size_t profile_path_length, profile_path_size;
+double profile_start_time, profile_total;
+long profile_interval;
+volatile sig_atomic_t profile_pending;
+struct value_profile_name profile_name_cache[PROFILE_NAME_CACHE_SIZE]; // Keyed by the C function.
+
+int init_profile();
+double value_profile_now();
+void value_profile_signal(int sig);
+void value_profile_reset();
+long value_profile_find(value *table, struct value_profile_entry **entries, size_t *length, size_t *size, char *key);
+void value_profile_take_samples();
+char * value_profile_bif_name(struct value_bif *bif);
+int value_profile_enter(char *name);
+int value_profile_exit(int depth);
+int value_profile_start_c(long interval);
+int value_profile_stop_c();
+int value_profile_compare(const void *a, const void *b);
+int value_profile_write_report(FILE *out);
+int value_profile_write_folded(FILE *out);
+int value_profile_main(int argc, const char *argv[]);
+
+value value_profile_start(value interval);
+value value_profile_stop();
+value value_profile_report(value path);
+
+value value_profile_start_arg(int argc, value argv[]);
+value value_profile_stop_arg(int argc, value argv[]);
+value value_profile_report_arg(int argc, value argv[]);
+
+
+/* 
+ * Declarations for memory.c
+ * 
+ * See memory.c for documentation.
+ * 
+ * memstats(): Returns a hash with the memory that's allocated now, the peak, and the 
+ *   number of allocations and frees, along with the memory for each type of value 
+ *   (types) and the call sites that have the most memory allocated (sites). 
+ *   Everything but peak_rss and arrays is 0 unless memory tracking is on.
+ *   arrays counts how often arrays grew, how many elements those grows had to 
+ *   move, and how many reserve() calls and shrinks there were.
+ */
+
+#define MEMORY_SITES 4096
+#define MEMORY_REPORT_SITES 20
+
+// Categories are value types, plus these two.
+#define MEMORY_CATEGORIES 64
+#define MEMORY_UNTYPED 62
+#define MEMORY_NUMBERS 63 // Memory that GMP and MPFR allocate.
+
+int memory_tracking_p;
+
+// These are set in init_memory().
+struct value_memory_block *memory_blocks; // Open addressing table keyed by pointer.
+size_t memory_blocks_size, memory_blocks_used;
+struct value_memory_site memory_sites[MEMORY_SITES];
+int memory_sites_used;
+struct value_memory_site memory_categories[MEMORY_CATEGORIES];
+size_t memory_live_bytes, memory_live_blocks, memory_peak_bytes;
+size_t memory_allocations, memory_frees;
+
+// How arrays and blocks change capacity. These are counted even when tracking is off.
+size_t memory_array_grows, memory_array_grow_copies, memory_array_reserves, memory_array_shrinks;
+
+/* Must be called before anything else allocates memory.
+ */
+int init_memory();
+
+size_t value_memory_hash(void *ptr);
+int value_memory_grow();
+int value_memory_site(const char *file, int line);
+int value_memory_track(void *ptr, size_t size, int category, const char *file, int line);
+int value_memory_untrack(void *ptr);
+int value_memory_move(uintptr_t old, void *ptr, size_t size, int type, const char *file, int line);
+int value_memory_category(int type);
+const char * value_memory_category_name(int category);
+void * value_memory_gmp_alloc(size_t size);
+void * value_memory_gmp_realloc(void *old, size_t old_size, size_t new_size);
+void value_memory_gmp_free(void *ptr, size_t size);
+size_t value_memory_peak_rss();
+int value_memory_compare_sites(const void *a, const void *b);
+int value_memory_sorted_sites(int *indices);
+int value_memory_write_report(FILE *out);
+void value_memory_exit_report();
+
+value value_memstats();
+
+value value_memstats_arg(int argc, value argv[]);
+
+
 /* 
  * Declarations for the Value Type
  */
@@ -522,6 +723,37 @@ value value_ne_arg(int argc, value argv[]);
 value value_ge_arg(int argc, value argv[]);
 value value_gt_arg(int argc, value argv[]);
 
+/* Specialized versions of the arithmetic and comparison functions for a single type of 
+ * operand, which the optimizer uses when it knows the types. If the operands turn out 
+ * to be some other type, they fall back to the generic function.
+ */
+value value_add_int_arg(int argc, value argv[]);
+value value_sub_int_arg(int argc, value argv[]);
+value value_mul_int_arg(int argc, value argv[]);
+value value_add_float_arg(int argc, value argv[]);
+value value_sub_float_arg(int argc, value argv[]);
+value value_mul_float_arg(int argc, value argv[]);
+value value_concat_str_arg(int argc, value argv[]);
+value value_lt_int_arg(int argc, value argv[]);
+value value_le_int_arg(int argc, value argv[]);
+value value_gt_int_arg(int argc, value argv[]);
+value value_ge_int_arg(int argc, value argv[]);
+value value_lt_float_arg(int argc, value argv[]);
+value value_le_float_arg(int argc, value argv[]);
+value value_gt_float_arg(int argc, value argv[]);
+value value_ge_float_arg(int argc, value argv[]);
+value value_eq_int_arg(int argc, value argv[]);
+value value_ne_int_arg(int argc, value argv[]);
+value value_eq_float_arg(int argc, value argv[]);
+value value_ne_float_arg(int argc, value argv[]);
+value value_eq_str_arg(int argc, value argv[]);
+value value_ne_str_arg(int argc, value argv[]);
+
+/* Returns the version of (f) specialized to arguments of (type1) and (type2), or NULL 
+ * if there isn't one.
+ */
+value (*value_specialized_arg(value (*f)(int, value *), int type1, int type2))(int, value *);
+
 
 /*
  * Logical operations. The std versions of these return not a boolean, but 
@@ -533,14 +765,22 @@ value value_gt_arg(int argc, value argv[]);
  * (false && "hi") returns (false), because (false) makes the expression false
  * 
  * The versions that return ints merely return true (nonzero) or false (zero).
+ * 
+ * The lazy versions are what the && and || operators call. They take their 
+ * operands unevaluated and only evaluate (op2) if (op1) does not already decide 
+ * the result, so (i < n && a[i] > 0) never looks at a[n]. They return a boolean.
  */
 int value_and_p(value op1, value op2);
 value value_and_p_std(value op1, value op2);
+value value_and_p_lazy(value *variables, value op1, value op2);
 int value_or_p(value op1, value op2);
 value value_or_p_std(value op1, value op2);
+value value_or_p_lazy(value *variables, value op1, value op2);
 int value_not_p(value op);
 value value_not_p_std(value op);
 
+int value_private_truth_eval(value *variables, value op);
+
 value value_and_p_arg(int argc, value argv[]);
 value value_or_p_arg(int argc, value argv[]);
 value value_not_p_arg(int argc, value argv[]);
@@ -676,6 +916,11 @@ value value_factorial_arg(int argc, value argv[]);
  */
 value value_trig(value op, int func);
 
+/* Calls value_trig(), or value_exp(), value_log(), value_log2(), value_log10() or
+ * value_sqrt() for VALUE_EXP, VALUE_LOG, VALUE_LOG2, VALUE_LOG10 or VALUE_SQRT.
+ */
+value value_math_function(value op, int func);
+
 value value_sin_arg(int argc, value argv[]);
 value value_cos_arg(int argc, value argv[]);
 value value_tan_arg(int argc, value argv[]);
@@ -741,8 +986,14 @@ value value_times(value *variables, value op, value func);
  */
 value value_summation(value *variables, value op, value func);
 
+/* Adds up the elements of (op), which should be an array, list or range. 
+ * The sum of an empty array is 0.
+ */
+value value_sum(value op);
+
 value value_times_arg(int argc, value argv[]);
 value value_summation_arg(int argc, value argv[]);
+value value_sum_arg(int argc, value argv[]);
 
 
 #define VALUE_SIN 0
@@ -765,6 +1016,13 @@ value value_summation_arg(int argc, value argv[]);
 #define VALUE_ACOSH 16
 #define VALUE_ATANH 17
 
+// The other functions that value_vector_math() can apply to each element.
+#define VALUE_EXP 18
+#define VALUE_LOG 19
+#define VALUE_LOG2 20
+#define VALUE_LOG10 21
+#define VALUE_SQRT 22
+
 // These are done with macros instead of functions because it is more concise.
 #define value_sin(op) value_trig(op, 0)
 #define value_cos(op) value_trig(op, 1)
@@ -940,6 +1198,10 @@ value value_to_lower_arg(int argc, value argv[]);
  */
 int compile_regex(regex_t *compiled, char *regex, int flags);
 
+/* Calls regexec() on (str), which is a string or a slice of one.
+ */
+int value_regexec(regex_t *compiled, value str, size_t nmatch, regmatch_t pmatch[]);
+
 
 /* If (regex) matches (str), return true. Otherwise, returns false.
  */
@@ -968,6 +1230,26 @@ value value_append(value op1, value op2);
 value value_append_now(value *op1, value op2);
 value value_append_now2(value *op1, value *op2);
 
+/* Makes sure (op), an array or block, has room for (capacity) elements, growing it to 
+ * the next power of 2 if it doesn't. Returns false and reports an error if it can't.
+ */
+int value_private_array_grow(value *op, size_t capacity);
+
+/* Gives half the memory of (op) back once its length falls below a quarter of its 
+ * capacity. Call it after removing elements.
+ */
+void value_private_array_settle(value *op);
+
+/* array_with_capacity() returns an empty array with room for (op) elements. reserve() 
+ * makes room for at least (capacity) elements in (op) without changing what it holds, 
+ * and shrink!() frees the room past the last element. capacity() returns how many 
+ * elements (op) has room for.
+ */
+value value_array_with_capacity(value op);
+value value_capacity(value op);
+value value_reserve(value *op, value capacity);
+value value_shrink_now(value *op);
+
 /* 
  * Returns the value in (op) at (index).
  * 
@@ -1032,6 +1314,7 @@ value value_delete_at_now(value *op, value index);
  * must be a type that can be called with value_call().
  */
 value value_each(value *variables, value op, value func);
+int value_private_each_step(value *res, value tmp);
 
 /* Iterates through each index in (op) and calls (func) for each one. (func) 
  * must be a type that can be called with value_call().
@@ -1111,11 +1394,80 @@ value value_size_std(value op);
  */
 value value_sort(value op);
 value value_sort_now(value *op);
-value value_private_sort_pivot;
-int value_private_sort_lt(value op);
-int value_private_sort_eq(value op);
-int value_private_sort_gt(value op);
-int value_private_sort_recursive(value array[], int left, int right);
+
+/* 
+ * sort_by() sorts by the result of calling (func) once on each element. sort_with() 
+ * calls (func) on two elements and expects a number that is negative, zero or 
+ * positive, or true if the first element belongs before the second. Both are 
+ * stable and work on arrays and lists.
+ */
+value value_sort_by(value *variables, value op, value func);
+value value_sort_with(value *variables, value op, value func);
+value value_private_sort_block(value *variables, value op, value func, int key_p);
+
+#define SORT_INSERTION_THRESHOLD 24 // Ranges shorter than this are insertion sorted.
+#define SORT_NINTHER_THRESHOLD 128 // Ranges longer than this use a ninther for the pivot.
+#define SORT_PARTIAL_INSERTION_LIMIT 8
+#define SORT_STABLE_INSERTION_THRESHOLD 8 // Lower because comparisons may call blocks.
+
+/* Sorts (length) values in place. Returns VALUE_ERROR if two of them cannot be 
+ * compared. value_private_sort_with() sorts with the comparator in (sort).
+ */
+int value_private_sort_array(value array[], size_t length);
+int value_private_sort_with(struct value_sort *sort, value array[], size_t length);
+int value_private_sort_presorted_p(struct value_sort *sort, value array[], size_t length);
+int value_private_sort_fast(struct value_sort *sort, value array[], size_t length);
+void value_private_sort_comparator(struct value_sort *sort, value array[], size_t length);
+int value_private_sort_cmp_mpz(struct value_sort *sort, value op1, value op2);
+int value_private_sort_cmp_mpf(struct value_sort *sort, value op1, value op2);
+int value_private_sort_cmp_str(struct value_sort *sort, value op1, value op2);
+int value_private_sort_cmp_any(struct value_sort *sort, value op1, value op2);
+int value_private_sort_cmp_block(struct value_sort *sort, value op1, value op2);
+void value_private_sort_swap(value *op1, value *op2);
+void value_private_sort_sort3(struct value_sort *sort, value *a, value *b, value *c);
+void value_private_sort_insertion(struct value_sort *sort, value *begin, value *end);
+int value_private_sort_partial_insertion(struct value_sort *sort, value *begin, value *end);
+void value_private_sort_sift_down(struct value_sort *sort, value heap[], size_t root, size_t length);
+void value_private_sort_heap(struct value_sort *sort, value *begin, value *end);
+value *value_private_sort_partition_right(struct value_sort *sort, value *begin, value *end, int *partitioned_p);
+value *value_private_sort_partition_left(struct value_sort *sort, value *begin, value *end);
+void value_private_sort_recursive(struct value_sort *sort, value *begin, value *end, int bad_allowed, int leftmost_p);
+
+/* Arrays of integers that fit in a long, or of strings, with at least 
+ * SORT_RADIX_THRESHOLD elements are radix sorted; see value_array.c.
+ */
+#define SORT_RADIX_THRESHOLD 256
+#define SORT_RADIX_STRING_THRESHOLD 64 // Smaller buckets of strings are sorted with pdqsort.
+
+int value_private_sort_radix_int(value array[], size_t length);
+int value_private_sort_radix_strings(value array[], size_t length);
+void value_private_sort_radix_str(value array[], value temp[], size_t length, size_t depth);
+
+/* Arrays at least (sort_parallel_threshold) long whose elements are all integers, 
+ * all floats or all strings are sorted on value_sort_threads() threads; see the 
+ * notes in value_array.c. SIMFPL_THREADS in the environment sets the number of 
+ * threads, which is otherwise the number of processors, and SIMFPL_SORT_PARALLEL 
+ * sets the threshold.
+ */
+#define SORT_PARALLEL_THRESHOLD 65536
+#define SORT_MAX_THREADS 64
+#define SORT_SAMPLES_PER_THREAD 32
+
+#define SORT_ROUND_CLASSIFY 0
+#define SORT_ROUND_SCATTER 1
+#define SORT_ROUND_SORT 2
+
+// Set the first time value_sort_threads() is called.
+int sort_threads;
+size_t sort_parallel_threshold;
+
+int value_sort_threads();
+int value_private_sort_parallel(value array[], size_t length, int threads);
+void value_private_sort_parallel_round(struct value_sort_team *team, int round);
+void *value_private_sort_parallel_worker(void *arg);
+
+int value_private_sort_stable(struct value_sort *sort, value keys[], size_t perm[], size_t length);
+void value_private_sort_stable_recursive(struct value_sort *sort, value keys[], size_t perm[], size_t temp[], size_t length);
 int value_private_sort_list(value *op);
 
 value value_swap_now(value *op, size_t i, size_t j);
@@ -1133,6 +1485,7 @@ value value_uniq_sort_now(value *op);
 
 value value_append_arg(int argc, value argv[]);
 value value_append_now_arg(int argc, value argv[]);
+value value_array_with_capacity_arg(int argc, value argv[]);
 value value_array_with_length_arg(int argc, value argv[]);
 
 /* Takes at least three arguments: op1, index[, more], op2.
@@ -1150,6 +1503,7 @@ value value_at_assign_or_arg(int argc, value argv[]);
 value value_at_assign_shl_arg(int argc, value argv[]);
 value value_at_assign_shr_arg(int argc, value argv[]);
 
+value value_capacity_arg(int argc, value argv[]);
 value value_concat_arg(int argc, value argv[]);
 value value_delete_arg(int argc, value argv[]);
 value value_delete_all_arg(int argc, value argv[]);
@@ -1171,11 +1525,15 @@ value value_map_now_arg(int argc, value argv[]);
 value value_map_drop_arg(int argc, value argv[]);
 value value_pop_arg(int argc, value argv[]);
 value value_pop_now_arg(int argc, value argv[]);
+value value_reserve_arg(int argc, value argv[]);
+value value_shrink_now_arg(int argc, value argv[]);
 value value_shuffle_arg(int argc, value argv[]);
 value value_shuffle_now_arg(int argc, value argv[]);
 value value_size_arg(int argc, value argv[]);
 value value_sort_arg(int argc, value argv[]);
 value value_sort_now_arg(int argc, value argv[]);
+value value_sort_by_arg(int argc, value argv[]);
+value value_sort_with_arg(int argc, value argv[]);
 value value_uniq_arg(int argc, value argv[]);
 value value_uniq_now_arg(int argc, value argv[]);
 value value_uniq_sort_arg(int argc, value argv[]);
@@ -1347,6 +1705,480 @@ value value_range_to_arg(int argc, value argv[]);
 value value_range_until_arg(int argc, value argv[]);
 
 
+/* 
+ * Generator functions.
+ * 
+ * A function defined with the :generator symbol in its variable list returns a 
+ * generator when it is called, without running its body. Each time a value is 
+ * pulled out of the generator, the body runs until it reaches a yield and the 
+ * yielded value is returned. The body picks up where it left off the next time.
+ * 
+ * Inside a generator, every yield suspends the generator, even one that is 
+ * inside a loop or inside another function called by the body.
+ */
+#define GEN_READY 0
+#define GEN_RUNNING 1
+#define GEN_SUSPENDED 2
+#define GEN_DONE 3
+
+// The size of the stack mapped for each generator. Pages are only used once the body 
+// reaches them. A function call inside a generator is an error once less than 
+// GENERATOR_STACK_RESERVE bytes are left.
+#define GENERATOR_STACK_SIZE (1 << 24)
+#define GENERATOR_STACK_RESERVE (1 << 18)
+
+// The generator that is currently running, or NULL.
+struct value_generator *current_generator;
+
+/* Creates a generator for a call to (func) with arguments (argv). The arguments 
+ * are evaluated right away.
+ */
+value value_generator_init(value *variables, value func, int argc, value argv[]);
+
+/* Pulls the next value out of (gen) and puts it in (res). Returns TRUE if there 
+ * was a value, FALSE if the generator is finished, or VALUE_ERROR.
+ */
+int value_generator_pull(value gen, value *res);
+
+/* Returns the next value from (gen), or nil if it is finished.
+ */
+value value_next(value gen);
+
+/* Returns true if (gen) has no more values. This may run the generator up to 
+ * its next yield.
+ */
+int value_done_p(value gen);
+value value_done_p_std(value gen);
+
+/* Pulls every remaining value out of (gen) into an array. This will not return 
+ * if the generator never finishes.
+ */
+value value_generator_to_a(value gen);
+
+/* Called by yield() when a generator is running.
+ */
+value value_generator_yield(struct value_generator *gen, value op);
+
+/* Returns true if (gen), which must be running, is too close to the end of its stack 
+ * to call another function.
+ */
+int value_generator_stack_full_p(struct value_generator *gen);
+
+void value_private_generator_free(struct value_generator *gen);
+int value_private_generator_resume(struct value_generator *gen);
+void value_private_generator_start();
+
+value value_next_arg(int argc, value argv[]);
+value value_done_p_arg(int argc, value argv[]);
+
+
+/*
+ * Packed array functions.
+ *
+ * A packed array holds nothing but integers that fit in 64 bits, nothing but
+ * floats that fit in a double, or nothing but booleans, and stores them as raw
+ * machine numbers instead of as values. It can be used anywhere an array can.
+ * Storing an element that doesn't fit turns it into an ordinary array.
+ */
+#define PACKED_NONE -1
+#define PACKED_INT 0
+#define PACKED_FLOAT 1
+#define PACKED_BOOL 2
+
+/* Creates an empty packed array of the given kind with room for (capacity) elements.
+ */
+value value_packed_init(int kind, size_t capacity);
+
+value value_set_pak_long(long array[], size_t length);
+value value_set_pak_double(double array[], size_t length);
+value value_set_pak_bool(int array[], size_t length);
+
+/* Returns the kind of packed array that (op) could be stored in, or PACKED_NONE.
+ */
+int value_packed_kind(value op);
+
+/* The number of bytes that one element of the given kind takes up.
+ */
+size_t value_packed_width(int kind);
+
+value value_packed_set(value op);
+void value_packed_clear(value *op);
+
+/* Returns the element at (index) as an ordinary value. (index) is not checked.
+ */
+value value_packed_get(value op, size_t index);
+
+/* Does what value_at() does when (op) is a packed array.
+ */
+value value_packed_at(value op, value index);
+
+/* Stores (elem) at (index). Returns TRUE if it was stored, FALSE if (elem)
+ * doesn't fit in (op), or VALUE_ERROR if (index) is out of bounds.
+ */
+int value_packed_store(value *op, value index, value elem);
+
+/* Appends (elem) to (op), turning (op) into an ordinary array if (elem) doesn't
+ * fit in it. An empty packed array takes on the kind of the first element.
+ * (op) takes ownership of (elem).
+ */
+value value_packed_append_now2(value *op, value *elem);
+
+/* Returns a packed copy of (op) if every element fits in a packed array, and
+ * an ordinary copy if not.
+ */
+value value_pack(value op);
+int value_pack_now(value *op);
+
+/* Returns (op) as an ordinary array.
+ */
+value value_unpack(value op);
+int value_unpack_now(value *op);
+
+/* Calls (f) with any packed arrays in (op1) and (op2) unpacked.
+ */
+value value_packed_unpacked_call2(value (*f)(value, value), value op1, value op2);
+
+int value_packed_eq(value op1, value op2);
+int value_packed_cmp(value op1, value op2);
+size_t value_packed_hash_function(value op);
+int value_packed_put(char buffer[], size_t length, value op, char *format);
+
+value value_packed_each(value *variables, value op, value func);
+value value_packed_map(value *variables, value op, value func);
+value value_packed_summation(value *variables, value op, value func);
+value value_packed_sort_now(value *op);
+value value_packed_sum(value op);
+
+/* Unpacks any packed arrays in (argv) unless (spec), the spec of the built-in 
+ * function being called, says that it knows about them, and turns n-dimensional 
+ * arrays into nested arrays and slices into ordinary strings and arrays the same way. 
+ * The originals are put in (saved), and any argument that wasn't unpacked has nil 
+ * there. Returns TRUE if anything was unpacked.
+ */
+int value_private_unpack_args(struct value_spec spec, int argc, value argv[], value saved[]);
+
+/* Undoes value_private_unpack_args() after the call. An argument in (keep)
+ * that's TRUE may have been changed in place by the function, so it's kept and
+ * packed again if it still fits, or made n-dimensional again if it still has a 
+ * shape. A copy of a slice is kept as it is. The others are put back the way they 
+ * were.
+ */
+void value_private_repack_args(int argc, value argv[], value saved[], int keep[]);
+
+value value_pack_arg(int argc, value argv[]);
+value value_packed_p_arg(int argc, value argv[]);
+
+
+/*
+ * N-dimensional array functions.
+ *
+ * An n-dimensional array keeps its elements in one block along with a shape and
+ * strides. ndarray() makes one of a given shape, and to_nd() makes one out of nested
+ * arrays that have the same length at each level. at() takes an index for each
+ * dimension and finds the element directly. A range for an index, or fewer indices
+ * than there are dimensions, gives a view that shares the elements, and so do
+ * transpose() and reshape(). See value_nd.c.
+ */
+
+/* Makes an n-dimensional array of the given shape with every element set to (fill). 
+ * ndarray() takes the shape as an array of integers and fills with 0 by default.
+ */
+value value_nd_init(int rank, size_t shape[], value fill);
+value value_ndarray(value shape, value fill);
+
+/* Reads an array of integers into (dims) and returns how many there are, or reports 
+ * an error and returns VALUE_ERROR. (name) is used in error messages.
+ */
+int value_private_nd_read_shape(value shape, size_t dims[], char *name);
+
+/* value_private_nd_strides() gives (nd) the strides of its shape laid out in 
+ * row-major order. value_private_nd_contiguous_p() tells whether it is laid out 
+ * that way already.
+ */
+void value_private_nd_strides(struct value_nd *nd);
+int value_private_nd_contiguous_p(struct value_nd *nd);
+
+/* The number of elements in (op), and where the (i)th of them in row-major order is 
+ * in the block.
+ */
+size_t value_nd_size(value op);
+size_t value_private_nd_offset(struct value_nd *nd, size_t i);
+
+/* value_nd_set() shares the block, and value_nd_clear() frees it once nothing else 
+ * uses it.
+ */
+value value_nd_set(value op);
+void value_nd_clear(value *op);
+value value_private_nd_copy(value op);
+
+/* Makes sure that no other array shares the elements of (op), copying them if one 
+ * does, so that they can be changed. Returns 0, or VALUE_ERROR if the copy fails. 
+ * value_nd_at_ref() calls it before it returns a reference to an element.
+ */
+int value_nd_own(value *op);
+
+/* Returns (op), which holds nested arrays, as an n-dimensional array, or reports an 
+ * error if its arrays aren't the same length at each level. value_to_nd_now() does 
+ * it in place without reporting anything, and returns VALUE_ERROR if it can't.
+ */
+value value_to_nd(value op);
+int value_to_nd_now(value *op);
+value value_private_to_nd(value op, int quiet_p);
+int value_private_nd_shape(value op, int *rank, size_t shape[]);
+int value_private_nd_fill(value op, int rank, size_t shape[], int d, value **a);
+
+/* Returns (op) as nested arrays.
+ */
+value value_nd_to_a(value op);
+value value_private_nd_to_a(struct value_nd *nd, int d, size_t offset);
+
+/* Does what value_at() and value_at_ref() do when (op) is an n-dimensional array. 
+ * (index) and (more) hold one index for each dimension, or fewer for value_nd_at().
+ */
+value value_nd_at(value op, value index, value more[], size_t length);
+value * value_nd_at_ref(value op, value index, value more[], size_t length);
+int value_private_nd_select(struct value_nd *nd, value indices[], size_t count, char *name);
+
+/* shape() returns the length of each dimension. transpose() reverses the order of 
+ * the dimensions, and reshape() gives the same elements a different shape.
+ */
+value value_shape(value op);
+value value_transpose(value op);
+value value_reshape(value op, value shape);
+
+int value_nd_eq(value op1, value op2);
+int value_nd_cmp(value op1, value op2);
+size_t value_nd_hash_function(value op);
+int value_nd_put(char buffer[], size_t length, value op, char *format);
+
+value value_ndarray_arg(int argc, value argv[]);
+value value_nd_p_arg(int argc, value argv[]);
+value value_reshape_arg(int argc, value argv[]);
+value value_shape_arg(int argc, value argv[]);
+value value_to_nd_arg(int argc, value argv[]);
+value value_transpose_arg(int argc, value argv[]);
+
+
+/*
+ * Vector functions.
+ *
+ * vadd(), vsub(), vmul() and vdiv() do arithmetic element by element on two
+ * numeric arrays of the same size, or on an array and a number. dot(), min(),
+ * max() and prefix_sum() work on one numeric array. The work is done on packed
+ * arrays with SIMD instructions where possible; see value_vector.c.
+ *
+ * The math functions sin(), exp(), log(), sqrt(), ** and the rest also work
+ * element by element when given an array; see value_vector_math().
+ *
+ * SIMFPL_SIMD=0 in the environment turns off the SIMD loops, and SIMFPL_SIMD=1
+ * allows SSE2 but not AVX2.
+ */
+#define VECTOR_ADD 0
+#define VECTOR_SUB 1
+#define VECTOR_MUL 2
+#define VECTOR_DIV 3
+#define VECTOR_POW 4
+
+#define VECTOR_SCALAR 1
+#define VECTOR_SSE2 2
+#define VECTOR_AVX2 3
+
+// Set the first time value_vector_level() is called.
+int vector_level;
+
+/* The best SIMD instruction set that can be used: VECTOR_SCALAR, VECTOR_SSE2 or
+ * VECTOR_AVX2.
+ */
+int value_vector_level();
+
+/* Applies the VECTOR_ operation (op) to (op1) and (op2) element by element. The
+ * result is a packed array if it fits in one. (name) is used in error messages.
+ */
+value value_vector_op(int op, value op1, value op2, char *name);
+
+/* Whether (op) is an array, packed array or range, which the math functions
+ * in value_math.c apply to element by element.
+ */
+int value_vector_p(value op);
+
+/* Does value_math_function() with (func) to every element of (op). When the
+ * default precision is 53 bits and (op) packs, this uses the C library and
+ * returns a packed array of floats, which may be an ulp or two off from what MPFR
+ * gives for a single number. Otherwise it uses MPFR at the default precision.
+ */
+value value_vector_math(value op, int func);
+
+value value_vadd(value op1, value op2);
+value value_vsub(value op1, value op2);
+value value_vmul(value op1, value op2);
+value value_vdiv(value op1, value op2);
+value value_dot(value op1, value op2);
+value value_min(value op);
+value value_max(value op);
+value value_prefix_sum(value op);
+
+/* Used by value_packed_sum(). value_vector_sum_int() returns TRUE if the sum
+ * overflowed, in which case (*sum) is not set.
+ */
+int value_vector_sum_int(int64_t *sum, int64_t a[], size_t length);
+double value_vector_sum_float(double a[], size_t length);
+
+/* Used by value_matrix.c. value_private_vector_dot_float() adds up the products of 
+ * (a) and (b) in four running totals, and value_private_vector_unpackable_p() tells 
+ * whether (x) is a double that MPFR wouldn't give.
+ */
+double value_private_vector_dot_float(double a[], double b[], size_t length);
+int value_private_vector_unpackable_p(double x);
+
+value value_vadd_arg(int argc, value argv[]);
+value value_vsub_arg(int argc, value argv[]);
+value value_vmul_arg(int argc, value argv[]);
+value value_vdiv_arg(int argc, value argv[]);
+value value_dot_arg(int argc, value argv[]);
+value value_min_arg(int argc, value argv[]);
+value value_max_arg(int argc, value argv[]);
+value value_prefix_sum_arg(int argc, value argv[]);
+
+
+/*
+ * Matrix functions.
+ *
+ * A matrix is an array of rows of the same length, or an NDArray with two dimensions.
+ * matmul() multiplies two matrices, or a matrix and a vector, and matvec() multiplies a
+ * matrix and a vector. solve() returns x where (matmul op1 x) is op2. transpose() takes
+ * matrices too. The results are arrays of packed rows, or NDArrays if op1 is one. See
+ * value_matrix.c.
+ */
+#define MATRIX_BLOCK 64
+#define MATRIX_PARALLEL_THRESHOLD 262144
+
+// Set the first time value_matrix_parallel_threshold() is called.
+size_t matrix_parallel_threshold;
+
+/* The number of multiplications at which a product is split among threads. 
+ * SIMFPL_MATRIX_PARALLEL in the environment sets it.
+ */
+size_t value_matrix_parallel_threshold();
+
+value value_private_matrix_row(value op, int vector_p, size_t i, value **a, size_t *step);
+int value_private_matrix_kind(value x);
+
+/* Reads (op) into (m). Returns VALUE_ERROR after reporting an error if (op) isn't a 
+ * matrix or vector. (name) and (which) are used in error messages.
+ */
+int value_private_matrix_read(struct value_matrix *m, value op, char *name, char *which);
+int value_private_matrix_alloc(struct value_matrix *m);
+int value_private_matrix_fill(struct value_matrix *m, value op);
+void value_private_matrix_free(struct value_matrix *m);
+int value_private_matrix_convert(struct value_matrix *m, int kind);
+int value_private_matrix_unify(struct value_matrix *a, struct value_matrix *b);
+int value_private_matrix_init(struct value_matrix *m, int kind, size_t rows, size_t cols, int vector_p);
+value value_private_matrix_get(struct value_matrix *m, size_t i);
+value value_private_matrix_row_value(struct value_matrix *m, size_t i);
+value value_private_matrix_value(struct value_matrix *m, value like);
+
+/* Adds (x) times (b) to (r), with SIMD instructions where possible.
+ */
+void value_private_matrix_axpy(double r[], double x, double b[], size_t length);
+void value_private_matrix_tile(double c[], size_t ldc, double a[], size_t lda, double b[], size_t ldb, size_t rows, size_t depth, size_t width);
+
+/* The kernels do rows (lo) through (hi - 1) of the product of (a) and (b) into (c). 
+ * The ones for integers return TRUE if one overflowed.
+ */
+void value_private_matrix_mul_float(struct value_matrix *a, struct value_matrix *b, struct value_matrix *c, size_t lo, size_t hi);
+int value_private_matrix_mul_int(struct value_matrix *a, struct value_matrix *b, struct value_matrix *c, size_t lo, size_t hi);
+int value_private_matrix_mul_vector(struct value_matrix *a, struct value_matrix *b, struct value_matrix *c, size_t lo, size_t hi);
+void *value_private_matrix_worker(void *arg);
+int value_private_matrix_mul_fast(struct value_matrix *a, struct value_matrix *b, struct value_matrix *c, int threads);
+int value_private_matrix_mul_generic(struct value_matrix *a, struct value_matrix *b, struct value_matrix *c);
+value value_private_matmul(value op1, value op2, int vector_p, char *name);
+
+value value_matmul(value op1, value op2);
+value value_matvec(value op1, value op2);
+
+/* Transposes an array of rows. value_transpose() calls this for anything but an 
+ * NDArray.
+ */
+value value_matrix_transpose(value op);
+
+int value_private_matrix_solve_float(double lu[], double x[], size_t n, size_t m);
+int value_private_matrix_solve_generic(value lu[], value x[], size_t n, size_t m);
+value value_solve(value op1, value op2);
+
+value value_matmul_arg(int argc, value argv[]);
+value value_matvec_arg(int argc, value argv[]);
+value value_solve_arg(int argc, value argv[]);
+
+
+/*
+ * Slice functions.
+ *
+ * range(), take() and drop() give a slice when they select a long enough piece of a 
+ * string or array. A slice shares its characters or elements with the slices that it 
+ * was taken from, so slicing it again or passing it around copies nothing. type() says 
+ * that it's a String or an Array. at(), length(), size(), each(), index(), contains?(), 
+ * starts_with?(), ends_with?(), split() and match?() read it in place, and the other 
+ * built-in functions are given an ordinary copy. See value_slice.c.
+ */
+
+/* A piece shorter than this is copied rather than sliced.
+ */
+#define SLICE_MIN_LENGTH 32
+
+/* A piece shorter than 1 / SLICE_RETAIN_RATIO of the characters or elements it would 
+ * share is copied, so that it doesn't keep the rest of them alive.
+ */
+#define SLICE_RETAIN_RATIO 4
+
+/* Returns characters or elements (start) through (end - 1) of (op), which is a string, 
+ * an array or a slice of either, as a slice or as a copy. The caller checks the bounds.
+ */
+value value_slice(value op, size_t start, size_t end);
+struct value_slice_data * value_private_slice_data(char *s, value a[], size_t length);
+value value_private_slice_array(value a[], size_t length);
+
+/* value_slice_set() shares the characters or elements, and value_slice_clear() frees 
+ * them once no other slice uses them.
+ */
+value value_slice_set(value op);
+void value_slice_clear(value *op);
+
+/* Returns (op) as an ordinary string or array. value_unslice_now() does it in place, 
+ * and returns 0, or VALUE_ERROR if the copy fails.
+ */
+value value_unslice(value op);
+int value_unslice_now(value *op);
+
+/* VALUE_STR or VALUE_ARY if (op) is a slice, otherwise the type of (op).
+ */
+int value_slice_type(value op);
+
+/* value_string_view() returns the characters of (op) if it's a string or a slice of 
+ * one, and puts how many there are in (length). They aren't NUL-terminated if (op) is a 
+ * slice. value_array_view() does the same for an array or a slice of one. Both return 
+ * NULL and put 0 in (length) for anything else.
+ */
+char * value_string_view(value op, size_t *length);
+value * value_array_view(value op, size_t *length);
+
+/* Where (str) first occurs in (op), a string or a slice of one, or -1.
+ */
+long value_string_find(value op, char *str, size_t length);
+
+value value_slice_at(value op, value index, value more[], size_t length);
+value value_slice_each(value *variables, value op, value func);
+
+/* value_slice_cmp() compares the way value_cmp() does, or value_cmp_any() if (any_p) 
+ * is TRUE.
+ */
+int value_slice_eq(value op1, value op2);
+int value_slice_cmp(value op1, value op2, int any_p);
+size_t value_slice_hash_function(value op);
+int value_slice_put(char buffer[], size_t length, value op, char *format);
+
+value value_slice_p_arg(int argc, value argv[]);
+
+
 /* 
  * Block and function functions.
  */
@@ -1362,6 +2194,29 @@ value value_call(value *variables, value func, int argc, value argv[]);
  */
 value value_bifcall_sexp(value *variables, value *ud_functions, value sexp);
 
+/* 
+ * Call-site quickening. value_bifcall_sexp() watches the argument types at each call 
+ * of a two-argument built-in function. After QUICKEN_THRESHOLD calls with the same 
+ * types, the call site uses the specialized function for those types, like add_int for 
+ * two integers. If a quickened site later sees other types, it goes back to the generic 
+ * function and is never quickened again. def() gives each two-argument call site in the 
+ * body a struct value_site, which is shared by the copies of the body that each call 
+ * makes, so what a site has seen lasts across calls.
+ * 
+ * quicken_stats(): Returns a hash with the number of call sites that have been 
+ *   quickened and deoptimized.
+ */
+#define QUICKEN_THRESHOLD 8
+#define QUICKEN_NEVER -1
+
+unsigned long quickened_sites, deoptimized_sites;
+
+struct value_site * value_private_site_init();
+void value_private_site_free(struct value_site *site);
+int value_private_make_sites(value op);
+int value_private_observe_site(struct value_bif *bif, value op1, value op2);
+value value_quicken_stats();
+
 /* Call a built-in function (op) with arguments (argv).
  */
 value value_bifcall(value op, int argc, value argv[]);
@@ -1373,6 +2228,8 @@ value value_bifcall(value op, int argc, value argv[]);
  * argv: Argument list.
  */
 value value_udfcall(value *variables, value op, int argc, value argv[]);
+value value_private_dispatch_udfcall(value *variables, value op, int argc, value argv[]);
+value value_private_udfcall(value *variables, value op, int argc, value argv[], int evaluated_p);
 
 /* Defines a user-defined function.
  */
@@ -1380,6 +2237,38 @@ value value_def(value *variables, value name, value vars, value body);
 
 value value_lambda(value *variables, value vars, value body);
 
+/* 
+ * Memoization.
+ * 
+ * A memoized function remembers the results of its most recent (capacity) calls, 
+ * keyed by the evaluated arguments. When the cache is full, the entry that was 
+ * used least recently is thrown out. A function should only be memoized if it 
+ * has no side effects and its result depends only on its arguments.
+ * 
+ * memoize(func, capacity): Returns a memoized copy of (func), which is a function 
+ *   or the name of a function given as a symbol. If (func) has a name, the 
+ *   memoized copy replaces it, so recursive calls use the cache as well.
+ * defmemo: Like def, but the function is memoized.
+ * memo_stats(func): Returns a hash with the hits, misses, size and capacity of 
+ *   the cache.
+ * memo_clear(func): Empties the cache and resets its counters.
+ */
+#define MEMO_DEFAULT_CAPACITY 1024
+#define MEMO_NO_ENTRY ((size_t) -1)
+
+value value_memoize(value *ud_functions, value func, value capacity);
+value value_defmemo(value *variables, value name, value vars, value body);
+value value_memo_stats(value *ud_functions, value func);
+value value_memo_clear(value *ud_functions, value func);
+
+value value_private_memo_function(value ud_functions, value func, char *fname);
+struct value_memo * value_private_memo_init(size_t capacity);
+void value_private_memo_free(struct value_memo *memo);
+void value_private_memo_reset(struct value_memo *memo);
+void value_private_memo_unlink(struct value_memo *memo, size_t n);
+void value_private_memo_push(struct value_memo *memo, size_t n);
+value value_private_memo_call(value *variables, value op, int argc, value argv[]);
+
 /* Defines a macro.
  */
 value value_defmacro(value *variables, value name, value vars, value body);
@@ -1392,6 +2281,11 @@ value value_quote(value *variables, value op);
 
 value value_def_arg(int argc, value argv[]);
 value value_lambda_arg(int argc, value argv[]);
+value value_memoize_arg(int argc, value argv[]);
+value value_defmemo_arg(int argc, value argv[]);
+value value_memo_stats_arg(int argc, value argv[]);
+value value_quicken_stats_arg(int argc, value argv[]);
+value value_memo_clear_arg(int argc, value argv[]);
 
 /* Do not evaluate (op), including anything inside a call to (dq) or (dv).
  */
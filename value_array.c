@@ -8,6 +8,9 @@
 
 #include "value.h"
 
+#include <pthread.h>
+#include <unistd.h>
+
 /* 
  * Contains functions for manipulating arrays. Notice that all of 
  * these functions work on lists as well.
@@ -16,12 +19,14 @@
 /* 
  * Array Implementation
  * 
- * At any given time, the amount of memory allocated for the array is 
- * always a power of 2. This keeps insertion relatively efficient 
- * while also not using too much extra memory. Technically, it's 
- * always a power of 2 plus one, because of the extra element that 
- * represents the length. This implementation has not been tested 
- * very thoroughly, so there may be bugs.
+ * An array keeps its length and its capacity, the number of elements it 
+ * has room for. When an append runs out of room, the array grows to the 
+ * next power of 2, which keeps insertion relatively efficient while also 
+ * not using too much extra memory. When it falls to a quarter of its 
+ * capacity, it gives half of the memory back. reserve() and shrink!() set 
+ * the capacity directly for code that knows how big the array will get. 
+ * The capacity is kept in front of the elements rather than in the header, 
+ * which leaves room in the header for the type.
  */
 
 value block_array_cast(value op)
@@ -150,7 +155,16 @@ value value_set_ary_str(char *array[], size_t length)
 
 value value_append(value op1, value op2)
 {
-	if (op1.type == VALUE_ARY) {
+	if (op1.type == VALUE_PAK) {
+		value res = value_packed_set(op1);
+		return_if_error(res);
+		value err = value_append_now(&res, op2);
+		if (err.type == VALUE_ERROR) {
+			value_clear(&res);
+			return err;
+		}
+		return res;
+	} else if (op1.type == VALUE_ARY) {
 		size_t length = value_length(op1);
 		
 		value res;
@@ -204,14 +218,15 @@ value value_append_now2(value *op1, value *op2)
 {
 	if (op1->type == VALUE_ARY) {
 		size_t length = op1->core.u_a.length;
-		if (resize_p(length)) {
-			value_realloc(op1, next_size(length));
-			return_if_error(*op1);
-		}
+		if (!value_private_array_grow(op1, length + 1))
+			return value_init_error();
 		
 		op1->core.u_a.a[length] = *op2;
 		++op1->core.u_a.length;
 		
+	} else if (op1->type == VALUE_PAK) {
+		return value_packed_append_now2(op1, op2);
+		
 	} else if (op1->type == VALUE_LST) {
 		value ptr = *op1;
 		while (!value_empty_p(ptr))
@@ -229,11 +244,8 @@ value value_append_now2(value *op1, value *op2)
 
 	} else if (op1->type == VALUE_BLK) {
 		size_t length = value_length(*op1);
-		if (resize_p(length)) {
-			value_realloc(op1, next_size(length));
-			if (op1->type == VALUE_ERROR)
-				return value_init_error();
-		}
+		if (!value_private_array_grow(op1, length + 1))
+			return value_init_error();
 		
 		op1->core.u_blk.a[length] = *op2;
 		++op1->core.u_blk.length;
@@ -246,6 +258,129 @@ value value_append_now2(value *op1, value *op2)
 	return value_init_nil();
 }
 
+int value_private_array_grow(value *op, size_t capacity)
+{
+	size_t length, current;
+	if (op->type == VALUE_BLK) {
+		length = op->core.u_blk.length;
+		current = value_array_capacity(op->core.u_blk.a);
+	} else {
+		length = op->core.u_a.length;
+		current = value_array_capacity(op->core.u_a.a);
+	}
+	
+	if (capacity <= current)
+		return TRUE;
+	if (capacity > ARRAY_MAX_LENGTH) {
+		value_error(1, "Memory Error: An array cannot hold more than %ld elements.", (long) ARRAY_MAX_LENGTH);
+		return FALSE;
+	}
+	
+	size_t size = next_size(capacity);
+	if (size > ARRAY_MAX_LENGTH)
+		size = ARRAY_MAX_LENGTH;
+	
+	++memory_array_grows;
+	memory_array_grow_copies += length;
+	value_realloc(op, size);
+	return op->type != VALUE_ERROR;
+}
+
+void value_private_array_settle(value *op)
+{
+	size_t capacity = value_array_capacity(op->core.u_a.a);
+	
+	// Halve rather than fit the length exactly, so that pushing after popping doesn't 
+	// have to grow right away.
+	if (capacity > RESIZE_MIN && op->core.u_a.length < capacity / 4) {
+		++memory_array_shrinks;
+		value_realloc(op, capacity / 2);
+	}
+}
+
+value value_array_with_capacity(value op)
+{
+	if (op.type != VALUE_MPZ) {
+		value_error(1, "Type Error: array_with_capacity() is undefined where op is %ts (integer expected).", op);
+		return value_init_error();
+	} else if (value_lt(op, value_zero) || value_gt(op, value_int_max)) {
+		value_error(1, "Domain Error: array_with_capacity() is undefined where op is %s (between 0 and %s expected).", op, value_int_max);
+		return value_init_error();
+	}
+	
+	value res = value_init(VALUE_ARY);
+	if (value_get_long(op) > 0)
+		value_malloc(&res, value_get_long(op));
+	return res;
+}
+
+value value_capacity(value op)
+{
+	if (op.type == VALUE_ARY)
+		return value_set_ulong(value_array_capacity(op.core.u_a.a));
+	else if (op.type == VALUE_PAK)
+		return value_set_ulong(op.core.u_pk->capacity);
+	
+	value_error(1, "Type Error: capacity() is undefined where op is %ts (array expected).", op);
+	return value_init_error();
+}
+
+value value_reserve(value *op, value capacity)
+{
+	if (op->type != VALUE_ARY && op->type != VALUE_PAK) {
+		value_error(1, "Type Error: reserve() is undefined where op1 is %ts (array expected).", *op);
+		return value_init_error();
+	} else if (capacity.type != VALUE_MPZ) {
+		value_error(1, "Type Error: reserve() is undefined where op2 is %ts (integer expected).", capacity);
+		return value_init_error();
+	} else if (value_lt(capacity, value_zero) || value_gt(capacity, value_int_max)) {
+		value_error(1, "Domain Error: reserve() is undefined where op2 is %s (between 0 and %s expected).", capacity, value_int_max);
+		return value_init_error();
+	}
+	
+	size_t size = value_get_long(capacity);
+	size_t current = op->type == VALUE_PAK ? op->core.u_pk->capacity : value_array_capacity(op->core.u_a.a);
+	if (size <= current)
+		return value_init_nil();
+	
+	// Unlike growing on append, this allocates exactly what was asked for.
+	++memory_array_reserves;
+	value_realloc(op, size);
+	return_if_error(*op);
+	return value_init_nil();
+}
+
+value value_shrink_now(value *op)
+{
+	if (op->type == VALUE_PAK) {
+		// A packed array always keeps room for at least one element.
+		size_t length = op->core.u_pk->length;
+		if (op->core.u_pk->capacity > length && length > 0) {
+			++memory_array_shrinks;
+			value_realloc(op, length);
+			return_if_error(*op);
+		}
+		return value_init_nil();
+	} else if (op->type != VALUE_ARY) {
+		value_error(1, "Type Error: shrink!() is undefined where op is %ts (array expected).", *op);
+		return value_init_error();
+	}
+	
+	if (value_array_capacity(op->core.u_a.a) == op->core.u_a.length)
+		return value_init_nil();
+	
+	++memory_array_shrinks;
+	if (op->core.u_a.length == 0) {
+		value_free_elements(op->core.u_a.a);
+		*op = value_init(VALUE_ARY);
+	} else {
+		value_realloc(op, op->core.u_a.length);
+		return_if_error(*op);
+	}
+	
+	return value_init_nil();
+}
+
 value value_array_with_length(value op)
 {
 	value res = value_init_nil();
@@ -282,6 +417,12 @@ value value_at(value op, value index, value more[], size_t length)
 			return value_at(op, more[0], more+1, length-1);
 		else return value_set(op);
 	
+	if (op.type == VALUE_NDA)
+		return value_nd_at(op, index, more, length);
+	
+	if (op.type == VALUE_SLC)
+		return value_slice_at(op, index, more, length);
+	
 	if (op.type == VALUE_STR) {
 		if (index.type == VALUE_MPZ) {
 			value len = value_set_long(strlen(op.core.u_s));
@@ -361,6 +502,9 @@ value value_at(value op, value index, value more[], size_t length)
 		}
 		
 		
+	} else if (op.type == VALUE_PAK) {
+		res = value_packed_at(op, index);
+		
 	} else if (op.type == VALUE_LST) {
 		if (index.type != VALUE_MPZ) {
 			value_error(1, "Type Error: at() is undefined where op is %ts and index is %ts (integer expected).", op, index);
@@ -447,6 +591,9 @@ value * value_at_ref(value op, value index, value more[], size_t length)
 			return value_at_ref(op, more[0], more+1, length-1);
 		else return &op;
 	
+	if (op.type == VALUE_NDA)
+		return value_nd_at_ref(op, index, more, length);
+	
 	if (op.type == VALUE_ARY) {
 		if (index.type == VALUE_MPZ) {
 			long lindex = value_get_long(index);
@@ -455,6 +602,10 @@ value * value_at_ref(value op, value index, value more[], size_t length)
 				return NULL;
 			}
 			
+			// Something inside the element is about to be changed, so a slice has to 
+			// become a copy of its own first.
+			if (length && value_unslice_now(&op.core.u_a.a[lindex]) == VALUE_ERROR)
+				return NULL;
 			if (length)
 				return value_at_ref(op.core.u_a.a[lindex], more[0], more+1, length-1);
 			else return &op.core.u_a.a[lindex];
@@ -525,17 +676,66 @@ value * value_at_ref(value op, value index, value more[], size_t length)
 
 value value_at_assign_do(value *variables, value *op1, value index, value more[], size_t length, value func, value op2)
 {
-	value *modify;
+	value *modify, *data = op1;
 	if (op1->type == VALUE_VAR) {
-		value *data = value_hash_get_ref(*variables, *op1);
+		data = value_hash_get_ref(*variables, *op1);
 		if (data == NULL) {
 			value_error(1, "Error: In at=(), undefined variable %s.", *op1);
 			return value_init_error();
 		}
-		modify = value_at_ref(*data, index, more, length);
-	} else {
-		modify = value_at_ref(*op1, index, more, length);
 	}
+	
+	// A slice shares what it refers to, so it becomes a copy before it's changed.
+	if (index.type != VALUE_NIL && value_unslice_now(data) == VALUE_ERROR)
+		return value_init_error();
+	
+	if (data->type == VALUE_PAK && index.type != VALUE_NIL) {
+		// Store straight into the packed array if the new element fits. Otherwise 
+		// it has to become an ordinary array.
+		value elem = value_init_nil();
+		int stored_p = FALSE;
+		if (length == 0) {
+			if (func.type != VALUE_NIL) {
+				value old = value_packed_at(*data, index);
+				return_if_error(old);
+				value ary[] = { old, op2 };
+				elem = value_call(variables, func, 2, ary);
+				value_clear(&old);
+				return_if_error(elem);
+				stored_p = value_packed_store(data, index, elem);
+			} else stored_p = value_packed_store(data, index, op2);
+			
+			if (stored_p == VALUE_ERROR) {
+				value_clear(&elem);
+				return value_init_error();
+			}
+		}
+		
+		if (stored_p) {
+			if (func.type == VALUE_NIL)
+				return value_set(op2);
+			return elem;
+		}
+		
+		if (value_unpack_now(data) == VALUE_ERROR) {
+			value_clear(&elem);
+			return value_init_error();
+		}
+		
+		if (elem.type != VALUE_NIL) {
+			// The function has already been called, so just store its result.
+			modify = value_at_ref(*data, index, more, length);
+			if (modify == NULL) {
+				value_clear(&elem);
+				return value_init_error();
+			}
+			value_clear(modify);
+			*modify = elem;
+			return value_set(*modify);
+		}
+	}
+	
+	modify = value_at_ref(*data, index, more, length);
 
 	if (modify && modify->type == VALUE_ERROR)
 		return value_set(*modify);
@@ -607,8 +807,7 @@ value value_concat_now2(value *op1, value *op2)
 				return res;
 			}
 			
-			value_realloc(op1, next_size(length));
-			if (op1->type == VALUE_ERROR)
+			if (!value_private_array_grow(op1, length))
 				return value_init_error();
 				
 			size_t i;
@@ -618,11 +817,8 @@ value value_concat_now2(value *op1, value *op2)
 			op1->core.u_a.length = length;
 		} else {
 			size_t length = value_length(*op1);
-			if (resize_p(length+1)) {
-				value_realloc(op1, next_size(length+1));
-				if (op1->type == VALUE_ERROR)
-					return value_init_error();
-			}
+			if (!value_private_array_grow(op1, length + 1))
+				return value_init_error();
 			op1->core.u_a.a[length] = *op2;
 			++op1->core.u_a.length;
 		}
@@ -877,12 +1073,10 @@ value value_delete_at_now(value *op, value index)
 		// Remove (res) from the array by taking it out of the block of memory. This memmove() call might be 
 		// a little obscure, but the speed makes it worth it, especially when you're deleting an element from 
 		// near the beginning of a very long array.
-		memmove((void *) (op->core.u_a.a + lindex), (void *) (op->core.u_a.a + lindex + 1), sizeof(value) * (length - lindex + 1));
-		
-		if (resize_p(length))
-			value_realloc(op, next_size(length));
+		memmove((void *) (op->core.u_a.a + lindex), (void *) (op->core.u_a.a + lindex + 1), sizeof(value) * (length - lindex));
 		
 		--op->core.u_a.length;
+		value_private_array_settle(op);
 				
 		return res;
 	
@@ -900,62 +1094,41 @@ value value_delete_at_now(value *op, value index)
 value value_each(value *variables, value op, value func)
 {
 	value res = value_init_nil();
-	if (op.type == VALUE_ARY) {
+	if (op.type == VALUE_PAK) {
+		res = value_packed_each(variables, op, func);
+		
+	} else if (op.type == VALUE_SLC) {
+		res = value_slice_each(variables, op, func);
+		
+	} else if (op.type == VALUE_ARY) {
 		size_t i;
 		for (i = 0; i < op.core.u_a.length; ++i) {
 			value tmp = value_call(variables, func, 1, op.core.u_a.a + i);
-			if (tmp.type == VALUE_STOP && tmp.core.u_stop.type == STOP_BREAK) {
+			if (value_private_each_step(&res, tmp))
 				break;
-			} else if (tmp.type == VALUE_STOP && tmp.core.u_stop.type == STOP_YIELD) {
-				if (res.type == VALUE_NIL) res = value_init(VALUE_ARY);
-				value_append_now(&res, *tmp.core.u_stop.core);
-			} else if (tmp.type == VALUE_ERROR || tmp.type == VALUE_STOP && (tmp.core.u_stop.type == STOP_RETURN || tmp.core.u_stop.type == STOP_EXIT)) {
-				value_clear(&res);
-				res = tmp;
-				break;
-			}
-			value_clear(&tmp);
 		}
 		
 	} else if (op.type == VALUE_LST) {	
 		value optr = op;
 		while (optr.type == VALUE_LST) {
 			value tmp = value_call(variables, func, 1, optr.core.u_l + 0);
-			if (tmp.type == VALUE_STOP && tmp.core.u_stop.type == STOP_BREAK) {
-				break;
-			} else if (tmp.type == VALUE_STOP && tmp.core.u_stop.type == STOP_YIELD) {
-				if (res.type == VALUE_NIL) res = value_init(VALUE_ARY);
-				value_append_now(&res, *tmp.core.u_stop.core);
-			} else if (tmp.type == VALUE_ERROR || tmp.type == VALUE_STOP && (tmp.core.u_stop.type == STOP_RETURN || tmp.core.u_stop.type == STOP_EXIT)) {
-				value_clear(&res);
-				res = tmp;
+			if (value_private_each_step(&res, tmp))
 				break;
-			}
-			value_clear(&tmp);
 			
 			optr = optr.core.u_l[1];
 		}
 	
 	} else if (op.type == VALUE_HSH) {
 		size_t i, j;
-		for (i = 0; i < op.core.u_h.length; ++i) {
-			if (op.core.u_h.a[i].type == VALUE_ARY) {
-				value bucket = op.core.u_h.a[i];
+		for (i = 0; i < op.core.u_h->length; ++i) {
+			if (op.core.u_h->a[i].type == VALUE_ARY) {
+				value bucket = op.core.u_h->a[i];
 				for (j = 0; j < bucket.core.u_a.length; ++j) {
 					if (bucket.core.u_a.a[j].type != VALUE_ARY || bucket.core.u_a.a[j].core.u_a.length != 2)
 						continue;
 					value tmp = value_call(variables, func, 2, bucket.core.u_a.a[j].core.u_a.a + 0);
-					if (tmp.type == VALUE_STOP && tmp.core.u_stop.type == STOP_BREAK) {
+					if (value_private_each_step(&res, tmp))
 						break;
-					} else if (tmp.type == VALUE_STOP && tmp.core.u_stop.type == STOP_YIELD) {
-						if (res.type == VALUE_NIL) res = value_init(VALUE_ARY);
-						value_append_now(&res, *tmp.core.u_stop.core);
-					} else if (tmp.type == VALUE_ERROR || tmp.type == VALUE_STOP && (tmp.core.u_stop.type == STOP_RETURN || tmp.core.u_stop.type == STOP_EXIT)) {
-						value_clear(&res);
-						res = tmp;
-						break;
-					}
-					value_clear(&tmp);
 				}
 			}
 		}
@@ -974,22 +1147,29 @@ value value_each(value *variables, value op, value func)
 		for (; reversed_p ? value_gt(min, max) : value_lt(min, max); reversed_p ? value_dec_now(&min) : value_inc_now(&min)) {
 			value tmp = value_call(variables, func, 1, &min);
 			
-			if (tmp.type == VALUE_STOP && tmp.core.u_stop.type == STOP_BREAK) {
+			if (value_private_each_step(&res, tmp))
 				break;
-			} else if (tmp.type == VALUE_STOP && tmp.core.u_stop.type == STOP_YIELD) {
-				if (res.type == VALUE_NIL) res = value_init(VALUE_ARY);
-				value_append_now(&res, *tmp.core.u_stop.core);
-			} else if (tmp.type == VALUE_ERROR || tmp.type == VALUE_STOP && (tmp.core.u_stop.type == STOP_RETURN || tmp.core.u_stop.type == STOP_EXIT)) {
-				value_clear(&res);
-				res = tmp;
-				break;
-			}
-			value_clear(&tmp);
 		}
 		
 		value_clear(&min);
 		value_clear(&max);
 		
+	} else if (op.type == VALUE_GEN) {
+		value x;
+		int found_p;
+		while ((found_p = value_generator_pull(op, &x)) == TRUE) {
+			value tmp = value_call(variables, func, 1, &x);
+			value_clear(&x);
+			
+			if (value_private_each_step(&res, tmp))
+				break;
+		}
+		
+		if (found_p == VALUE_ERROR) {
+			value_clear(&res);
+			res = value_init_error();
+		}
+		
 	} else {
 		value_error(1, "Type Error: each() is undefined where op is %ts (iterable expected).", op);
 		res = value_init_error();
@@ -998,6 +1178,28 @@ value value_each(value *variables, value op, value func)
 	return res;
 }
 
+/* 
+ * Handles the result (tmp) of one call made by each(). A yield is appended to (res). 
+ * Returns TRUE if the loop should stop: on a break, or on an error, return or exit, 
+ * which replaces (res).
+ */
+int value_private_each_step(value *res, value tmp)
+{
+	if (tmp.type == VALUE_STOP && tmp.core.u_stop.type == STOP_BREAK) {
+		value_clear(&tmp);
+		return TRUE;
+	} else if (tmp.type == VALUE_STOP && tmp.core.u_stop.type == STOP_YIELD) {
+		if (res->type == VALUE_NIL) *res = value_init(VALUE_ARY);
+		value_append_now(res, *tmp.core.u_stop.core);
+	} else if (tmp.type == VALUE_ERROR || (tmp.type == VALUE_STOP && (tmp.core.u_stop.type == STOP_RETURN || tmp.core.u_stop.type == STOP_EXIT))) {
+		value_clear(res);
+		*res = tmp;
+		return TRUE;
+	}
+	value_clear(&tmp);
+	return FALSE;
+}
+
 value value_each_index(value *variables, value op, value func)
 {
 	value res = value_init_nil();
@@ -1025,14 +1227,21 @@ int value_empty_p(value op)
 		return TRUE;
 	} else if (op.type == VALUE_STR) {
 		return *op.core.u_s == '\0';
-	} else if (op.type == VALUE_ARY) {
+	} else if (op.type == VALUE_ARY || op.type == VALUE_PAK) {
 		return value_length(op) == 0;
+	} else if (op.type == VALUE_NDA) {
+		return value_nd_size(op) == 0;
+	} else if (op.type == VALUE_SLC) {
+		return op.core.u_sl->length == 0;
 	} else if (op.type == VALUE_LST) {
 		return FALSE;
 	} else if (op.type == VALUE_HSH) {
 		return value_hash_size(op) == 0;
+	} else if (op.type == VALUE_RNG) {
+		// Matches value_each(), which visits nothing when the ends are equal.
+		return value_eq(op.core.u_r->min, op.core.u_r->max);
 	} else {
-		value_error(1, "Type Error: empty?() is undefined where op is %ts (string, array, list or hash expected).", op);
+		value_error(1, "Type Error: empty?() is undefined where op is %ts (string, array, list, hash or range expected).", op);
 		return VALUE_ERROR;
 	}
 }
@@ -1170,9 +1379,9 @@ value value_find(value *variables, value op, value func)
 	
 	} else if (op.type == VALUE_HSH) {
 		size_t i, j;
-		for (i = 0; i < op.core.u_h.length; ++i) {
-			if (op.core.u_h.a[i].type == VALUE_ARY) {
-				value bucket = op.core.u_h.a[i];
+		for (i = 0; i < op.core.u_h->length; ++i) {
+			if (op.core.u_h->a[i].type == VALUE_ARY) {
+				value bucket = op.core.u_h->a[i];
 				for (j = 0; j < bucket.core.u_a.length; ++j) {
 					if (bucket.core.u_a.a[j].type != VALUE_ARY || bucket.core.u_a.a[j].core.u_a.length != 2)
 						continue;
@@ -1330,9 +1539,9 @@ value value_fold(value *variables, value op, value initial, value func)
 	
 	} else if (op.type == VALUE_HSH) {
 		size_t i, j;
-		for (i = 0; i < op.core.u_h.length; ++i) {
-			if (op.core.u_h.a[i].type == VALUE_ARY) {
-				value bucket = op.core.u_h.a[i];
+		for (i = 0; i < op.core.u_h->length; ++i) {
+			if (op.core.u_h->a[i].type == VALUE_ARY) {
+				value bucket = op.core.u_h->a[i];
 				for (j = 0; j < bucket.core.u_a.length; ++j) {
 					if (bucket.core.u_a.a[j].type != VALUE_ARY || bucket.core.u_a.a[j].core.u_a.length != 2)
 						continue;
@@ -1456,7 +1665,10 @@ value value_last(value op)
 value value_map(value *variables, value op, value func)
 {
 	value res = value_init_nil();
-	if (op.type == VALUE_ARY) {
+	if (op.type == VALUE_PAK) {
+		res = value_packed_map(variables, op, func);
+		
+	} else if (op.type == VALUE_ARY) {
 		res.type = VALUE_ARY;
 		value_malloc(&res, op.core.u_a.length);
 		return_if_error(res);
@@ -1497,9 +1709,9 @@ value value_map(value *variables, value op, value func)
 		res = value_init(VALUE_HSH);
 		
 		size_t i, j;
-		for (i = 0; i < op.core.u_h.length; ++i) {
-			if (op.core.u_h.a[i].type == VALUE_ARY) {
-				value bucket = op.core.u_h.a[i];
+		for (i = 0; i < op.core.u_h->length; ++i) {
+			if (op.core.u_h->a[i].type == VALUE_ARY) {
+				value bucket = op.core.u_h->a[i];
 				for (j = 0; j < bucket.core.u_a.length; ++j) {
 					if (bucket.core.u_a.a[j].type != VALUE_ARY || bucket.core.u_a.a[j].core.u_a.length != 2)
 						continue;
@@ -1614,8 +1826,7 @@ value value_pop_now(value *op)
 	
 	value_clear(&(op->core.u_a.a[length-1]));
 	--op->core.u_a.length;
-	if (resize_p(length))
-		value_realloc(op, next_size(length));
+	value_private_array_settle(op);
 	
 	return res;
 }
@@ -1673,8 +1884,12 @@ value value_shuffle_now(value *op)
 
 size_t value_size(value op)
 {
-	if (op.type == VALUE_ARY || op.type == VALUE_LST || op.type == VALUE_BLK)
+	if (op.type == VALUE_ARY || op.type == VALUE_PAK || op.type == VALUE_LST || op.type == VALUE_BLK)
 		return value_length(op);
+	else if (op.type == VALUE_NDA)
+		return value_nd_size(op);
+	else if (value_slice_type(op) == VALUE_ARY)
+		return op.core.u_sl->length;
 	else if (op.type == VALUE_HSH)
 		return value_hash_size(op);
 	else return 1;
@@ -1687,10 +1902,15 @@ value value_size_std(value op)
 
 value value_sort(value op)
 {
-	if (op.type == VALUE_ARY) {
+	if (op.type == VALUE_PAK) {
+		value res = value_packed_set(op);
+		return_if_error(res);
+		value_packed_sort_now(&res);
+		return res;
+	} else if (op.type == VALUE_ARY) {
 		value res = value_set(op);
 	
-		if (value_private_sort_recursive(res.core.u_a.a, 0, value_length(res) - 1) == VALUE_ERROR) {
+		if (value_private_sort_array(res.core.u_a.a, value_length(res)) == VALUE_ERROR) {
 			value_error(1, "Error: sort() is undefined where the types of the elements of op do not match.");
 			return value_init_error();
 		}
@@ -1713,8 +1933,10 @@ value value_sort_now(value *op)
 {
 	if (op->type == VALUE_NIL) {
 		;
+	} else if (op->type == VALUE_PAK) {
+		return value_packed_sort_now(op);
 	} else if (op->type == VALUE_ARY) {
-		if (value_private_sort_recursive(op->core.u_a.a, 0, value_length(*op) - 1) == VALUE_ERROR) {
+		if (value_private_sort_array(op->core.u_a.a, value_length(*op)) == VALUE_ERROR) {
 			value_error(1, "Error: sort() is undefined where the types of the elements of op do not match.");
 			return value_init_error();
 		}
@@ -1737,71 +1959,872 @@ value value_sort_now(value *op)
 	return value_init_nil();
 }
 
-int value_private_sort_lt(value op)
+/* 
+ * sort_by() calls (func) once on each element and sorts the elements by the 
+ * results. sort_with() calls (func) on pairs of elements. It should return a 
+ * negative number, zero or a positive number, like cmp(), or true if its first 
+ * argument belongs before its second. Both are stable.
+ */
+value value_sort_by(value *variables, value op, value func)
+{
+	return value_private_sort_block(variables, op, func, TRUE);
+}
+
+value value_sort_with(value *variables, value op, value func)
+{
+	return value_private_sort_block(variables, op, func, FALSE);
+}
+
+/* 
+ * Sorts the indices of the elements of (op) rather than the elements themselves, 
+ * so that the keys computed by sort_by() can stay where they are, and then builds 
+ * the result from the sorted indices.
+ */
+value value_private_sort_block(value *variables, value op, value func, int key_p)
+{
+	char *name = key_p ? "sort_by()" : "sort_with()";
+	if (op.type != VALUE_ARY && op.type != VALUE_LST && op.type != VALUE_PAR && op.type != VALUE_NIL) {
+		value_error(1, "Type Error: %c is undefined where op is %ts (array or list expected).", name, op);
+		return value_init_error();
+	}
+	
+	size_t i, length = value_length(op);
+	if (length == 0)
+		return value_set(op);
+	
+	value *elems = op.core.u_a.a;
+	if (op.type != VALUE_ARY) {
+		elems = value_malloc(NULL, sizeof(value) * length);
+		if (elems == NULL) return value_init_error();
+		value ptr = op;
+		for (i = 0; i < length; ++i) {
+			elems[i] = ptr.core.u_l[0];
+			ptr = ptr.core.u_l[1];
+		}
+	}
+	
+	value res = value_init_nil();
+	value *keys = elems;
+	size_t *perm = value_malloc(NULL, sizeof(size_t) * length);
+	if (perm == NULL) {
+		res = value_init_error();
+		goto cleanup;
+	}
+	
+	if (key_p) {
+		keys = value_malloc(NULL, sizeof(value) * length);
+		if (keys == NULL) {
+			res = value_init_error();
+			goto cleanup;
+		}
+		
+		for (i = 0; i < length; ++i) {
+			keys[i] = value_call(variables, func, 1, elems + i);
+			if (keys[i].type == VALUE_ERROR || keys[i].type == VALUE_STOP) {
+				res = keys[i];
+				while (i > 0)
+					value_clear(&keys[--i]);
+				value_free(keys);
+				keys = elems;
+				goto cleanup;
+			}
+		}
+	}
+	
+	struct value_sort sort;
+	if (key_p)
+		value_private_sort_comparator(&sort, keys, length);
+	else sort.cmp = &value_private_sort_cmp_block;
+	sort.error_p = FALSE;
+	sort.variables = variables;
+	sort.func = func;
+	sort.result = value_init_nil();
+	
+	for (i = 0; i < length; ++i)
+		perm[i] = i;
+	
+	if (value_private_sort_stable(&sort, keys, perm, length) == VALUE_ERROR) {
+		if (sort.result.type != VALUE_NIL) {
+			res = sort.result;
+		} else {
+			value_error(1, "Error: %c is undefined where the keys cannot be compared.", name);
+			res = value_init_error();
+		}
+		
+	} else if (op.type == VALUE_ARY) {
+		res.type = VALUE_ARY;
+		value_malloc(&res, next_size(length));
+		if (res.type != VALUE_ERROR) {
+			for (i = 0; i < length; ++i)
+				res.core.u_a.a[i] = value_set(elems[perm[i]]);
+			res.core.u_a.length = length;
+		}
+		
+	} else if (op.type == VALUE_LST) {
+		value *rptr = &res;
+		for (i = 0; i < length; ++i) {
+			*rptr = value_init(VALUE_LST);
+			rptr->core.u_l[0] = value_set(elems[perm[i]]);
+			rptr = &rptr->core.u_l[1];
+		}
+		
+	} else {
+		for (i = length; i > 0; --i)
+			if (value_cons_now(elems[perm[i-1]], &res).type == VALUE_ERROR) {
+				value_clear(&res);
+				res = value_init_error();
+				break;
+			}
+	}
+	
+cleanup:
+	if (keys != elems) {
+		for (i = 0; i < length; ++i)
+			value_clear(&keys[i]);
+		value_free(keys);
+	}
+	if (op.type != VALUE_ARY)
+		value_free(elems);
+	value_free(perm);
+	return res;
+}
+
+/* 
+ * Sorts an array in place with pattern-defeating quicksort (Orson Peters' pdqsort). 
+ * It is an introsort: a quicksort with median-of-three pivots, or a ninther for 
+ * longer ranges, that switches to heapsort after too many unbalanced partitions, 
+ * so it is O(n log n) in the worst case. A partition that didn't have to move 
+ * anything is finished off with a bounded insertion sort, which makes sorted and 
+ * nearly sorted ranges linear. Reverse-sorted arrays are caught up front.
+ * 
+ * Arrays whose elements are all integers, all floats or all strings are compared 
+ * with mpz_cmp(), mpfr_cmp() or strcmp() directly. Anything else goes through 
+ * value_cmp_any(). All of the state lives in (sort), so sorts can nest.
+ * 
+ * Returns VALUE_ERROR if two of the elements cannot be compared.
+ */
+int value_private_sort_array(value array[], size_t length)
 {
-	return value_lt(op, value_private_sort_pivot);
+	if (value_sort_threads() > 1 && length >= sort_parallel_threshold)
+		return value_private_sort_parallel(array, length, sort_threads);
+	
+	struct value_sort sort;
+	value_private_sort_comparator(&sort, array, length);
+	sort.error_p = FALSE;
+	return value_private_sort_fast(&sort, array, length);
 }
 
-int value_private_sort_eq(value op)
+/* 
+ * Picks the fastest comparator that can compare every element of (array).
+ */
+void value_private_sort_comparator(struct value_sort *sort, value array[], size_t length)
 {
-	return value_eq(op, value_private_sort_pivot);
+	size_t i;
+	int type = length ? array[0].type : VALUE_NIL;
+	
+	for (i = 1; i < length && array[i].type == type; ++i)
+		;
+	
+	if (i < length)
+		sort->cmp = &value_private_sort_cmp_any;
+	else if (type == VALUE_MPZ)
+		sort->cmp = &value_private_sort_cmp_mpz;
+	else if (type == VALUE_MPF)
+		sort->cmp = &value_private_sort_cmp_mpf;
+	else if (type == VALUE_STR)
+		sort->cmp = &value_private_sort_cmp_str;
+	else sort->cmp = &value_private_sort_cmp_any;
 }
 
-int value_private_sort_gt(value op)
+int value_private_sort_with(struct value_sort *sort, value array[], size_t length)
 {
-	return value_gt(op, value_private_sort_pivot);
+	size_t n;
+	int bad_allowed;
+	
+	if (value_private_sort_presorted_p(sort, array, length))
+		return sort->error_p ? VALUE_ERROR : 0;
+	
+	for (bad_allowed = 0, n = length; n > 1; n >>= 1)
+		++bad_allowed;
+	
+	value_private_sort_recursive(sort, array, array + length, bad_allowed, TRUE);
+	return sort->error_p ? VALUE_ERROR : 0;
 }
 
-int value_private_sort_recursive(value array[], int left, int right)
+/* 
+ * Sorted and reverse-sorted input are common enough to check for up front, which 
+ * makes them linear. Returns TRUE if (array) was one or the other and is now 
+ * sorted.
+ */
+int value_private_sort_presorted_p(struct value_sort *sort, value array[], size_t length)
 {
-	if (right - left > 12) {
-		int i = left;
-		int j = right;
-		int cmp;
+	size_t i;
+	if (length < 2)
+		return TRUE;
+	
+	for (i = 1; i < length && sort->cmp(sort, array[i-1], array[i]) <= 0; ++i)
+		;
+	if (i == length)
+		return TRUE;
+	
+	for (i = 1; i < length && sort->cmp(sort, array[i-1], array[i]) >= 0; ++i)
+		;
+	if (i == length) {
+		for (i = 0; i < length / 2; ++i)
+			value_private_sort_swap(&array[i], &array[length - 1 - i]);
+		return TRUE;
+	}
+	
+	return FALSE;
+}
+
+int value_private_sort_cmp_mpz(struct value_sort *sort, value op1, value op2)
+{
+	return mpz_cmp(op1.core.u_mz, op2.core.u_mz);
+}
+
+/* 
+ * mpfr_cmp() says NaN is equal to everything, which isn't an ordering at all, so 
+ * NaN is put after every other float instead.
+ */
+int value_private_sort_cmp_mpf(struct value_sort *sort, value op1, value op2)
+{
+	if (mpfr_nan_p(op1.core.u_mf) || mpfr_nan_p(op2.core.u_mf))
+		return (mpfr_nan_p(op1.core.u_mf) != 0) - (mpfr_nan_p(op2.core.u_mf) != 0);
+	return mpfr_cmp(op1.core.u_mf, op2.core.u_mf);
+}
+
+int value_private_sort_cmp_str(struct value_sort *sort, value op1, value op2)
+{
+	return strcmp(op1.core.u_s, op2.core.u_s);
+}
+
+int value_private_sort_cmp_any(struct value_sort *sort, value op1, value op2)
+{
+	int cmp = value_cmp_any(op1, op2);
+	if (cmp == -2) {
+		sort->error_p = TRUE;
+		return 0;
+	}
+	return cmp;
+}
+
+/* 
+ * Calls the block given to sort_with(). If it fails, the error is kept in (sort) 
+ * to be returned once the sort stops.
+ */
+int value_private_sort_cmp_block(struct value_sort *sort, value op1, value op2)
+{
+	value args[2];
+	args[0] = op1;
+	args[1] = op2;
+	
+	value res = value_call(sort->variables, sort->func, 2, args);
+	int cmp = 0;
+	if (res.type == VALUE_MPZ)
+		cmp = mpz_sgn(res.core.u_mz);
+	else if (res.type == VALUE_MPF)
+		cmp = mpfr_sgn(res.core.u_mf);
+	else if (res.type == VALUE_BOO)
+		cmp = res.core.u_b ? -1 : 0;
+	else if (res.type == VALUE_ERROR || res.type == VALUE_STOP) {
+		sort->error_p = TRUE;
+		sort->result = res;
+		return 0;
+	} else {
+		value_error(1, "Type Error: sort_with() is undefined where the block returns %ts (number or boolean expected).", res);
+		sort->error_p = TRUE;
+		sort->result = value_init_error();
+	}
+	
+	value_clear(&res);
+	return cmp;
+}
+
+void value_private_sort_swap(value *op1, value *op2)
+{
+	value temp = *op1;
+	*op1 = *op2;
+	*op2 = temp;
+}
+
+#define value_private_sort_less(sort, op1, op2) ((sort)->cmp((sort), (op1), (op2)) < 0)
+
+void value_private_sort_sort3(struct value_sort *sort, value *a, value *b, value *c)
+{
+	if (value_private_sort_less(sort, *b, *a))
+		value_private_sort_swap(a, b);
+	if (value_private_sort_less(sort, *c, *b))
+		value_private_sort_swap(b, c);
+	if (value_private_sort_less(sort, *b, *a))
+		value_private_sort_swap(a, b);
+}
+
+void value_private_sort_insertion(struct value_sort *sort, value *begin, value *end)
+{
+	value *cur, *sift;
+	for (cur = begin + 1; cur < end; ++cur) {
+		value temp = *cur;
+		for (sift = cur; sift > begin && value_private_sort_less(sort, temp, sift[-1]); --sift)
+			*sift = sift[-1];
+		*sift = temp;
+	}
+}
+
+/* 
+ * Like value_private_sort_insertion(), but gives up and returns FALSE once it has 
+ * moved more than a handful of elements.
+ */
+int value_private_sort_partial_insertion(struct value_sort *sort, value *begin, value *end)
+{
+	value *cur, *sift;
+	size_t moved = 0;
+	for (cur = begin + 1; cur < end; ++cur) {
+		value temp = *cur;
+		for (sift = cur; sift > begin && value_private_sort_less(sort, temp, sift[-1]); --sift)
+			*sift = sift[-1];
+		*sift = temp;
+		
+		moved += cur - sift;
+		if (moved > SORT_PARTIAL_INSERTION_LIMIT)
+			return FALSE;
+	}
+	
+	return TRUE;
+}
+
+void value_private_sort_sift_down(struct value_sort *sort, value heap[], size_t root, size_t length)
+{
+	value temp = heap[root];
+	size_t child;
+	while ((child = 2 * root + 1) < length) {
+		if (child + 1 < length && value_private_sort_less(sort, heap[child], heap[child+1]))
+			++child;
+		if (!value_private_sort_less(sort, temp, heap[child]))
+			break;
+		heap[root] = heap[child];
+		root = child;
+	}
+	heap[root] = temp;
+}
+
+void value_private_sort_heap(struct value_sort *sort, value *begin, value *end)
+{
+	size_t i, length = end - begin;
+	for (i = length / 2; i-- > 0; )
+		value_private_sort_sift_down(sort, begin, i, length);
+	for (i = length; i-- > 1; ) {
+		value_private_sort_swap(begin, begin + i);
+		value_private_sort_sift_down(sort, begin, 0, i);
+	}
+}
+
+/* 
+ * Partitions [begin, end) around the pivot at (begin), putting the elements equal 
+ * to it on the right. Returns the pivot's new position. Sets (*partitioned_p) if 
+ * nothing had to be swapped.
+ * 
+ * The scans in pdqsort are unguarded, relying on the median-of-three to stop them. 
+ * A comparator that isn't a strict weak ordering could run them off the end of 
+ * the array, so they're bounded here. That costs a pointer comparison, which is 
+ * nothing next to a call through (sort->cmp).
+ */
+value *value_private_sort_partition_right(struct value_sort *sort, value *begin, value *end, int *partitioned_p)
+{
+	value pivot = *begin;
+	value *first = begin;
+	value *last = end;
+	
+	while (++first < end && value_private_sort_less(sort, *first, pivot))
+		;
+	while (first < last && !value_private_sort_less(sort, *--last, pivot))
+		;
+	
+	*partitioned_p = first >= last;
+	
+	while (first < last) {
+		value_private_sort_swap(first, last);
+		while (++first < end && value_private_sort_less(sort, *first, pivot))
+			;
+		while (--last > begin && !value_private_sort_less(sort, *last, pivot))
+			;
+	}
+	
+	value *pivot_pos = first - 1;
+	*begin = *pivot_pos;
+	*pivot_pos = pivot;
+	return pivot_pos;
+}
+
+/* 
+ * Partitions [begin, end) around the pivot at (begin), putting the elements equal 
+ * to it on the left. This is used when the pivot is equal to the element just 
+ * before the range, in which case everything on the left is equal and is already 
+ * in place. That keeps arrays with lots of duplicates from going quadratic.
+ */
+value *value_private_sort_partition_left(struct value_sort *sort, value *begin, value *end)
+{
+	value pivot = *begin;
+	value *first = begin;
+	value *last = end;
+	
+	while (--last > begin && value_private_sort_less(sort, pivot, *last))
+		;
+	while (first < last && !value_private_sort_less(sort, pivot, *++first))
+		;
+	
+	while (first < last) {
+		value_private_sort_swap(first, last);
+		while (--last > begin && value_private_sort_less(sort, pivot, *last))
+			;
+		while (++first < end && !value_private_sort_less(sort, pivot, *first))
+			;
+	}
+	
+	*begin = *last;
+	*last = pivot;
+	return last;
+}
+
+void value_private_sort_recursive(struct value_sort *sort, value *begin, value *end, int bad_allowed, int leftmost_p)
+{
+	while (sort->error_p == FALSE) {
+		size_t length = end - begin;
+		if (length < SORT_INSERTION_THRESHOLD) {
+			value_private_sort_insertion(sort, begin, end);
+			return;
+		}
+		
+		// Move the median of three, or of three medians of three, to (begin).
+		size_t half = length / 2;
+		if (length > SORT_NINTHER_THRESHOLD) {
+			value_private_sort_sort3(sort, begin, begin + half, end - 1);
+			value_private_sort_sort3(sort, begin + 1, begin + (half - 1), end - 2);
+			value_private_sort_sort3(sort, begin + 2, begin + (half + 1), end - 3);
+			value_private_sort_sort3(sort, begin + (half - 1), begin + half, begin + (half + 1));
+			value_private_sort_swap(begin, begin + half);
+		} else value_private_sort_sort3(sort, begin + half, begin, end - 1);
+		
+		if (!leftmost_p && !value_private_sort_less(sort, begin[-1], *begin)) {
+			begin = value_private_sort_partition_left(sort, begin, end) + 1;
+			continue;
+		}
 		
-		// The pivot's index is selected randomly between the two spots 
-		// closest to the center, to decrease the probability of O(n^2) 
-		// runtime.
-		value pivot = array[(left+right)/2 + (genrand_int31() & 1)];
+		int partitioned_p;
+		value *pivot_pos = value_private_sort_partition_right(sort, begin, end, &partitioned_p);
+		size_t left_length = pivot_pos - begin;
+		size_t right_length = end - (pivot_pos + 1);
 		
-		do {
-			while ((cmp = value_cmp_any(array[i], pivot)) == -1) ++i;
-			if (cmp == -2) return VALUE_ERROR;
-			while ((cmp = value_cmp_any(array[j], pivot)) > 0) --j;
-			if (cmp == -2) return VALUE_ERROR;
-			if (i <= j) {
-				value temp = array[i];
-				array[i] = array[j];
-				array[j] = temp;
-				++i; --j;
+		if (left_length < length / 8 || right_length < length / 8) {
+			// A bad partition. After too many, fall back to heapsort. Otherwise 
+			// shuffle a few elements around to break up whatever pattern caused it.
+			if (--bad_allowed == 0) {
+				value_private_sort_heap(sort, begin, end);
+				return;
 			}
 			
-		} while (i <= j);
-		
-		if (left < j) 
-			if (value_private_sort_recursive(array, left, j) == VALUE_ERROR)
-				return VALUE_ERROR;
-		if (i < right) 
-			if (value_private_sort_recursive(array, i, right) == VALUE_ERROR)
-				return VALUE_ERROR;
-
-	} else {
-		int i, j, cmp;
-		for (i = left; i <= right; ++i) {
-			value temp = array[i];
-			j = i - 1;
-			while (j >= 0 && (cmp = value_cmp_any(array[j], temp)) > 0) {
-				array[j+1] = array[j--];
+			if (left_length >= SORT_INSERTION_THRESHOLD) {
+				value_private_sort_swap(begin, begin + left_length / 4);
+				value_private_sort_swap(pivot_pos - 1, pivot_pos - left_length / 4);
+				if (left_length > SORT_NINTHER_THRESHOLD) {
+					value_private_sort_swap(begin + 1, begin + (left_length / 4 + 1));
+					value_private_sort_swap(begin + 2, begin + (left_length / 4 + 2));
+					value_private_sort_swap(pivot_pos - 2, pivot_pos - (left_length / 4 + 1));
+					value_private_sort_swap(pivot_pos - 3, pivot_pos - (left_length / 4 + 2));
+				}
 			}
-			if (cmp == -2) return VALUE_ERROR;
 			
-			array[j+1] = temp;
+			if (right_length >= SORT_INSERTION_THRESHOLD) {
+				value_private_sort_swap(pivot_pos + 1, pivot_pos + (1 + right_length / 4));
+				value_private_sort_swap(end - 1, end - right_length / 4);
+				if (right_length > SORT_NINTHER_THRESHOLD) {
+					value_private_sort_swap(pivot_pos + 2, pivot_pos + (2 + right_length / 4));
+					value_private_sort_swap(pivot_pos + 3, pivot_pos + (3 + right_length / 4));
+					value_private_sort_swap(end - 2, end - (1 + right_length / 4));
+					value_private_sort_swap(end - 3, end - (2 + right_length / 4));
+				}
+			}
+		} else if (partitioned_p 
+				&& value_private_sort_partial_insertion(sort, begin, pivot_pos) 
+				&& value_private_sort_partial_insertion(sort, pivot_pos + 1, end)) {
+			return;
 		}
+		
+		// Recurse into the left side and loop on the right.
+		value_private_sort_recursive(sort, begin, pivot_pos, bad_allowed, leftmost_p);
+		begin = pivot_pos + 1;
+		leftmost_p = FALSE;
 	}
+}
+
+/* 
+ * Sorts with a radix sort when (sort) says the elements are all integers or all 
+ * strings, and with value_private_sort_with() otherwise.
+ */
+int value_private_sort_fast(struct value_sort *sort, value array[], size_t length)
+{
+	int int_p = sort->cmp == &value_private_sort_cmp_mpz;
+	if (length < SORT_RADIX_THRESHOLD || (int_p == FALSE && sort->cmp != &value_private_sort_cmp_str))
+		return value_private_sort_with(sort, array, length);
 	
+	if (value_private_sort_presorted_p(sort, array, length))
+		return 0;
+	if (int_p ? value_private_sort_radix_int(array, length) : value_private_sort_radix_strings(array, length))
+		return 0;
+	return value_private_sort_with(sort, array, length);
+}
+
+/* 
+ * Radix Sorts
+ * 
+ * Integers that all fit in a long are sorted with an LSD radix sort, one byte at 
+ * a time. Each key is the integer with its sign bit flipped, so that the negative 
+ * ones come first as unsigned numbers, and is kept next to the index of its 
+ * element, so each pass only moves 16 bytes per element. The counts for every byte 
+ * are taken in one pass at the start, and a byte that is the same in every key is 
+ * skipped, so small integers take only a pass or two. The elements themselves are 
+ * moved once at the end.
+ * 
+ * Strings are sorted with an MSD radix sort. Each call puts the strings into 256 
+ * buckets by the byte at (depth) and sorts each bucket by the next byte. Bucket 0 
+ * holds the strings that end at (depth), which are all equal. A bucket smaller 
+ * than SORT_RADIX_STRING_THRESHOLD is finished with pdqsort, and the last bucket 
+ * is handled by looping rather than recursing, so a long run of strings that share 
+ * a prefix doesn't go deep.
+ * 
+ * These can run on the parallel sort's threads, so they use malloc() and free() 
+ * directly; value_malloc() keeps statistics that aren't thread-safe. They return 
+ * FALSE without sorting if an integer doesn't fit or memory runs out.
+ */
+int value_private_sort_radix_int(value array[], size_t length)
+{
+	size_t i, b, d;
+	for (i = 0; i < length; ++i)
+		if (mpz_fits_slong_p(array[i].core.u_mz) == 0)
+			return FALSE;
+	
+	struct value_radix_key *keys = malloc(sizeof(struct value_radix_key) * length * 2);
+	value *temp = malloc(sizeof(value) * length);
+	if (keys == NULL || temp == NULL) {
+		free(keys);
+		free(temp);
+		return FALSE;
+	}
+	
+	struct value_radix_key *src = keys, *dst = keys + length, *swap;
+	size_t counts[sizeof(uint64_t)][256];
+	memset(counts, 0, sizeof(counts));
+	for (i = 0; i < length; ++i) {
+		uint64_t key = (uint64_t) (int64_t) mpz_get_si(array[i].core.u_mz) ^ ((uint64_t) 1 << 63);
+		src[i].key = key;
+		src[i].index = i;
+		for (d = 0; d < sizeof(uint64_t); ++d)
+			++counts[d][(key >> 8 * d) & 255];
+	}
+	
+	for (d = 0; d < sizeof(uint64_t); ++d) {
+		size_t *count = counts[d], start = 0, n;
+		if (count[(src[0].key >> 8 * d) & 255] == length)
+			continue;
+		
+		for (b = 0; b < 256; ++b) {
+			n = count[b];
+			count[b] = start;
+			start += n;
+		}
+		for (i = 0; i < length; ++i)
+			dst[count[(src[i].key >> 8 * d) & 255]++] = src[i];
+		
+		swap = src;
+		src = dst;
+		dst = swap;
+	}
+	
+	for (i = 0; i < length; ++i)
+		temp[i] = array[src[i].index];
+	memcpy(array, temp, sizeof(value) * length);
+	
+	free(keys);
+	free(temp);
+	return TRUE;
+}
+
+int value_private_sort_radix_strings(value array[], size_t length)
+{
+	value *temp = malloc(sizeof(value) * length);
+	if (temp == NULL)
+		return FALSE;
+	
+	value_private_sort_radix_str(array, temp, length, 0);
+	free(temp);
+	return TRUE;
+}
+
+void value_private_sort_radix_str(value array[], value temp[], size_t length, size_t depth)
+{
+	size_t counts[256], starts[256], i, start;
+	int b, last;
+	
+	while (length >= SORT_RADIX_STRING_THRESHOLD) {
+		memset(counts, 0, sizeof(counts));
+		for (i = 0; i < length; ++i)
+			++counts[(unsigned char) array[i].core.u_s[depth]];
+		
+		b = (unsigned char) array[0].core.u_s[depth];
+		if (counts[b] == length) {
+			// Every string has the same byte here. Either they all end, or there's 
+			// nothing to move.
+			if (b == 0)
+				return;
+			++depth;
+			continue;
+		}
+		
+		for (b = 0, start = 0; b < 256; ++b) {
+			starts[b] = start;
+			start += counts[b];
+		}
+		for (i = 0; i < length; ++i)
+			temp[starts[(unsigned char) array[i].core.u_s[depth]]++] = array[i];
+		memcpy(array, temp, sizeof(value) * length);
+		
+		// (starts) now holds where each bucket ends.
+		for (last = 255; counts[last] == 0; --last)
+			;
+		for (b = 1; b < last; ++b)
+			if (counts[b] > 1)
+				value_private_sort_radix_str(array + (starts[b] - counts[b]), temp, counts[b], depth + 1);
+		
+		if (last == 0)
+			return;
+		array += starts[last] - counts[last];
+		length = counts[last];
+		++depth;
+	}
+	
+	struct value_sort sort;
+	sort.cmp = &value_private_sort_cmp_str;
+	sort.error_p = FALSE;
+	value_private_sort_with(&sort, array, length);
+}
+
+/* 
+ * Parallel Sort
+ * 
+ * Arrays of at least sort_parallel_threshold elements that all compare without the 
+ * interpreter (all integers, all floats or all strings) are sorted with a sample 
+ * sort on value_sort_threads() threads. The main thread picks (threads - 1) 
+ * splitters from a random sample, and then the threads work in three rounds:
+ * 
+ *   1. Each thread finds the bucket of each element in its slice of the array.
+ *   2. Each thread copies its slice into place in a second array, bucket by bucket.
+ *   3. Each thread sorts one bucket and copies it back.
+ * 
+ * Each round starts a thread per slice and waits for all of them, which keeps to 
+ * plain pthread_create() and pthread_join(). Nothing in the rounds touches the 
+ * interpreter, which is why the comparator must be one of the three direct ones. The 
+ * only memory allocated in the rounds is the radix sorts' scratch space in round 3, 
+ * which uses malloc() rather than value_malloc() for this reason. If a thread can't 
+ * be started, its share is done on the main thread.
+ * 
+ * The result is the same as value_private_sort_with() gives: the comparators are 
+ * total orders, so there is only one sorted order.
+ */
+int value_sort_threads()
+{
+	if (sort_threads)
+		return sort_threads;
+	
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	char *str = getenv("SIMFPL_THREADS");
+	if (str && *str && atoi(str) > 0)
+		n = atoi(str);
+	sort_threads = n < 1 ? 1 : n > SORT_MAX_THREADS ? SORT_MAX_THREADS : n;
+	
+	str = getenv("SIMFPL_SORT_PARALLEL");
+	sort_parallel_threshold = str && *str ? strtoul(str, NULL, 10) : SORT_PARALLEL_THRESHOLD;
+	return sort_threads;
+}
+
+/* 
+ * Sorts (array) on (threads) threads. Falls back to sorting on this thread if 
+ * the comparator for (array) might call into the interpreter. Returns VALUE_ERROR 
+ * if two of the elements cannot be compared.
+ */
+int value_private_sort_parallel(value array[], size_t length, int threads)
+{
+	struct value_sort_team team;
+	value_private_sort_comparator(&team.sort, array, length);
+	team.sort.error_p = FALSE;
+	
+	if (threads > SORT_MAX_THREADS)
+		threads = SORT_MAX_THREADS;
+	if (threads < 2 || length < (size_t) threads * SORT_SAMPLES_PER_THREAD 
+			|| team.sort.cmp == &value_private_sort_cmp_any)
+		return value_private_sort_fast(&team.sort, array, length);
+	if (value_private_sort_presorted_p(&team.sort, array, length))
+		return 0;
+	
+	size_t i, samples = (size_t) threads * SORT_SAMPLES_PER_THREAD;
+	value sample[samples];
+	for (i = 0; i < samples; ++i)
+		sample[i] = array[genrand_int31() % length];
+	value_private_sort_with(&team.sort, sample, samples);
+	
+	value splitters[threads];
+	for (i = 1; i < threads; ++i)
+		splitters[i-1] = sample[i * SORT_SAMPLES_PER_THREAD];
+	
+	size_t counts[threads * threads];
+	team.array = array;
+	team.temp = value_malloc(NULL, sizeof(value) * length);
+	team.buckets = value_malloc(NULL, length);
+	if (team.temp == NULL || team.buckets == NULL) {
+		value_free(team.temp);
+		value_free(team.buckets);
+		return value_private_sort_fast(&team.sort, array, length);
+	}
+	team.length = length;
+	team.threads = threads;
+	team.splitters = splitters;
+	team.counts = counts;
+	memset(counts, 0, sizeof(counts));
+	
+	value_private_sort_parallel_round(&team, SORT_ROUND_CLASSIFY);
+	value_private_sort_parallel_round(&team, SORT_ROUND_SCATTER);
+	value_private_sort_parallel_round(&team, SORT_ROUND_SORT);
+	
+	value_free(team.temp);
+	value_free(team.buckets);
 	return 0;
 }
 
+/* 
+ * Runs one round on every thread and waits for them to finish.
+ */
+void value_private_sort_parallel_round(struct value_sort_team *team, int round)
+{
+	struct value_sort_worker workers[team->threads];
+	pthread_t ids[team->threads];
+	int started[team->threads];
+	int i;
+	
+	for (i = 0; i < team->threads; ++i) {
+		workers[i].team = team;
+		workers[i].id = i;
+		workers[i].round = round;
+		started[i] = i > 0 && pthread_create(&ids[i], NULL, &value_private_sort_parallel_worker, &workers[i]) == 0;
+	}
+	
+	for (i = 0; i < team->threads; ++i)
+		if (started[i] == FALSE)
+			value_private_sort_parallel_worker(&workers[i]);
+	for (i = 1; i < team->threads; ++i)
+		if (started[i])
+			pthread_join(ids[i], NULL);
+}
+
+void *value_private_sort_parallel_worker(void *arg)
+{
+	struct value_sort_worker *worker = arg;
+	struct value_sort_team *team = worker->team;
+	struct value_sort sort = team->sort;
+	int id = worker->id, threads = team->threads;
+	size_t i, lo = team->length * id / threads, hi = team->length * (id + 1) / threads;
+	size_t *counts = team->counts + (size_t) id * threads;
+	int b, t;
+	
+	if (worker->round == SORT_ROUND_CLASSIFY) {
+		// Each element goes in the bucket after the last splitter that isn't greater 
+		// than it, so elements equal to a splitter all land in the same bucket.
+		for (i = lo; i < hi; ++i) {
+			int low = 0, high = threads - 1;
+			while (low < high) {
+				int mid = (low + high) / 2;
+				if (sort.cmp(&sort, team->array[i], team->splitters[mid]) < 0)
+					high = mid;
+				else low = mid + 1;
+			}
+			team->buckets[i] = (unsigned char) low;
+			++counts[low];
+		}
+		
+	} else if (worker->round == SORT_ROUND_SCATTER) {
+		size_t offsets[threads], start = 0;
+		for (b = 0; b < threads; ++b) {
+			offsets[b] = start;
+			for (t = 0; t < threads; ++t) {
+				if (t < id)
+					offsets[b] += team->counts[(size_t) t * threads + b];
+				start += team->counts[(size_t) t * threads + b];
+			}
+		}
+		for (i = lo; i < hi; ++i)
+			team->temp[offsets[team->buckets[i]]++] = team->array[i];
+		
+	} else {
+		// Thread (id) sorts bucket (id).
+		size_t start = 0, length = 0;
+		for (b = 0; b <= id; ++b) {
+			start += length;
+			for (length = 0, t = 0; t < threads; ++t)
+				length += team->counts[(size_t) t * threads + b];
+		}
+		value_private_sort_fast(&sort, team->temp + start, length);
+		memcpy(team->array + start, team->temp + start, sizeof(value) * length);
+	}
+	
+	return NULL;
+}
+
+/* 
+ * A stable merge sort of the indices in (perm) by the keys they point to. It is 
+ * used by sort_by() and sort_with(), where a comparison may call back into the 
+ * interpreter, so it merges only when the halves overlap, which makes sorted 
+ * input linear. Returns VALUE_ERROR if the comparator fails.
+ */
+int value_private_sort_stable(struct value_sort *sort, value keys[], size_t perm[], size_t length)
+{
+	if (length < 2)
+		return 0;
+	
+	size_t *temp = value_malloc(NULL, sizeof(size_t) * (length / 2));
+	if (temp == NULL)
+		return VALUE_ERROR;
+	
+	value_private_sort_stable_recursive(sort, keys, perm, temp, length);
+	value_free(temp);
+	return sort->error_p ? VALUE_ERROR : 0;
+}
+
+void value_private_sort_stable_recursive(struct value_sort *sort, value keys[], size_t perm[], size_t temp[], size_t length)
+{
+	size_t i, j, k, half = length / 2;
+	
+	if (length < SORT_STABLE_INSERTION_THRESHOLD) {
+		for (i = 1; i < length && sort->error_p == FALSE; ++i) {
+			size_t x = perm[i];
+			for (j = i; j > 0 && value_private_sort_less(sort, keys[x], keys[perm[j-1]]); --j)
+				perm[j] = perm[j-1];
+			perm[j] = x;
+		}
+		return;
+	}
+	
+	value_private_sort_stable_recursive(sort, keys, perm, temp, half);
+	value_private_sort_stable_recursive(sort, keys, perm + half, temp, length - half);
+	if (sort->error_p || !value_private_sort_less(sort, keys[perm[half]], keys[perm[half-1]]))
+		return;
+	
+	// Merge from (temp) back into (perm). (k) never passes (j), so the right half 
+	// can be read in place.
+	memcpy(temp, perm, sizeof(size_t) * half);
+	for (i = 0, j = half, k = 0; i < half && j < length; ++k)
+		perm[k] = value_private_sort_less(sort, keys[perm[j]], keys[temp[i]]) ? perm[j++] : temp[i++];
+	while (i < half)
+		perm[k++] = temp[i++];
+}
+
 /* 
  * Implements merge sort for linked lists. Because it is intended to be able to 
  * deal with very long lists, the code is highly optimized. Function calls are 
@@ -1951,17 +2974,23 @@ value value_uniq_sort(value op)
 	if (op.type == VALUE_ARY) {
 		value copy = value_set(op);
 		size_t old_length = value_length(copy);
-		value_private_sort_recursive(copy.core.u_a.a, 0, old_length - 1);
+		if (value_private_sort_array(copy.core.u_a.a, old_length) == VALUE_ERROR) {
+			value_clear(&copy);
+			value_error(1, "Error: uniq_sort() is undefined where the types of the elements of op do not match.");
+			return value_init_error();
+		}
 		
-		value array[old_length];
+		// Drop the duplicates in place. Copying the survivors into an array on the 
+		// stack overflowed it for large arrays.
 		size_t i, new_length;
 		for (i = 0, new_length = 0; i < old_length; ++i) {
-			if (i == 0 || value_cmp_any(copy.core.u_a.a[i-1], copy.core.u_a.a[i]) != 0)
-				array[new_length++] = copy.core.u_a.a[i];
+			if (i == 0 || value_cmp_any(copy.core.u_a.a[new_length-1], copy.core.u_a.a[i]) != 0)
+				copy.core.u_a.a[new_length++] = copy.core.u_a.a[i];
+			else value_clear(&copy.core.u_a.a[i]);
 		}
-				
-		res = value_set_ary(array, new_length);
-		value_clear(&copy);
+		
+		copy.core.u_a.length = new_length;
+		res = copy;
 	
 	} else if (op.type == VALUE_LST) {
 		value copy = value_sort(op);
@@ -2011,6 +3040,11 @@ value value_append_now_arg(int argc, value argv[])
 	return missing_arguments(argc, argv, "append!()") ? value_init_error() : value_append_now(&argv[0], argv[1]);
 }
 
+value value_array_with_capacity_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "array_with_capacity()") ? value_init_error() : value_array_with_capacity(argv[0]);
+}
+
 value value_array_with_length_arg(int argc, value argv[])
 {
 	return missing_arguments(argc, argv, "array_with_length()") ? value_init_error() : value_array_with_length(argv[0]);
@@ -2160,6 +3194,11 @@ value value_at_assign_shr_arg(int argc, value argv[])
 	return res;
 }
 
+value value_capacity_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "capacity()") ? value_init_error() : value_capacity(argv[0]);
+}
+
 value value_concat_arg(int argc, value argv[])
 {
 	return missing_arguments(argc, argv, "concat()") ? value_init_error() : value_concat(argv[0], argv[1]);
@@ -2268,6 +3307,16 @@ value value_pop_now_arg(int argc, value argv[])
 	return missing_arguments(argc, argv, "pop!()") ? value_init_error() : value_pop_now(&argv[0]);
 }
 
+value value_reserve_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "reserve()") ? value_init_error() : value_reserve(&argv[0], argv[1]);
+}
+
+value value_shrink_now_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "shrink!()") ? value_init_error() : value_shrink_now(&argv[0]);
+}
+
 value value_shuffle_arg(int argc, value argv[])
 {
 	return missing_arguments(argc, argv, "shuffle()") ? value_init_error() : value_shuffle(argv[0]);
@@ -2293,6 +3342,18 @@ value value_sort_now_arg(int argc, value argv[])
 	return missing_arguments(argc, argv, "sort!()") ? value_init_error() : value_sort_now(&argv[0]);
 }
 
+value value_sort_by_arg(int argc, value argv[])
+{
+	value *tmp = value_deref(argv[0]);
+	return missing_arguments(argc-1, argv+1, "sort_by()") ? value_init_error() : value_sort_by(tmp, argv[1], argv[2]);
+}
+
+value value_sort_with_arg(int argc, value argv[])
+{
+	value *tmp = value_deref(argv[0]);
+	return missing_arguments(argc-1, argv+1, "sort_with()") ? value_init_error() : value_sort_with(tmp, argv[1], argv[2]);
+}
+
 value value_uniq_arg(int argc, value argv[])
 {
 	return missing_arguments(argc, argv, "uniq()") ? value_init_error() : value_uniq(argv[0]);
@@ -31,9 +31,7 @@ value value_set_block(value array[], size_t length)
 		length = 0;
 	value res;
 	res.type = VALUE_BLK;
-	res.core.u_blk.s = NULL;
-	res.core.u_blk.a = value_malloc(NULL, sizeof(value) * next_size(length));
-	return_if_null(res.core.u_blk.a);
+	return_if_null(value_malloc(&res, next_size(length)));
 	res.core.u_blk.length = length;
 	
 	unsigned long i;
@@ -52,6 +50,7 @@ value value_set_fun(value (*fun)(int argc, value argv[]))
 	return_if_null(res.core.u_bif);
 	res.core.u_bif->f = fun;
 	res.core.u_bif->spec = value_nil_function_spec;
+	res.core.u_bif->site = NULL;
 	return res;
 }
 
@@ -88,6 +87,99 @@ value value_call(value *variables, value func, int argc, value argv[])
 	return res;
 }
 
+struct value_site * value_private_site_init()
+{
+	struct value_site *site = value_malloc(NULL, sizeof(struct value_site));
+	if (site == NULL) return NULL;
+	site->refcount = 1;
+	site->f = NULL;
+	site->seen_type1 = VALUE_NIL;
+	site->seen_type2 = VALUE_NIL;
+	site->seen_count = 0;
+	return site;
+}
+
+void value_private_site_free(struct value_site *site)
+{
+	if (--site->refcount > 0)
+		return;
+	value_free(site);
+}
+
+/* 
+ * Gives every two-argument built-in call in (op) that doesn't have one a struct 
+ * value_site. The function body is copied every time the function is called, so a site 
+ * has to exist before the first copy for what it sees to be kept.
+ */
+int value_private_make_sites(value op)
+{
+	if (op.type != VALUE_BLK)
+		return 0;
+	
+	value *words = op.core.u_blk.a;
+	if (op.core.u_blk.length == 3 && words[0].type == VALUE_BIF && words[0].core.u_bif->site == NULL && 
+			!words[0].core.u_bif->spec.needs_variables_p && !words[0].core.u_bif->spec.delay_eval_p) {
+		words[0].core.u_bif->site = value_private_site_init();
+		if (words[0].core.u_bif->site == NULL) return VALUE_ERROR;
+	}
+	
+	size_t i;
+	for (i = 0; i < op.core.u_blk.length; ++i)
+		if (value_private_make_sites(words[i]) == VALUE_ERROR)
+			return VALUE_ERROR;
+	return 0;
+}
+
+/* 
+ * Records the types of the arguments at a two-argument call site. Once a site has seen 
+ * the same pair of types QUICKEN_THRESHOLD times in a row, it calls the version of its 
+ * function specialized to those types. The specialized functions check their arguments 
+ * anyway, but a quickened site that sees other types is put back to the generic 
+ * function for good, so that a site that mixes types doesn't keep paying for the 
+ * failed check.
+ * 
+ * The profile is kept in (bif->site), which belongs to the call site and not to the 
+ * function. (bif->f) is never changed, so the copies of the site stay generic and 
+ * follow the shared profile.
+ */
+int value_private_observe_site(struct value_bif *bif, value op1, value op2)
+{
+	struct value_site *site = bif->site;
+	if (site->f) {
+		if (op1.type != site->seen_type1 || op2.type != site->seen_type2) {
+			site->f = NULL;
+			site->seen_count = QUICKEN_NEVER;
+			++deoptimized_sites;
+		}
+		return 0;
+	}
+	
+	if (site->seen_count == 0 || op1.type != site->seen_type1 || op2.type != site->seen_type2) {
+		site->seen_type1 = op1.type;
+		site->seen_type2 = op2.type;
+		site->seen_count = 1;
+		return 0;
+	}
+	
+	if (++site->seen_count < QUICKEN_THRESHOLD)
+		return 0;
+	
+	site->f = value_specialized_arg(bif->f, op1.type, op2.type);
+	if (site->f)
+		++quickened_sites;
+	else site->seen_count = QUICKEN_NEVER;
+	
+	return 0;
+}
+
+value value_quicken_stats()
+{
+	value res = value_hash_init();
+	value_hash_put_str(&res, "quickened", value_set_ulong(quickened_sites));
+	value_hash_put_str(&res, "deoptimized", value_set_ulong(deoptimized_sites));
+	return res;
+}
+
 value value_bifcall_sexp(value *variables, value *ud_functions, value sexp)
 {
 	size_t length = sexp.core.u_blk.length;
@@ -108,7 +200,7 @@ value value_bifcall_sexp(value *variables, value *ud_functions, value sexp)
 	value *vptrs[args_length]; // holds pointers to variables inside of a variable list
 	memset(clear_args_p, 0, sizeof(int) * (args_length)); // the default for clear_args_p is FALSE; 
 														  // that is, don't clear unless specifically told to
-	memset(vptrs, 0, sizeof(value) * (args_length));
+	memset(vptrs, 0, sizeof(value *) * (args_length));
 	
 	// The reason for vptrs is because of how value copying works. If the function to be called 
 	// takes a pointer, the pointer has to be a reference to the correct value. (args) will not 
@@ -170,9 +262,30 @@ value value_bifcall_sexp(value *variables, value *ud_functions, value sexp)
 		error_p = TRUE;
 	}
 	
+	struct value_bif *bif = sexp.core.u_blk.a[0].core.u_bif;
+	if (!error_p && j == 2 && bif->site && bif->site->seen_count != QUICKEN_NEVER)
+		value_private_observe_site(bif, args[0], args[1]);
+	value (*f)(int, value *) = bif->site && bif->site->f ? bif->site->f : bif->f;
+	
+	// A function that doesn't know about packed arrays gets ordinary ones.
+	value saved[args_length];
+	int unpacked_p = !error_p && value_private_unpack_args(bif->spec, j, args, saved);
+	
 	if (error_p) {
 		res = value_init_error();
-	} else res = (*sexp.core.u_blk.a[0].core.u_bif->f)(j, args);
+	} else if (profiling_p) {
+		int depth = value_profile_enter(value_profile_bif_name(bif));
+		res = (*f)(j, args);
+		value_profile_exit(depth);
+	} else res = (*f)(j, args);
+	
+	if (unpacked_p) {
+		// Only a variable that the function could have changed keeps the new array.
+		int keep[args_length];
+		for (i = 0; i < j; ++i)
+			keep[i] = vptrs[i] && !spec.pure_p;
+		value_private_repack_args(j, args, saved, keep);
+	}
 	
 	i = 0;
 	if (spec.needs_variables_p)
@@ -191,7 +304,13 @@ value value_bifcall_sexp(value *variables, value *ud_functions, value sexp)
 value value_bifcall(value op, int argc, value argv[])
 {
 	if (op.type == VALUE_BIF) {
-		return (*(op.core.u_bif->f))(argc, argv);
+		value saved[argc > 0 ? argc : 1];
+		if (value_private_unpack_args(op.core.u_bif->spec, argc, argv, saved) == FALSE)
+			return (*(op.core.u_bif->f))(argc, argv);
+		
+		value res = (*(op.core.u_bif->f))(argc, argv);
+		value_private_repack_args(argc, argv, saved, NULL);
+		return res;
 	} else {
 		value_error(1, "Type Error: bifcall() is undefined where op is %ts (function expected).", op);
 		return value_init_error();
@@ -211,8 +330,52 @@ value value_udfcall(value *variables, value op, int argc, value argv[])
 		return value_init_error();
 	}
 	
+	if (profiling_p) {
+		int depth = value_profile_enter(op.core.u_udf->name ? op.core.u_udf->name : "(lambda)");
+		value res = value_private_dispatch_udfcall(variables, op, argc, argv);
+		value_profile_exit(depth);
+		return res;
+	}
+	
+	return value_private_dispatch_udfcall(variables, op, argc, argv);
+}
+
+/* 
+ * Calls (op) the right way for what kind of function it is, once value_udfcall() has 
+ * checked the arguments.
+ */
+value value_private_dispatch_udfcall(value *variables, value op, int argc, value argv[])
+{
+	if (op.core.u_udf->spec.generator_p)
+		return value_generator_init(variables, op, argc, argv);
+	
+	if (op.core.u_udf->memo)
+		return value_private_memo_call(variables, op, argc, argv);
+	
+	struct value_jit *jit = op.core.u_udf->jit;
+	if (jit) {
+		if (jit->state == JIT_NATIVE)
+			return value_jit_call(variables, op, argc, argv);
+		if (jit_enabled_p)
+			value_jit_count(op);
+	}
+	
+	return value_private_udfcall(variables, op, argc, argv, FALSE);
+}
+
+/* 
+ * Does the work for value_udfcall(). If (evaluated_p) is true, the arguments have 
+ * already been evaluated and are copied in as they are.
+ */
+value value_private_udfcall(value *variables, value op, int argc, value argv[], int evaluated_p)
+{
 	int change_scope_p = op.core.u_udf->spec.change_scope_p;
 	int delay_eval_p = op.core.u_udf->spec.delay_eval_p;
+	
+	if (current_generator && value_generator_stack_full_p(current_generator)) {
+		value_error(1, "Stack Error: Too many nested function calls inside a generator.");
+		return value_init_error();
+	}
 			
 	value varkeys = op.core.u_udf->vars;
 	value vnil = value_init_nil();
@@ -250,7 +413,7 @@ value value_udfcall(value *variables, value op, int argc, value argv[])
 				value_hash_put_refs(new_vars, &key, &vnil);
 			} else {
 				value x;
-				if (delay_eval_p)
+				if (delay_eval_p || evaluated_p)
 					x = value_set(argv[i]);
 				else x = eval(variables, argv[i]);
 				value_hash_put_refs(new_vars, &key, &x);
@@ -266,7 +429,7 @@ value value_udfcall(value *variables, value op, int argc, value argv[])
 			value_hash_put_refs(new_vars, &key, &vnil);
 		} else {
 			value x;
-			if (delay_eval_p)
+			if (delay_eval_p || evaluated_p)
 				x = value_set(argv[0]);
 			else x = eval(variables, argv[0]);
 			value_hash_put_refs(new_vars, &key, &x);
@@ -352,6 +515,8 @@ value value_def(value *variables, value name, value vars, value body)
 				spec.delay_eval_p = TRUE;
 			} else if (streq(vars.core.u_blk.a[i].core.u_s, "keep_scope")) {
 				spec.change_scope_p = FALSE;
+			} else if (streq(vars.core.u_blk.a[i].core.u_s, "generator")) {
+				spec.generator_p = TRUE;
 //			} else if (streq(vars.core.u_blk.a[i].core.u_s, "rest")) {
 				// This is not fully implemented yet. The UDF has to have a way to access the argument list.
 //				rest_p = TRUE;
@@ -369,6 +534,11 @@ value value_def(value *variables, value name, value vars, value body)
 		return value_init_error();
 	}
 	
+	// The body is optimized once here rather than every time the function is called.
+	value fbody = value_set(body);
+	value_optimize_now(&fbody, O_1 | O_2 | O_3 | O_4);
+	value_private_make_sites(fbody);
+	
 	value fun;
 	
 	if (named_p) {
@@ -384,7 +554,9 @@ value value_def(value *variables, value name, value vars, value body)
 		fun.core.u_udf->spec = spec;
 		
 		fun.core.u_udf->vars = fvars;
-		fun.core.u_udf->body = value_set(body);
+		fun.core.u_udf->body = fbody;
+		fun.core.u_udf->memo = NULL;
+		fun.core.u_udf->jit = value_jit_init();
 			
 		value_hash_put(variables, name, fun);
 	} else {
@@ -398,7 +570,9 @@ value value_def(value *variables, value name, value vars, value body)
 		fun.core.u_udf->spec = spec;
 		
 		fun.core.u_udf->vars = fvars;
-		fun.core.u_udf->body = value_set(body);
+		fun.core.u_udf->body = fbody;
+		fun.core.u_udf->memo = NULL;
+		fun.core.u_udf->jit = value_jit_init();
 	}
 
 			
@@ -410,6 +584,267 @@ value value_lambda(value *variables, value vars, value body)
 	return value_def(variables, value_nil, vars, body);
 }
 
+value value_memoize(value *ud_functions, value func, value capacity)
+{
+	long icapacity = MEMO_DEFAULT_CAPACITY;
+	if (capacity.type == VALUE_MPZ) {
+		icapacity = mpz_get_si(capacity.core.u_mz);
+		if (icapacity <= 0) {
+			value_error(1, "Argument Error: In memoize(), capacity must be positive (%s found).", capacity);
+			return value_init_error();
+		}
+	} else if (capacity.type != VALUE_NIL) {
+		value_error(1, "Type Error: memoize() is undefined where capacity is %ts (integer expected).", capacity);
+		return value_init_error();
+	}
+	
+	value fun = value_private_memo_function(*ud_functions, func, "memoize()");
+	return_if_error(fun);
+	
+	// Memoizing a function that is already memoized starts over with a new cache.
+	if (fun.core.u_udf->memo)
+		value_private_memo_free(fun.core.u_udf->memo);
+	fun.core.u_udf->memo = value_private_memo_init(icapacity);
+	if (fun.core.u_udf->memo == NULL) {
+		value_clear(&fun);
+		return value_init_error();
+	}
+	
+	// Replace the registered function so that recursive calls go through the cache.
+	if (fun.core.u_udf->name) {
+		value name = value_set_str(fun.core.u_udf->name);
+		name.type = VALUE_VAR;
+		value_hash_put(ud_functions, name, fun);
+		value_clear(&name);
+	}
+	
+	return fun;
+}
+
+value value_defmemo(value *variables, value name, value vars, value body)
+{
+	value fun = value_def(variables, name, vars, body);
+	return_if_error(fun);
+	value res = value_memoize(variables, fun, value_nil);
+	value_clear(&fun);
+	return res;
+}
+
+value value_memo_stats(value *ud_functions, value func)
+{
+	value fun = value_private_memo_function(*ud_functions, func, "memo_stats()");
+	return_if_error(fun);
+	
+	struct value_memo *memo = fun.core.u_udf->memo;
+	if (memo == NULL) {
+		value_error(1, "Error: In memo_stats(), %s is not memoized.", func);
+		value_clear(&fun);
+		return value_init_error();
+	}
+	
+	value res = value_hash_init();
+	value_hash_put_str(&res, "hits", value_set_ulong(memo->hits));
+	value_hash_put_str(&res, "misses", value_set_ulong(memo->misses));
+	value_hash_put_str(&res, "size", value_set_ulong(memo->size));
+	value_hash_put_str(&res, "capacity", value_set_ulong(memo->capacity));
+	
+	value_clear(&fun);
+	return res;
+}
+
+value value_memo_clear(value *ud_functions, value func)
+{
+	value fun = value_private_memo_function(*ud_functions, func, "memo_clear()");
+	return_if_error(fun);
+	
+	if (fun.core.u_udf->memo)
+		value_private_memo_reset(fun.core.u_udf->memo);
+	
+	value_clear(&fun);
+	return value_init_nil();
+}
+
+/* 
+ * Finds the function that (func) refers to. (func) may be a function or the name 
+ * of a function given as a symbol. Returns a copy.
+ */
+value value_private_memo_function(value ud_functions, value func, char *fname)
+{
+	value fun;
+	if (func.type == VALUE_SYM) {
+		value name = value_set_str(func.core.u_s);
+		name.type = VALUE_VAR;
+		fun = value_hash_get(ud_functions, name);
+		value_clear(&name);
+		if (fun.type != VALUE_UDF) {
+			value_error(1, "Error: In %c, undefined function %s.", fname, func);
+			value_clear(&fun);
+			return value_init_error();
+		}
+	} else if (func.type == VALUE_UDF) {
+		fun = value_set(func);
+	} else {
+		value_error(1, "Type Error: %c is undefined where func is %ts (function or symbol expected).", fname, func);
+		return value_init_error();
+	}
+	
+	return fun;
+}
+
+struct value_memo * value_private_memo_init(size_t capacity)
+{
+	struct value_memo *memo = value_malloc(NULL, sizeof(struct value_memo));
+	if (memo == NULL) return NULL;
+	memo->entries = value_malloc(NULL, sizeof(struct value_memo_entry) * capacity);
+	if (memo->entries == NULL) {
+		value_free(memo);
+		return NULL;
+	}
+	
+	// The index has twice as many buckets as the cache has entries, so it never 
+	// gets full enough to be resized.
+	memo->index = value_hash_init_capacity(2 * capacity);
+	if (memo->index.type == VALUE_ERROR) {
+		value_free(memo->entries);
+		value_free(memo);
+		return NULL;
+	}
+	
+	memo->refcount = 1;
+	memo->capacity = capacity;
+	memo->size = 0;
+	memo->hits = 0;
+	memo->misses = 0;
+	memo->head = MEMO_NO_ENTRY;
+	memo->tail = MEMO_NO_ENTRY;
+	
+	return memo;
+}
+
+void value_private_memo_free(struct value_memo *memo)
+{
+	if (--memo->refcount > 0)
+		return;
+	
+	size_t i;
+	for (i = 0; i < memo->size; ++i) {
+		value_clear(&memo->entries[i].args);
+		value_clear(&memo->entries[i].result);
+	}
+	value_hash_clear(&memo->index);
+	value_free(memo->entries);
+	value_free(memo);
+}
+
+void value_private_memo_reset(struct value_memo *memo)
+{
+	size_t i;
+	for (i = 0; i < memo->size; ++i) {
+		value_clear(&memo->entries[i].args);
+		value_clear(&memo->entries[i].result);
+	}
+	value_hash_clear(&memo->index);
+	memo->index = value_hash_init_capacity(2 * memo->capacity);
+	
+	memo->size = 0;
+	memo->hits = 0;
+	memo->misses = 0;
+	memo->head = MEMO_NO_ENTRY;
+	memo->tail = MEMO_NO_ENTRY;
+}
+
+/* 
+ * Takes entry (n) out of the recently-used list.
+ */
+void value_private_memo_unlink(struct value_memo *memo, size_t n)
+{
+	struct value_memo_entry *entry = &memo->entries[n];
+	
+	if (entry->prev == MEMO_NO_ENTRY)
+		memo->head = entry->next;
+	else memo->entries[entry->prev].next = entry->next;
+	
+	if (entry->next == MEMO_NO_ENTRY)
+		memo->tail = entry->prev;
+	else memo->entries[entry->next].prev = entry->prev;
+}
+
+/* 
+ * Puts entry (n) at the front of the recently-used list.
+ */
+void value_private_memo_push(struct value_memo *memo, size_t n)
+{
+	memo->entries[n].prev = MEMO_NO_ENTRY;
+	memo->entries[n].next = memo->head;
+	
+	if (memo->head == MEMO_NO_ENTRY)
+		memo->tail = n;
+	else memo->entries[memo->head].prev = n;
+	memo->head = n;
+}
+
+value value_private_memo_call(value *variables, value op, int argc, value argv[])
+{
+	struct value_memo *memo = op.core.u_udf->memo;
+	int i, fargc = op.core.u_udf->spec.argc;
+	
+	// Evaluate the arguments up front, since the evaluated arguments are the key.
+	value key = value_init(VALUE_ARY);
+	return_if_error(key);
+	for (i = 0; i < fargc; ++i) {
+		value x;
+		if (op.core.u_udf->spec.delay_eval_p)
+			x = value_set(argv[i]);
+		else x = eval(variables, argv[i]);
+		if (x.type == VALUE_ERROR) {
+			value_clear(&key);
+			return x;
+		}
+		value_append_now2(&key, &x);
+	}
+	
+	value *found = value_hash_get_ref(memo->index, key);
+	if (found) {
+		size_t n = mpz_get_ui(found->core.u_mz);
+		++memo->hits;
+		value_clear(&key);
+		
+		value_private_memo_unlink(memo, n);
+		value_private_memo_push(memo, n);
+		return value_set(memo->entries[n].result);
+	}
+	
+	++memo->misses;
+	value res = value_private_udfcall(variables, op, fargc, key.core.u_a.a, TRUE);
+	
+	// Errors and stops are not remembered. If a nested call already stored this 
+	// key, don't store it twice.
+	if (res.type == VALUE_ERROR || res.type == VALUE_STOP || value_hash_exists(memo->index, key)) {
+		value_clear(&key);
+		return res;
+	}
+	
+	size_t n;
+	if (memo->size < memo->capacity) {
+		n = memo->size++;
+	} else {
+		// Evict the least recently used entry and reuse its place.
+		n = memo->tail;
+		value_private_memo_unlink(memo, n);
+		value_hash_delete_at_void(&memo->index, memo->entries[n].args);
+		value_clear(&memo->entries[n].args);
+		value_clear(&memo->entries[n].result);
+	}
+	
+	value k = value_set(key), v = value_set_ulong(n);
+	value_hash_put_refs(&memo->index, &k, &v);
+	memo->entries[n].args = key;
+	memo->entries[n].result = value_set(res);
+	value_private_memo_push(memo, n);
+	
+	return res;
+}
+
 value value_defmacro(value *variables, value name, value vars, value body)
 {
 	return value_init_error();
@@ -427,6 +862,35 @@ value value_lambda_arg(int argc, value argv[])
 	return missing_arguments(argc-1, argv+1, "lambda()") ? value_init_error() : value_lambda(tmp, argv[1], argv[2]);
 }
 
+value value_memoize_arg(int argc, value argv[])
+{
+	value *tmp = value_deref(argv[0]);
+	return missing_arguments(argc-1, argv+1, "memoize()") ? value_init_error() : value_memoize(tmp, argv[1], argv[2]);
+}
+
+value value_defmemo_arg(int argc, value argv[])
+{
+	value *tmp = value_deref(argv[0]);
+	return missing_arguments(argc-1, argv+1, "defmemo()") ? value_init_error() : value_defmemo(tmp, argv[1], argv[2], argv[3]);
+}
+
+value value_quicken_stats_arg(int argc, value argv[])
+{
+	return value_quicken_stats();
+}
+
+value value_memo_stats_arg(int argc, value argv[])
+{
+	value *tmp = value_deref(argv[0]);
+	return missing_arguments(argc-1, argv+1, "memo_stats()") ? value_init_error() : value_memo_stats(tmp, argv[1]);
+}
+
+value value_memo_clear_arg(int argc, value argv[])
+{
+	value *tmp = value_deref(argv[0]);
+	return missing_arguments(argc-1, argv+1, "memo_clear()") ? value_init_error() : value_memo_clear(tmp, argv[1]);
+}
+
 value value_quote(value *variables, value op)
 {
 	value res = value_init_nil();
@@ -519,6 +983,11 @@ value value_yield_arg(int argc, value argv[])
 {
 	if (missing_arguments(argc, argv, "yield()"))
 		return value_init_error();
+	
+	// Inside a generator, yield hands the value to whatever is pulling from the 
+	// generator instead of returning it to the enclosing loop.
+	if (current_generator)
+		return value_generator_yield(current_generator, argv[0]);
 		
 	value res;
 	res.type = VALUE_STOP;
@@ -22,11 +22,12 @@ exception exception_init(exception *parent, char *name)
 value value_throw(exception op, char *description)
 {
 	value exc;
-	exc.core.u_exc = op;
+	exc.type = VALUE_EXC;
+	exc.core.u_exc = &op;
 	value res = value_set(exc);
-	if (res.core.u_exc.description)value_free(res.core.u_exc.description);
-	res.core.u_exc.description = value_malloc(NULL, strlen(description) + 1);
-	return_if_null(res.core.u_exc.description);
-	strcpy(res.core.u_exc.description, description);
+	if (res.core.u_exc->description)value_free(res.core.u_exc->description);
+	res.core.u_exc->description = value_malloc(NULL, strlen(description) + 1);
+	return_if_null(res.core.u_exc->description);
+	strcpy(res.core.u_exc->description, description);
 	return res;
 }
\ No newline at end of file
@@ -0,0 +1,283 @@
+/*
+ *  value_generator.c
+ *  Simfpl
+ *
+ *  All definitions for functions and variables in value_generator.c can be found in value.h.
+ *  
+ */
+
+/* 
+ * Generator Implementation
+ * 
+ * A generator runs its function body on a stack of its own. The ucontext functions 
+ * are used to switch between the generator and whatever is pulling values out of it. 
+ * When the body calls yield, the generator saves its context and switches back to 
+ * the caller; the next pull switches into the generator again, and yield returns nil. 
+ * Since the generator's whole C stack is kept, yield can be called at any depth, for 
+ * instance inside an iterator that the body is running.
+ * 
+ * Generators are not copied. Every copy of a generator value points to the same 
+ * struct value_generator, and (refcount) counts how many there are.
+ * 
+ * If the last copy is cleared while the generator is suspended, the generator is 
+ * resumed one more time with (closing_p) set. This makes yield return an exit, so 
+ * the body unwinds and clears whatever its frame is holding.
+ * 
+ * The stack is mapped with mmap() rather than allocated, so that its pages are only 
+ * touched as the body goes deeper, and the lowest page is made inaccessible. Every 
+ * function call checks how much of the stack is left (see 
+ * value_generator_stack_full_p()), so deep recursion is reported as an error; the 
+ * guard page turns anything that still gets past that into a crash instead of 
+ * silently overwriting the heap.
+ */
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "value.h"
+
+value value_generator_init(value *variables, value func, int argc, value argv[])
+{
+	int i, fargc = func.core.u_udf->spec.argc;
+	value args = value_init(VALUE_ARY);
+	return_if_error(args);
+	for (i = 0; i < fargc; ++i) {
+		value x;
+		if (func.core.u_udf->spec.delay_eval_p)
+			x = value_set(argv[i]);
+		else x = eval(variables, argv[i]);
+		if (x.type == VALUE_ERROR) {
+			value_clear(&args);
+			return x;
+		}
+		value_append_now2(&args, &x);
+	}
+	
+	value res;
+	res.type = VALUE_GEN;
+	res.core.u_gen = value_malloc(NULL, sizeof(struct value_generator));
+	if (res.core.u_gen == NULL) {
+		value_clear(&args);
+		return value_init_error();
+	}
+	
+	struct value_generator *gen = res.core.u_gen;
+	gen->refcount = 1;
+	gen->state = GEN_READY;
+	gen->buffered_p = FALSE;
+	gen->closing_p = FALSE;
+	gen->error_p = FALSE;
+	gen->stack = NULL; // The stack is not allocated until the generator is first run.
+	gen->outer = NULL;
+	gen->func = value_set(func);
+	gen->args = args;
+	gen->scope = value_hash_init();
+	gen->yielded = value_init_nil();
+	
+	return res;
+}
+
+int value_generator_pull(value gen, value *res)
+{
+	if (gen.type != VALUE_GEN) {
+		value_error(1, "Type Error: pull() is undefined where gen is %ts (generator expected).", gen);
+		return VALUE_ERROR;
+	}
+	
+	struct value_generator *g = gen.core.u_gen;
+	if (g->buffered_p == FALSE && g->state != GEN_DONE) {
+		if (g->state == GEN_RUNNING) {
+			value_error(1, "Error: A generator cannot pull values out of itself.");
+			return VALUE_ERROR;
+		}
+		if (value_private_generator_resume(g) == VALUE_ERROR)
+			return VALUE_ERROR;
+		if (g->error_p) {
+			// Only report the error once. After that, the generator is simply finished.
+			g->error_p = FALSE;
+			return VALUE_ERROR;
+		}
+	}
+	
+	if (g->buffered_p == FALSE)
+		return FALSE;
+	
+	if (res) {
+		*res = g->yielded;
+		g->yielded.type = VALUE_NIL;
+	} else value_clear(&g->yielded);
+	g->buffered_p = FALSE;
+	return TRUE;
+}
+
+value value_next(value gen)
+{
+	if (gen.type != VALUE_GEN) {
+		value_error(1, "Type Error: next() is undefined where op is %ts (generator expected).", gen);
+		return value_init_error();
+	}
+	
+	value res;
+	int found_p = value_generator_pull(gen, &res);
+	if (found_p == VALUE_ERROR)
+		return value_init_error();
+	if (found_p == FALSE)
+		return value_init_nil();
+	return res;
+}
+
+int value_done_p(value gen)
+{
+	struct value_generator *g = gen.core.u_gen;
+	if (g->buffered_p == FALSE && g->state != GEN_DONE && g->state != GEN_RUNNING) {
+		value_private_generator_resume(g);
+		
+		// An error in the generator will be reported by value_error(). There's nothing 
+		// more to do with it here, since the generator is now finished either way.
+		g->error_p = FALSE;
+	}
+	
+	return g->buffered_p == FALSE && g->state == GEN_DONE;
+}
+
+value value_done_p_std(value gen)
+{
+	if (gen.type != VALUE_GEN) {
+		value_error(1, "Type Error: done?() is undefined where op is %ts (generator expected).", gen);
+		return value_init_error();
+	}
+	
+	return value_set_bool(value_done_p(gen));
+}
+
+value value_generator_to_a(value gen)
+{
+	value res = value_init(VALUE_ARY);
+	return_if_error(res);
+	
+	value x;
+	int found_p;
+	while ((found_p = value_generator_pull(gen, &x)) == TRUE)
+		value_append_now2(&res, &x);
+	
+	if (found_p == VALUE_ERROR) {
+		value_clear(&res);
+		return value_init_error();
+	}
+	
+	return res;
+}
+
+value value_generator_yield(struct value_generator *gen, value op)
+{
+	value res;
+	res.type = VALUE_STOP;
+	res.core.u_stop.type = STOP_EXIT;
+	res.core.u_stop.core = NULL;
+	
+	if (gen->closing_p)
+		return res;
+	
+	gen->yielded = value_set(op);
+	gen->buffered_p = TRUE;
+	gen->state = GEN_SUSPENDED;
+	swapcontext(&gen->context, &gen->caller);
+	
+	// The generator has been resumed.
+	if (gen->closing_p)
+		return res;
+	return value_init_nil();
+}
+
+void value_private_generator_free(struct value_generator *gen)
+{
+	if (--gen->refcount > 0)
+		return;
+	
+	if (gen->state == GEN_SUSPENDED) {
+		gen->closing_p = TRUE;
+		value_private_generator_resume(gen);
+	}
+	
+	// A body that never finished will not be resumed again, so its frames can be 
+	// dropped. The only stack that can't be unmapped is the one we are running on.
+	if (gen->stack && gen->state != GEN_RUNNING) {
+		munmap(gen->stack, GENERATOR_STACK_SIZE);
+		gen->stack = NULL;
+	}
+	
+	value_clear(&gen->func);
+	value_clear(&gen->args);
+	value_clear(&gen->scope);
+	value_clear(&gen->yielded);
+	value_free(gen);
+}
+
+/* 
+ * Switches into (gen) and runs it until it yields or finishes.
+ */
+int value_private_generator_resume(struct value_generator *gen)
+{
+	if (gen->state == GEN_READY) {
+		void *stack = mmap(NULL, GENERATOR_STACK_SIZE, PROT_READ | PROT_WRITE, 
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (stack == MAP_FAILED) {
+			value_error(1, "Memory Error: Could not map a stack for the generator.");
+			return VALUE_ERROR;
+		}
+		
+		// The stack grows down, so the guard page goes at the bottom.
+		if (mprotect(stack, sysconf(_SC_PAGESIZE), PROT_NONE) != 0) {
+			munmap(stack, GENERATOR_STACK_SIZE);
+			value_error(1, "Memory Error: Could not map a stack for the generator.");
+			return VALUE_ERROR;
+		}
+		gen->stack = stack;
+		
+		getcontext(&gen->context);
+		gen->context.uc_stack.ss_sp = gen->stack;
+		gen->context.uc_stack.ss_size = GENERATOR_STACK_SIZE;
+		gen->context.uc_link = &gen->caller;
+		makecontext(&gen->context, value_private_generator_start, 0);
+	}
+	
+	gen->outer = current_generator;
+	current_generator = gen;
+	gen->state = GEN_RUNNING;
+	swapcontext(&gen->caller, &gen->context);
+	current_generator = gen->outer;
+	
+	return 0;
+}
+
+int value_generator_stack_full_p(struct value_generator *gen)
+{
+	char here;
+	return &here < gen->stack + GENERATOR_STACK_RESERVE;
+}
+
+/* 
+ * The entry point of a generator's context. When this returns, control goes to 
+ * (uc_link), which is the context that resumed the generator.
+ */
+void value_private_generator_start()
+{
+	struct value_generator *gen = current_generator;
+	
+	value res = value_private_udfcall(&gen->scope, gen->func, gen->args.core.u_a.length, gen->args.core.u_a.a, TRUE);
+	if (res.type == VALUE_ERROR && gen->closing_p == FALSE)
+		gen->error_p = TRUE;
+	value_clear(&res);
+	
+	gen->state = GEN_DONE;
+}
+
+value value_next_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "next()") ? value_init_error() : value_next(argv[0]);
+}
+
+value value_done_p_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "done?()") ? value_init_error() : value_done_p_std(argv[0]);
+}
@@ -15,9 +15,9 @@
  * used to represent the bucket rather than a linked list because 
  * lists take at least five times longer to iterate over.
  * 
- * (name).core.u_h is used to store the array. On the surface, a hash 
- * is identical to an array except that its type is VALUE_HSH instead 
- * of VALUE_ARY.
+ * (name).core.u_h points to the array of buckets along with its 
+ * length and counts, so that a hash takes up no more room in a value 
+ * than an array does.
  * 
  */
 
@@ -40,15 +40,20 @@ value value_hash_init_capacity(size_t capacity)
 	value hash;
 	
 	hash.type = VALUE_HSH;
-	hash.core.u_h.a = value_malloc(NULL, sizeof(value) * next_size(capacity));
-	return_if_null(hash.core.u_h.a);
-	hash.core.u_h.length = capacity;
-	hash.core.u_h.occupied = 0;
-	hash.core.u_h.size = 0;
+	hash.core.u_h = value_malloc(NULL, sizeof(struct value_hash));
+	return_if_null(hash.core.u_h);
+	hash.core.u_h->a = value_malloc(NULL, sizeof(value) * next_size(capacity));
+	if (hash.core.u_h->a == NULL) {
+		value_free(hash.core.u_h);
+		return value_init_error();
+	}
+	hash.core.u_h->length = capacity;
+	hash.core.u_h->occupied = 0;
+	hash.core.u_h->size = 0;
 	
 	size_t i;
 	for (i = 0; i < capacity; ++i)
-		hash.core.u_h.a[i] = value_init_nil();
+		hash.core.u_h->a[i] = value_init_nil();
 				
 	return hash;
 }
@@ -62,9 +67,10 @@ void value_hash_clear(value *hash)
 	size_t i, length = value_hash_length(*hash);
 	
 	for (i = 0; i < length; ++i)
-		value_clear(&hash->core.u_h.a[i]);
+		value_clear(&hash->core.u_h->a[i]);
 	
-value_free(hash->core.u_h.a);
+	value_free(hash->core.u_h->a);
+	value_free(hash->core.u_h);
 	hash->type = VALUE_NIL;
 }
 
@@ -76,7 +82,7 @@ size_t value_hash_length(value hash)
 		value_error(1, "Type Error: hash_length() is undefined where hash is %ts (hash expected).", hash);
 		return -1;
 	}
-	return hash.core.u_h.length;
+	return hash.core.u_h->length;
 }
 
 /* A count of the number of currently occupied buckets.
@@ -87,7 +93,7 @@ size_t value_hash_occupied(value hash)
 		value_error(1, "Type Error: hash_occupied() is undefined where hash is %ts (hash expected).", hash);
 		return -1;
 	}
-	return hash.core.u_h.occupied;
+	return hash.core.u_h->occupied;
 }
 
 /* The number of elements in the hash.
@@ -98,7 +104,7 @@ size_t value_hash_size(value hash)
 		value_error(1, "Type Error: hash_size() is undefined where hash is %ts (hash expected).", hash);
 		return -1;
 	}
-	return hash.core.u_h.size;
+	return hash.core.u_h->size;
 }
 
 value value_hash_resize(value *hash)
@@ -112,25 +118,30 @@ value value_hash_resize(value *hash)
 	value new = value_hash_init_capacity(next_size(length * 4));
 	size_t i, j;
 	for (i = 0; i < length; ++i) {
-		if (hash->core.u_h.a[i].type == VALUE_NIL)
+		if (hash->core.u_h->a[i].type == VALUE_NIL)
 			continue;
-		inner_len = value_length(hash->core.u_h.a[i]);
+		inner_len = value_length(hash->core.u_h->a[i]);
 		for (j = 0; j < inner_len; ++j)
-			value_hash_put_refs(&new, &hash->core.u_h.a[i].core.u_a.a[j].core.u_p->head, &hash->core.u_h.a[i].core.u_a.a[j].core.u_p->head);
+			value_hash_put_refs(&new, &hash->core.u_h->a[i].core.u_a.a[j].core.u_p->head, &hash->core.u_h->a[i].core.u_a.a[j].core.u_p->tail);
 	}
 	
 	// Don't clear the keys and the values, because they are now references in the new hash. But clear everything else.
 //	value_hash_clear(hash);
 	for (i = 0; i < length; ++i) {
-		if (hash->core.u_h.a[i].type == VALUE_NIL)
+		if (hash->core.u_h->a[i].type == VALUE_NIL)
 			continue;
-		inner_len = value_length(hash->core.u_h.a[i]);
-		for (j = 0; j < inner_len; ++j)
-			value_free(hash->core.u_h.a[i].core.u_a.a[j].core.u_p);
-		value_free(hash->core.u_h.a[i].core.u_a.a);
+		inner_len = value_length(hash->core.u_h->a[i]);
+		for (j = 0; j < inner_len; ++j) {
+			value *pair = &hash->core.u_h->a[i].core.u_a.a[j];
+			if (pair->type == VALUE_ARY)
+				value_free_elements(pair->core.u_a.a);
+			else value_free(pair->core.u_p);
+		}
+		value_free_elements(hash->core.u_h->a[i].core.u_a.a);
 	}
 	
-	value_free(hash->core.u_h.a);
+	value_free(hash->core.u_h->a);
+	value_free(hash->core.u_h);
 	
 	*hash = new;
 	
@@ -169,33 +180,32 @@ value value_hash_put_refs_generic(value *hash, value *key, value *val, int clear
 	size_t index = value_private_hash_function(*key) % length;
 	
 	int count;
-	if (hash->core.u_h.a[index].type == VALUE_NIL) {
+	if (hash->core.u_h->a[index].type == VALUE_NIL) {
 		// This bucket hasn't been initialized. Initialize it, and add the first element.
 		value ary[] = { *key, *val };
 		
-		hash->core.u_h.a[index].type = VALUE_ARY;
-		hash->core.u_h.a[index].core.u_a.a = value_malloc(NULL, sizeof(value) * next_size(1));
-		if (hash->core.u_h.a[index].core.u_h.a == NULL) {
+		hash->core.u_h->a[index].type = VALUE_ARY;
+		if (value_malloc(&hash->core.u_h->a[index], next_size(1)) == NULL) {
 			return value_init_nil();
 		}
-		hash->core.u_h.a[index].core.u_a.length = 1;
-		hash->core.u_h.a[index].core.u_a.a[0] = value_set_ary_ref(ary, 2);
-		++hash->core.u_h.occupied;
+		hash->core.u_h->a[index].core.u_a.length = 1;
+		hash->core.u_h->a[index].core.u_a.a[0] = value_set_ary_ref(ary, 2);
+		++hash->core.u_h->occupied;
 		count = 1;
 	} else {
-		if (hash->core.u_h.a[index].core.u_a.length == 0)
-			++hash->core.u_h.occupied;
+		if (hash->core.u_h->a[index].core.u_a.length == 0)
+			++hash->core.u_h->occupied;
 		
-		count = value_private_put_pair_in_bucket(&hash->core.u_h.a[index], key, val, clear_p);
+		count = value_private_put_pair_in_bucket(&hash->core.u_h->a[index], key, val, clear_p);
 		if (count == VALUE_ERROR) {
 			return value_init_error();
 		}
 	}
 
-	hash->core.u_h.size += count;
+	hash->core.u_h->size += count;
 
 	/* If more than 75% of the indices are occupied, it's to make a new, bigger hash. */
-	if ((hash->core.u_h.occupied * 100) / length > 75) {
+	if ((hash->core.u_h->occupied * 100) / length > 75) {
 		value_hash_resize(hash);
 	}
 	
@@ -273,11 +283,11 @@ int value_hash_exists(value hash, value key)
 	if (length == 0)
 		return FALSE;
 	size_t index = value_private_hash_function(key) % length;
-	if (hash.core.u_h.a[index].type == VALUE_NIL)
+	if (hash.core.u_h->a[index].type == VALUE_NIL)
 		return FALSE;
-	size_t inner_len = value_length(hash.core.u_h.a[index]);
+	size_t inner_len = value_length(hash.core.u_h->a[index]);
 	for (i = 0; i < inner_len; ++i)
-		if (value_eq(hash.core.u_h.a[index].core.u_a.a[i].core.u_p->head, key))
+		if (value_eq(hash.core.u_h->a[index].core.u_a.a[i].core.u_p->head, key))
 			return TRUE;
 	return FALSE;
 }
@@ -308,11 +318,11 @@ int value_contains_value(value op, value val)
 	
 	size_t i, length = value_hash_length(op);
 	size_t index = value_private_hash_function(val) % length;
-	if (op.core.u_h.a[index].type == VALUE_NIL)
+	if (op.core.u_h->a[index].type == VALUE_NIL)
 		return FALSE;
-	size_t inner_len = value_length(op.core.u_h.a[index]);
+	size_t inner_len = value_length(op.core.u_h->a[index]);
 	for (i = 0; i < inner_len; ++i)
-		if (value_eq(op.core.u_h.a[index].core.u_a.a[i].core.u_p->tail, val))
+		if (value_eq(op.core.u_h->a[index].core.u_a.a[i].core.u_p->tail, val))
 			return TRUE;
 	
 	return FALSE;
@@ -339,28 +349,28 @@ value value_hash_delete_at(value *hash, value key)
 		return value_init_error();
 	}
 	
-	size_t length = hash->core.u_h.length;
+	size_t length = hash->core.u_h->length;
 	if (length == 0)
 		return value_init_nil();
 	size_t index = value_private_hash_function(key) % length;
-	if (hash->core.u_h.a[index].type == VALUE_NIL)
+	if (hash->core.u_h->a[index].type == VALUE_NIL)
 		return value_init_nil();
 	
 	value res = value_init_nil();
-	value ptr = hash->core.u_h.a[index];
+	value ptr = hash->core.u_h->a[index];
 	
 	size_t i;
 	for (i = 0; i < ptr.core.u_a.length; ++i) {
 		if (value_eq(ptr.core.u_a.a[i].core.u_p->head, key)) {
-			--hash->core.u_h.size;
-			--hash->core.u_h.a[index].core.u_a.length;
+			--hash->core.u_h->size;
+			--hash->core.u_h->a[index].core.u_a.length;
 			res = ptr.core.u_a.a[i];
 //			memmove(ptr.core.u_a.a + i, ptr.core.u_a.a + i + 1, ptr.core.u_a.length - i);
 			for (; i < ptr.core.u_a.length; ++i)
 				ptr.core.u_a.a[i] = ptr.core.u_a.a[i+1];
 			
-			if (hash->core.u_h.a[index].core.u_a.length == 0)
-				--hash->core.u_h.occupied;
+			if (hash->core.u_h->a[index].core.u_a.length == 0)
+				--hash->core.u_h->occupied;
 		}
 	}
 	
@@ -390,9 +400,9 @@ value * value_hash_get_ref(value hash, value key)
 	if (length == 0)
 		return NULL;
 	size_t index = value_private_hash_function(key) % length;
-	if (hash.core.u_h.a[index].type == VALUE_NIL)
+	if (hash.core.u_h->a[index].type == VALUE_NIL)
 		return NULL;
-	value pair = value_private_find_pair_in_bucket(hash.core.u_h.a[index], key);
+	value pair = value_private_find_pair_in_bucket(hash.core.u_h->a[index], key);
 	if (pair.type == VALUE_NIL)
 		return NULL;
 	return &pair.core.u_p->tail;
@@ -455,11 +465,11 @@ value * value_hash_get_pair_ref(value hash, value key)
 	if (length == 0)
 		return NULL;
 	size_t index = value_private_hash_function(key) % length;
-	if (hash.core.u_h.a[index].type == VALUE_NIL)
+	if (hash.core.u_h->a[index].type == VALUE_NIL)
 		return NULL;
 	value *pair = value_malloc(NULL, sizeof(value));
 	if (pair == NULL) return pair;
-	*pair = value_private_find_pair_in_bucket(hash.core.u_h.a[index], key);
+	*pair = value_private_find_pair_in_bucket(hash.core.u_h->a[index], key);
 	if (pair->type == VALUE_NIL)
 		return NULL;
 	
@@ -486,7 +496,9 @@ int value_private_put_pair_in_bucket(value *bucket, value *key, value *val, int
 {	
 	size_t i, length = value_length(*bucket);
 	for (i = 0; i < length; ++i) {
-		if (bucket->core.u_a.a[i].type == VALUE_ARY && value_eq(bucket->core.u_a.a[i].core.u_p->head, *key)) {
+		// The first pair in a bucket is a two-element array and the rest are pairs.
+		if ((bucket->core.u_a.a[i].type == VALUE_ARY || bucket->core.u_a.a[i].type == VALUE_PAR) && 
+				value_eq(bucket->core.u_a.a[i].core.u_p->head, *key)) {
 			if (clear_p) {
 				value_clear(&bucket->core.u_a.a[i].core.u_p->head);
 				value_clear(&bucket->core.u_a.a[i].core.u_p->tail);
@@ -572,14 +584,21 @@ size_t value_private_hash_function(value op)
 		case VALUE_HSH:
 		case VALUE_BLK:
 			;
-			size_t i;
+			size_t i, length = op.type == VALUE_HSH ? op.core.u_h->length : op.core.u_a.length;
+			value *a = op.type == VALUE_HSH ? op.core.u_h->a : op.core.u_a.a;
 			// What (length / 10) + 1 does is that it ensures that no more than 
 			// ten elements out of the array will be hashed. Doing more than that 
 			// would be slow and not provide much benefit.
-			for (i = 0; i < op.core.u_h.length; i += (op.core.u_h.length / 10) + 1)
-				hash += value_private_hash_function(op.core.u_a.a[i]);
-			hash += op.core.u_h.length;
+			for (i = 0; i < length; i += (length / 10) + 1)
+				hash += value_private_hash_function(a[i]);
+			hash += length;
 			break;
+		case VALUE_PAK:
+			return value_packed_hash_function(op);
+		case VALUE_NDA:
+			return value_nd_hash_function(op);
+		case VALUE_SLC:
+			return value_slice_hash_function(op);
 		case VALUE_LST:
 			hash += value_private_hash_function(op.core.u_l[0]);
 			hash += value_private_hash_function(op.core.u_l[1]);
@@ -608,11 +627,11 @@ int value_hash_print(value hash)
 	size_t i, length = value_hash_length(hash);
 	printf("{ ");
 	for (i = 0; i < length; ++i) {
-		if (hash.core.u_h.a[i].type == VALUE_NIL)
+		if (hash.core.u_h->a[i].type == VALUE_NIL)
 			continue;
-		size_t j, inner_len = value_length(hash.core.u_h.a[i]);
+		size_t j, inner_len = value_length(hash.core.u_h->a[i]);
 		for (j = 0; j < inner_len; ++j) {
-			value_print(hash.core.u_h.a[i].core.u_a.a[j]);
+			value_print(hash.core.u_h->a[i].core.u_a.a[j]);
 			printf(", ");
 		}
 	}
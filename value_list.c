@@ -86,19 +86,12 @@ value value_cons_now2(value *op1, value *op2)
 		op2->core.u_p->tail = value_init_nil();
 		
 	} else if (op2->type == VALUE_ARY) {
-		value res;
-		res.type = VALUE_ARY;
-		size_t i, length = value_length(*op2);
-		if (resize_p(length+1)) {
-			value_realloc(op1, next_size(length+1) + 1);
-			if (op1->type == VALUE_ERROR)
-				return value_init_error();
-		}
-		for (i = 1; i < length; ++i)
-			res.core.u_a.a[i+1] = op2->core.u_a.a[i];
-		res.core.u_a.a[0] = *op1;
-		res.core.u_a.length = op2->core.u_a.length + 1;
-		*op2 = res;
+		size_t length = value_length(*op2);
+		if (!value_private_array_grow(op2, length + 1))
+			return value_init_error();
+		memmove(op2->core.u_a.a + 1, op2->core.u_a.a, sizeof(value) * length);
+		op2->core.u_a.a[0] = *op1;
+		++op2->core.u_a.length;
 	} else if (op2->type == VALUE_LST) {
 		value res;
 		res.type = VALUE_LST;
@@ -129,9 +122,9 @@ value value_drop(value op, value n)
 {
 	if (op.type == VALUE_NIL) {
 		return value_init_nil();
-	} else if (op.type == VALUE_ARY) {
+	} else if (op.type == VALUE_ARY || op.type == VALUE_STR || op.type == VALUE_SLC) {
 		if (n.type == VALUE_MPZ) {
-			value length = value_set_long(op.core.u_a.length);
+			value length = value_set_long(value_length(op));
 			value res = value_range(op, n, length);
 			value_clear(&length);
 			return res;
@@ -171,7 +164,7 @@ value value_drop(value op, value n)
 			return value_set(ptr);
 		}
 	} else {
-		value_error(1, "Type Error: drop() is undefined where op1 is %ts (array or list expected).", op);
+		value_error(1, "Type Error: drop() is undefined where op1 is %ts (string, array or list expected).", op);
 		if (n.type == VALUE_MPZ)
 			return value_init_error();
 	}
@@ -293,7 +286,7 @@ value value_take(value op, value n)
 {
 	if (op.type == VALUE_NIL) {
 		return value_init_nil();
-	} else if (op.type == VALUE_ARY) {
+	} else if (op.type == VALUE_ARY || op.type == VALUE_STR || op.type == VALUE_SLC) {
 		if (n.type == VALUE_MPZ) {
 			value start = value_set_long(0);
 			value res = value_range(op, start, n);
@@ -342,10 +335,32 @@ value value_take(value op, value n)
 			
 			value_reverse_now(&res);
 			
+			return res;
+		}
+	} else if (op.type == VALUE_GEN) {
+		if (n.type == VALUE_MPZ) {
+			if (value_lt(n, value_zero)) {
+				value_error(1, "Domain Error: take() is undefined where n is %s (>= 0 expected).", n);
+				return value_init_error();
+			}
+			
+			value res = value_init(VALUE_ARY);
+			return_if_error(res);
+			size_t i, max = value_get_ulong(n);
+			value x;
+			int found_p = TRUE;
+			for (i = 0; i < max && (found_p = value_generator_pull(op, &x)) == TRUE; ++i)
+				value_append_now2(&res, &x);
+			
+			if (found_p == VALUE_ERROR) {
+				value_clear(&res);
+				return value_init_error();
+			}
+			
 			return res;
 		}
 	} else {
-		value_error(1, "Type Error: take() is undefined where op is %ts (array or list expected).", op);
+		value_error(1, "Type Error: take() is undefined where op is %ts (string, array, list or generator expected).", op);
 		if (n.type == VALUE_MPZ)
 			return value_init_error();
 	}
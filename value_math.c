@@ -85,6 +85,9 @@ value value_seconds_arg(int argc, value argv[])
 
 value value_pow(value op1, value op2)
 {
+	if (value_vector_p(op1) || value_vector_p(op2))
+		return value_vector_op(VECTOR_POW, op1, op2, "exponentiation");
+
 	int error_p = FALSE;
 	
 	if (op1.type != VALUE_MPZ && op1.type != VALUE_MPF) {
@@ -159,14 +162,16 @@ value value_choose(value op1, value op2)
 	}
 	unsigned long ui = mpz_get_ui(op2.core.u_mz);
 	
-	res.type = VALUE_MPZ;
-	mpz_init(res.core.u_mz);
+	mpz_init(value_box_mpz(&res));
 	mpz_bin_ui(res.core.u_mz, op1.core.u_mz, ui);
 	return res;
 }
 
 value value_exp(value op)
 {
+	if (value_vector_p(op))
+		return value_vector_math(op, VALUE_EXP);
+
 	if (op.type != VALUE_MPZ && op.type != VALUE_MPF) {
 		value_error(1, "Argument Error: Logarithms are undefined when op is %ts (number expected).", op);
 		return value_init_error();
@@ -186,6 +191,9 @@ value value_exp(value op)
 
 value value_log(value op)
 {
+	if (value_vector_p(op))
+		return value_vector_math(op, VALUE_LOG);
+
 	if (op.type != VALUE_MPZ && op.type != VALUE_MPF) {
 		value_error(1, "Argument Error: Logarithms are undefined when op is %ts (number expected).", op);
 		return value_init_error();
@@ -208,6 +216,9 @@ value value_log(value op)
 
 value value_log2(value op)
 {
+	if (value_vector_p(op))
+		return value_vector_math(op, VALUE_LOG2);
+
 	if (op.type != VALUE_MPZ && op.type != VALUE_MPF) {
 		value_error(1, "Argument Error: Logarithms are undefined when op is %ts (number expected).", op);
 		return value_init_error();
@@ -230,6 +241,9 @@ value value_log2(value op)
 
 value value_log10(value op)
 {
+	if (value_vector_p(op))
+		return value_vector_math(op, VALUE_LOG10);
+
 	if (op.type != VALUE_MPZ && op.type != VALUE_MPF) {
 		value_error(1, "Argument Error: Logarithms are undefined when op is %ts (number expected).", op);
 		return value_init_error();
@@ -252,6 +266,9 @@ value value_log10(value op)
 
 value value_sqrt(value op)
 {	
+	if (value_vector_p(op))
+		return value_vector_math(op, VALUE_SQRT);
+
 	if (op.type != VALUE_MPZ && op.type != VALUE_MPF) {
 		value_error(1, "Argument Error: Square root is undefined when op is %ts (number expected).", op);
 		return value_init_error();
@@ -341,13 +358,16 @@ value value_factorial_arg(int argc, value argv[])
 
 value value_trig(value op, int func)
 {
+	if (value_vector_p(op))
+		return value_vector_math(op, func);
+
 	if (op.type != VALUE_MPZ && op.type != VALUE_MPF) {
 		value_error(1, "Argument Error: Trigonometric functions are undefined when op is %ts (number expected.", op);
 		return value_init_error();
 	}
 	
 	value res;
-	res.type = VALUE_MPF;
+	value_box_mpf(&res);
 
 	if (op.type == VALUE_MPZ)
 		mpfr_init_set_z(res.core.u_mf, op.core.u_mz, value_mpfr_round);
@@ -429,6 +449,24 @@ value value_trig(value op, int func)
 	return res;
 }
 
+value value_math_function(value op, int func)
+{
+	switch (func) {
+	case VALUE_EXP:
+		return value_exp(op);
+	case VALUE_LOG:
+		return value_log(op);
+	case VALUE_LOG2:
+		return value_log2(op);
+	case VALUE_LOG10:
+		return value_log10(op);
+	case VALUE_SQRT:
+		return value_sqrt(op);
+	}
+
+	return value_trig(op, func);
+}
+
 value value_sin_arg(int argc, value argv[])
 {
 	return missing_arguments(argc, argv, "sin") ? value_init_error() : value_sin(argv[0]);
@@ -0,0 +1,1042 @@
+/*
+ *  value_matrix.c
+ *  Simfpl
+ *
+ *  All definitions for functions and variables in value_matrix.c can be found in value.h.
+ *
+ */
+
+/*
+ * Matrix Implementation
+ *
+ * A matrix is an array of rows, each an array or packed array of the same length, or
+ * an NDArray with two dimensions. A vector is an array, packed array or range of
+ * numbers, or an NDArray with one dimension. matmul() and the rest first copy their
+ * operands into a struct value_matrix, a row-major block of int64_t's if every element
+ * is an integer that fits in one, a block of doubles if the default precision is 53
+ * bits and every element is an integer or a float, and a block of values otherwise.
+ * Reading the operands takes time proportional to their size, which the product of
+ * two matrices more than makes up for.
+ *
+ * Products of doubles are cache blocked: the columns of the result are done
+ * MATRIX_BLOCK at a time, and within them the inner dimension MATRIX_BLOCK at a time,
+ * so the block of the right-hand matrix being used stays in the cache while every row
+ * of the left-hand one goes past it. The innermost loop adds a multiple of a row of the
+ * right-hand matrix to a row of the result with AVX2 or SSE2 instructions, like the
+ * loops in value_vector.c, and SIMFPL_SIMD turns them off the same way.
+ *
+ * Each element of the result is a sum over the inner dimension taken in order, one
+ * product at a time, with no fused multiply-add, which is how a plain triple loop adds
+ * them up too. So the result is the same at every SIMD level and with any number of
+ * threads, and matches a naive product bit for bit. matvec() instead takes the dot
+ * product of each row with the vector, in four running totals as dot() does, so that
+ * each element of its result equals dot() of the row and the vector.
+ *
+ * Products of integers are done one element at a time with a check for overflow, since
+ * neither AVX2 nor SSE2 multiplies 64-bit integers. If one overflows, or a float comes
+ * out as something MPFR wouldn't give (see value_private_vector_unpackable_p()), the
+ * product is done again with value_mul() and value_add(), as are products of anything
+ * else, so the elements of the result are always what a loop over value_mul() would
+ * give.
+ *
+ * Products with at least MATRIX_PARALLEL_THRESHOLD multiplications (or as many as
+ * SIMFPL_MATRIX_PARALLEL in the environment says) are split by rows of the result among
+ * value_sort_threads() threads, which start and are joined the way the rounds of a
+ * parallel sort are. The threads share nothing but the operands, which they only
+ * read, and separate rows of the result.
+ *
+ * solve() does Gaussian elimination with partial pivoting, which factors the matrix
+ * into LU and applies the factors to the right-hand side as it goes, with doubles and
+ * the same SIMD row operation. With any other default precision, or elements that
+ * aren't numbers, it does the same steps with MPFR floats at the default precision.
+ *
+ * Results are arrays of packed rows, or NDArrays if the first operand was one.
+ */
+
+#include "value.h"
+
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MATRIX_X86
+#endif
+
+size_t value_matrix_parallel_threshold()
+{
+	if (matrix_parallel_threshold)
+		return matrix_parallel_threshold;
+
+	char *str = getenv("SIMFPL_MATRIX_PARALLEL");
+	matrix_parallel_threshold = str && *str ? strtoul(str, NULL, 10) : MATRIX_PARALLEL_THRESHOLD;
+	if (matrix_parallel_threshold == 0)
+		matrix_parallel_threshold = 1;
+	return matrix_parallel_threshold;
+}
+
+/*
+ * Sets (*a) and (*step) to where the elements of row (i) of (op) are, or returns the
+ * row if it's a packed array. A vector is read as one row.
+ */
+value value_private_matrix_row(value op, int vector_p, size_t i, value **a, size_t *step)
+{
+	*a = NULL;
+	*step = 1;
+
+	if (op.type == VALUE_NDA) {
+		struct value_nd *nd = op.core.u_nd;
+		*a = nd->data->a + nd->offset + i * nd->strides[0];
+		*step = nd->strides[nd->rank - 1];
+		return value_init_nil();
+	}
+
+	value row = vector_p ? op : op.core.u_a.a[i];
+	if (row.type == VALUE_PAK)
+		return row;
+	*a = row.core.u_a.a;
+	return value_init_nil();
+}
+
+/*
+ * The kind of block that (x) could be stored in, going by its type. A float may still
+ * turn out not to fit in a double; see value_private_matrix_fill().
+ */
+int value_private_matrix_kind(value x)
+{
+	if (x.type == VALUE_MPZ)
+		return mpz_fits_slong_p(x.core.u_mz) ? PACKED_INT : PACKED_NONE;
+	return x.type == VALUE_MPF ? PACKED_FLOAT : PACKED_NONE;
+}
+
+int value_private_matrix_read(struct value_matrix *m, value op, char *name, char *which)
+{
+	size_t i, j, step;
+	value *a;
+
+	m->kind = PACKED_INT;
+	m->z = NULL;
+	m->f = NULL;
+	m->a = NULL;
+
+	// Ranges and lists are read as the packed arrays they turn into.
+	if (op.type == VALUE_RNG || op.type == VALUE_LST || op.type == VALUE_PAR) {
+		value packed = value_pack(op);
+		if (packed.type == VALUE_ERROR)
+			return VALUE_ERROR;
+		int res = value_private_matrix_read(m, packed, name, which);
+		value_clear(&packed);
+		return res;
+	}
+
+	if (op.type == VALUE_NDA && op.core.u_nd->rank <= 2) {
+		m->vector_p = op.core.u_nd->rank == 1;
+		m->rows = op.core.u_nd->shape[0];
+		m->cols = m->vector_p ? 1 : op.core.u_nd->shape[1];
+	} else if (op.type == VALUE_ARY && op.core.u_a.length && (op.core.u_a.a[0].type == VALUE_ARY || op.core.u_a.a[0].type == VALUE_PAK)) {
+		m->vector_p = FALSE;
+		m->rows = op.core.u_a.length;
+		m->cols = value_length(op.core.u_a.a[0]);
+		for (i = 0; i < m->rows; ++i) {
+			value row = op.core.u_a.a[i];
+			if ((row.type != VALUE_ARY && row.type != VALUE_PAK) || value_length(row) != m->cols) {
+				value_error(1, "Domain Error: %c is undefined where %c is %s (rows of the same length expected).", name, which, op);
+				return VALUE_ERROR;
+			}
+		}
+	} else if (op.type == VALUE_ARY || op.type == VALUE_PAK) {
+		m->vector_p = TRUE;
+		m->rows = value_length(op);
+		m->cols = 1;
+	} else {
+		value_error(1, "Type Error: %c is undefined where %c is %ts (matrix or vector expected).", name, which, op);
+		return VALUE_ERROR;
+	}
+
+	// Find the kind of block that every element fits in.
+	size_t rows = m->vector_p ? 1 : m->rows, width = m->vector_p ? m->rows : m->cols;
+	for (i = 0; i < rows && m->kind != PACKED_NONE; ++i) {
+		value row = value_private_matrix_row(op, m->vector_p, i, &a, &step);
+		if (row.type == VALUE_PAK) {
+			if (row.core.u_pk->kind == PACKED_BOOL)
+				m->kind = PACKED_NONE;
+			else if (row.core.u_pk->kind == PACKED_FLOAT && width)
+				m->kind = PACKED_FLOAT;
+			continue;
+		}
+
+		for (j = 0; j < width; ++j) {
+			int kind = value_private_matrix_kind(a[j * step]);
+			if (kind == PACKED_NONE) {
+				m->kind = PACKED_NONE;
+				break;
+			} else if (kind == PACKED_FLOAT)
+				m->kind = PACKED_FLOAT;
+		}
+	}
+	if (m->kind == PACKED_FLOAT && mpfr_get_default_prec() != DBL_MANT_DIG)
+		m->kind = PACKED_NONE;
+
+	if (value_private_matrix_alloc(m) == VALUE_ERROR)
+		return VALUE_ERROR;
+	if (value_private_matrix_fill(m, op)) {
+		// A float doesn't fit in a double after all.
+		value_private_matrix_free(m);
+		m->kind = PACKED_NONE;
+		if (value_private_matrix_alloc(m) == VALUE_ERROR)
+			return VALUE_ERROR;
+		value_private_matrix_fill(m, op);
+	}
+
+	return 0;
+}
+
+/*
+ * Allocates the block for the kind of (m). The elements aren't set.
+ */
+int value_private_matrix_alloc(struct value_matrix *m)
+{
+	size_t length = m->rows * m->cols;
+	if (m->kind == PACKED_INT)
+		m->z = value_malloc(NULL, sizeof(int64_t) * (length ? length : 1));
+	else if (m->kind == PACKED_FLOAT)
+		m->f = value_malloc(NULL, sizeof(double) * (length ? length : 1));
+	else m->a = value_malloc(NULL, sizeof(value) * (length ? length : 1));
+	return m->z == NULL && m->f == NULL && m->a == NULL ? VALUE_ERROR : 0;
+}
+
+/*
+ * Copies the elements of (op) into the block of (m). Returns TRUE if a float came out
+ * as a double that MPFR wouldn't give, in which case the block has to hold values.
+ */
+int value_private_matrix_fill(struct value_matrix *m, value op)
+{
+	size_t i, j, step, rows = m->vector_p ? 1 : m->rows, width = m->vector_p ? m->rows : m->cols;
+	value *a;
+	int bad_p = FALSE;
+
+	for (i = 0; i < rows; ++i) {
+		value row = value_private_matrix_row(op, m->vector_p, i, &a, &step);
+		size_t k = i * width;
+		for (j = 0; j < width; ++j, ++k) {
+			if (row.type == VALUE_PAK) {
+				struct value_packed *pk = row.core.u_pk;
+				if (m->kind == PACKED_INT)
+					m->z[k] = pk->a.z[j];
+				else if (m->kind == PACKED_FLOAT)
+					m->f[k] = pk->kind == PACKED_FLOAT ? pk->a.f[j] : (double) pk->a.z[j];
+				else m->a[k] = value_packed_get(row, j);
+			} else {
+				value x = a[j * step];
+				if (m->kind == PACKED_INT)
+					m->z[k] = value_get_long(x);
+				else if (m->kind == PACKED_FLOAT) {
+					m->f[k] = x.type == VALUE_MPF ? mpfr_get_d(x.core.u_mf, MPFR_RNDN) : (double) value_get_long(x);
+					bad_p |= x.type == VALUE_MPF && value_private_vector_unpackable_p(m->f[k]);
+				} else m->a[k] = value_set(x);
+			}
+		}
+	}
+
+	return bad_p;
+}
+
+void value_private_matrix_free(struct value_matrix *m)
+{
+	value_free(m->z);
+	value_free(m->f);
+	if (m->a) {
+		size_t i, length = m->rows * m->cols;
+		for (i = 0; i < length; ++i)
+			value_clear(&m->a[i]);
+		value_free(m->a);
+	}
+	m->z = NULL;
+	m->f = NULL;
+	m->a = NULL;
+}
+
+/*
+ * Stores the elements of (m) as doubles, or as values if (kind) is PACKED_NONE.
+ */
+int value_private_matrix_convert(struct value_matrix *m, int kind)
+{
+	size_t i, length = m->rows * m->cols;
+	if (m->kind == kind || m->kind == PACKED_NONE)
+		return 0;
+
+	if (kind == PACKED_FLOAT) {
+		m->f = value_malloc(NULL, sizeof(double) * (length ? length : 1));
+		if (m->f == NULL)
+			return VALUE_ERROR;
+		for (i = 0; i < length; ++i)
+			m->f[i] = (double) m->z[i];
+		value_free(m->z);
+		m->z = NULL;
+	} else {
+		m->a = value_malloc(NULL, sizeof(value) * (length ? length : 1));
+		if (m->a == NULL)
+			return VALUE_ERROR;
+		for (i = 0; i < length; ++i)
+			m->a[i] = m->kind == PACKED_INT ? value_set_long(m->z[i]) : value_set_double(m->f[i]);
+		value_free(m->kind == PACKED_INT ? (void *) m->z : (void *) m->f);
+		m->z = NULL;
+		m->f = NULL;
+	}
+
+	m->kind = kind;
+	return 0;
+}
+
+/*
+ * Makes (a) and (b) the same kind, the one that both of them fit in.
+ */
+int value_private_matrix_unify(struct value_matrix *a, struct value_matrix *b)
+{
+	int kind = a->kind == PACKED_NONE || b->kind == PACKED_NONE ? PACKED_NONE
+		: a->kind == PACKED_FLOAT || b->kind == PACKED_FLOAT ? PACKED_FLOAT : PACKED_INT;
+	if (value_private_matrix_convert(a, kind) == VALUE_ERROR || value_private_matrix_convert(b, kind) == VALUE_ERROR)
+		return VALUE_ERROR;
+	return 0;
+}
+
+/*
+ * Makes an empty matrix of the given kind and shape for a result.
+ */
+int value_private_matrix_init(struct value_matrix *m, int kind, size_t rows, size_t cols, int vector_p)
+{
+	size_t length = rows * cols;
+	m->kind = kind;
+	m->rows = rows;
+	m->cols = cols;
+	m->vector_p = vector_p;
+	m->z = NULL;
+	m->f = NULL;
+	m->a = NULL;
+
+	if (value_private_matrix_alloc(m) == VALUE_ERROR)
+		return VALUE_ERROR;
+	if (kind == PACKED_NONE) {
+		size_t i;
+		for (i = 0; i < length; ++i)
+			m->a[i] = value_init_nil();
+	}
+	return 0;
+}
+
+/*
+ * Returns element (i) of (m) as a new value.
+ */
+value value_private_matrix_get(struct value_matrix *m, size_t i)
+{
+	if (m->kind == PACKED_INT)
+		return value_set_long(m->z[i]);
+	else if (m->kind == PACKED_FLOAT)
+		return value_set_double(m->f[i]);
+	return value_set(m->a[i]);
+}
+
+/*
+ * Returns row (i) of (m), or the whole of (m) if it's a vector, as a packed array if
+ * it fits in one.
+ */
+value value_private_matrix_row_value(struct value_matrix *m, size_t i)
+{
+	size_t width = m->vector_p ? m->rows : m->cols, start = m->vector_p ? 0 : i * m->cols;
+
+	if (m->kind == PACKED_INT)
+		return value_set_pak_long((long *) m->z + start, width);
+	else if (m->kind == PACKED_FLOAT)
+		return value_set_pak_double(m->f + start, width);
+
+	value res;
+	res.type = VALUE_ARY;
+	if (width == 0)
+		return value_init(VALUE_ARY);
+	value_malloc(&res, width);
+	return_if_error(res);
+	size_t j;
+	for (j = 0; j < width; ++j)
+		res.core.u_a.a[j] = value_set(m->a[start + j]);
+	res.core.u_a.length = width;
+	value_pack_now(&res);
+	return res;
+}
+
+/*
+ * Returns (m) as an NDArray if (like) is one, or as an array of packed rows.
+ */
+value value_private_matrix_value(struct value_matrix *m, value like)
+{
+	value res;
+	size_t i;
+
+	if (like.type == VALUE_NDA) {
+		size_t shape[2] = { m->rows, m->cols };
+		res = value_nd_init(m->vector_p ? 1 : 2, shape, value_nil);
+		return_if_error(res);
+		value *a = res.core.u_nd->data->a;
+		for (i = 0; i < m->rows * m->cols; ++i) {
+			value_clear(&a[i]);
+			a[i] = value_private_matrix_get(m, i);
+		}
+		return res;
+	}
+
+	if (m->vector_p)
+		return value_private_matrix_row_value(m, 0);
+
+	res.type = VALUE_ARY;
+	if (m->rows == 0)
+		return value_init(VALUE_ARY);
+	value_malloc(&res, m->rows);
+	return_if_error(res);
+	res.core.u_a.length = 0;
+	for (i = 0; i < m->rows; ++i) {
+		value row = value_private_matrix_row_value(m, i);
+		if (row.type == VALUE_ERROR) {
+			value_clear(&res);
+			return row;
+		}
+		res.core.u_a.a[res.core.u_a.length++] = row;
+	}
+	return res;
+}
+
+/*
+ * The SIMD kernels. The axpy kernels add (x) times (b) to (r), and the tile kernels add
+ * the product of four rows of (a), (depth) long, and (depth) rows of (b) to four rows of
+ * (c), keeping a tile of (c) in registers while they go down (b). Each one returns the
+ * number of columns it did; the caller does the rest. The tile kernels still add the
+ * products to each element of (c) one at a time in order.
+ */
+#ifdef MATRIX_X86
+
+__attribute__((target("avx2")))
+size_t value_private_matrix_tile_avx2(double c[], size_t ldc, double a[], size_t lda, double b[], size_t ldb, size_t depth, size_t width)
+{
+	size_t j, k, end = width & ~(size_t) 7;
+
+	for (j = 0; j < end; j += 8) {
+		double *r = c + j;
+		__m256d c00 = _mm256_loadu_pd(r), c01 = _mm256_loadu_pd(r + 4);
+		__m256d c10 = _mm256_loadu_pd(r + ldc), c11 = _mm256_loadu_pd(r + ldc + 4);
+		__m256d c20 = _mm256_loadu_pd(r + 2 * ldc), c21 = _mm256_loadu_pd(r + 2 * ldc + 4);
+		__m256d c30 = _mm256_loadu_pd(r + 3 * ldc), c31 = _mm256_loadu_pd(r + 3 * ldc + 4);
+
+		for (k = 0; k < depth; ++k) {
+			__m256d b0 = _mm256_loadu_pd(b + k * ldb + j), b1 = _mm256_loadu_pd(b + k * ldb + j + 4), x;
+			x = _mm256_set1_pd(a[k]);
+			c00 = _mm256_add_pd(c00, _mm256_mul_pd(x, b0));
+			c01 = _mm256_add_pd(c01, _mm256_mul_pd(x, b1));
+			x = _mm256_set1_pd(a[lda + k]);
+			c10 = _mm256_add_pd(c10, _mm256_mul_pd(x, b0));
+			c11 = _mm256_add_pd(c11, _mm256_mul_pd(x, b1));
+			x = _mm256_set1_pd(a[2 * lda + k]);
+			c20 = _mm256_add_pd(c20, _mm256_mul_pd(x, b0));
+			c21 = _mm256_add_pd(c21, _mm256_mul_pd(x, b1));
+			x = _mm256_set1_pd(a[3 * lda + k]);
+			c30 = _mm256_add_pd(c30, _mm256_mul_pd(x, b0));
+			c31 = _mm256_add_pd(c31, _mm256_mul_pd(x, b1));
+		}
+
+		_mm256_storeu_pd(r, c00);
+		_mm256_storeu_pd(r + 4, c01);
+		_mm256_storeu_pd(r + ldc, c10);
+		_mm256_storeu_pd(r + ldc + 4, c11);
+		_mm256_storeu_pd(r + 2 * ldc, c20);
+		_mm256_storeu_pd(r + 2 * ldc + 4, c21);
+		_mm256_storeu_pd(r + 3 * ldc, c30);
+		_mm256_storeu_pd(r + 3 * ldc + 4, c31);
+	}
+
+	// Called often enough that mixing in SSE code afterwards would otherwise be slow.
+	_mm256_zeroupper();
+	return end;
+}
+
+__attribute__((target("sse2")))
+size_t value_private_matrix_tile_sse2(double c[], size_t ldc, double a[], size_t lda, double b[], size_t ldb, size_t depth, size_t width)
+{
+	size_t j, k, end = width & ~(size_t) 3;
+
+	for (j = 0; j < end; j += 4) {
+		double *r = c + j;
+		__m128d c00 = _mm_loadu_pd(r), c01 = _mm_loadu_pd(r + 2);
+		__m128d c10 = _mm_loadu_pd(r + ldc), c11 = _mm_loadu_pd(r + ldc + 2);
+		__m128d c20 = _mm_loadu_pd(r + 2 * ldc), c21 = _mm_loadu_pd(r + 2 * ldc + 2);
+		__m128d c30 = _mm_loadu_pd(r + 3 * ldc), c31 = _mm_loadu_pd(r + 3 * ldc + 2);
+
+		for (k = 0; k < depth; ++k) {
+			__m128d b0 = _mm_loadu_pd(b + k * ldb + j), b1 = _mm_loadu_pd(b + k * ldb + j + 2), x;
+			x = _mm_set1_pd(a[k]);
+			c00 = _mm_add_pd(c00, _mm_mul_pd(x, b0));
+			c01 = _mm_add_pd(c01, _mm_mul_pd(x, b1));
+			x = _mm_set1_pd(a[lda + k]);
+			c10 = _mm_add_pd(c10, _mm_mul_pd(x, b0));
+			c11 = _mm_add_pd(c11, _mm_mul_pd(x, b1));
+			x = _mm_set1_pd(a[2 * lda + k]);
+			c20 = _mm_add_pd(c20, _mm_mul_pd(x, b0));
+			c21 = _mm_add_pd(c21, _mm_mul_pd(x, b1));
+			x = _mm_set1_pd(a[3 * lda + k]);
+			c30 = _mm_add_pd(c30, _mm_mul_pd(x, b0));
+			c31 = _mm_add_pd(c31, _mm_mul_pd(x, b1));
+		}
+
+		_mm_storeu_pd(r, c00);
+		_mm_storeu_pd(r + 2, c01);
+		_mm_storeu_pd(r + ldc, c10);
+		_mm_storeu_pd(r + ldc + 2, c11);
+		_mm_storeu_pd(r + 2 * ldc, c20);
+		_mm_storeu_pd(r + 2 * ldc + 2, c21);
+		_mm_storeu_pd(r + 3 * ldc, c30);
+		_mm_storeu_pd(r + 3 * ldc + 2, c31);
+	}
+
+	return end;
+}
+
+__attribute__((target("avx2")))
+size_t value_private_matrix_axpy_avx2(double r[], double x, double b[], size_t length)
+{
+	__m256d xs = _mm256_set1_pd(x);
+	size_t i, end = length & ~(size_t) 7;
+
+	// Two vectors at a time, so that the adds don't wait on each other.
+	for (i = 0; i < end; i += 8) {
+		__m256d r0 = _mm256_add_pd(_mm256_loadu_pd(r + i), _mm256_mul_pd(xs, _mm256_loadu_pd(b + i)));
+		__m256d r1 = _mm256_add_pd(_mm256_loadu_pd(r + i + 4), _mm256_mul_pd(xs, _mm256_loadu_pd(b + i + 4)));
+		_mm256_storeu_pd(r + i, r0);
+		_mm256_storeu_pd(r + i + 4, r1);
+	}
+	for (end = length & ~(size_t) 3; i < end; i += 4)
+		_mm256_storeu_pd(r + i, _mm256_add_pd(_mm256_loadu_pd(r + i), _mm256_mul_pd(xs, _mm256_loadu_pd(b + i))));
+
+	_mm256_zeroupper();
+	return end;
+}
+
+__attribute__((target("sse2")))
+size_t value_private_matrix_axpy_sse2(double r[], double x, double b[], size_t length)
+{
+	__m128d xs = _mm_set1_pd(x);
+	size_t i, end = length & ~(size_t) 1;
+
+	for (i = 0; i < end; i += 2)
+		_mm_storeu_pd(r + i, _mm_add_pd(_mm_loadu_pd(r + i), _mm_mul_pd(xs, _mm_loadu_pd(b + i))));
+
+	return end;
+}
+
+#endif
+
+void value_private_matrix_axpy(double r[], double x, double b[], size_t length)
+{
+	size_t i = 0;
+
+#ifdef MATRIX_X86
+	if (value_vector_level() == VECTOR_AVX2)
+		i = value_private_matrix_axpy_avx2(r, x, b, length);
+	else if (value_vector_level() == VECTOR_SSE2)
+		i = value_private_matrix_axpy_sse2(r, x, b, length);
+#endif
+
+	for (; i < length; ++i)
+		r[i] += x * b[i];
+}
+
+/*
+ * Adds the product of (rows) rows of (a), (depth) long, and (depth) rows of (b) to (rows)
+ * rows of (c), (width) wide. (lda), (ldb) and (ldc) are the lengths of whole rows.
+ */
+void value_private_matrix_tile(double c[], size_t ldc, double a[], size_t lda, double b[], size_t ldb, size_t rows, size_t depth, size_t width)
+{
+	size_t i, k, j = 0;
+
+#ifdef MATRIX_X86
+	if (rows == 4 && value_vector_level() == VECTOR_AVX2)
+		j = value_private_matrix_tile_avx2(c, ldc, a, lda, b, ldb, depth, width);
+	else if (rows == 4 && value_vector_level() == VECTOR_SSE2)
+		j = value_private_matrix_tile_sse2(c, ldc, a, lda, b, ldb, depth, width);
+#endif
+
+	if (j < width)
+		for (i = 0; i < rows; ++i)
+			for (k = 0; k < depth; ++k)
+				value_private_matrix_axpy(c + i * ldc + j, a[i * lda + k], b + k * ldb + j, width - j);
+}
+
+/*
+ * Rows (lo) through (hi - 1) of the product of (a) and (b), which are doubles, into (c).
+ */
+void value_private_matrix_mul_float(struct value_matrix *a, struct value_matrix *b, struct value_matrix *c, size_t lo, size_t hi)
+{
+	size_t n = a->cols, p = b->cols;
+	size_t i, jj, kk;
+
+	memset(c->f + lo * p, 0, sizeof(double) * (hi - lo) * p);
+	for (jj = 0; jj < p; jj += MATRIX_BLOCK) {
+		size_t width = p - jj < MATRIX_BLOCK ? p - jj : MATRIX_BLOCK;
+		for (kk = 0; kk < n; kk += MATRIX_BLOCK) {
+			size_t depth = n - kk < MATRIX_BLOCK ? n - kk : MATRIX_BLOCK;
+			for (i = lo; i < hi; i += 4)
+				value_private_matrix_tile(c->f + i * p + jj, p, a->f + i * n + kk, n, b->f + kk * p + jj, p,
+						hi - i < 4 ? hi - i : 4, depth, width);
+		}
+	}
+}
+
+/*
+ * Like value_private_matrix_mul_float(), for integers. Returns TRUE if one overflowed.
+ */
+int value_private_matrix_mul_int(struct value_matrix *a, struct value_matrix *b, struct value_matrix *c, size_t lo, size_t hi)
+{
+	size_t n = a->cols, p = b->cols;
+	size_t i, j, k, jj, kk;
+	int64_t product;
+
+	memset(c->z + lo * p, 0, sizeof(int64_t) * (hi - lo) * p);
+	for (jj = 0; jj < p; jj += MATRIX_BLOCK) {
+		size_t jend = p - jj < MATRIX_BLOCK ? p : jj + MATRIX_BLOCK;
+		for (kk = 0; kk < n; kk += MATRIX_BLOCK) {
+			size_t kend = n - kk < MATRIX_BLOCK ? n : kk + MATRIX_BLOCK;
+			for (i = lo; i < hi; ++i) {
+				int64_t *row = a->z + i * n, *r = c->z + i * p;
+				for (k = kk; k < kend; ++k) {
+					int64_t x = row[k], *y = b->z + k * p;
+					for (j = jj; j < jend; ++j)
+						if (__builtin_mul_overflow(x, y[j], &product) || __builtin_add_overflow(r[j], product, &r[j]))
+							return TRUE;
+				}
+			}
+		}
+	}
+
+	return FALSE;
+}
+
+/*
+ * Rows (lo) through (hi - 1) of the product of (a) and the vector (b) into (c). Returns
+ * TRUE if an integer overflowed.
+ */
+int value_private_matrix_mul_vector(struct value_matrix *a, struct value_matrix *b, struct value_matrix *c, size_t lo, size_t hi)
+{
+	size_t n = a->cols, i, k;
+	int64_t product;
+
+	for (i = lo; i < hi; ++i) {
+		if (a->kind == PACKED_FLOAT) {
+			c->f[i] = value_private_vector_dot_float(a->f + i * n, b->f, n);
+		} else {
+			int64_t *row = a->z + i * n, sum = 0;
+			for (k = 0; k < n; ++k)
+				if (__builtin_mul_overflow(row[k], b->z[k], &product) || __builtin_add_overflow(sum, product, &sum))
+					return TRUE;
+			c->z[i] = sum;
+		}
+	}
+
+	return FALSE;
+}
+
+/*
+ * Does the rows of (c) that belong to (worker).
+ */
+void *value_private_matrix_worker(void *arg)
+{
+	struct value_matrix_worker *worker = arg;
+	struct value_matrix_team *team = worker->team;
+	size_t rows = team->c->rows;
+	size_t lo = rows * worker->id / team->threads, hi = rows * (worker->id + 1) / team->threads;
+
+	if (team->b->vector_p)
+		worker->bad_p = value_private_matrix_mul_vector(team->a, team->b, team->c, lo, hi);
+	else if (team->a->kind == PACKED_FLOAT)
+		value_private_matrix_mul_float(team->a, team->b, team->c, lo, hi);
+	else worker->bad_p = value_private_matrix_mul_int(team->a, team->b, team->c, lo, hi);
+	return NULL;
+}
+
+/*
+ * The product of (a) and (b), which are both integers or both doubles, into (c) on
+ * (threads) threads. Returns TRUE if an integer overflowed or a double came out as
+ * something MPFR wouldn't give.
+ */
+int value_private_matrix_mul_fast(struct value_matrix *a, struct value_matrix *b, struct value_matrix *c, int threads)
+{
+	struct value_matrix_team team;
+	size_t i;
+	int t, bad_p = FALSE;
+
+	if (threads > SORT_MAX_THREADS)
+		threads = SORT_MAX_THREADS;
+	if (threads > c->rows)
+		threads = c->rows ? (int) c->rows : 1;
+	if (threads < 1)
+		threads = 1;
+
+	team.a = a;
+	team.b = b;
+	team.c = c;
+	team.threads = threads;
+
+	struct value_matrix_worker workers[threads];
+	pthread_t ids[threads];
+	int started[threads];
+	for (t = 0; t < threads; ++t) {
+		workers[t].team = &team;
+		workers[t].id = t;
+		workers[t].bad_p = FALSE;
+		started[t] = t > 0 && pthread_create(&ids[t], NULL, &value_private_matrix_worker, &workers[t]) == 0;
+	}
+
+	for (t = 0; t < threads; ++t)
+		if (started[t] == FALSE)
+			value_private_matrix_worker(&workers[t]);
+	for (t = 1; t < threads; ++t)
+		if (started[t])
+			pthread_join(ids[t], NULL);
+
+	for (t = 0; t < threads; ++t)
+		bad_p |= workers[t].bad_p;
+	if (c->kind == PACKED_FLOAT)
+		for (i = 0; i < c->rows * c->cols && bad_p == FALSE; ++i)
+			bad_p = value_private_vector_unpackable_p(c->f[i]);
+	return bad_p;
+}
+
+/*
+ * The slow way, with value_mul() and value_add().
+ */
+int value_private_matrix_mul_generic(struct value_matrix *a, struct value_matrix *b, struct value_matrix *c)
+{
+	size_t n = a->cols, p = b->cols;
+	size_t i, j, k;
+
+	for (i = 0; i < c->rows; ++i)
+		for (j = 0; j < p; ++j) {
+			value sum = value_set_long(0);
+			for (k = 0; k < n; ++k) {
+				value product = value_mul(a->a[i * n + k], b->a[k * p + j]);
+				if (product.type == VALUE_ERROR) {
+					value_clear(&sum);
+					return VALUE_ERROR;
+				}
+				value_add_now(&sum, product);
+				value_clear(&product);
+			}
+			value_clear(&c->a[i * p + j]);
+			c->a[i * p + j] = sum;
+		}
+
+	return 0;
+}
+
+/*
+ * Does matmul() or matvec(). (vector_p) says which one.
+ */
+value value_private_matmul(value op1, value op2, int vector_p, char *name)
+{
+	struct value_matrix a, b, c;
+	value res;
+
+	if (value_private_matrix_read(&a, op1, name, "op1") == VALUE_ERROR)
+		return value_init_error();
+	if (value_private_matrix_read(&b, op2, name, "op2") == VALUE_ERROR) {
+		value_private_matrix_free(&a);
+		return value_init_error();
+	}
+
+	if (a.vector_p) {
+		value_error(1, "Type Error: %c is undefined where op1 is %s (matrix expected).", name, op1);
+		res = value_init_error();
+	} else if (vector_p && !b.vector_p) {
+		value_error(1, "Type Error: %c is undefined where op2 is %s (vector expected).", name, op2);
+		res = value_init_error();
+	} else if (a.cols != b.rows) {
+		value_error(1, "Domain Error: %c is undefined where op1 has %ld columns and op2 has %ld rows.", name, (long) a.cols, (long) b.rows);
+		res = value_init_error();
+	} else if (value_private_matrix_unify(&a, &b) == VALUE_ERROR
+			|| value_private_matrix_init(&c, a.kind, a.rows, b.cols, b.vector_p) == VALUE_ERROR) {
+		res = value_init_error();
+	} else {
+		int bad_p = a.kind == PACKED_NONE;
+		if (bad_p == FALSE) {
+			int threads = a.rows * a.cols * b.cols >= value_matrix_parallel_threshold() ? value_sort_threads() : 1;
+			bad_p = value_private_matrix_mul_fast(&a, &b, &c, threads);
+		}
+
+		if (bad_p && a.kind != PACKED_NONE) {
+			value_private_matrix_free(&c);
+			if (value_private_matrix_convert(&a, PACKED_NONE) == VALUE_ERROR || value_private_matrix_convert(&b, PACKED_NONE) == VALUE_ERROR
+					|| value_private_matrix_init(&c, PACKED_NONE, a.rows, b.cols, b.vector_p) == VALUE_ERROR) {
+				value_private_matrix_free(&a);
+				value_private_matrix_free(&b);
+				return value_init_error();
+			}
+		}
+
+		if (bad_p && value_private_matrix_mul_generic(&a, &b, &c) == VALUE_ERROR)
+			res = value_init_error();
+		else res = value_private_matrix_value(&c, op1);
+		value_private_matrix_free(&c);
+	}
+
+	value_private_matrix_free(&a);
+	value_private_matrix_free(&b);
+	return res;
+}
+
+value value_matmul(value op1, value op2)
+{
+	return value_private_matmul(op1, op2, FALSE, "matmul()");
+}
+
+value value_matvec(value op1, value op2)
+{
+	return value_private_matmul(op1, op2, TRUE, "matvec()");
+}
+
+/*
+ * Transposes an array of rows. The elements are copied a block at a time, so that the
+ * rows being read and the rows being written both stay in the cache.
+ */
+value value_matrix_transpose(value op)
+{
+	struct value_matrix m;
+	size_t i, j, ii, jj;
+
+	if (op.type != VALUE_ARY || op.core.u_a.length == 0 || (op.core.u_a.a[0].type != VALUE_ARY && op.core.u_a.a[0].type != VALUE_PAK)) {
+		value_error(1, "Type Error: transpose() is undefined where op is %ts (matrix expected).", op);
+		return value_init_error();
+	}
+
+	if (value_private_matrix_read(&m, op, "transpose()", "op") == VALUE_ERROR)
+		return value_init_error();
+
+	struct value_matrix t;
+	if (value_private_matrix_init(&t, m.kind, m.cols, m.rows, FALSE) == VALUE_ERROR) {
+		value_private_matrix_free(&m);
+		return value_init_error();
+	}
+
+	for (ii = 0; ii < m.rows; ii += MATRIX_BLOCK)
+		for (jj = 0; jj < m.cols; jj += MATRIX_BLOCK) {
+			size_t iend = m.rows - ii < MATRIX_BLOCK ? m.rows : ii + MATRIX_BLOCK;
+			size_t jend = m.cols - jj < MATRIX_BLOCK ? m.cols : jj + MATRIX_BLOCK;
+			for (i = ii; i < iend; ++i)
+				for (j = jj; j < jend; ++j) {
+					size_t from = i * m.cols + j, to = j * m.rows + i;
+					if (m.kind == PACKED_INT)
+						t.z[to] = m.z[from];
+					else if (m.kind == PACKED_FLOAT)
+						t.f[to] = m.f[from];
+					else {
+						t.a[to] = m.a[from];
+						m.a[from] = value_init_nil();
+					}
+				}
+		}
+
+	value res = value_private_matrix_value(&t, op);
+	value_private_matrix_free(&m);
+	value_private_matrix_free(&t);
+	return res;
+}
+
+/*
+ * Gaussian elimination on doubles. (lu) is (n) by (n) and (x) is (n) by (m); both are
+ * overwritten, and (x) ends up holding the solution. Returns FALSE if the matrix is
+ * singular.
+ */
+int value_private_matrix_solve_float(double lu[], double x[], size_t n, size_t m)
+{
+	size_t i, j, k, pivot;
+	double tmp;
+
+	for (k = 0; k < n; ++k) {
+		pivot = k;
+		for (i = k + 1; i < n; ++i)
+			if (fabs(lu[i * n + k]) > fabs(lu[pivot * n + k]))
+				pivot = i;
+		if (lu[pivot * n + k] == 0)
+			return FALSE;
+
+		if (pivot != k) {
+			for (j = 0; j < n; ++j) {
+				tmp = lu[k * n + j]; lu[k * n + j] = lu[pivot * n + j]; lu[pivot * n + j] = tmp;
+			}
+			for (j = 0; j < m; ++j) {
+				tmp = x[k * m + j]; x[k * m + j] = x[pivot * m + j]; x[pivot * m + j] = tmp;
+			}
+		}
+
+		for (i = k + 1; i < n; ++i) {
+			double l = lu[i * n + k] / lu[k * n + k];
+			lu[i * n + k] = l;
+			value_private_matrix_axpy(lu + i * n + k + 1, -l, lu + k * n + k + 1, n - k - 1);
+			value_private_matrix_axpy(x + i * m, -l, x + k * m, m);
+		}
+	}
+
+	for (i = n; i-- > 0; ) {
+		for (k = i + 1; k < n; ++k)
+			value_private_matrix_axpy(x + i * m, -lu[i * n + k], x + k * m, m);
+		for (j = 0; j < m; ++j)
+			x[i * m + j] /= lu[i * n + i];
+	}
+
+	return TRUE;
+}
+
+/*
+ * The same steps with MPFR floats. Returns FALSE if the matrix is singular, and
+ * VALUE_ERROR if an operation fails.
+ */
+int value_private_matrix_solve_generic(value lu[], value x[], size_t n, size_t m)
+{
+	size_t i, j, k, pivot;
+	value tmp;
+
+	for (i = 0; i < n * n; ++i) {
+		tmp = value_cast(lu[i], VALUE_MPF);
+		if (tmp.type == VALUE_ERROR)
+			return VALUE_ERROR;
+		value_clear(&lu[i]);
+		lu[i] = tmp;
+	}
+	for (i = 0; i < n * m; ++i) {
+		tmp = value_cast(x[i], VALUE_MPF);
+		if (tmp.type == VALUE_ERROR)
+			return VALUE_ERROR;
+		value_clear(&x[i]);
+		x[i] = tmp;
+	}
+
+	for (k = 0; k < n; ++k) {
+		pivot = k;
+		for (i = k + 1; i < n; ++i)
+			if (mpfr_cmpabs(lu[i * n + k].core.u_mf, lu[pivot * n + k].core.u_mf) > 0)
+				pivot = i;
+		if (mpfr_zero_p(lu[pivot * n + k].core.u_mf))
+			return FALSE;
+
+		if (pivot != k) {
+			for (j = 0; j < n; ++j) {
+				tmp = lu[k * n + j]; lu[k * n + j] = lu[pivot * n + j]; lu[pivot * n + j] = tmp;
+			}
+			for (j = 0; j < m; ++j) {
+				tmp = x[k * m + j]; x[k * m + j] = x[pivot * m + j]; x[pivot * m + j] = tmp;
+			}
+		}
+
+		for (i = k + 1; i < n; ++i) {
+			value l = value_div(lu[i * n + k], lu[k * n + k]);
+			if (l.type == VALUE_ERROR)
+				return VALUE_ERROR;
+			for (j = k + 1; j < n; ++j) {
+				tmp = value_mul(l, lu[k * n + j]);
+				value_sub_now(&lu[i * n + j], tmp);
+				value_clear(&tmp);
+			}
+			for (j = 0; j < m; ++j) {
+				tmp = value_mul(l, x[k * m + j]);
+				value_sub_now(&x[i * m + j], tmp);
+				value_clear(&tmp);
+			}
+			value_clear(&lu[i * n + k]);
+			lu[i * n + k] = l;
+		}
+	}
+
+	for (i = n; i-- > 0; ) {
+		for (k = i + 1; k < n; ++k)
+			for (j = 0; j < m; ++j) {
+				tmp = value_mul(lu[i * n + k], x[k * m + j]);
+				value_sub_now(&x[i * m + j], tmp);
+				value_clear(&tmp);
+			}
+		for (j = 0; j < m; ++j) {
+			tmp = value_div(x[i * m + j], lu[i * n + i]);
+			value_clear(&x[i * m + j]);
+			x[i * m + j] = tmp;
+		}
+	}
+
+	return TRUE;
+}
+
+value value_solve(value op1, value op2)
+{
+	struct value_matrix a, b;
+	value res = value_init_nil();
+
+	if (value_private_matrix_read(&a, op1, "solve()", "op1") == VALUE_ERROR)
+		return value_init_error();
+	if (value_private_matrix_read(&b, op2, "solve()", "op2") == VALUE_ERROR) {
+		value_private_matrix_free(&a);
+		return value_init_error();
+	}
+
+	if (a.vector_p || a.rows != a.cols) {
+		value_error(1, "Type Error: solve() is undefined where op1 is %s (square matrix expected).", op1);
+		res = value_init_error();
+	} else if (a.rows != b.rows) {
+		value_error(1, "Domain Error: solve() is undefined where op1 has %ld rows and op2 has %ld.", (long) a.rows, (long) b.rows);
+		res = value_init_error();
+	} else if (value_private_matrix_unify(&a, &b) == VALUE_ERROR || value_private_matrix_convert(&a, PACKED_FLOAT) == VALUE_ERROR
+			|| value_private_matrix_convert(&b, PACKED_FLOAT) == VALUE_ERROR) {
+		res = value_init_error();
+	} else {
+		int solved_p = VALUE_ERROR;
+		size_t i;
+
+		if (a.kind == PACKED_FLOAT) {
+			solved_p = value_private_matrix_solve_float(a.f, b.f, a.rows, b.cols);
+			for (i = 0; i < b.rows * b.cols && solved_p == TRUE; ++i)
+				if (value_private_vector_unpackable_p(b.f[i]))
+					solved_p = VALUE_ERROR;
+		}
+
+		if (solved_p == VALUE_ERROR) {
+			// Start over from the original numbers with MPFR.
+			value_private_matrix_free(&a);
+			value_private_matrix_free(&b);
+			if (value_private_matrix_read(&a, op1, "solve()", "op1") == VALUE_ERROR)
+				return value_init_error();
+			if (value_private_matrix_read(&b, op2, "solve()", "op2") == VALUE_ERROR
+					|| value_private_matrix_convert(&a, PACKED_NONE) == VALUE_ERROR
+					|| value_private_matrix_convert(&b, PACKED_NONE) == VALUE_ERROR) {
+				value_private_matrix_free(&a);
+				value_private_matrix_free(&b);
+				return value_init_error();
+			}
+			solved_p = value_private_matrix_solve_generic(a.a, b.a, a.rows, b.cols);
+		}
+
+		if (solved_p == FALSE) {
+			value_error(1, "Domain Error: solve() is undefined where op1 is %s (nonsingular matrix expected).", op1);
+			res = value_init_error();
+		} else if (solved_p == VALUE_ERROR) {
+			res = value_init_error();
+		} else res = value_private_matrix_value(&b, op1);
+	}
+
+	value_private_matrix_free(&a);
+	value_private_matrix_free(&b);
+	return res;
+}
+
+value value_matmul_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "matmul()") ? value_init_error() : value_matmul(argv[0], argv[1]);
+}
+
+value value_matvec_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "matvec()") ? value_init_error() : value_matvec(argv[0], argv[1]);
+}
+
+value value_solve_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "solve()") ? value_init_error() : value_solve(argv[0], argv[1]);
+}
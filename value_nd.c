@@ -0,0 +1,590 @@
+/*
+ *  value_nd.c
+ *  Simfpl
+ *
+ *  All definitions for functions and variables in value_nd.c can be found in value.h.
+ *
+ */
+
+/*
+ * N-Dimensional Array Implementation
+ *
+ * An array of arrays keeps every row in an allocation of its own, so indexing a grid
+ * follows one pointer per dimension, and slicing it copies the rows. An n-dimensional
+ * array keeps all of its elements in a single block, a value_nd_data, and finds
+ * element (i, j, ...) at offset + i * strides[0] + j * strides[1] + ... in it.
+ *
+ * Slicing, transposing and reshaping only make a new header with a different offset,
+ * shape and strides, so the result shares the block instead of copying it. value_set()
+ * shares the block too. The block counts the headers that use it and is freed along
+ * with the last one. Before an element is changed, value_nd_own() copies the elements
+ * if any other array still uses them, so changing one array never changes another.
+ *
+ * Built-in functions that haven't been taught about n-dimensional arrays are handed
+ * nested arrays instead, the same way that value_bifcall_sexp() unpacks packed arrays.
+ */
+
+#include "value.h"
+
+value value_nd_init(int rank, size_t shape[], value fill)
+{
+	size_t i, length = 1;
+	for (i = 0; i < rank; ++i) {
+		if (shape[i] && length > (size_t) LONG_MAX / sizeof(value) / shape[i]) {
+			value_error(1, "Memory Error: An n-dimensional array of that shape is too large.");
+			return value_init_error();
+		}
+		length *= shape[i];
+	}
+
+	value res;
+	res.type = VALUE_NDA;
+	res.core.u_nd = value_malloc(NULL, sizeof(struct value_nd));
+	return_if_null(res.core.u_nd);
+
+	struct value_nd *nd = res.core.u_nd;
+	nd->data = value_malloc(NULL, sizeof(struct value_nd_data));
+	if (nd->data == NULL) {
+		value_free(nd);
+		return value_init_error();
+	}
+
+	nd->data->a = value_malloc(NULL, sizeof(value) * (length ? length : 1));
+	if (nd->data->a == NULL) {
+		value_free(nd->data);
+		value_free(nd);
+		return value_init_error();
+	}
+
+	nd->data->refcount = 1;
+	nd->data->length = length;
+	nd->offset = 0;
+	nd->rank = rank;
+	memcpy(nd->shape, shape, sizeof(size_t) * rank);
+	value_private_nd_strides(nd);
+
+	for (i = 0; i < length; ++i)
+		nd->data->a[i] = value_set(fill);
+
+	return res;
+}
+
+value value_ndarray(value shape, value fill)
+{
+	size_t dims[ND_MAX_RANK];
+	int rank = value_private_nd_read_shape(shape, dims, "ndarray()");
+	if (rank == VALUE_ERROR)
+		return value_init_error();
+
+	if (fill.type == VALUE_MISSING_ARG || fill.type == VALUE_NIL)
+		return value_nd_init(rank, dims, value_zero);
+	return value_nd_init(rank, dims, fill);
+}
+
+int value_private_nd_read_shape(value shape, size_t dims[], char *name)
+{
+	if (shape.type == VALUE_PAK) {
+		value ary = value_unpack(shape);
+		if (ary.type == VALUE_ERROR)
+			return VALUE_ERROR;
+		int rank = value_private_nd_read_shape(ary, dims, name);
+		value_clear(&ary);
+		return rank;
+	} else if (shape.type == VALUE_MPZ) {
+		shape = value_set_ary_ref(&shape, 1);
+		int rank = value_private_nd_read_shape(shape, dims, name);
+		value_free_elements(shape.core.u_a.a);
+		return rank;
+	} else if (shape.type != VALUE_ARY) {
+		value_error(1, "Type Error: %c is undefined where the shape is %ts (array of integers expected).", name, shape);
+		return VALUE_ERROR;
+	} else if (shape.core.u_a.length == 0 || shape.core.u_a.length > ND_MAX_RANK) {
+		value_error(1, "Domain Error: %c is undefined where the shape is %s (1 to %d dimensions expected).", name, shape, ND_MAX_RANK);
+		return VALUE_ERROR;
+	}
+
+	size_t i;
+	for (i = 0; i < shape.core.u_a.length; ++i) {
+		value dim = shape.core.u_a.a[i];
+		if (dim.type != VALUE_MPZ || value_lt(dim, value_zero) || value_gt(dim, value_int_max)) {
+			value_error(1, "Domain Error: %c is undefined where the shape is %s (array of integers greater than or equal to 0 expected).", name, shape);
+			return VALUE_ERROR;
+		}
+		dims[i] = value_get_long(dim);
+	}
+
+	return (int) shape.core.u_a.length;
+}
+
+void value_private_nd_strides(struct value_nd *nd)
+{
+	size_t stride = 1;
+	int i;
+	for (i = nd->rank - 1; i >= 0; --i) {
+		nd->strides[i] = stride;
+		stride *= nd->shape[i];
+	}
+}
+
+int value_private_nd_contiguous_p(struct value_nd *nd)
+{
+	size_t stride = 1;
+	int i;
+	for (i = nd->rank - 1; i >= 0; --i) {
+		// The stride of a dimension of length 1 doesn't matter.
+		if (nd->shape[i] != 1 && nd->strides[i] != stride)
+			return FALSE;
+		stride *= nd->shape[i];
+	}
+	return TRUE;
+}
+
+size_t value_nd_size(value op)
+{
+	size_t length = 1;
+	int i;
+	for (i = 0; i < op.core.u_nd->rank; ++i)
+		length *= op.core.u_nd->shape[i];
+	return length;
+}
+
+size_t value_private_nd_offset(struct value_nd *nd, size_t i)
+{
+	size_t offset = nd->offset;
+	int d;
+	for (d = nd->rank - 1; d >= 0; --d) {
+		offset += (i % nd->shape[d]) * nd->strides[d];
+		i /= nd->shape[d];
+	}
+	return offset;
+}
+
+value value_nd_set(value op)
+{
+	value res;
+	res.type = VALUE_NDA;
+	res.core.u_nd = value_malloc(NULL, sizeof(struct value_nd));
+	return_if_null(res.core.u_nd);
+	*res.core.u_nd = *op.core.u_nd;
+	++res.core.u_nd->data->refcount;
+	return res;
+}
+
+void value_nd_clear(value *op)
+{
+	struct value_nd *nd = op->core.u_nd;
+	if (nd == NULL)
+		return;
+
+	if (--nd->data->refcount == 0) {
+		size_t i;
+		for (i = 0; i < nd->data->length; ++i)
+			value_clear(&nd->data->a[i]);
+		value_free(nd->data->a);
+		value_free(nd->data);
+	}
+	value_free(nd);
+}
+
+/*
+ * Copies the elements of (op) into a block of their own, in row-major order.
+ */
+value value_private_nd_copy(value op)
+{
+	struct value_nd *nd = op.core.u_nd;
+	value res = value_nd_init(nd->rank, nd->shape, value_nil);
+	return_if_error(res);
+
+	size_t i, length = value_nd_size(op);
+	value *a = res.core.u_nd->data->a;
+	if (value_private_nd_contiguous_p(nd)) {
+		for (i = 0; i < length; ++i)
+			a[i] = value_set(nd->data->a[nd->offset + i]);
+	} else {
+		for (i = 0; i < length; ++i)
+			a[i] = value_set(nd->data->a[value_private_nd_offset(nd, i)]);
+	}
+
+	return res;
+}
+
+int value_nd_own(value *op)
+{
+	struct value_nd *nd = op->core.u_nd;
+	if (nd->data->refcount == 1)
+		return 0;
+
+	value copy = value_private_nd_copy(*op);
+	if (copy.type == VALUE_ERROR)
+		return VALUE_ERROR;
+
+	// The header is changed in place, since it may be an element of another container.
+	--nd->data->refcount;
+	*nd = *copy.core.u_nd;
+	value_free(copy.core.u_nd);
+	return 0;
+}
+
+int value_private_nd_shape(value op, int *rank, size_t shape[])
+{
+	*rank = 0;
+	while (op.type == VALUE_ARY || op.type == VALUE_PAK) {
+		if (*rank == ND_MAX_RANK)
+			return FALSE;
+		shape[(*rank)++] = value_length(op);
+		if (value_length(op) == 0 || op.type == VALUE_PAK)
+			break;
+		op = op.core.u_a.a[0];
+	}
+
+	return *rank > 0;
+}
+
+/*
+ * Copies the elements of (op), which has the given shape from dimension (d) on, into
+ * (a) in row-major order. Returns FALSE if some array is the wrong length.
+ */
+int value_private_nd_fill(value op, int rank, size_t shape[], int d, value **a)
+{
+	size_t i;
+	if ((op.type != VALUE_ARY && op.type != VALUE_PAK) || value_length(op) != shape[d])
+		return FALSE;
+
+	for (i = 0; i < shape[d]; ++i) {
+		if (d + 1 < rank) {
+			if (op.type == VALUE_PAK || value_private_nd_fill(op.core.u_a.a[i], rank, shape, d + 1, a) == FALSE)
+				return FALSE;
+		} else {
+			value_clear(*a);
+			*((*a)++) = op.type == VALUE_PAK ? value_packed_get(op, i) : value_set(op.core.u_a.a[i]);
+		}
+	}
+
+	return TRUE;
+}
+
+value value_private_to_nd(value op, int quiet_p)
+{
+	if (op.type == VALUE_NDA)
+		return value_set(op);
+
+	int rank;
+	size_t shape[ND_MAX_RANK];
+	if (value_private_nd_shape(op, &rank, shape) == FALSE) {
+		if (!quiet_p)
+			value_error(1, "Type Error: to_nd() is undefined where op is %ts (array with at most %d levels expected).", op, ND_MAX_RANK);
+		return value_init_error();
+	}
+
+	value res = value_nd_init(rank, shape, value_nil);
+	return_if_error(res);
+
+	value *a = res.core.u_nd->data->a;
+	if (value_private_nd_fill(op, rank, shape, 0, &a) == FALSE) {
+		if (!quiet_p)
+			value_error(1, "Domain Error: to_nd() is undefined where op is %s (arrays of the same length at each level expected).", op);
+		value_clear(&res);
+		return value_init_error();
+	}
+
+	return res;
+}
+
+value value_to_nd(value op)
+{
+	return value_private_to_nd(op, FALSE);
+}
+
+int value_to_nd_now(value *op)
+{
+	value res = value_private_to_nd(*op, TRUE);
+	if (res.type == VALUE_ERROR)
+		return VALUE_ERROR;
+	value_clear(op);
+	*op = res;
+	return 0;
+}
+
+/*
+ * Builds the nested arrays for dimension (d) on, starting at (offset).
+ */
+value value_private_nd_to_a(struct value_nd *nd, int d, size_t offset)
+{
+	size_t i, length = nd->shape[d];
+	value res;
+	res.type = VALUE_ARY;
+	if (length == 0)
+		return value_init(VALUE_ARY);
+	value_malloc(&res, length);
+	return_if_error(res);
+
+	for (i = 0; i < length; ++i, offset += nd->strides[d]) {
+		if (d + 1 < nd->rank)
+			res.core.u_a.a[i] = value_private_nd_to_a(nd, d + 1, offset);
+		else res.core.u_a.a[i] = value_set(nd->data->a[offset]);
+	}
+	res.core.u_a.length = length;
+
+	return res;
+}
+
+value value_nd_to_a(value op)
+{
+	if (op.type != VALUE_NDA)
+		return value_set(op);
+	return value_private_nd_to_a(op.core.u_nd, 0, op.core.u_nd->offset);
+}
+
+/*
+ * Narrows (nd) down to what (indices) select. An integer picks one position and drops
+ * its dimension, a range keeps the positions in it, and the dimensions past the last
+ * index are kept whole. Returns FALSE after reporting an error if an index doesn't fit.
+ */
+int value_private_nd_select(struct value_nd *nd, value indices[], size_t count, char *name)
+{
+	struct value_nd res = *nd;
+	int d;
+
+	if (count > nd->rank) {
+		value_error(1, "Argument Error: in %c, %ld indices are too many for an array with %d dimensions.", name, (long) count, nd->rank);
+		return FALSE;
+	}
+
+	res.rank = 0;
+	for (d = 0; d < nd->rank; ++d) {
+		if (d >= count) {
+			res.shape[res.rank] = nd->shape[d];
+			res.strides[res.rank++] = nd->strides[d];
+			continue;
+		}
+
+		value index = indices[d];
+		if (index.type == VALUE_MPZ) {
+			if (value_lt(index, value_zero) || value_gt(index, value_int_max) || value_get_long(index) >= nd->shape[d]) {
+				value_error(1, "Domain Error: in %c, index %s is beyond the bounds of dimension %d (length %ld).", name, index, d, (long) nd->shape[d]);
+				return FALSE;
+			}
+			res.offset += value_get_long(index) * nd->strides[d];
+
+		} else if (index.type == VALUE_RNG && index.core.u_r->min.type == VALUE_MPZ && index.core.u_r->max.type == VALUE_MPZ) {
+			value min = index.core.u_r->min, max = index.core.u_r->max;
+			if (value_lt(min, value_zero) || value_gt(min, max) || value_gt(max, value_int_max)) {
+				value_error(1, "Domain Error: in %c, range %s is beyond the bounds of dimension %d (length %ld).", name, index, d, (long) nd->shape[d]);
+				return FALSE;
+			}
+			size_t start = value_get_long(min), end = value_get_long(max) + (index.core.u_r->inclusive_p ? 1 : 0);
+			if (end > nd->shape[d]) {
+				value_error(1, "Domain Error: in %c, range %s is beyond the bounds of dimension %d (length %ld).", name, index, d, (long) nd->shape[d]);
+				return FALSE;
+			}
+			res.offset += start * nd->strides[d];
+			res.shape[res.rank] = end - start;
+			res.strides[res.rank++] = nd->strides[d];
+
+		} else {
+			value_error(1, "Type Error: %c is undefined where index %d is %ts (integer or range expected).", name, d, index);
+			return FALSE;
+		}
+	}
+
+	*nd = res;
+	return TRUE;
+}
+
+value value_nd_at(value op, value index, value more[], size_t length)
+{
+	size_t i, count = length + 1;
+	value indices[count];
+	indices[0] = index;
+	for (i = 0; i < length; ++i)
+		indices[i+1] = more[i];
+
+	struct value_nd view = *op.core.u_nd;
+	if (value_private_nd_select(&view, indices, count, "at()") == FALSE)
+		return value_init_error();
+
+	if (view.rank == 0)
+		return value_set(view.data->a[view.offset]);
+
+	value res;
+	res.type = VALUE_NDA;
+	res.core.u_nd = value_malloc(NULL, sizeof(struct value_nd));
+	return_if_null(res.core.u_nd);
+	*res.core.u_nd = view;
+	++view.data->refcount;
+	return res;
+}
+
+value * value_nd_at_ref(value op, value index, value more[], size_t length)
+{
+	size_t i, count = length + 1;
+	value indices[count];
+	indices[0] = index;
+	for (i = 0; i < length; ++i)
+		indices[i+1] = more[i];
+
+	if (value_nd_own(&op) == VALUE_ERROR)
+		return NULL;
+
+	struct value_nd view = *op.core.u_nd;
+	if (value_private_nd_select(&view, indices, count, "at=()") == FALSE)
+		return NULL;
+
+	if (view.rank != 0) {
+		value_error(1, "Argument Error: in at=(), an array with %d dimensions needs an integer index for each one.", op.core.u_nd->rank);
+		return NULL;
+	}
+
+	return &view.data->a[view.offset];
+}
+
+value value_shape(value op)
+{
+	if (op.type == VALUE_NDA) {
+		long shape[ND_MAX_RANK];
+		int i;
+		for (i = 0; i < op.core.u_nd->rank; ++i)
+			shape[i] = (long) op.core.u_nd->shape[i];
+		return value_set_ary_long(shape, op.core.u_nd->rank);
+	} else if (op.type == VALUE_ARY || op.type == VALUE_PAK) {
+		long length = (long) value_length(op);
+		return value_set_ary_long(&length, 1);
+	}
+
+	value_error(1, "Type Error: shape() is undefined where op is %ts (array expected).", op);
+	return value_init_error();
+}
+
+value value_transpose(value op)
+{
+	if (op.type != VALUE_NDA)
+		return value_matrix_transpose(op);
+
+	value res = value_nd_set(op);
+	return_if_error(res);
+
+	struct value_nd *nd = res.core.u_nd;
+	int i, rank = nd->rank;
+	for (i = 0; i < rank; ++i) {
+		nd->shape[i] = op.core.u_nd->shape[rank - 1 - i];
+		nd->strides[i] = op.core.u_nd->strides[rank - 1 - i];
+	}
+
+	return res;
+}
+
+value value_reshape(value op, value shape)
+{
+	size_t dims[ND_MAX_RANK];
+	int i, rank = value_private_nd_read_shape(shape, dims, "reshape()");
+	if (rank == VALUE_ERROR)
+		return value_init_error();
+
+	value res;
+	if (op.type == VALUE_NDA) {
+		// A view whose elements aren't in order has to be copied first.
+		if (value_private_nd_contiguous_p(op.core.u_nd))
+			res = value_nd_set(op);
+		else res = value_private_nd_copy(op);
+	} else if (op.type == VALUE_ARY || op.type == VALUE_PAK) {
+		res = value_to_nd(op);
+	} else {
+		value_error(1, "Type Error: reshape() is undefined where op is %ts (array expected).", op);
+		return value_init_error();
+	}
+	return_if_error(res);
+
+	size_t length = 1;
+	for (i = 0; i < rank; ++i)
+		length *= dims[i];
+	if (length != value_nd_size(res)) {
+		value_error(1, "Domain Error: reshape() is undefined where op has %ld elements and the shape is %s.", (long) value_nd_size(res), shape);
+		value_clear(&res);
+		return value_init_error();
+	}
+
+	struct value_nd *nd = res.core.u_nd;
+	nd->rank = rank;
+	memcpy(nd->shape, dims, sizeof(size_t) * rank);
+	value_private_nd_strides(nd);
+	return res;
+}
+
+int value_nd_eq(value op1, value op2)
+{
+	if (op1.type == VALUE_NDA && op2.type == VALUE_NDA) {
+		struct value_nd *nd1 = op1.core.u_nd, *nd2 = op2.core.u_nd;
+		if (nd1->rank != nd2->rank || memcmp(nd1->shape, nd2->shape, sizeof(size_t) * nd1->rank) != 0)
+			return FALSE;
+
+		size_t i, length = value_nd_size(op1);
+		for (i = 0; i < length; ++i)
+			if (!value_eq(nd1->data->a[value_private_nd_offset(nd1, i)], nd2->data->a[value_private_nd_offset(nd2, i)]))
+				return FALSE;
+		return TRUE;
+	}
+
+	// An n-dimensional array is equal to the nested arrays with the same elements.
+	value a = value_nd_to_a(op1), b = value_nd_to_a(op2);
+	int res = value_eq(a, b);
+	value_clear(&a);
+	value_clear(&b);
+	return res;
+}
+
+int value_nd_cmp(value op1, value op2)
+{
+	value a = value_nd_to_a(op1), b = value_nd_to_a(op2);
+	int res = value_cmp(a, b);
+	value_clear(&a);
+	value_clear(&b);
+	return res;
+}
+
+size_t value_nd_hash_function(value op)
+{
+	value a = value_nd_to_a(op);
+	size_t hash = value_private_hash_function(a);
+	value_clear(&a);
+	return hash;
+}
+
+int value_nd_put(char buffer[], size_t length, value op, char *format)
+{
+	value a = value_nd_to_a(op);
+	if (a.type == VALUE_ERROR)
+		return VALUE_ERROR;
+	int error_p = value_put(buffer, length, a, format);
+	value_clear(&a);
+	return error_p;
+}
+
+value value_ndarray_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "ndarray()") ? value_init_error() : value_ndarray(argv[0], argv[1]);
+}
+
+value value_nd_p_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "nd?()") ? value_init_error() : value_set_bool(argv[0].type == VALUE_NDA);
+}
+
+value value_reshape_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "reshape()") ? value_init_error() : value_reshape(argv[0], argv[1]);
+}
+
+value value_shape_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "shape()") ? value_init_error() : value_shape(argv[0]);
+}
+
+value value_to_nd_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "to_nd()") ? value_init_error() : value_to_nd(argv[0]);
+}
+
+value value_transpose_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "transpose()") ? value_init_error() : value_transpose(argv[0]);
+}
@@ -49,6 +49,8 @@ value value_add(value op1, value op2)
 		strcpy(str+strlen(op1.core.u_x), op2.core.u_x);
 		res.type = VALUE_RGX;
 		res.core.u_x = str;
+	} else if (op1.type == VALUE_PAK || op2.type == VALUE_PAK) {
+		res = value_packed_unpacked_call2(&value_add, op1, op2);
 	} else if (op1.type == VALUE_ARY && op2.type == VALUE_ARY
 			|| op1.type == VALUE_PAR && op2.type == VALUE_PAR) {
 		res = value_concat(op1, op2);
@@ -79,7 +81,7 @@ value value_add_now(value *op1, value op2)
 		mpz_add(op1->core.u_mz, op1->core.u_mz, op2.core.u_mz);
 	} else if (op1->type == VALUE_MPZ && op2.type == VALUE_MPF) {
 		value tmp;
-		tmp.type = VALUE_MPF;
+		value_box_mpf(&tmp);
 		mpfr_init_set_z(tmp.core.u_mf, op1->core.u_mz, value_mpfr_round);
 		mpfr_add(tmp.core.u_mf, tmp.core.u_mf, op2.core.u_mf, value_mpfr_round);
 		value_clear(op1);
@@ -211,6 +213,8 @@ value value_mul(value op1, value op2)
 		int i; for (i = 0; i < count; ++i, ptr += len)
 			strcpy(ptr, op2.core.u_s);
 		res = value_set_str(str);	
+	} else if (op1.type == VALUE_PAK || op2.type == VALUE_PAK) {
+		res = value_packed_unpacked_call2(&value_mul, op1, op2);
 	} else if (op1.type == VALUE_ARY && op2.type == VALUE_MPZ) {
 		if (value_lt(op2, value_zero)) {
 			value_error(1, "Domain Error: Cannot multiply an array by a negative number.");
@@ -575,10 +579,19 @@ int value_cmp(value op1, value op2)
 		if (op2.type == VALUE_MPZ) {
 			return ((v = mpfr_cmp_z(op1.core.u_mf, op2.core.u_mz)) > 0) - (v < 0);
 		} else if (op2.type == VALUE_MPF) {
-			return ((mpfr_cmp(op1.core.u_mf, op2.core.u_mf)) > 0) - (v < 0);
+			return ((v = mpfr_cmp(op1.core.u_mf, op2.core.u_mf)) > 0) - (v < 0);
 		}
 	}
 	
+	if (op1.type == VALUE_NDA || op2.type == VALUE_NDA)
+		return value_nd_cmp(op1, op2);
+	
+	if (op1.type == VALUE_SLC || op2.type == VALUE_SLC)
+		return value_slice_cmp(op1, op2, FALSE);
+	
+	if (op1.type == VALUE_PAK || op2.type == VALUE_PAK)
+		return value_packed_cmp(op1, op2);
+	
 	if (op1.type != op2.type)
 		return -2;
 	
@@ -668,10 +681,22 @@ int value_cmp_any(value op1, value op2)
 		if (op2.type == VALUE_MPZ) {
 			return ((v = mpfr_cmp_z(op1.core.u_mf, op2.core.u_mz)) > 0) - (v < 0);
 		} else if (op2.type == VALUE_MPF) {
-			return ((mpfr_cmp(op1.core.u_mf, op2.core.u_mf)) > 0) - (v < 0);
+			return ((v = mpfr_cmp(op1.core.u_mf, op2.core.u_mf)) > 0) - (v < 0);
 		}
 	}
 	
+	// A packed array is ordered with the ordinary arrays.
+	if ((op1.type == VALUE_PAK && op2.type == VALUE_ARY) || (op1.type == VALUE_ARY && op2.type == VALUE_PAK))
+		return value_packed_cmp(op1, op2);
+	
+	// So is an n-dimensional array.
+	if ((op1.type == VALUE_NDA && op2.type == VALUE_ARY) || (op1.type == VALUE_ARY && op2.type == VALUE_NDA))
+		return value_nd_cmp(op1, op2);
+	
+	// A slice is ordered with what it's a slice of.
+	if (op1.type == VALUE_SLC || op2.type == VALUE_SLC)
+		return value_slice_cmp(op1, op2, TRUE);
+	
 	if (op1.type != op2.type)
 		return op1.type < op2.type ? -1 : op1.type == op2.type ? 0 : 1;
 		
@@ -720,6 +745,15 @@ value value_le_std(value op1, value op2)
 
 int value_eq(value op1, value op2)
 {
+	if (op1.type == VALUE_NDA || op2.type == VALUE_NDA)
+		return value_nd_eq(op1, op2);
+	
+	if (op1.type == VALUE_SLC || op2.type == VALUE_SLC)
+		return value_slice_eq(op1, op2);
+	
+	if (op1.type == VALUE_PAK || op2.type == VALUE_PAK)
+		return value_packed_eq(op1, op2);
+	
 	// If the types are not equal, op1 and op2 cannot be equal unless they are MPZ or MPF.
 	if (op1.type != op2.type && !(op1.type == VALUE_MPZ && op2.type == VALUE_MPF || op1.type == VALUE_MPF && op2.type == VALUE_MPZ))
 		return FALSE;
@@ -797,7 +831,7 @@ int value_eq(value op1, value op2)
 		if (length1 != length2)
 			return FALSE;
 		for (i = 0; i < length1; ++i)
-			if (value_ne(op1.core.u_h.a[i], op2.core.u_h.a[i]))
+			if (value_ne(op1.core.u_h->a[i], op2.core.u_h->a[i]))
 				return FALSE;
 		return TRUE;
 	
@@ -885,7 +919,7 @@ int value_eq_with_if_statements(value op1, value op2)
 		if (length1 != length2)
 			return FALSE;
 		for (i = 0; i < length1; ++i)
-			if (value_ne(op1.core.u_h.a[i], op2.core.u_h.a[i]))
+			if (value_ne(op1.core.u_h->a[i], op2.core.u_h->a[i]))
 				return FALSE;
 		return TRUE;
 	}
@@ -1016,6 +1050,211 @@ value value_gt_arg(int argc, value argv[])
 	return missing_arguments(argc, argv, "greater than comparison") ? value_init_error() : value_gt_std(argv[0], argv[1]);
 }
 
+/* 
+ * Specialized arithmetic. The optimizer puts these in place of the generic functions 
+ * at call sites where it has proven the types of both operands. Each one still checks 
+ * the types and hands off to the generic function if they don't match, so a wrong 
+ * guess is never more than a little slower.
+ */
+
+value value_add_int_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_MPZ || argv[1].type != VALUE_MPZ)
+		return value_add_arg(argc, argv);
+	value res = value_init(VALUE_MPZ);
+	mpz_add(res.core.u_mz, argv[0].core.u_mz, argv[1].core.u_mz);
+	return res;
+}
+
+value value_sub_int_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_MPZ || argv[1].type != VALUE_MPZ)
+		return value_sub_arg(argc, argv);
+	value res = value_init(VALUE_MPZ);
+	mpz_sub(res.core.u_mz, argv[0].core.u_mz, argv[1].core.u_mz);
+	return res;
+}
+
+value value_mul_int_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_MPZ || argv[1].type != VALUE_MPZ)
+		return value_mul_arg(argc, argv);
+	value res = value_init(VALUE_MPZ);
+	mpz_mul(res.core.u_mz, argv[0].core.u_mz, argv[1].core.u_mz);
+	return res;
+}
+
+value value_add_float_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_MPF || argv[1].type != VALUE_MPF)
+		return value_add_arg(argc, argv);
+	value res = value_init(VALUE_MPF);
+	mpfr_add(res.core.u_mf, argv[0].core.u_mf, argv[1].core.u_mf, value_mpfr_round);
+	return res;
+}
+
+value value_sub_float_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_MPF || argv[1].type != VALUE_MPF)
+		return value_sub_arg(argc, argv);
+	value res = value_init(VALUE_MPF);
+	mpfr_sub(res.core.u_mf, argv[0].core.u_mf, argv[1].core.u_mf, value_mpfr_round);
+	return res;
+}
+
+value value_mul_float_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_MPF || argv[1].type != VALUE_MPF)
+		return value_mul_arg(argc, argv);
+	value res = value_init(VALUE_MPF);
+	mpfr_mul(res.core.u_mf, argv[0].core.u_mf, argv[1].core.u_mf, value_mpfr_round);
+	return res;
+}
+
+value value_concat_str_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_STR || argv[1].type != VALUE_STR)
+		return value_add_arg(argc, argv);
+	size_t length1 = strlen(argv[0].core.u_s);
+	size_t length2 = strlen(argv[1].core.u_s);
+	value res;
+	res.type = VALUE_STR;
+	res.core.u_s = value_malloc(NULL, length1 + length2 + 1);
+	return_if_null(res.core.u_s);
+	memcpy(res.core.u_s, argv[0].core.u_s, length1);
+	memcpy(res.core.u_s + length1, argv[1].core.u_s, length2 + 1);
+	return res;
+}
+
+value value_lt_int_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_MPZ || argv[1].type != VALUE_MPZ)
+		return value_lt_arg(argc, argv);
+	return value_set_bool(mpz_cmp(argv[0].core.u_mz, argv[1].core.u_mz) < 0);
+}
+
+value value_le_int_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_MPZ || argv[1].type != VALUE_MPZ)
+		return value_le_arg(argc, argv);
+	return value_set_bool(mpz_cmp(argv[0].core.u_mz, argv[1].core.u_mz) <= 0);
+}
+
+value value_gt_int_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_MPZ || argv[1].type != VALUE_MPZ)
+		return value_gt_arg(argc, argv);
+	return value_set_bool(mpz_cmp(argv[0].core.u_mz, argv[1].core.u_mz) > 0);
+}
+
+value value_ge_int_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_MPZ || argv[1].type != VALUE_MPZ)
+		return value_ge_arg(argc, argv);
+	return value_set_bool(mpz_cmp(argv[0].core.u_mz, argv[1].core.u_mz) >= 0);
+}
+
+value value_lt_float_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_MPF || argv[1].type != VALUE_MPF)
+		return value_lt_arg(argc, argv);
+	return value_set_bool(mpfr_less_p(argv[0].core.u_mf, argv[1].core.u_mf));
+}
+
+value value_le_float_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_MPF || argv[1].type != VALUE_MPF)
+		return value_le_arg(argc, argv);
+	return value_set_bool(mpfr_lessequal_p(argv[0].core.u_mf, argv[1].core.u_mf));
+}
+
+value value_gt_float_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_MPF || argv[1].type != VALUE_MPF)
+		return value_gt_arg(argc, argv);
+	return value_set_bool(mpfr_greater_p(argv[0].core.u_mf, argv[1].core.u_mf));
+}
+
+value value_ge_float_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_MPF || argv[1].type != VALUE_MPF)
+		return value_ge_arg(argc, argv);
+	return value_set_bool(mpfr_greaterequal_p(argv[0].core.u_mf, argv[1].core.u_mf));
+}
+
+value value_eq_int_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_MPZ || argv[1].type != VALUE_MPZ)
+		return value_eq_arg(argc, argv);
+	return value_set_bool(mpz_cmp(argv[0].core.u_mz, argv[1].core.u_mz) == 0);
+}
+
+value value_ne_int_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_MPZ || argv[1].type != VALUE_MPZ)
+		return value_ne_arg(argc, argv);
+	return value_set_bool(mpz_cmp(argv[0].core.u_mz, argv[1].core.u_mz) != 0);
+}
+
+value value_eq_float_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_MPF || argv[1].type != VALUE_MPF)
+		return value_eq_arg(argc, argv);
+	return value_set_bool(mpfr_equal_p(argv[0].core.u_mf, argv[1].core.u_mf));
+}
+
+value value_ne_float_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_MPF || argv[1].type != VALUE_MPF)
+		return value_ne_arg(argc, argv);
+	return value_set_bool(!mpfr_equal_p(argv[0].core.u_mf, argv[1].core.u_mf));
+}
+
+value value_eq_str_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_STR || argv[1].type != VALUE_STR)
+		return value_eq_arg(argc, argv);
+	return value_set_bool(streq(argv[0].core.u_s, argv[1].core.u_s));
+}
+
+value value_ne_str_arg(int argc, value argv[])
+{
+	if (argv[0].type != VALUE_STR || argv[1].type != VALUE_STR)
+		return value_ne_arg(argc, argv);
+	return value_set_bool(strne(argv[0].core.u_s, argv[1].core.u_s));
+}
+
+value (*value_specialized_arg(value (*f)(int, value *), int type1, int type2))(int, value *)
+{
+	if (type1 == VALUE_MPZ && type2 == VALUE_MPZ) {
+		if (f == &value_add_arg) return &value_add_int_arg;
+		if (f == &value_sub_arg) return &value_sub_int_arg;
+		if (f == &value_mul_arg) return &value_mul_int_arg;
+		if (f == &value_lt_arg) return &value_lt_int_arg;
+		if (f == &value_le_arg) return &value_le_int_arg;
+		if (f == &value_gt_arg) return &value_gt_int_arg;
+		if (f == &value_ge_arg) return &value_ge_int_arg;
+		if (f == &value_eq_arg) return &value_eq_int_arg;
+		if (f == &value_ne_arg) return &value_ne_int_arg;
+	} else if (type1 == VALUE_MPF && type2 == VALUE_MPF) {
+		if (f == &value_add_arg) return &value_add_float_arg;
+		if (f == &value_sub_arg) return &value_sub_float_arg;
+		if (f == &value_mul_arg) return &value_mul_float_arg;
+		if (f == &value_lt_arg) return &value_lt_float_arg;
+		if (f == &value_le_arg) return &value_le_float_arg;
+		if (f == &value_gt_arg) return &value_gt_float_arg;
+		if (f == &value_ge_arg) return &value_ge_float_arg;
+		if (f == &value_eq_arg) return &value_eq_float_arg;
+		if (f == &value_ne_arg) return &value_ne_float_arg;
+	} else if (type1 == VALUE_STR && type2 == VALUE_STR) {
+		if (f == &value_add_arg) return &value_concat_str_arg;
+		if (f == &value_eq_arg) return &value_eq_str_arg;
+		if (f == &value_ne_arg) return &value_ne_str_arg;
+	}
+	
+	return NULL;
+}
+
 
 int value_not_p(value op)
 {
@@ -1051,6 +1290,63 @@ value value_or_p_std(value op1, value op2)
 	return value_set(op2);
 }
 
+/* 
+ * Finds the truth value of an unevaluated argument. Variables are looked up by 
+ * reference and constants are tested directly, so only an s-expression has to be 
+ * evaluated and cleared. Returns VALUE_ERROR if the evaluation fails.
+ */
+int value_private_truth_eval(value *variables, value op)
+{
+	if (op.type == VALUE_VAR) {
+		value *ref = value_hash_get_ref(*variables, op);
+		if (ref == NULL)
+			ref = value_hash_get_ref(global_variables, op);
+		if (ref == NULL) {
+			value_error(1, "Error: Unrecognized function or value %s.", op);
+			return VALUE_ERROR;
+		}
+		return value_true_p(*ref);
+		
+	} else if (op.type == VALUE_BLK) {
+		value res = eval_generic(variables, op, TRUE);
+		if (res.type == VALUE_ERROR)
+			return VALUE_ERROR;
+		int truth = value_true_p(res);
+		value_clear(&res);
+		return truth;
+	}
+	
+	return value_true_p(op);
+}
+
+value value_and_p_lazy(value *variables, value op1, value op2)
+{
+	int truth = value_private_truth_eval(variables, op1);
+	if (truth == VALUE_ERROR)
+		return value_init_error();
+	if (truth == FALSE)
+		return value_set_bool(FALSE);
+	
+	truth = value_private_truth_eval(variables, op2);
+	if (truth == VALUE_ERROR)
+		return value_init_error();
+	return value_set_bool(truth);
+}
+
+value value_or_p_lazy(value *variables, value op1, value op2)
+{
+	int truth = value_private_truth_eval(variables, op1);
+	if (truth == VALUE_ERROR)
+		return value_init_error();
+	if (truth)
+		return value_set_bool(TRUE);
+	
+	truth = value_private_truth_eval(variables, op2);
+	if (truth == VALUE_ERROR)
+		return value_init_error();
+	return value_set_bool(truth);
+}
+
 value value_not_p_arg(int argc, value argv[])
 {
 	return missing_arguments(argc, argv, "logical NOT") ? value_init_error() : value_not_p_std(argv[0]);
@@ -1058,12 +1354,14 @@ value value_not_p_arg(int argc, value argv[])
 
 value value_and_p_arg(int argc, value argv[])
 {
-	return missing_arguments(argc, argv, "logical AND") ? value_init_error() : value_and_p_std(argv[0], argv[1]);
+	value *tmp = value_deref(argv[0]);
+	return missing_arguments(argc-1, argv+1, "logical AND") ? value_init_error() : value_and_p_lazy(tmp, argv[1], argv[2]);
 }
 
 value value_or_p_arg(int argc, value argv[])
 {
-	return missing_arguments(argc, argv, "logical OR") ? value_init_error() : value_or_p_std(argv[0], argv[1]);
+	value *tmp = value_deref(argv[0]);
+	return missing_arguments(argc-1, argv+1, "logical OR") ? value_init_error() : value_or_p_lazy(tmp, argv[1], argv[2]);
 }
 
 
@@ -1336,7 +1634,7 @@ value value_rand(value max)
 		prec += mpfr_get_prec(randf.core.u_mf);
 		
 		res.type = VALUE_MPF;
-		mpfr_init2(res.core.u_mf, prec + 1);
+		mpfr_init2(value_box_mpf(&res), prec + 1);
 		mpfr_add_z(res.core.u_mf, randf.core.u_mf, zres.core.u_mz, value_mpfr_round);
 		
 		value_clear(&zmax);
@@ -1400,7 +1698,10 @@ value value_summation(value *variables, value op, value func)
 {
 	value res = value_init_nil();
 	
-	if (op.type == VALUE_ARY) {
+	if (op.type == VALUE_PAK) {
+		res = value_packed_summation(variables, op, func);
+		
+	} else if (op.type == VALUE_ARY) {
 		size_t i;
 		value tmp = value_init_nil();
 		for (i = 0; i < op.core.u_a.length; ++i) {
@@ -1496,6 +1797,33 @@ value value_summation(value *variables, value op, value func)
 	return res;
 }
 
+value value_sum(value op)
+{
+	if (op.type == VALUE_PAK)
+		return value_packed_sum(op);
+	
+	if (op.type == VALUE_ARY) {
+		if (op.core.u_a.length == 0)
+			return value_set_long(0);
+		
+		value res = value_set(op.core.u_a.a[0]);
+		size_t i;
+		for (i = 1; i < op.core.u_a.length && res.type != VALUE_ERROR; ++i)
+			value_add_now(&res, op.core.u_a.a[i]);
+		return res;
+		
+	} else if (op.type == VALUE_LST || op.type == VALUE_PAR || op.type == VALUE_RNG) {
+		value ary = value_cast(op, VALUE_ARY);
+		return_if_error(ary);
+		value res = value_sum(ary);
+		value_clear(&ary);
+		return res;
+	}
+	
+	value_error(1, "Type Error: sum() is undefined where op is %ts (array, list or range expected).", op);
+	return value_init_error();
+}
+
 value value_times_arg(int argc, value argv[])
 {
 	value *tmp = value_deref(argv[0]);
@@ -1506,4 +1834,9 @@ value value_summation_arg(int argc, value argv[])
 {
 	value *tmp = value_deref(argv[0]);
 	return missing_arguments(argc-1, argv+1, "summation()") ? value_init_error() : value_summation(tmp, argv[1], argv[2]);
+}
+
+value value_sum_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "sum()") ? value_init_error() : value_sum(argv[0]);
 }
\ No newline at end of file
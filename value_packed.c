@@ -0,0 +1,722 @@
+/*
+ *  value_packed.c
+ *  Simfpl
+ *
+ *  All definitions for functions and variables in value_packed.c can be found in value.h.
+ *
+ */
+
+/*
+ * Packed Array Implementation
+ *
+ * An ordinary array of a million integers holds a million values, each with its own
+ * GMP number. A packed array holds the same integers in a single block of int64_t's,
+ * or a block of doubles for floats, or a block of bytes for booleans. The header is
+ * allocated separately, like a hash's, so that the value stays small.
+ *
+ * Unlike an ordinary array, a packed array keeps track of its capacity, which doubles
+ * whenever an append runs out of room.
+ *
+ * Whenever an element is taken out of a packed array, a new value is made for it. So
+ * reading is a little slower than it is for an ordinary array, but there is nothing
+ * to allocate or clear for each element that sits in the array.
+ *
+ * Built-in functions that haven't been taught about packed arrays are handed ordinary
+ * copies of them by value_bifcall_sexp(). If the function may have changed one of them
+ * in place, it is packed again afterwards if it still fits.
+ */
+
+#include "value.h"
+
+value value_packed_init(int kind, size_t capacity)
+{
+	value res;
+
+	res.type = VALUE_PAK;
+	res.core.u_pk = value_malloc(NULL, sizeof(struct value_packed));
+	return_if_null(res.core.u_pk);
+	res.core.u_pk->kind = kind;
+	res.core.u_pk->length = 0;
+	res.core.u_pk->capacity = 0;
+	value_malloc(&res, capacity < RESIZE_MIN ? RESIZE_MIN : capacity);
+	return res;
+}
+
+value value_set_pak_long(long array[], size_t length)
+{
+	value res = value_packed_init(PACKED_INT, length);
+	return_if_error(res);
+
+	size_t i;
+	for (i = 0; i < length; ++i)
+		res.core.u_pk->a.z[i] = array[i];
+	res.core.u_pk->length = length;
+
+	return res;
+}
+
+value value_set_pak_double(double array[], size_t length)
+{
+	value res = value_packed_init(PACKED_FLOAT, length);
+	return_if_error(res);
+
+	memcpy(res.core.u_pk->a.f, array, sizeof(double) * length);
+	res.core.u_pk->length = length;
+
+	return res;
+}
+
+value value_set_pak_bool(int array[], size_t length)
+{
+	value res = value_packed_init(PACKED_BOOL, length);
+	return_if_error(res);
+
+	size_t i;
+	for (i = 0; i < length; ++i)
+		res.core.u_pk->a.b[i] = array[i] != 0;
+	res.core.u_pk->length = length;
+
+	return res;
+}
+
+int value_packed_kind(value op)
+{
+	if (op.type == VALUE_MPZ) {
+		if (mpz_fits_slong_p(op.core.u_mz))
+			return PACKED_INT;
+	} else if (op.type == VALUE_MPF) {
+		// A float with more precision than a double would lose some of it, and so would
+		// one outside of the range of normal doubles.
+		if (mpfr_get_prec(op.core.u_mf) <= DBL_MANT_DIG && (mpfr_zero_p(op.core.u_mf) || (mpfr_number_p(op.core.u_mf)
+				&& mpfr_get_exp(op.core.u_mf) >= DBL_MIN_EXP && mpfr_get_exp(op.core.u_mf) <= DBL_MAX_EXP)))
+			return PACKED_FLOAT;
+	} else if (op.type == VALUE_BOO) {
+		return PACKED_BOOL;
+	}
+
+	return PACKED_NONE;
+}
+
+size_t value_packed_width(int kind)
+{
+	if (kind == PACKED_INT)
+		return sizeof(int64_t);
+	if (kind == PACKED_FLOAT)
+		return sizeof(double);
+	return sizeof(uint8_t);
+}
+
+value value_packed_set(value op)
+{
+	struct value_packed *pk = op.core.u_pk;
+	value res = value_packed_init(pk->kind, pk->length);
+	return_if_error(res);
+
+	memcpy(res.core.u_pk->a.b, pk->a.b, value_packed_width(pk->kind) * pk->length);
+	res.core.u_pk->length = pk->length;
+	return res;
+}
+
+void value_packed_clear(value *op)
+{
+	if (op->core.u_pk) {
+		value_free(op->core.u_pk->a.b);
+		value_free(op->core.u_pk);
+	}
+}
+
+value value_packed_get(value op, size_t index)
+{
+	struct value_packed *pk = op.core.u_pk;
+
+	if (pk->kind == PACKED_INT)
+		return value_set_long((long) pk->a.z[index]);
+	if (pk->kind == PACKED_FLOAT)
+		return value_set_double(pk->a.f[index]);
+	return value_set_bool(pk->a.b[index]);
+}
+
+value value_packed_at(value op, value index)
+{
+	struct value_packed *pk = op.core.u_pk;
+
+	if (index.type == VALUE_MPZ) {
+		if (value_lt(index, value_zero) || value_gt(index, value_int_max) || value_get_ulong(index) >= pk->length) {
+			value_error(1, "Domain Error: in at(), index %s is beyond the bounds of array %s.", index, op);
+			return value_init_error();
+		}
+
+		return value_packed_get(op, value_get_ulong(index));
+
+	} else if (index.type == VALUE_ARY) {
+		value res = value_packed_init(pk->kind, index.core.u_a.length);
+		return_if_error(res);
+
+		size_t i;
+		for (i = 0; i < index.core.u_a.length; ++i) {
+			value elem = value_packed_at(op, index.core.u_a.a[i]);
+			if (elem.type == VALUE_ERROR) {
+				value_clear(&res);
+				return elem;
+			}
+			value_packed_append_now2(&res, &elem);
+		}
+
+		return res;
+
+	} else if (index.type == VALUE_RNG) {
+		if (index.core.u_r->min.type != VALUE_MPZ || index.core.u_r->max.type != VALUE_MPZ) {
+			value_error(1, "Type Error: at() is undefined where op is %ts and index is %ts (integer range expected).", op, index);
+			return value_init_error();
+		}
+		if (value_gt(index.core.u_r->min, index.core.u_r->max)) {
+			value_error(1, "Domain Error: at() is undefined for range %ts where min is greater than max.", index);
+			return value_init_error();
+		}
+
+		long start = value_get_long(index.core.u_r->min);
+		long finish = value_get_long(index.core.u_r->max);
+		if (index.core.u_r->inclusive_p)
+			++finish;
+		if (start < 0 || finish > pk->length) {
+			value_error(1, "Domain Error: in at(), range %s is beyond the bounds of array %s.", index, op);
+			return value_init_error();
+		}
+
+		size_t width = value_packed_width(pk->kind);
+		value res = value_packed_init(pk->kind, finish - start);
+		return_if_error(res);
+		memcpy(res.core.u_pk->a.b, pk->a.b + start * width, (finish - start) * width);
+		res.core.u_pk->length = finish - start;
+		return res;
+	}
+
+	value_error(1, "Type Error: at() is undefined where op is %ts and index is %ts (integer, array, or range expected).", op, index);
+	return value_init_error();
+}
+
+int value_packed_store(value *op, value index, value elem)
+{
+	struct value_packed *pk = op->core.u_pk;
+
+	if (index.type != VALUE_MPZ) {
+		value_error(1, "Type Error: at_ref() is undefined where op is %ts and index is %ts (integer expected).", *op, index);
+		return VALUE_ERROR;
+	}
+	if (value_lt(index, value_zero) || value_gt(index, value_int_max) || value_get_ulong(index) >= pk->length) {
+		value_error(1, "Domain Error: in at_ref(), index %s is beyond the bounds of array %s.", index, *op);
+		return VALUE_ERROR;
+	}
+
+	if (value_packed_kind(elem) != pk->kind)
+		return FALSE;
+
+	size_t i = value_get_ulong(index);
+	if (pk->kind == PACKED_INT)
+		pk->a.z[i] = mpz_get_si(elem.core.u_mz);
+	else if (pk->kind == PACKED_FLOAT)
+		pk->a.f[i] = mpfr_get_d(elem.core.u_mf, value_mpfr_round);
+	else pk->a.b[i] = elem.core.u_b != 0;
+
+	return TRUE;
+}
+
+value value_packed_append_now2(value *op, value *elem)
+{
+	struct value_packed *pk = op->core.u_pk;
+	int kind = value_packed_kind(*elem);
+
+	if (pk->length == 0 && kind != PACKED_NONE)
+		pk->kind = kind;
+
+	if (kind != pk->kind) {
+		if (value_unpack_now(op) == VALUE_ERROR)
+			return value_init_error();
+		return value_append_now2(op, elem);
+	}
+
+	if (pk->length == pk->capacity) {
+		value_realloc(op, 2 * pk->capacity);
+		return_if_error(*op);
+	}
+
+	if (kind == PACKED_INT)
+		pk->a.z[pk->length] = mpz_get_si(elem->core.u_mz);
+	else if (kind == PACKED_FLOAT)
+		pk->a.f[pk->length] = mpfr_get_d(elem->core.u_mf, value_mpfr_round);
+	else pk->a.b[pk->length] = elem->core.u_b != 0;
+	++pk->length;
+
+	value_clear(elem);
+	return value_init_nil();
+}
+
+value value_pack(value op)
+{
+	if (op.type == VALUE_PAK)
+		return value_packed_set(op);
+
+	if (op.type == VALUE_RNG && op.core.u_r->min.type == VALUE_MPZ && op.core.u_r->max.type == VALUE_MPZ
+			&& mpz_fits_slong_p(op.core.u_r->min.core.u_mz) && mpz_fits_slong_p(op.core.u_r->max.core.u_mz)) {
+		// Fill it in directly, rather than making an ordinary array of the range first.
+		long min = value_get_long(op.core.u_r->min), max = value_get_long(op.core.u_r->max);
+		long step = min <= max ? 1 : -1;
+		size_t i, length = (size_t) (max - min) * step;
+		if (op.core.u_r->inclusive_p)
+			++length;
+
+		value res = value_packed_init(PACKED_INT, length);
+		return_if_error(res);
+		for (i = 0; i < length; ++i, min += step)
+			res.core.u_pk->a.z[i] = min;
+		res.core.u_pk->length = length;
+		return res;
+	}
+
+	if (op.type != VALUE_ARY) {
+		value ary = value_cast(op, VALUE_ARY);
+		return_if_error(ary);
+		value res = value_pack(ary);
+		value_clear(&ary);
+		return res;
+	}
+
+	size_t i, length = op.core.u_a.length;
+	int kind = length ? value_packed_kind(op.core.u_a.a[0]) : PACKED_INT;
+	for (i = 1; i < length && kind != PACKED_NONE; ++i)
+		if (value_packed_kind(op.core.u_a.a[i]) != kind)
+			kind = PACKED_NONE;
+
+	if (kind == PACKED_NONE)
+		return value_set(op);
+
+	value res = value_packed_init(kind, length);
+	return_if_error(res);
+	struct value_packed *pk = res.core.u_pk;
+
+	for (i = 0; i < length; ++i) {
+		if (kind == PACKED_INT)
+			pk->a.z[i] = mpz_get_si(op.core.u_a.a[i].core.u_mz);
+		else if (kind == PACKED_FLOAT)
+			pk->a.f[i] = mpfr_get_d(op.core.u_a.a[i].core.u_mf, value_mpfr_round);
+		else pk->a.b[i] = op.core.u_a.a[i].core.u_b != 0;
+	}
+	pk->length = length;
+
+	return res;
+}
+
+int value_pack_now(value *op)
+{
+	if (op->type != VALUE_ARY)
+		return 0;
+
+	value res = value_pack(*op);
+	if (res.type == VALUE_ERROR)
+		return VALUE_ERROR;
+	value_clear(op);
+	*op = res;
+	return 0;
+}
+
+value value_unpack(value op)
+{
+	if (op.type != VALUE_PAK)
+		return value_set(op);
+
+	size_t i, length = op.core.u_pk->length;
+	value res;
+	res.type = VALUE_ARY;
+	value_malloc(&res, next_size(length));
+	return_if_error(res);
+
+	for (i = 0; i < length; ++i)
+		res.core.u_a.a[i] = value_packed_get(op, i);
+	res.core.u_a.length = length;
+
+	return res;
+}
+
+int value_unpack_now(value *op)
+{
+	if (op->type != VALUE_PAK)
+		return 0;
+
+	value res = value_unpack(*op);
+	if (res.type == VALUE_ERROR)
+		return VALUE_ERROR;
+	value_clear(op);
+	*op = res;
+	return 0;
+}
+
+value value_packed_unpacked_call2(value (*f)(value, value), value op1, value op2)
+{
+	value a = op1.type == VALUE_PAK ? value_unpack(op1) : op1;
+	return_if_error(a);
+	value b = op2.type == VALUE_PAK ? value_unpack(op2) : op2;
+	if (b.type == VALUE_ERROR) {
+		if (op1.type == VALUE_PAK)
+			value_clear(&a);
+		return b;
+	}
+
+	value res = (*f)(a, b);
+
+	if (op1.type == VALUE_PAK)
+		value_clear(&a);
+	if (op2.type == VALUE_PAK)
+		value_clear(&b);
+	return res;
+}
+
+int value_packed_eq(value op1, value op2)
+{
+	if (op1.type == VALUE_PAK && op2.type == VALUE_PAK && op1.core.u_pk->kind == op2.core.u_pk->kind) {
+		struct value_packed *pk1 = op1.core.u_pk, *pk2 = op2.core.u_pk;
+		if (pk1->length != pk2->length)
+			return FALSE;
+
+		size_t i;
+		if (pk1->kind == PACKED_FLOAT) {
+			for (i = 0; i < pk1->length; ++i)
+				if (pk1->a.f[i] != pk2->a.f[i])
+					return FALSE;
+			return TRUE;
+		}
+		return memcmp(pk1->a.b, pk2->a.b, value_packed_width(pk1->kind) * pk1->length) == 0;
+	}
+
+	if ((op1.type != VALUE_PAK && op1.type != VALUE_ARY) || (op2.type != VALUE_PAK && op2.type != VALUE_ARY))
+		return FALSE;
+	if (value_length(op1) != value_length(op2))
+		return FALSE;
+
+	value a = value_unpack(op1), b = value_unpack(op2);
+	int res = value_eq(a, b);
+	value_clear(&a);
+	value_clear(&b);
+	return res;
+}
+
+int value_private_packed_cmp_int(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+	return (x > y) - (x < y);
+}
+
+int value_private_packed_cmp_float(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+int value_packed_cmp(value op1, value op2)
+{
+	if (op1.type == VALUE_PAK && op2.type == VALUE_PAK && op1.core.u_pk->kind == op2.core.u_pk->kind) {
+		struct value_packed *pk1 = op1.core.u_pk, *pk2 = op2.core.u_pk;
+		size_t i;
+		size_t length = pk1->length < pk2->length ? pk1->length : pk2->length;
+
+		for (i = 0; i < length; ++i) {
+			int cmp;
+			if (pk1->kind == PACKED_INT)
+				cmp = value_private_packed_cmp_int(pk1->a.z + i, pk2->a.z + i);
+			else if (pk1->kind == PACKED_FLOAT)
+				cmp = value_private_packed_cmp_float(pk1->a.f + i, pk2->a.f + i);
+			else cmp = (pk1->a.b[i] > pk2->a.b[i]) - (pk1->a.b[i] < pk2->a.b[i]);
+			if (cmp)
+				return cmp;
+		}
+
+		return (pk1->length > pk2->length) - (pk1->length < pk2->length);
+	}
+
+	value a = value_unpack(op1), b = value_unpack(op2);
+	int res = value_cmp(a, b);
+	value_clear(&a);
+	value_clear(&b);
+	return res;
+}
+
+/*
+ * A packed array hashes the same as the ordinary array with the same elements, since
+ * the two are equal.
+ */
+size_t value_packed_hash_function(value op)
+{
+	size_t hash = 5381 - VALUE_STR + VALUE_ARY;
+	size_t i, length = op.core.u_pk->length;
+
+	for (i = 0; i < length; i += (length / 10) + 1) {
+		value elem = value_packed_get(op, i);
+		hash += value_private_hash_function(elem);
+		value_clear(&elem);
+	}
+	hash += length;
+
+	return (size_t) abs(hash);
+}
+
+int value_packed_put(char buffer[], size_t length, value op, char *format)
+{
+	if (strlen("(array)") + 1 > length) return VALUE_ERROR;
+	sprintf(buffer, "(array");
+	size_t added_len = strlen(buffer);
+	char *ptr = buffer + added_len;
+	size_t i, ptrlen = length - added_len;
+
+	for (i = 0; i < op.core.u_pk->length; ++i) {
+		if (ptrlen < 3) return VALUE_ERROR;
+		*(ptr++) = ' '; --ptrlen;
+
+		value elem = value_packed_get(op, i);
+		int error_p = value_put(ptr, ptrlen, elem, format);
+		value_clear(&elem);
+		if (error_p) return error_p;
+		added_len = strlen(ptr);
+		ptr += added_len;
+		ptrlen -= added_len;
+	}
+
+	if (ptrlen < 2) return VALUE_ERROR;
+	sprintf(ptr, ")");
+	return 0;
+}
+
+value value_packed_each(value *variables, value op, value func)
+{
+	value res = value_init_nil();
+	size_t i;
+
+	for (i = 0; i < op.core.u_pk->length; ++i) {
+		value elem = value_packed_get(op, i);
+		value tmp = value_call(variables, func, 1, &elem);
+		value_clear(&elem);
+
+		if (tmp.type == VALUE_STOP && tmp.core.u_stop.type == STOP_BREAK) {
+			break;
+		} else if (tmp.type == VALUE_STOP && tmp.core.u_stop.type == STOP_YIELD) {
+			if (res.type == VALUE_NIL) res = value_init(VALUE_ARY);
+			value_append_now(&res, *tmp.core.u_stop.core);
+		} else if (tmp.type == VALUE_ERROR || (tmp.type == VALUE_STOP && (tmp.core.u_stop.type == STOP_RETURN || tmp.core.u_stop.type == STOP_EXIT))) {
+			value_clear(&res);
+			res = tmp;
+			break;
+		}
+		value_clear(&tmp);
+	}
+
+	return res;
+}
+
+/*
+ * The result is packed for as long as the block keeps returning elements that fit.
+ * It doesn't have to be the same kind as (op).
+ */
+value value_packed_map(value *variables, value op, value func)
+{
+	value res = value_packed_init(op.core.u_pk->kind, op.core.u_pk->length);
+	return_if_error(res);
+	size_t i;
+
+	for (i = 0; i < op.core.u_pk->length; ++i) {
+		value elem = value_packed_get(op, i);
+		value tmp = value_call(variables, func, 1, &elem);
+		value_clear(&elem);
+
+		if (tmp.type == VALUE_STOP && tmp.core.u_stop.type == STOP_BREAK) {
+			value_clear(&tmp);
+			break;
+		} else if (tmp.type == VALUE_ERROR || (tmp.type == VALUE_STOP && (tmp.core.u_stop.type == STOP_RETURN || tmp.core.u_stop.type == STOP_EXIT))) {
+			value_clear(&res);
+			return tmp;
+		}
+
+		if (res.type == VALUE_PAK)
+			value_packed_append_now2(&res, &tmp);
+		else value_append_now2(&res, &tmp);
+		return_if_error(res);
+	}
+
+	return res;
+}
+
+value value_packed_summation(value *variables, value op, value func)
+{
+	value res = value_init_nil();
+	size_t i;
+
+	for (i = 0; i < op.core.u_pk->length; ++i) {
+		value elem = value_packed_get(op, i);
+		value tmp = value_call(variables, func, 1, &elem);
+		value_clear(&elem);
+
+		if (tmp.type == VALUE_STOP && tmp.core.u_stop.type == STOP_BREAK) {
+			value_clear(&tmp);
+			break;
+		} else if (tmp.type == VALUE_ERROR || (tmp.type == VALUE_STOP && (tmp.core.u_stop.type == STOP_RETURN || tmp.core.u_stop.type == STOP_EXIT))) {
+			value_clear(&res);
+			res = tmp;
+			break;
+		}
+
+		if (i == 0)
+			res = tmp;
+		else {
+			value_add_now(&res, tmp);
+			value_clear(&tmp);
+		}
+	}
+
+	return res;
+}
+
+value value_packed_sort_now(value *op)
+{
+	struct value_packed *pk = op->core.u_pk;
+
+	if (pk->kind == PACKED_INT) {
+		qsort(pk->a.z, pk->length, sizeof(int64_t), &value_private_packed_cmp_int);
+	} else if (pk->kind == PACKED_FLOAT) {
+		qsort(pk->a.f, pk->length, sizeof(double), &value_private_packed_cmp_float);
+	} else {
+		// There are only two possible values, so just count them.
+		size_t i, falses = 0;
+		for (i = 0; i < pk->length; ++i)
+			falses += !pk->a.b[i];
+		memset(pk->a.b, 0, falses);
+		memset(pk->a.b + falses, 1, pk->length - falses);
+	}
+
+	return value_init_nil();
+}
+
+/*
+ * Integers are added up in an int64_t by value_vector_sum_int(). If that overflows,
+ * they're added up again here, and moved into a GMP number whenever the next one
+ * would overflow the int64_t. Floats are added up by value_vector_sum_float() if the
+ * default precision is 53 bits.
+ * Booleans are counted as 1 for true and 0 for false.
+ */
+value value_packed_sum(value op)
+{
+	struct value_packed *pk = op.core.u_pk;
+	size_t i;
+
+	if (pk->kind == PACKED_FLOAT && mpfr_get_default_prec() == DBL_MANT_DIG)
+		return value_set_double(value_vector_sum_float(pk->a.f, pk->length));
+
+	if (pk->kind == PACKED_FLOAT) {
+		// A double would round differently than MPFR at the default precision.
+		value res = value_set_long(0);
+		for (i = 0; i < pk->length; ++i) {
+			value x = value_packed_get(op, i);
+			value_add_now(&res, x);
+			value_clear(&x);
+		}
+		return res;
+	}
+
+	if (pk->kind == PACKED_BOOL) {
+		long count = 0;
+		for (i = 0; i < pk->length; ++i)
+			count += pk->a.b[i];
+		return value_set_long(count);
+	}
+
+	int64_t sum = 0;
+	if (value_vector_sum_int(&sum, pk->a.z, pk->length) == FALSE)
+		return value_set_long(sum);
+
+	value res = value_set_long(0);
+	for (i = 0; i < pk->length; ++i) {
+		int64_t x = pk->a.z[i];
+		if ((x > 0 && sum > INT64_MAX - x) || (x < 0 && sum < INT64_MIN - x)) {
+			if (sum >= 0)
+				mpz_add_ui(res.core.u_mz, res.core.u_mz, (unsigned long) sum);
+			else mpz_sub_ui(res.core.u_mz, res.core.u_mz, -(unsigned long) sum);
+			sum = 0;
+		}
+		sum += x;
+	}
+
+	if (sum >= 0)
+		mpz_add_ui(res.core.u_mz, res.core.u_mz, (unsigned long) sum);
+	else mpz_sub_ui(res.core.u_mz, res.core.u_mz, -(unsigned long) sum);
+
+	return res;
+}
+
+int value_private_unpack_args(struct value_spec spec, int argc, value argv[], value saved[])
+{
+	int i, packed_p = FALSE, nd_p = FALSE, slice_p = FALSE;
+	for (i = 0; i < argc; ++i) {
+		if (argv[i].type == VALUE_PAK)
+			packed_p = TRUE;
+		else if (argv[i].type == VALUE_NDA)
+			nd_p = TRUE;
+		else if (argv[i].type == VALUE_SLC)
+			slice_p = TRUE;
+	}
+
+	if (spec.packed_aware_p)
+		packed_p = FALSE;
+	if (spec.nd_aware_p)
+		nd_p = FALSE;
+	if (spec.slice_aware_p)
+		slice_p = FALSE;
+	if (packed_p == FALSE && nd_p == FALSE && slice_p == FALSE)
+		return FALSE;
+
+	for (i = 0; i < argc; ++i) {
+		saved[i].type = VALUE_NIL;
+		value ary;
+		if (packed_p && argv[i].type == VALUE_PAK)
+			ary = value_unpack(argv[i]);
+		else if (nd_p && argv[i].type == VALUE_NDA)
+			ary = value_nd_to_a(argv[i]);
+		else if (slice_p && argv[i].type == VALUE_SLC)
+			ary = value_unslice(argv[i]);
+		else continue;
+		
+		if (ary.type == VALUE_ERROR)
+			continue;
+		saved[i] = argv[i];
+		argv[i] = ary;
+	}
+
+	return TRUE;
+}
+
+void value_private_repack_args(int argc, value argv[], value saved[], int keep[])
+{
+	int i;
+	for (i = 0; i < argc; ++i) {
+		if (saved[i].type != VALUE_PAK && saved[i].type != VALUE_NDA && saved[i].type != VALUE_SLC)
+			continue;
+
+		if (keep && keep[i]) {
+			// The arrays are kept as they are if they no longer have a shape. A slice 
+			// stays the copy that was made of it.
+			if (saved[i].type == VALUE_PAK)
+				value_pack_now(&argv[i]);
+			else if (saved[i].type == VALUE_NDA)
+				value_to_nd_now(&argv[i]);
+			value_clear(&saved[i]);
+		} else {
+			value_clear(&argv[i]);
+			argv[i] = saved[i];
+		}
+	}
+}
+
+value value_pack_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "pack()") ? value_init_error() : value_pack(argv[0]);
+}
+
+value value_packed_p_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "packed?()") ? value_init_error() : value_set_bool(argv[0].type == VALUE_PAK);
+}
@@ -42,15 +42,41 @@ int compile_regex(regex_t *compiled, char *regex, int flags)
 	return r;
 }
 
+int value_regexec(regex_t *compiled, value str, size_t nmatch, regmatch_t pmatch[])
+{
+	if (str.type != VALUE_SLC)
+		return regexec(compiled, str.core.u_s, nmatch, pmatch, 0);
+	
+	// A slice isn't NUL-terminated, so where it ends goes in the first match instead.
+	size_t length;
+	char *s = value_string_view(str, &length);
+	regmatch_t bounds[nmatch ? nmatch : 1];
+	bounds[0].rm_so = 0;
+	bounds[0].rm_eo = length;
+	int res = regexec(compiled, s, nmatch, bounds, REG_STARTEND);
+	if (res == 0)
+		memcpy(pmatch, bounds, sizeof(regmatch_t) * nmatch);
+	return res;
+}
+
 int value_match_p(value regex, value str)
 {
+	if (regex.type == VALUE_SLC) {
+		value copy = value_unslice(regex);
+		if (copy.type == VALUE_ERROR)
+			return -2;
+		int res = value_match_p(copy, str);
+		value_clear(&copy);
+		return res;
+	}
+	
 	int error_p = FALSE;
 	if (regex.type != VALUE_RGX && regex.type != VALUE_STR) {
 		value_error(1, "Type Error: match?() is undefined where regex is %ts (string or regular expression expected).", regex);
 		error_p = TRUE;
 	}
 	
-	if (str.type != VALUE_STR) {
+	if (value_slice_type(str) != VALUE_STR) {
 		value_error(1, "Type Error: match?() is undefined where str is %ts (string expected).", str);
 		error_p = TRUE;
 	}
@@ -62,7 +88,7 @@ int value_match_p(value regex, value str)
 	int r = compile_regex(&compiled, regex.core.u_x, 0);
 	if (r != 0)
 		return -2;
-	int match = regexec(&compiled, str.core.u_s, 0, NULL, 0);
+	int match = value_regexec(&compiled, str, 0, NULL);
 	if (match == REG_ESPACE) {
 		value_error(1, "Memory Error: match?() ran out of memory.");
 		return -3;
@@ -89,13 +115,20 @@ value value_match_p_std(value regex, value str)
  */
 regmatch_t value_match(value regex, value str)
 {
+	if (regex.type == VALUE_SLC) {
+		value copy = value_unslice(regex);
+		regmatch_t res = value_match(copy, str);
+		value_clear(&copy);
+		return res;
+	}
+	
 	int error_p = FALSE;
 	if (regex.type != VALUE_RGX && regex.type != VALUE_STR) {
 		value_error(1, "Type Error: match() is undefined where regex is %ts (string or regular expression expected).", regex);
 		error_p = TRUE;
 	}
 	
-	if (str.type != VALUE_STR) {
+	if (value_slice_type(str) != VALUE_STR) {
 		value_error(1, "Type Error: match() is undefined where str is %ts (string expected).", str);
 		error_p = TRUE;
 	}
@@ -115,7 +148,7 @@ regmatch_t value_match(value regex, value str)
 		return matchptr[0];
 	}
 	
-	int match = regexec(&compiled, str.core.u_s, 1, matchptr, 0);
+	int match = value_regexec(&compiled, str, 1, matchptr);
 	if (match == REG_ESPACE) {
 		value_error(1, "Memory Error: match() ran out of memory.");
 		matchptr[0].rm_so = -2;
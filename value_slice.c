@@ -0,0 +1,356 @@
+/*
+ *  value_slice.c
+ *  Simfpl
+ *
+ *  All definitions for functions and variables in value_slice.c can be found in value.h.
+ *
+ */
+
+/*
+ * Slice Implementation
+ *
+ * range(), take() and drop() used to copy whatever they selected, so a loop that keeps
+ * cutting pieces off the front of a long string copied the rest of it every time. A
+ * slice refers to (length) characters or elements of a value_slice_data, starting at
+ * (offset). Slicing a slice only makes a header with a different offset and length, and
+ * value_set() only makes one more header, so neither of them copies the block. The
+ * block is freed along with the last header that uses it.
+ *
+ * Some pieces are still copied. One shorter than SLICE_MIN_LENGTH costs about as much
+ * to copy as to share. One shorter than 1 / SLICE_RETAIN_RATIO of its block gets a
+ * block of its own, so that holding on to a small piece doesn't keep a large block
+ * alive. A slice of an ordinary string or array copies what it selects into a new
+ * block, which costs what range() always did, and slices of that slice are free.
+ *
+ * The characters of a slice aren't NUL-terminated, so the string functions that read
+ * them go by value_string_view() and value_regexec() instead of the C string functions.
+ * Built-in functions that haven't been taught about slices are handed ordinary copies,
+ * the same way that value_bifcall_sexp() unpacks packed arrays. A function that changes
+ * its argument in place leaves the variable holding the copy, so the characters and
+ * elements of a block are never changed once it's made.
+ */
+
+#include "value.h"
+
+value value_slice(value op, size_t start, size_t end)
+{
+	size_t length, count = end - start;
+	char *s = value_string_view(op, &length);
+	value *a = s ? NULL : value_array_view(op, &length);
+
+	if (op.type == VALUE_SLC && count >= SLICE_MIN_LENGTH && count >= op.core.u_sl->data->length / SLICE_RETAIN_RATIO) {
+		value res = value_slice_set(op);
+		return_if_error(res);
+		res.core.u_sl->offset += start;
+		res.core.u_sl->length = count;
+		return res;
+	}
+
+	if (count < SLICE_MIN_LENGTH || count > UINT32_MAX)
+		return s ? value_set_str_length(s + start, count) : value_private_slice_array(a + start, count);
+
+	value res;
+	res.type = VALUE_SLC;
+	res.core.u_sl = value_malloc(NULL, sizeof(struct value_slice));
+	if (res.core.u_sl == NULL)
+		return value_init_error();
+	res.core.u_sl->data = value_private_slice_data(s ? s + start : NULL, s ? NULL : a + start, count);
+	if (res.core.u_sl->data == NULL) {
+		value_free(res.core.u_sl);
+		return value_init_error();
+	}
+	res.core.u_sl->offset = 0;
+	res.core.u_sl->length = count;
+	return res;
+}
+
+struct value_slice_data * value_private_slice_data(char *s, value a[], size_t length)
+{
+	struct value_slice_data *data = value_malloc(NULL, sizeof(struct value_slice_data));
+	if (data == NULL)
+		return NULL;
+
+	data->refcount = 1;
+	data->length = length;
+	data->s = NULL;
+	data->a = NULL;
+	if (s) {
+		data->s = value_malloc(NULL, length + 1);
+		if (data->s == NULL) {
+			value_free(data);
+			return NULL;
+		}
+		memcpy(data->s, s, length);
+		data->s[length] = '\0';
+	} else {
+		data->a = value_malloc(NULL, sizeof(value) * (length ? length : 1));
+		if (data->a == NULL) {
+			value_free(data);
+			return NULL;
+		}
+		size_t i;
+		for (i = 0; i < length; ++i)
+			data->a[i] = value_set(a[i]);
+	}
+
+	return data;
+}
+
+value value_private_slice_array(value a[], size_t length)
+{
+	value res;
+	res.type = VALUE_ARY;
+	value_malloc(&res, length + 1);
+	return_if_error(res);
+
+	size_t i;
+	for (i = 0; i < length; ++i)
+		res.core.u_a.a[i] = value_set(a[i]);
+	res.core.u_a.length = length;
+	return res;
+}
+
+value value_slice_set(value op)
+{
+	struct value_slice *header = value_malloc(NULL, sizeof(struct value_slice));
+	if (header == NULL)
+		return value_init_error();
+	*header = *op.core.u_sl;
+	++header->data->refcount;
+	op.core.u_sl = header;
+	return op;
+}
+
+void value_slice_clear(value *op)
+{
+	struct value_slice_data *data = op->core.u_sl->data;
+	value_free(op->core.u_sl);
+	if (data == NULL || --data->refcount > 0)
+		return;
+
+	if (data->a) {
+		size_t i;
+		for (i = 0; i < data->length; ++i)
+			value_clear(&data->a[i]);
+		value_free(data->a);
+	} else value_free(data->s);
+	value_free(data);
+}
+
+value value_unslice(value op)
+{
+	if (op.type != VALUE_SLC)
+		return value_set(op);
+
+	size_t length;
+	char *s = value_string_view(op, &length);
+	if (s)
+		return value_set_str_length(s, length);
+	value *a = value_array_view(op, &length);
+	return value_private_slice_array(a, length);
+}
+
+int value_unslice_now(value *op)
+{
+	if (op->type != VALUE_SLC)
+		return 0;
+
+	value res = value_unslice(*op);
+	if (res.type == VALUE_ERROR)
+		return VALUE_ERROR;
+	value_slice_clear(op);
+	*op = res;
+	return 0;
+}
+
+int value_slice_type(value op)
+{
+	if (op.type == VALUE_SLC)
+		return op.core.u_sl->data->s ? VALUE_STR : VALUE_ARY;
+	return op.type;
+}
+
+char * value_string_view(value op, size_t *length)
+{
+	if (op.type == VALUE_STR) {
+		*length = strlen(op.core.u_s);
+		return op.core.u_s;
+	} else if (op.type == VALUE_SLC && op.core.u_sl->data->s) {
+		*length = op.core.u_sl->length;
+		return op.core.u_sl->data->s + op.core.u_sl->offset;
+	}
+
+	*length = 0;
+	return NULL;
+}
+
+value * value_array_view(value op, size_t *length)
+{
+	if (op.type == VALUE_ARY) {
+		*length = op.core.u_a.length;
+		return op.core.u_a.a;
+	} else if (op.type == VALUE_SLC && op.core.u_sl->data->a) {
+		*length = op.core.u_sl->length;
+		return op.core.u_sl->data->a + op.core.u_sl->offset;
+	}
+
+	*length = 0;
+	return NULL;
+}
+
+long value_string_find(value op, char *str, size_t length)
+{
+	if (op.type == VALUE_STR) {
+		char *ptr = strstr(op.core.u_s, str);
+		return ptr ? ptr - op.core.u_s : -1;
+	}
+
+	size_t op_length;
+	char *s = value_string_view(op, &op_length), *ptr = s;
+	if (length == 0)
+		return 0;
+
+	// Find each place where the first character occurs, and check the rest there.
+	while (op_length - (ptr - s) >= length) {
+		ptr = memchr(ptr, *str, op_length - (ptr - s) - length + 1);
+		if (ptr == NULL)
+			return -1;
+		if (memcmp(ptr, str, length) == 0)
+			return ptr - s;
+		++ptr;
+	}
+
+	return -1;
+}
+
+value value_slice_at(value op, value index, value more[], size_t length)
+{
+	if (index.type != VALUE_MPZ) {
+		value copy = value_unslice(op);
+		return_if_error(copy);
+		value res = value_at(copy, index, more, length);
+		value_clear(&copy);
+		return res;
+	}
+
+	char *s = op.core.u_sl->data->s;
+	if (value_lt(index, value_zero) || value_gt(index, value_int_max) || value_get_long(index) >= op.core.u_sl->length) {
+		value_error(1, "Domain Error: in at(), index %s is beyond the bounds of %c %s.", index, s ? "string" : "array", op);
+		return value_init_error();
+	}
+
+	size_t i = op.core.u_sl->offset + value_get_long(index);
+	value res = s ? value_set_str_length(s + i, 1) : value_set(op.core.u_sl->data->a[i]);
+	if (length == 0 || res.type == VALUE_ERROR)
+		return res;
+
+	value real_res = value_at(res, more[0], more+1, length-1);
+	value_clear(&res);
+	return real_res;
+}
+
+value value_slice_each(value *variables, value op, value func)
+{
+	if (op.core.u_sl->data->s) {
+		value_error(1, "Type Error: each() is undefined where op is %ts (iterable expected).", op);
+		return value_init_error();
+	}
+
+	// Hold on to the elements in case the function changes the variable that they
+	// came from.
+	value hold = value_slice_set(op);
+	value res = value_init_nil();
+	size_t i, length;
+	value *a = value_array_view(op, &length);
+	for (i = 0; i < length; ++i) {
+		value tmp = value_call(variables, func, 1, a + i);
+		if (tmp.type == VALUE_STOP && tmp.core.u_stop.type == STOP_BREAK) {
+			break;
+		} else if (tmp.type == VALUE_STOP && tmp.core.u_stop.type == STOP_YIELD) {
+			if (res.type == VALUE_NIL) res = value_init(VALUE_ARY);
+			value_append_now(&res, *tmp.core.u_stop.core);
+		} else if (tmp.type == VALUE_ERROR || (tmp.type == VALUE_STOP && (tmp.core.u_stop.type == STOP_RETURN || tmp.core.u_stop.type == STOP_EXIT))) {
+			value_clear(&res);
+			res = tmp;
+			break;
+		}
+		value_clear(&tmp);
+	}
+
+	value_slice_clear(&hold);
+	return res;
+}
+
+int value_slice_eq(value op1, value op2)
+{
+	size_t i, length1, length2;
+	char *s1 = value_string_view(op1, &length1), *s2 = value_string_view(op2, &length2);
+	if (s1 && s2)
+		return length1 == length2 && memcmp(s1, s2, length1) == 0;
+
+	value *a1 = value_array_view(op1, &length1), *a2 = value_array_view(op2, &length2);
+	if (a1 && a2) {
+		if (length1 != length2)
+			return FALSE;
+		for (i = 0; i < length1; ++i)
+			if (value_ne(a1[i], a2[i]))
+				return FALSE;
+		return TRUE;
+	}
+
+	value x = value_unslice(op1), y = value_unslice(op2);
+	int res = value_eq(x, y);
+	value_clear(&x);
+	value_clear(&y);
+	return res;
+}
+
+int value_slice_cmp(value op1, value op2, int any_p)
+{
+	size_t i, length1, length2;
+	int cmp;
+	char *s1 = value_string_view(op1, &length1), *s2 = value_string_view(op2, &length2);
+	if (s1 && s2) {
+		cmp = memcmp(s1, s2, length1 < length2 ? length1 : length2);
+		if (cmp)
+			return (cmp > 0) - (cmp < 0);
+		return (length1 > length2) - (length1 < length2);
+	}
+
+	value *a1 = value_array_view(op1, &length1), *a2 = value_array_view(op2, &length2);
+	if (a1 && a2) {
+		for (i = 0; i < length1 && i < length2; ++i)
+			if ((cmp = value_cmp_any(a1[i], a2[i])) != 0)
+				return cmp;
+		return (length1 > length2) - (length1 < length2);
+	}
+
+	value x = value_unslice(op1), y = value_unslice(op2);
+	int res = any_p ? value_cmp_any(x, y) : value_cmp(x, y);
+	value_clear(&x);
+	value_clear(&y);
+	return res;
+}
+
+size_t value_slice_hash_function(value op)
+{
+	value copy = value_unslice(op);
+	size_t hash = value_private_hash_function(copy);
+	value_clear(&copy);
+	return hash;
+}
+
+int value_slice_put(char buffer[], size_t length, value op, char *format)
+{
+	value copy = value_unslice(op);
+	if (copy.type == VALUE_ERROR)
+		return VALUE_ERROR;
+	int error_p = value_put(buffer, length, copy, format);
+	value_clear(&copy);
+	return error_p;
+}
+
+value value_slice_p_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "slice?()") ? value_init_error() : value_set_bool(argv[0].type == VALUE_SLC);
+}
@@ -59,8 +59,9 @@ value value_capitalize(value op)
 	strcpy(res.core.u_s, op.core.u_s);
 	char *ptr = res.core.u_s;
 	*ptr = toupper(*ptr);
-	while (*(++ptr) = tolower(*ptr))
-		;
+	if (*ptr)
+		while (*(++ptr))
+			*ptr = tolower(*ptr);
 	
 	return res;
 }
@@ -176,15 +177,17 @@ int value_contains_p(value op1, value op2)
 
 value value_contains_p_std(value op1, value op2)
 {
-	if (op1.type == VALUE_STR) {
-		if (op2.type == VALUE_STR) {
-			return value_set_bool(strstr(op1.core.u_s, op2.core.u_s) != NULL);
+	size_t length;
+	char *str;
+	if (value_slice_type(op1) == VALUE_STR) {
+		if ((str = value_string_view(op2, &length)) != NULL) {
+			return value_set_bool(value_string_find(op1, str, length) >= 0);
 		} else if (op2.type == VALUE_RGX) {
 			regex_t compiled;
 			int r = compile_regex(&compiled, op2.core.u_x, 0);
 			if (r != 0)
 				return value_init_error();
-			int match = regexec(&compiled, op1.core.u_s, 0, NULL, 0);
+			int match = value_regexec(&compiled, op1, 0, NULL);
 			if (match == REG_ESPACE) {
 				value_error(1, "Memory Error: contains?() ran out of memory.");
 				return value_init_error();
@@ -195,11 +198,11 @@ value value_contains_p_std(value op1, value op2)
 			return value_init_error();
 		}
 
-	} else if (op1.type == VALUE_ARY) {
-		int length = value_length(op1);
-		int i;
+	} else if (value_slice_type(op1) == VALUE_ARY) {
+		value *a = value_array_view(op1, &length);
+		size_t i;
 		for (i = 0; i < length; ++i)
-			if (value_eq(op1.core.u_a.a[i], op2))
+			if (value_eq(a[i], op2))
 				return value_set_bool(TRUE);
 		return value_set_bool(FALSE);
 		
@@ -233,12 +236,12 @@ int value_ends_with_p(value op1, value op2)
 value value_ends_with_p_std(value op1, value op2)
 {
 	int error_p = FALSE;
-	if (op1.type != VALUE_STR) {
+	if (value_slice_type(op1) != VALUE_STR) {
 		value_error(1, "Type Error: ends_with() is undefined where op1 is %ts (string expected).", op1);
 		error_p = TRUE;
 	}
 		
-	if (op2.type != VALUE_STR) {
+	if (value_slice_type(op2) != VALUE_STR) {
 		value_error(1, "Type Error: ends_with() is undefined where op2 is %ts (string expected).", op2);
 		error_p = TRUE;
 	}
@@ -246,18 +249,18 @@ value value_ends_with_p_std(value op1, value op2)
 	if (error_p)
 		return value_init_error();
 	
-	size_t addition = value_length(op1) - value_length(op2);
-	return value_set_bool(strcmp(op1.core.u_s + addition, op2.core.u_s) == 0);
+	size_t length1, length2;
+	char *s1 = value_string_view(op1, &length1), *s2 = value_string_view(op2, &length2);
+	return value_set_bool(length1 >= length2 && memcmp(s1 + length1 - length2, s2, length2) == 0);
 }
 
 size_t value_index(value op1, value op2)
 {	
-	if (op1.type == VALUE_STR) {
-		if (op2.type == VALUE_STR) {
-			char *ptr = strstr(op1.core.u_s, op2.core.u_s);
-			if (ptr == NULL)
-				return -1;
-			else return ptr - op1.core.u_s;
+	size_t length;
+	char *str;
+	if (value_slice_type(op1) == VALUE_STR) {
+		if ((str = value_string_view(op2, &length)) != NULL) {
+			return (size_t) value_string_find(op1, str, length);
 		} else if (op2.type == VALUE_RGX) {
 			regex_t compiled;
 			int r = compile_regex(&compiled, op2.core.u_x, 0);
@@ -267,7 +270,7 @@ size_t value_index(value op1, value op2)
 			// The first element of regexec() tells where the string matches. That's all we care about.
 			regmatch_t matchptr[1];
 			matchptr[0].rm_so = -1;
-			int match = regexec(&compiled, op1.core.u_s, 1, matchptr, 0);
+			int match = value_regexec(&compiled, op1, 1, matchptr);
 			if (match == REG_ESPACE) {
 				value_error(1, "Memory Error: match() ran out of memory.");
 				return -2;
@@ -283,11 +286,11 @@ size_t value_index(value op1, value op2)
 
 	}
 	
-	if (op1.type == VALUE_ARY) {
-		size_t length = value_length(op1);
+	if (value_slice_type(op1) == VALUE_ARY) {
+		value *a = value_array_view(op1, &length);
 		size_t i;
 		for (i = 0; i < length; ++i)
-			if (value_eq(op1.core.u_a.a[i], op2))
+			if (value_eq(a[i], op2))
 				return i;
 		return -1;
 	}
@@ -316,12 +319,14 @@ size_t value_index(value op1, value op2)
 
 value value_index_std(value op1, value op2)
 {
-	if (op1.type == VALUE_STR) {
-		if (op2.type == VALUE_STR) {
-			char *ptr = strstr(op1.core.u_s, op2.core.u_s);
-			if (ptr == NULL)
+	size_t length;
+	char *str;
+	if (value_slice_type(op1) == VALUE_STR) {
+		if ((str = value_string_view(op2, &length)) != NULL) {
+			long index = value_string_find(op1, str, length);
+			if (index < 0)
 				return value_init_nil();
-			else return value_set_long(ptr - op1.core.u_s);
+			else return value_set_long(index);
 		} else if (op2.type == VALUE_RGX) {
 			regex_t compiled;
 			int r = compile_regex(&compiled, op2.core.u_x, 0);
@@ -331,7 +336,7 @@ value value_index_std(value op1, value op2)
 			// The first element of regexec() tells where the string matches. That's all we care about.
 			regmatch_t matchptr[1];
 			matchptr[0].rm_so = -1;
-			int match = regexec(&compiled, op1.core.u_s, 1, matchptr, 0);
+			int match = value_regexec(&compiled, op1, 1, matchptr);
 			if (match == REG_ESPACE) {
 				value_error(1, "Memory Error: match() ran out of memory.");
 				return value_init_error();
@@ -345,11 +350,11 @@ value value_index_std(value op1, value op2)
 			return value_init_error();			
 		}
 
-	} else if (op1.type == VALUE_ARY) {
-		size_t length = value_length(op1);
+	} else if (value_slice_type(op1) == VALUE_ARY) {
+		value *a = value_array_view(op1, &length);
 		size_t i;
 		for (i = 0; i < length; ++i)
-			if (value_eq(op1.core.u_a.a[i], op2))
+			if (value_eq(a[i], op2))
 				return value_set_ulong(i);
 		return value_init_nil();
 		
@@ -424,8 +429,7 @@ value value_insert(value op1, value index, value op3)
 		if (inx > length)
 			inx = length;
 		
-		res.core.u_a.a = value_malloc(NULL, sizeof(value) * next_size(op1.core.u_a.length + 1));
-		return_if_null(res.core.u_a.a);
+		return_if_null(value_malloc(&res, next_size(op1.core.u_a.length + 1)));
 		res.core.u_a.length = op1.core.u_a.length + 1;
 		size_t i;
 		for (i = 0; i < inx; ++i)
@@ -549,10 +553,8 @@ value value_insert_now(value *op1, value index, value op3)
 			return value_init_error();
 		}
 		
-		if (resize_p(op1->core.u_a.length)) {
-			value_realloc(op1, next_size(op1->core.u_a.length));
-			return_if_error(*op1);
-		}
+		if (!value_private_array_grow(op1, op1->core.u_a.length + 1))
+			return value_init_error();
 				
 		long i;
 		for (i = op1->core.u_a.length; inx < i; )
@@ -734,6 +736,12 @@ size_t value_length(value op)
 		return strlen(op.core.u_s);
 	else if (op.type == VALUE_ARY)
 		return op.core.u_a.length;
+	else if (op.type == VALUE_PAK)
+		return op.core.u_pk->length;
+	else if (op.type == VALUE_NDA)
+		return op.core.u_nd->shape[0];
+	else if (op.type == VALUE_SLC)
+		return op.core.u_sl->length;
 	else if (op.type == VALUE_LST) {
 		size_t length = 0;
 		while (op.type == VALUE_LST) {
@@ -764,6 +772,12 @@ value value_length_std(value op)
 		return value_set_long(strlen(op.core.u_s));
 	else if (op.type == VALUE_ARY)
 		return value_set_long((long) op.core.u_a.length);
+	else if (op.type == VALUE_PAK)
+		return value_set_long((long) op.core.u_pk->length);
+	else if (op.type == VALUE_NDA)
+		return value_set_long((long) op.core.u_nd->shape[0]);
+	else if (op.type == VALUE_SLC)
+		return value_set_long((long) op.core.u_sl->length);
 	else if (op.type == VALUE_LST || op.type == VALUE_PAR)
 		return value_set_long(value_length(op));
 	else if (op.type == VALUE_BLK)
@@ -782,7 +796,7 @@ value value_lstrip(value op)
 		while (isspace(*ptr))
 			++ptr;
 		res.type = VALUE_STR;
-		res.core.u_s = value_malloc(NULL, strlen(ptr));
+		res.core.u_s = value_malloc(NULL, strlen(ptr) + 1);
 		return_if_null(res.core.u_s);
 		strcpy(res.core.u_s, ptr);
 	} else {
@@ -795,7 +809,7 @@ value value_lstrip(value op)
 
 value value_range(value op, value start, value end)
 {
-	long istart, iend;
+	long istart = 0, iend = 0;
 	int error_p = FALSE;
 	
 	if (start.type == VALUE_MPZ) {
@@ -812,7 +826,7 @@ value value_range(value op, value start, value end)
 		error_p = TRUE;
 	}
 	
-	if (op.type == VALUE_STR || op.type == VALUE_RGX) {
+	if (op.type == VALUE_RGX) {
 		if (error_p)
 			return value_init_error();
 		
@@ -834,7 +848,9 @@ value value_range(value op, value start, value end)
 		return res;
 	}
 	
-	if (op.type == VALUE_ARY) {
+	// A long enough piece of a string or array shares its characters or elements 
+	// instead of copying them. See value_slice().
+	if (op.type == VALUE_STR || op.type == VALUE_ARY || op.type == VALUE_SLC) {
 		if (error_p)
 			return value_init_error();
 
@@ -849,17 +865,7 @@ value value_range(value op, value start, value end)
 		if (iend > length)
 			iend = length;
 		
-		value res;
-		res.type = VALUE_ARY;
-		res.core.u_a.a = value_malloc(NULL, sizeof(value) * (iend - istart + 1));
-		return_if_null(res.core.u_a.a);
-
-		size_t i;
-		for (i = istart; i < iend; ++i)
-			res.core.u_a.a[i-istart] = value_set(op.core.u_a.a[i]);
-		res.core.u_a.length = iend - istart;
-		
-		return res;
+		return value_slice(op, istart, iend);
 	}
 	
 	value_error(1, "Type Error: Operation range() is undefined where op is %ts (string or array expected).", op);
@@ -1069,7 +1075,7 @@ value value_rstrip(value op)
 		char saved = *(end+1);
 		*(end+1) = '\0';
 		res.type = VALUE_STR;
-		value_malloc(&res, strlen(op.core.u_s));
+		value_malloc(&res, strlen(op.core.u_s) + 1);
 		return_if_error(res);
 		strcpy(res.core.u_s, op.core.u_s);
 		*(end+1) = saved;
@@ -1137,12 +1143,12 @@ value value_scan(value op1, value op2)
 value value_split(value op1, value op2)
 {
 	int error_p = FALSE;
-	if (op1.type != VALUE_STR) {
+	if (value_slice_type(op1) != VALUE_STR) {
 		value_error(1, "Type Error: split() is undefined where op1 is %ts (string expected).", op1);
 		error_p = TRUE;
 	}
 		
-	if (op2.type != VALUE_STR) {
+	if (value_slice_type(op2) != VALUE_STR) {
 		value_error(1, "Type Error: split() is undefined where op2 is %ts (string expected).", op2);
 		error_p = TRUE;
 	}
@@ -1150,15 +1156,16 @@ value value_split(value op1, value op2)
 	if (error_p)
 		return value_init_error();
 	
-	char *str = op2.core.u_s;
-	size_t len = strlen(str);
+	// Goes by lengths rather than NUL characters, since a slice doesn't end in one.
+	size_t len, length;
+	char *str = value_string_view(op2, &len);
+	char *start = value_string_view(op1, &length);
+	char *ptr = start, *end = start + length;
 	
 	value res = value_init(VALUE_ARY);
-	char *start = op1.core.u_s;
-	char *ptr = start;
 	
 	if (len == 0) {
-		while (*ptr) {
+		while (ptr < end) {
 			value tmp = value_set_str_length(ptr, 1);
 			value_append_now2(&res, &tmp);
 			++ptr;
@@ -1166,26 +1173,20 @@ value value_split(value op1, value op2)
 		return res;
 	}
 	
-	char saved;
 	value temp;
-	while (*ptr != '\0') {
-		if (strncmp(ptr, str, len) == 0) {
-			saved = *ptr;
-			*ptr = '\0';
-			if (strlen(start) > 0) {
-				temp = value_set_str(start);
-				value_append_now(&res, temp);
-				value_clear(&temp);
+	while (ptr < end) {
+		if ((size_t) (end - ptr) >= len && memcmp(ptr, str, len) == 0) {
+			if (ptr > start) {
+				temp = value_set_str_length(start, ptr - start);
+				value_append_now2(&res, &temp);
 			}
-			*ptr = saved;
 			ptr += len;
 			start = ptr;
 		} else ++ptr;
 	}
 	
-	temp = value_set_str(start);
-	value_append_now(&res, temp);
-	value_clear(&temp);
+	temp = value_set_str_length(start, end - start);
+	value_append_now2(&res, &temp);
 	
 	return res;
 }
@@ -1193,12 +1194,12 @@ value value_split(value op1, value op2)
 int value_starts_with_p(value op1, value op2)
 {
 	int error_p = FALSE;
-	if (op1.type != VALUE_STR) {
+	if (value_slice_type(op1) != VALUE_STR) {
 		value_error(1, "Type Error: starts_with() is undefined where op1 is %ts (string expected).", op1);
 		error_p = TRUE;
 	}
 		
-	if (op2.type != VALUE_STR) {
+	if (value_slice_type(op2) != VALUE_STR) {
 		value_error(1, "Type Error: starts_with() is undefined where op2 is %ts (string expected).", op2);
 		error_p = TRUE;
 	}
@@ -1206,18 +1207,24 @@ int value_starts_with_p(value op1, value op2)
 	if (error_p)
 		return VALUE_ERROR;
 	
-	return strncmp(op1.core.u_s, op2.core.u_s, value_length(op2)) == 0;
+	// Only a slice's length is needed, since strncmp() stops at the end of a string.
+	size_t length1, length2;
+	char *s2 = value_string_view(op2, &length2);
+	if (op1.type == VALUE_STR)
+		return strncmp(op1.core.u_s, s2, length2) == 0;
+	char *s1 = value_string_view(op1, &length1);
+	return length1 >= length2 && memcmp(s1, s2, length2) == 0;
 }
 
 value value_starts_with_p_std(value op1, value op2)
 {
 	int error_p = FALSE;
-	if (op1.type != VALUE_STR) {
+	if (value_slice_type(op1) != VALUE_STR) {
 		value_error(1, "Type Error: starts_with() is undefined where op1 is %ts (string expected).", op1);
 		error_p = TRUE;
 	}
 		
-	if (op2.type != VALUE_STR) {
+	if (value_slice_type(op2) != VALUE_STR) {
 		value_error(1, "Type Error: starts_with() is undefined where op2 is %ts (string expected).", op2);
 		error_p = TRUE;
 	}
@@ -1225,7 +1232,7 @@ value value_starts_with_p_std(value op1, value op2)
 	if (error_p)
 		return value_init_error();
 	
-	return value_set_bool(strncmp(op1.core.u_s, op2.core.u_s, value_length(op2)) == 0);
+	return value_set_bool(value_starts_with_p(op1, op2));
 }
 
 value value_strip(value op)
@@ -1245,7 +1252,7 @@ value value_strip(value op)
 	char saved = *(end+1);
 	*(end+1) = '\0';
 	res.type = VALUE_STR;
-	value_malloc(&res, strlen(ptr));
+	value_malloc(&res, strlen(ptr) + 1);
 	return_if_error(res);
 	strcpy(res.core.u_s, ptr);
 	*(end+1) = saved;
@@ -1282,9 +1289,9 @@ value value_to_upper(value op)
 	}
 	
 	value res = value_set_str(op.core.u_s);
-	char *ptr = res.core.u_s - 1;
-	while (*(++ptr) = toupper(*ptr))
-		;
+	char *ptr;
+	for (ptr = res.core.u_s; *ptr; ++ptr)
+		*ptr = toupper(*ptr);
 	
 	return res;
 }
@@ -1297,9 +1304,9 @@ value value_to_lower(value op)
 	}
 	
 	value res = value_set_str(op.core.u_s);
-	char *ptr = res.core.u_s - 1;
-	while (*(++ptr) = tolower(*ptr))
-		;
+	char *ptr;
+	for (ptr = res.core.u_s; *ptr; ++ptr)
+		*ptr = tolower(*ptr);
 	
 	return res;
 }
@@ -0,0 +1,1023 @@
+/*
+ *  value_vector.c
+ *  Simfpl
+ *
+ *  All definitions for functions and variables in value_vector.c can be found in value.h.
+ *
+ */
+
+/*
+ * Vector Implementation
+ *
+ * The arrays given to a vector function are packed first (see value_packed.c). A number
+ * given in place of an array is treated as a packed array of one element with a step of
+ * 0, so that it lines up with every element of the other array. If both sides are packed
+ * integers or floats, the loop runs over the raw numbers: four at a time with AVX2, two
+ * at a time with SSE2, and one at a time on processors that have neither. Integers and
+ * floats together are done as floats.
+ *
+ * The integer loops watch for overflow, and the float loops watch for infinities, NaNs
+ * and numbers too small for a double to hold all 53 bits of, none of which MPFR would
+ * give. When either turns up, or when an array doesn't
+ * pack, the whole operation is done again element by element with value_add() and the
+ * rest. Either way the elements of the result are the ones that map would give at the
+ * default precision of 53 bits. Dividing two integers rounds down, as / does.
+ *
+ * Sums and dot products of floats are kept in four running totals, one for each of
+ * the four lanes, which are added together at the end. The answer is the same at every
+ * SIMD level, but it can differ in the last bits from a sum taken left to right.
+ * prefix_sum() adds left to right.
+ *
+ * value_math.c hands arrays given to sin(), exp(), log(), sqrt(), ** and the rest to
+ * value_vector_math() and value_vector_op(). Those trade precision for speed like so:
+ *
+ *   - If the default precision is 53 bits and the array packs, each element is done
+ *     with the C library's function on a double, and the result is a packed array.
+ *     sqrt() is done with SIMD instructions and is correctly rounded. The others are
+ *     within an ulp or two of the correctly rounded answer (tests.c checks the bound
+ *     for each), so they can be a little off from what MPFR gives for one number.
+ *   - Otherwise, as after set_default_prec() with anything other than 53, each
+ *     element is done with MPFR at the default precision, which is exactly what map
+ *     would give.
+ *
+ * The same goes for floats in vadd() and the others: with any default precision other
+ * than 53 bits they are done with MPFR, since a double would round differently.
+ */
+
+#include "value.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VECTOR_X86
+#endif
+
+int value_vector_level()
+{
+	if (vector_level)
+		return vector_level;
+
+	vector_level = VECTOR_SCALAR;
+#ifdef VECTOR_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		vector_level = VECTOR_AVX2;
+	else if (__builtin_cpu_supports("sse2"))
+		vector_level = VECTOR_SSE2;
+#endif
+
+	char *str = getenv("SIMFPL_SIMD");
+	if (str && *str && atoi(str) + VECTOR_SCALAR < vector_level)
+		vector_level = atoi(str) + VECTOR_SCALAR;
+	return vector_level;
+}
+
+/*
+ * Whether (x) is an infinity, a NaN, or a nonzero number so small that a double
+ * can't hold 53 bits of it. MPFR would give none of these.
+ */
+int value_private_vector_unpackable_p(double x)
+{
+	return !(fabs(x) <= DBL_MAX) || (x != 0 && fabs(x) < DBL_MIN);
+}
+
+/*
+ * The SIMD kernels. Each one does as many elements as it can in whole vectors and
+ * returns the number it did; the caller finishes the rest one at a time. (a) and (b)
+ * must have at least one element.
+ */
+#ifdef VECTOR_X86
+
+__attribute__((target("avx2")))
+size_t value_private_vector_float_avx2(int op, double r[], double a[], size_t a_step, double b[], size_t b_step, size_t length, int *bad_p)
+{
+	if (op == VECTOR_POW)
+		return 0;
+
+	__m256d x = _mm256_set1_pd(a[0]), y = _mm256_set1_pd(b[0]), z;
+	__m256d zero = _mm256_setzero_pd(), check = zero, absz;
+	__m256d sign = _mm256_set1_pd(-0.0), max = _mm256_set1_pd(DBL_MAX), min = _mm256_set1_pd(DBL_MIN);
+	size_t i, end = length & ~(size_t) 3;
+
+	for (i = 0; i < end; i += 4) {
+		if (a_step)
+			x = _mm256_loadu_pd(a + i);
+		if (b_step)
+			y = _mm256_loadu_pd(b + i);
+		if (op == VECTOR_ADD)
+			z = _mm256_add_pd(x, y);
+		else if (op == VECTOR_SUB)
+			z = _mm256_sub_pd(x, y);
+		else if (op == VECTOR_MUL)
+			z = _mm256_mul_pd(x, y);
+		else z = _mm256_div_pd(x, y);
+		// Infinities, NaNs and nonzero numbers smaller than DBL_MIN.
+		absz = _mm256_andnot_pd(sign, z);
+		check = _mm256_or_pd(check, _mm256_cmp_pd(absz, max, _CMP_NLE_UQ));
+		check = _mm256_or_pd(check, _mm256_and_pd(_mm256_cmp_pd(absz, min, _CMP_LT_OQ), _mm256_cmp_pd(absz, zero, _CMP_NEQ_OQ)));
+		_mm256_storeu_pd(r + i, z);
+	}
+
+	*bad_p |= _mm256_movemask_pd(check) != 0;
+	return end;
+}
+
+__attribute__((target("sse2")))
+size_t value_private_vector_float_sse2(int op, double r[], double a[], size_t a_step, double b[], size_t b_step, size_t length, int *bad_p)
+{
+	if (op == VECTOR_POW)
+		return 0;
+
+	__m128d x = _mm_set1_pd(a[0]), y = _mm_set1_pd(b[0]), z;
+	__m128d zero = _mm_setzero_pd(), check = zero, absz;
+	__m128d sign = _mm_set1_pd(-0.0), max = _mm_set1_pd(DBL_MAX), min = _mm_set1_pd(DBL_MIN);
+	size_t i, end = length & ~(size_t) 1;
+
+	for (i = 0; i < end; i += 2) {
+		if (a_step)
+			x = _mm_loadu_pd(a + i);
+		if (b_step)
+			y = _mm_loadu_pd(b + i);
+		if (op == VECTOR_ADD)
+			z = _mm_add_pd(x, y);
+		else if (op == VECTOR_SUB)
+			z = _mm_sub_pd(x, y);
+		else if (op == VECTOR_MUL)
+			z = _mm_mul_pd(x, y);
+		else z = _mm_div_pd(x, y);
+		absz = _mm_andnot_pd(sign, z);
+		check = _mm_or_pd(check, _mm_cmpnle_pd(absz, max));
+		check = _mm_or_pd(check, _mm_and_pd(_mm_cmplt_pd(absz, min), _mm_cmpneq_pd(absz, zero)));
+		_mm_storeu_pd(r + i, z);
+	}
+
+	*bad_p |= _mm_movemask_pd(check) != 0;
+	return end;
+}
+
+/*
+ * There is no 64-bit integer multiply in AVX2 or SSE2, so only addition and
+ * subtraction are done here. An addition overflowed if the result's sign differs
+ * from the signs of both operands; a subtraction overflowed if the operands' signs
+ * differ and the result's sign differs from the first operand's.
+ */
+__attribute__((target("avx2")))
+size_t value_private_vector_int_avx2(int op, int64_t r[], int64_t a[], size_t a_step, int64_t b[], size_t b_step, size_t length, int *bad_p)
+{
+	if (op != VECTOR_ADD && op != VECTOR_SUB)
+		return 0;
+
+	__m256i x = _mm256_set1_epi64x(a[0]), y = _mm256_set1_epi64x(b[0]), z;
+	__m256i over = _mm256_setzero_si256();
+	size_t i, end = length & ~(size_t) 3;
+
+	for (i = 0; i < end; i += 4) {
+		if (a_step)
+			x = _mm256_loadu_si256((__m256i *) (a + i));
+		if (b_step)
+			y = _mm256_loadu_si256((__m256i *) (b + i));
+		if (op == VECTOR_ADD) {
+			z = _mm256_add_epi64(x, y);
+			over = _mm256_or_si256(over, _mm256_and_si256(_mm256_xor_si256(x, z), _mm256_xor_si256(y, z)));
+		} else {
+			z = _mm256_sub_epi64(x, y);
+			over = _mm256_or_si256(over, _mm256_and_si256(_mm256_xor_si256(x, y), _mm256_xor_si256(x, z)));
+		}
+		_mm256_storeu_si256((__m256i *) (r + i), z);
+	}
+
+	*bad_p |= _mm256_movemask_pd(_mm256_castsi256_pd(over)) != 0;
+	return end;
+}
+
+__attribute__((target("sse2")))
+size_t value_private_vector_int_sse2(int op, int64_t r[], int64_t a[], size_t a_step, int64_t b[], size_t b_step, size_t length, int *bad_p)
+{
+	if (op != VECTOR_ADD && op != VECTOR_SUB)
+		return 0;
+
+	__m128i x = _mm_set1_epi64x(a[0]), y = _mm_set1_epi64x(b[0]), z;
+	__m128i over = _mm_setzero_si128();
+	size_t i, end = length & ~(size_t) 1;
+
+	for (i = 0; i < end; i += 2) {
+		if (a_step)
+			x = _mm_loadu_si128((__m128i *) (a + i));
+		if (b_step)
+			y = _mm_loadu_si128((__m128i *) (b + i));
+		if (op == VECTOR_ADD) {
+			z = _mm_add_epi64(x, y);
+			over = _mm_or_si128(over, _mm_and_si128(_mm_xor_si128(x, z), _mm_xor_si128(y, z)));
+		} else {
+			z = _mm_sub_epi64(x, y);
+			over = _mm_or_si128(over, _mm_and_si128(_mm_xor_si128(x, y), _mm_xor_si128(x, z)));
+		}
+		_mm_storeu_si128((__m128i *) (r + i), z);
+	}
+
+	*bad_p |= _mm_movemask_pd(_mm_castsi128_pd(over)) != 0;
+	return end;
+}
+
+/*
+ * The reductions leave one running total per lane in (lanes), and return the
+ * number of elements done.
+ */
+__attribute__((target("avx2")))
+size_t value_private_vector_dot_float_avx2(double lanes[4], double a[], double b[], size_t length)
+{
+	__m256d sum = _mm256_setzero_pd();
+	size_t i, end = length & ~(size_t) 3;
+
+	if (b)
+		for (i = 0; i < end; i += 4)
+			sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+	else for (i = 0; i < end; i += 4)
+		sum = _mm256_add_pd(sum, _mm256_loadu_pd(a + i));
+
+	_mm256_storeu_pd(lanes, sum);
+	return end;
+}
+
+__attribute__((target("sse2")))
+size_t value_private_vector_dot_float_sse2(double lanes[4], double a[], double b[], size_t length)
+{
+	__m128d low = _mm_setzero_pd(), high = _mm_setzero_pd();
+	size_t i, end = length & ~(size_t) 3;
+
+	if (b)
+		for (i = 0; i < end; i += 4) {
+			low = _mm_add_pd(low, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+			high = _mm_add_pd(high, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+		}
+	else for (i = 0; i < end; i += 4) {
+		low = _mm_add_pd(low, _mm_loadu_pd(a + i));
+		high = _mm_add_pd(high, _mm_loadu_pd(a + i + 2));
+	}
+
+	_mm_storeu_pd(lanes, low);
+	_mm_storeu_pd(lanes + 2, high);
+	return end;
+}
+
+__attribute__((target("avx2")))
+size_t value_private_vector_sum_int_avx2(int64_t lanes[4], int64_t a[], size_t length, int *bad_p)
+{
+	__m256i sum = _mm256_setzero_si256(), over = _mm256_setzero_si256(), x, z;
+	size_t i, end = length & ~(size_t) 3;
+
+	for (i = 0; i < end; i += 4) {
+		x = _mm256_loadu_si256((__m256i *) (a + i));
+		z = _mm256_add_epi64(sum, x);
+		over = _mm256_or_si256(over, _mm256_and_si256(_mm256_xor_si256(sum, z), _mm256_xor_si256(x, z)));
+		sum = z;
+	}
+
+	_mm256_storeu_si256((__m256i *) lanes, sum);
+	*bad_p |= _mm256_movemask_pd(_mm256_castsi256_pd(over)) != 0;
+	return end;
+}
+
+__attribute__((target("avx2")))
+size_t value_private_vector_minmax_float_avx2(double *res, double a[], size_t length, int max_p)
+{
+	__m256d best = _mm256_set1_pd(a[0]);
+	size_t i, end = length & ~(size_t) 3;
+	double tmp[4];
+
+	for (i = 0; i < end; i += 4)
+		best = max_p ? _mm256_max_pd(best, _mm256_loadu_pd(a + i)) : _mm256_min_pd(best, _mm256_loadu_pd(a + i));
+
+	_mm256_storeu_pd(tmp, best);
+	for (i = 0; i < 4; ++i)
+		if (max_p ? tmp[i] > *res : tmp[i] < *res)
+			*res = tmp[i];
+	return end;
+}
+
+__attribute__((target("sse2")))
+size_t value_private_vector_minmax_float_sse2(double *res, double a[], size_t length, int max_p)
+{
+	__m128d best = _mm_set1_pd(a[0]);
+	size_t i, end = length & ~(size_t) 1;
+	double tmp[2];
+
+	for (i = 0; i < end; i += 2)
+		best = max_p ? _mm_max_pd(best, _mm_loadu_pd(a + i)) : _mm_min_pd(best, _mm_loadu_pd(a + i));
+
+	_mm_storeu_pd(tmp, best);
+	for (i = 0; i < 2; ++i)
+		if (max_p ? tmp[i] > *res : tmp[i] < *res)
+			*res = tmp[i];
+	return end;
+}
+
+// AVX2 has a 64-bit compare but no 64-bit min or max, so this blends on the compare.
+__attribute__((target("avx2")))
+size_t value_private_vector_minmax_int_avx2(int64_t *res, int64_t a[], size_t length, int max_p)
+{
+	__m256i best = _mm256_set1_epi64x(a[0]), x;
+	size_t i, end = length & ~(size_t) 3;
+	int64_t tmp[4];
+
+	for (i = 0; i < end; i += 4) {
+		x = _mm256_loadu_si256((__m256i *) (a + i));
+		best = max_p ? _mm256_blendv_epi8(best, x, _mm256_cmpgt_epi64(x, best))
+			: _mm256_blendv_epi8(best, x, _mm256_cmpgt_epi64(best, x));
+	}
+
+	_mm256_storeu_si256((__m256i *) tmp, best);
+	for (i = 0; i < 4; ++i)
+		if (max_p ? tmp[i] > *res : tmp[i] < *res)
+			*res = tmp[i];
+	return end;
+}
+
+__attribute__((target("avx2")))
+size_t value_private_vector_sqrt_avx2(double r[], double a[], size_t length)
+{
+	size_t i, end = length & ~(size_t) 3;
+	for (i = 0; i < end; i += 4)
+		_mm256_storeu_pd(r + i, _mm256_sqrt_pd(_mm256_loadu_pd(a + i)));
+	return end;
+}
+
+__attribute__((target("sse2")))
+size_t value_private_vector_sqrt_sse2(double r[], double a[], size_t length)
+{
+	size_t i, end = length & ~(size_t) 1;
+	for (i = 0; i < end; i += 2)
+		_mm_storeu_pd(r + i, _mm_sqrt_pd(_mm_loadu_pd(a + i)));
+	return end;
+}
+
+#endif
+
+/*
+ * The portable loops, which pick up wherever the SIMD kernels left off. Each returns
+ * TRUE if the result can't be packed.
+ */
+int value_private_vector_float(int op, double r[], double a[], size_t a_step, double b[], size_t b_step, size_t length)
+{
+	int bad_p = FALSE;
+	size_t i = 0;
+
+#ifdef VECTOR_X86
+	if (value_vector_level() == VECTOR_AVX2)
+		i = value_private_vector_float_avx2(op, r, a, a_step, b, b_step, length, &bad_p);
+	else if (value_vector_level() == VECTOR_SSE2)
+		i = value_private_vector_float_sse2(op, r, a, a_step, b, b_step, length, &bad_p);
+#endif
+
+	for (; i < length && bad_p == FALSE; ++i) {
+		double x = a[i * a_step], y = b[i * b_step];
+		if (op == VECTOR_ADD)
+			r[i] = x + y;
+		else if (op == VECTOR_SUB)
+			r[i] = x - y;
+		else if (op == VECTOR_MUL)
+			r[i] = x * y;
+		else if (op == VECTOR_DIV)
+			r[i] = x / y;
+		else r[i] = pow(x, y);
+		bad_p = value_private_vector_unpackable_p(r[i]);
+	}
+
+	return bad_p;
+}
+
+int value_private_vector_int(int op, int64_t r[], int64_t a[], size_t a_step, int64_t b[], size_t b_step, size_t length)
+{
+	int bad_p = FALSE;
+	size_t i = 0;
+
+#ifdef VECTOR_X86
+	if (value_vector_level() == VECTOR_AVX2)
+		i = value_private_vector_int_avx2(op, r, a, a_step, b, b_step, length, &bad_p);
+	else if (value_vector_level() == VECTOR_SSE2)
+		i = value_private_vector_int_sse2(op, r, a, a_step, b, b_step, length, &bad_p);
+#endif
+
+	for (; i < length && bad_p == FALSE; ++i) {
+		int64_t x = a[i * a_step], y = b[i * b_step];
+		if (op == VECTOR_ADD)
+			bad_p = __builtin_add_overflow(x, y, r + i);
+		else if (op == VECTOR_SUB)
+			bad_p = __builtin_sub_overflow(x, y, r + i);
+		else if (op == VECTOR_MUL)
+			bad_p = __builtin_mul_overflow(x, y, r + i);
+		else if (y == 0 || (x == INT64_MIN && y == -1))
+			bad_p = TRUE;
+		else r[i] = x / y - (x % y != 0 && (x < 0) != (y < 0));
+	}
+
+	return bad_p;
+}
+
+/*
+ * Adds up (a), or the products of (a) and (b) if (b) is not NULL, in four running
+ * totals.
+ */
+double value_private_vector_dot_float(double a[], double b[], size_t length)
+{
+	double lanes[4] = { 0, 0, 0, 0 };
+	size_t i = 0;
+
+#ifdef VECTOR_X86
+	if (value_vector_level() == VECTOR_AVX2)
+		i = value_private_vector_dot_float_avx2(lanes, a, b, length);
+	else if (value_vector_level() == VECTOR_SSE2)
+		i = value_private_vector_dot_float_sse2(lanes, a, b, length);
+#endif
+
+	for (; i < length; ++i)
+		lanes[i & 3] += b ? a[i] * b[i] : a[i];
+
+	return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+double value_vector_sum_float(double a[], size_t length)
+{
+	return value_private_vector_dot_float(a, NULL, length);
+}
+
+int value_vector_sum_int(int64_t *sum, int64_t a[], size_t length)
+{
+	int64_t lanes[4] = { 0, 0, 0, 0 }, total = 0;
+	int bad_p = FALSE;
+	size_t i = 0;
+
+#ifdef VECTOR_X86
+	if (value_vector_level() == VECTOR_AVX2)
+		i = value_private_vector_sum_int_avx2(lanes, a, length, &bad_p);
+#endif
+
+	for (; i < length && bad_p == FALSE; ++i)
+		bad_p = __builtin_add_overflow(lanes[i & 3], a[i], lanes + (i & 3));
+	for (i = 0; i < 4 && bad_p == FALSE; ++i)
+		bad_p = __builtin_add_overflow(total, lanes[i], &total);
+
+	if (bad_p == FALSE)
+		*sum = total;
+	return bad_p;
+}
+
+/*
+ * Turns an operand into a packed array, or an ordinary array if it won't pack. A
+ * number becomes an array of one element, and (*step) is set to 0. A packed array
+ * is returned as it is; release it with value_private_vector_release().
+ */
+value value_private_vector_operand(value op, size_t *step, char *name, char *which)
+{
+	*step = 1;
+
+	if (op.type == VALUE_PAK)
+		return op;
+
+	if (op.type == VALUE_MPZ || op.type == VALUE_MPF) {
+		*step = 0;
+		value res = value_init(VALUE_ARY);
+		return_if_error(res);
+		value_append_now(&res, op);
+		value_pack_now(&res);
+		return res;
+	}
+
+	if (op.type == VALUE_ARY || op.type == VALUE_LST || op.type == VALUE_PAR || op.type == VALUE_RNG)
+		return value_pack(op);
+
+	value_error(1, "Type Error: %c is undefined where %c is %ts (number or array expected).", name, which, op);
+	return value_init_error();
+}
+
+void value_private_vector_release(value *op, value orig)
+{
+	if (op->type != VALUE_PAK || orig.type != VALUE_PAK)
+		value_clear(op);
+}
+
+size_t value_private_vector_length(value op)
+{
+	return op.type == VALUE_PAK ? op.core.u_pk->length : op.core.u_a.length;
+}
+
+// Returns a new value for element (i) of a packed or ordinary array.
+value value_private_vector_elem(value op, size_t i)
+{
+	return op.type == VALUE_PAK ? value_packed_get(op, i) : value_set(op.core.u_a.a[i]);
+}
+
+// Returns a packed float copy of the first (length) elements of a packed array.
+double * value_private_vector_to_float(value op, size_t length)
+{
+	if (op.core.u_pk->kind == PACKED_FLOAT)
+		return op.core.u_pk->a.f;
+
+	double *res = value_malloc(NULL, sizeof(double) * (length ? length : 1));
+	if (res == NULL)
+		return NULL;
+	size_t i;
+	for (i = 0; i < length; ++i)
+		res[i] = (double) op.core.u_pk->a.z[i];
+	return res;
+}
+
+/*
+ * The fast way: returns nil if (a) and (b) aren't both packed integers or floats,
+ * if the result doesn't fit in a packed array, or if a double would give a different
+ * answer than MPFR at the default precision.
+ */
+value value_private_vector_packed(int op, value a, size_t a_step, value b, size_t b_step, size_t length)
+{
+	if (a.type != VALUE_PAK || b.type != VALUE_PAK
+			|| a.core.u_pk->kind == PACKED_BOOL || b.core.u_pk->kind == PACKED_BOOL)
+		return value_init_nil();
+
+	int kind = a.core.u_pk->kind == PACKED_FLOAT || b.core.u_pk->kind == PACKED_FLOAT ? PACKED_FLOAT : PACKED_INT;
+	// An integer to an integer power is an integer, which value_pow() gets by way of MPFR.
+	if (op == VECTOR_POW && kind == PACKED_INT)
+		kind = PACKED_NONE;
+	if (kind == PACKED_NONE || (kind == PACKED_FLOAT && mpfr_get_default_prec() != DBL_MANT_DIG))
+		return value_init_nil();
+
+	value res = value_packed_init(kind, length);
+	return_if_error(res);
+	if (length == 0)
+		return res;
+
+	int bad_p;
+	if (kind == PACKED_INT) {
+		bad_p = value_private_vector_int(op, res.core.u_pk->a.z, a.core.u_pk->a.z, a_step, b.core.u_pk->a.z, b_step, length);
+	} else {
+		double *x = value_private_vector_to_float(a, a_step ? length : 1);
+		double *y = value_private_vector_to_float(b, b_step ? length : 1);
+		bad_p = x == NULL || y == NULL || value_private_vector_float(op, res.core.u_pk->a.f, x, a_step, y, b_step, length);
+		if (x != a.core.u_pk->a.f)
+			value_free(x);
+		if (y != b.core.u_pk->a.f)
+			value_free(y);
+	}
+
+	if (bad_p) {
+		value_clear(&res);
+		return value_init_nil();
+	}
+
+	res.core.u_pk->length = length;
+	return res;
+}
+
+// The slow way, one element at a time.
+value value_private_vector_generic(int op, value a, size_t a_step, value b, size_t b_step, size_t length)
+{
+	value (*f)(value, value) = op == VECTOR_ADD ? &value_add : op == VECTOR_SUB ? &value_sub
+		: op == VECTOR_MUL ? &value_mul : op == VECTOR_DIV ? &value_div : &value_pow;
+
+	value res;
+	res.type = VALUE_ARY;
+	value_malloc(&res, next_size(length));
+	return_if_error(res);
+	res.core.u_a.length = 0;
+
+	size_t i;
+	for (i = 0; i < length; ++i) {
+		value x = value_private_vector_elem(a, i * a_step);
+		value y = value_private_vector_elem(b, i * b_step);
+		value z = f(x, y);
+		value_clear(&x);
+		value_clear(&y);
+		if (z.type == VALUE_ERROR) {
+			value_clear(&res);
+			return z;
+		}
+		res.core.u_a.a[res.core.u_a.length++] = z;
+	}
+
+	value_pack_now(&res);
+	return res;
+}
+
+value value_vector_op(int op, value op1, value op2, char *name)
+{
+	size_t step1, step2;
+	value a = value_private_vector_operand(op1, &step1, name, "op1");
+	return_if_error(a);
+	value b = value_private_vector_operand(op2, &step2, name, "op2");
+	if (b.type == VALUE_ERROR) {
+		value_private_vector_release(&a, op1);
+		return b;
+	}
+
+	value res;
+	if (step1 == 0 && step2 == 0) {
+		value_error(1, "Type Error: %c is undefined where op1 is %ts and op2 is %ts (at least one array expected).", name, op1, op2);
+		res = value_init_error();
+	} else if (step1 && step2 && value_private_vector_length(a) != value_private_vector_length(b)) {
+		value_error(1, "Domain Error: %c is undefined where op1 and op2 have different sizes.", name);
+		res = value_init_error();
+	} else {
+		size_t length = step1 ? value_private_vector_length(a) : value_private_vector_length(b);
+		res = value_private_vector_packed(op, a, step1, b, step2, length);
+		if (res.type == VALUE_NIL)
+			res = value_private_vector_generic(op, a, step1, b, step2, length);
+	}
+
+	value_private_vector_release(&a, op1);
+	value_private_vector_release(&b, op2);
+	return res;
+}
+
+value value_vadd(value op1, value op2)
+{
+	return value_vector_op(VECTOR_ADD, op1, op2, "vadd()");
+}
+
+value value_vsub(value op1, value op2)
+{
+	return value_vector_op(VECTOR_SUB, op1, op2, "vsub()");
+}
+
+value value_vmul(value op1, value op2)
+{
+	return value_vector_op(VECTOR_MUL, op1, op2, "vmul()");
+}
+
+value value_vdiv(value op1, value op2)
+{
+	return value_vector_op(VECTOR_DIV, op1, op2, "vdiv()");
+}
+
+/*
+ * Products of integers are added up in an int64_t while they fit, and in a GMP
+ * number once they don't.
+ */
+value value_dot(value op1, value op2)
+{
+	size_t step1, step2;
+	value a = value_private_vector_operand(op1, &step1, "dot()", "op1");
+	return_if_error(a);
+	value b = value_private_vector_operand(op2, &step2, "dot()", "op2");
+	if (b.type == VALUE_ERROR) {
+		value_private_vector_release(&a, op1);
+		return b;
+	}
+
+	value res = value_init_nil();
+	size_t i, length = value_private_vector_length(a);
+
+	if (step1 == 0 || step2 == 0) {
+		value_error(1, "Type Error: dot() is undefined where op1 is %ts and op2 is %ts (arrays expected).", op1, op2);
+		res = value_init_error();
+	} else if (length != value_private_vector_length(b)) {
+		value_error(1, "Domain Error: dot() is undefined where op1 and op2 have different sizes.");
+		res = value_init_error();
+
+	} else if (a.type == VALUE_PAK && b.type == VALUE_PAK && a.core.u_pk->kind == PACKED_INT && b.core.u_pk->kind == PACKED_INT) {
+		int64_t *x = a.core.u_pk->a.z, *y = b.core.u_pk->a.z, sum = 0, product;
+		for (i = 0; i < length; ++i)
+			if (__builtin_mul_overflow(x[i], y[i], &product) || __builtin_add_overflow(sum, product, &sum))
+				break;
+
+		if (i == length) {
+			res = value_set_long(sum);
+		} else {
+			res = value_set_long(0);
+			mpz_t tmp;
+			mpz_init(tmp);
+			for (i = 0; i < length; ++i) {
+				mpz_set_si(tmp, x[i]);
+				mpz_mul_si(tmp, tmp, y[i]);
+				mpz_add(res.core.u_mz, res.core.u_mz, tmp);
+			}
+			mpz_clear(tmp);
+		}
+
+	} else if (a.type == VALUE_PAK && b.type == VALUE_PAK && mpfr_get_default_prec() == DBL_MANT_DIG
+			&& a.core.u_pk->kind != PACKED_BOOL && b.core.u_pk->kind != PACKED_BOOL) {
+		double *x = value_private_vector_to_float(a, length);
+		double *y = value_private_vector_to_float(b, length);
+		if (x && y)
+			res = value_set_double(value_private_vector_dot_float(x, y, length));
+		else res = value_init_error();
+		if (x != a.core.u_pk->a.f)
+			value_free(x);
+		if (y != b.core.u_pk->a.f)
+			value_free(y);
+
+	} else {
+		res = value_set_long(0);
+		for (i = 0; i < length; ++i) {
+			value x = value_private_vector_elem(a, i);
+			value y = value_private_vector_elem(b, i);
+			value product = value_mul(x, y);
+			value_clear(&x);
+			value_clear(&y);
+			if (product.type == VALUE_ERROR) {
+				value_clear(&res);
+				res = product;
+				break;
+			}
+			value_add_now(&res, product);
+			value_clear(&product);
+		}
+	}
+
+	value_private_vector_release(&a, op1);
+	value_private_vector_release(&b, op2);
+	return res;
+}
+
+/*
+ * Returns the smallest element of (op), or the largest if (max_p) is TRUE, or nil
+ * if (op) is empty.
+ */
+value value_private_vector_minmax(value op, int max_p)
+{
+	char *name = max_p ? "max()" : "min()";
+	size_t step;
+	value a = value_private_vector_operand(op, &step, name, "op");
+	return_if_error(a);
+
+	value res = value_init_nil();
+	size_t i = 0, length = value_private_vector_length(a);
+
+	if (step == 0) {
+		value_error(1, "Type Error: %c is undefined where op is %ts (array expected).", name, op);
+		res = value_init_error();
+
+	} else if (length == 0) {
+		// Nothing to do.
+
+	} else if (a.type == VALUE_PAK && a.core.u_pk->kind == PACKED_FLOAT) {
+		double *x = a.core.u_pk->a.f, best = x[0];
+#ifdef VECTOR_X86
+		if (value_vector_level() == VECTOR_AVX2)
+			i = value_private_vector_minmax_float_avx2(&best, x, length, max_p);
+		else if (value_vector_level() == VECTOR_SSE2)
+			i = value_private_vector_minmax_float_sse2(&best, x, length, max_p);
+#endif
+		for (; i < length; ++i)
+			if (max_p ? x[i] > best : x[i] < best)
+				best = x[i];
+		res = value_set_double(best);
+
+	} else if (a.type == VALUE_PAK && a.core.u_pk->kind == PACKED_INT) {
+		int64_t *x = a.core.u_pk->a.z, best = x[0];
+#ifdef VECTOR_X86
+		if (value_vector_level() == VECTOR_AVX2)
+			i = value_private_vector_minmax_int_avx2(&best, x, length, max_p);
+#endif
+		for (; i < length; ++i)
+			if (max_p ? x[i] > best : x[i] < best)
+				best = x[i];
+		res = value_set_long(best);
+
+	} else {
+		size_t best = 0;
+		for (i = 1; i < length && res.type != VALUE_ERROR; ++i) {
+			value x = value_private_vector_elem(a, i), y = value_private_vector_elem(a, best);
+			int cmp = value_cmp(x, y);
+			if (cmp == -2) {
+				value_error(1, "Type Error: %c is undefined where op contains %ts and %ts (comparable elements expected).", name, x, y);
+				res = value_init_error();
+			} else if (max_p ? cmp > 0 : cmp < 0) {
+				best = i;
+			}
+			value_clear(&x);
+			value_clear(&y);
+		}
+		if (res.type != VALUE_ERROR)
+			res = value_private_vector_elem(a, best);
+	}
+
+	value_private_vector_release(&a, op);
+	return res;
+}
+
+value value_min(value op)
+{
+	return value_private_vector_minmax(op, FALSE);
+}
+
+value value_max(value op)
+{
+	return value_private_vector_minmax(op, TRUE);
+}
+
+/*
+ * Element (i) of the result is the sum of elements 0 through (i) of (op). Each sum
+ * depends on the one before it, so this runs one element at a time.
+ */
+value value_prefix_sum(value op)
+{
+	size_t step;
+	value a = value_private_vector_operand(op, &step, "prefix_sum()", "op");
+	return_if_error(a);
+
+	value res = value_init_nil();
+	size_t i, length = value_private_vector_length(a);
+
+	if (step == 0) {
+		value_error(1, "Type Error: prefix_sum() is undefined where op is %ts (array expected).", op);
+		value_private_vector_release(&a, op);
+		return value_init_error();
+	}
+
+	if (a.type == VALUE_PAK && (a.core.u_pk->kind == PACKED_INT
+			|| (a.core.u_pk->kind == PACKED_FLOAT && mpfr_get_default_prec() == DBL_MANT_DIG))) {
+		int kind = a.core.u_pk->kind, bad_p = FALSE;
+		res = value_packed_init(kind, length);
+		if (res.type == VALUE_ERROR) {
+			value_private_vector_release(&a, op);
+			return res;
+		}
+
+		if (kind == PACKED_INT) {
+			int64_t *x = a.core.u_pk->a.z, *r = res.core.u_pk->a.z, sum = 0;
+			for (i = 0; i < length && bad_p == FALSE; ++i) {
+				bad_p = __builtin_add_overflow(sum, x[i], &sum);
+				r[i] = sum;
+			}
+		} else {
+			double *x = a.core.u_pk->a.f, *r = res.core.u_pk->a.f, sum = 0;
+			for (i = 0; i < length && bad_p == FALSE; ++i) {
+				r[i] = sum += x[i];
+				bad_p = value_private_vector_unpackable_p(sum);
+			}
+		}
+
+		if (bad_p == FALSE) {
+			res.core.u_pk->length = length;
+			value_private_vector_release(&a, op);
+			return res;
+		}
+		value_clear(&res);
+	}
+
+	res.type = VALUE_ARY;
+	value_malloc(&res, next_size(length));
+	if (res.type == VALUE_ERROR) {
+		value_private_vector_release(&a, op);
+		return res;
+	}
+	res.core.u_a.length = 0;
+
+	for (i = 0; i < length; ++i) {
+		value x = value_private_vector_elem(a, i);
+		value sum = i ? value_add(res.core.u_a.a[i-1], x) : value_set(x);
+		value_clear(&x);
+		if (sum.type == VALUE_ERROR) {
+			value_clear(&res);
+			res = sum;
+			break;
+		}
+		res.core.u_a.a[res.core.u_a.length++] = sum;
+	}
+
+	value_private_vector_release(&a, op);
+	if (res.type == VALUE_ARY)
+		value_pack_now(&res);
+	return res;
+}
+
+int value_vector_p(value op)
+{
+	return op.type == VALUE_ARY || op.type == VALUE_PAK || op.type == VALUE_RNG;
+}
+
+/*
+ * Does (func) to each of (a) with the C library. Returns TRUE if (func) isn't one
+ * that can be done this way, or if any result can't be packed.
+ */
+int value_private_vector_math_float(int func, double r[], double a[], size_t length)
+{
+	size_t i = 0;
+
+	switch (func) {
+	case VALUE_SQRT:
+#ifdef VECTOR_X86
+		if (value_vector_level() == VECTOR_AVX2)
+			i = value_private_vector_sqrt_avx2(r, a, length);
+		else if (value_vector_level() == VECTOR_SSE2)
+			i = value_private_vector_sqrt_sse2(r, a, length);
+#endif
+		for (; i < length; ++i)
+			r[i] = sqrt(a[i]);
+		break;
+	case VALUE_SIN: for (; i < length; ++i) r[i] = sin(a[i]); break;
+	case VALUE_COS: for (; i < length; ++i) r[i] = cos(a[i]); break;
+	case VALUE_TAN: for (; i < length; ++i) r[i] = tan(a[i]); break;
+	case VALUE_ASIN: for (; i < length; ++i) r[i] = asin(a[i]); break;
+	case VALUE_ACOS: for (; i < length; ++i) r[i] = acos(a[i]); break;
+	case VALUE_ATAN: for (; i < length; ++i) r[i] = atan(a[i]); break;
+	case VALUE_SINH: for (; i < length; ++i) r[i] = sinh(a[i]); break;
+	case VALUE_COSH: for (; i < length; ++i) r[i] = cosh(a[i]); break;
+	case VALUE_TANH: for (; i < length; ++i) r[i] = tanh(a[i]); break;
+	case VALUE_EXP: for (; i < length; ++i) r[i] = exp(a[i]); break;
+	case VALUE_LOG: for (; i < length; ++i) r[i] = log(a[i]); break;
+	case VALUE_LOG2: for (; i < length; ++i) r[i] = log2(a[i]); break;
+	case VALUE_LOG10: for (; i < length; ++i) r[i] = log10(a[i]); break;
+	default:
+		// The reciprocal functions would round twice, and the inverse hyperbolic ones
+		// have domain checks in value_trig() that the C library doesn't.
+		return TRUE;
+	}
+
+	for (i = 0; i < length; ++i)
+		if (value_private_vector_unpackable_p(r[i]))
+			return TRUE;
+	return FALSE;
+}
+
+value value_vector_math(value op, int func)
+{
+	size_t step;
+	value a = value_private_vector_operand(op, &step, "math function", "op");
+	return_if_error(a);
+
+	value res;
+	size_t i, length = value_private_vector_length(a);
+
+	if (a.type == VALUE_PAK && a.core.u_pk->kind != PACKED_BOOL && mpfr_get_default_prec() == DBL_MANT_DIG) {
+		res = value_packed_init(PACKED_FLOAT, length);
+		if (res.type == VALUE_ERROR) {
+			value_private_vector_release(&a, op);
+			return res;
+		}
+
+		double *x = value_private_vector_to_float(a, length);
+		int bad_p = x == NULL || value_private_vector_math_float(func, res.core.u_pk->a.f, x, length);
+		if (x != a.core.u_pk->a.f)
+			value_free(x);
+		if (bad_p == FALSE) {
+			res.core.u_pk->length = length;
+			value_private_vector_release(&a, op);
+			return res;
+		}
+		value_clear(&res);
+	}
+
+	res.type = VALUE_ARY;
+	value_malloc(&res, next_size(length));
+	if (res.type == VALUE_ERROR) {
+		value_private_vector_release(&a, op);
+		return res;
+	}
+	res.core.u_a.length = 0;
+
+	for (i = 0; i < length; ++i) {
+		value x = value_private_vector_elem(a, i);
+		value y = value_math_function(x, func);
+		value_clear(&x);
+		if (y.type == VALUE_ERROR) {
+			value_clear(&res);
+			res = y;
+			break;
+		}
+		res.core.u_a.a[res.core.u_a.length++] = y;
+	}
+
+	value_private_vector_release(&a, op);
+	if (res.type == VALUE_ARY)
+		value_pack_now(&res);
+	return res;
+}
+
+value value_vadd_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "vadd()") ? value_init_error() : value_vadd(argv[0], argv[1]);
+}
+
+value value_vsub_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "vsub()") ? value_init_error() : value_vsub(argv[0], argv[1]);
+}
+
+value value_vmul_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "vmul()") ? value_init_error() : value_vmul(argv[0], argv[1]);
+}
+
+value value_vdiv_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "vdiv()") ? value_init_error() : value_vdiv(argv[0], argv[1]);
+}
+
+value value_dot_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "dot()") ? value_init_error() : value_dot(argv[0], argv[1]);
+}
+
+value value_min_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "min()") ? value_init_error() : value_min(argv[0]);
+}
+
+value value_max_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "max()") ? value_init_error() : value_max(argv[0]);
+}
+
+value value_prefix_sum_arg(int argc, value argv[])
+{
+	return missing_arguments(argc, argv, "prefix_sum()") ? value_init_error() : value_prefix_sum(argv[0]);
+}